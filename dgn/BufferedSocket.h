@@ -0,0 +1 @@
+#include "../dgnbase/BufferedSocket.h"
@@ -0,0 +1 @@
+#include "../dgnbase/ConnPool.h"
@@ -0,0 +1 @@
+#include "../dgnbase/HttpSvr.h"
@@ -0,0 +1 @@
+#include "../dgnbase/Reactor.h"
@@ -0,0 +1 @@
+#include "../dgnbase/Resolver.h"
@@ -0,0 +1 @@
+#include "../dgnbase/Rpc.h"
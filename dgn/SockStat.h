@@ -0,0 +1 @@
+#include "../dgnbase/SockStat.h"
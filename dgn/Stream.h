@@ -0,0 +1 @@
+#include "../dgnbase/Stream.h"
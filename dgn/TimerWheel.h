@@ -0,0 +1 @@
+#include "../dgnbase/TimerWheel.h"
@@ -0,0 +1 @@
+#include "../dgnbase/TlsStream.h"
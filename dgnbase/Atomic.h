@@ -39,6 +39,8 @@ public:
 	inline int Sub( int val );
 	inline int Inc();
 	inline int Dec();
+	inline int Exchange( int val ); // return old value
+	inline bool CompareSet( int old_val, int val ); // set if still old_val
 
 protected:
 	volatile int m_val;
@@ -92,6 +94,34 @@ inline int Atomic::Dec()
 #endif
 }
 
+inline int Atomic::Exchange( int val )
+{
+#ifdef _WIN32
+	return InterlockedExchange( (LONG *)&m_val, val );
+#else
+	// xchg with memory always locked
+	asm volatile ("xchgl %0,%1"
+		: "=r" (val), "+m" (m_val)
+		: "0" (val)
+		: "memory");
+	return val;
+#endif
+}
+
+inline bool Atomic::CompareSet( int old_val, int val )
+{
+#ifdef _WIN32
+	return InterlockedCompareExchange( (LONG *)&m_val, val, old_val ) == old_val;
+#else
+	int prev;
+	asm volatile ("lock; cmpxchgl %2,%1"
+		: "=a" (prev), "+m" (m_val)
+		: "r" (val), "0" (old_val)
+		: "memory", "cc");
+	return prev == old_val;
+#endif
+}
+
 ////////////////
 END_NS_DGN
 
@@ -0,0 +1,306 @@
+// BufferedSocket.cpp : buffered read/write and message framing over Socket
+// Copyright (C) 2011 ~ 2023 drangon <drangon.zhou (at) gmail.com>
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+
+#include <dgn/BufferedSocket.h>
+#include <dgn/Logger.h>
+
+#include <string.h>
+
+#define DGN_BUFSOCK_MIN_RECV	4096 // read at least this much room per recv
+
+BEGIN_NS_DGN
+////////////////
+
+// return offset of delim in buf, -1 if not found
+static int find_delim( const char * buf, int len, const char * delim, int delim_len )
+{
+	if( len < delim_len )
+		return -1;
+	const char * p = buf;
+	const char * end = buf + len - delim_len + 1;
+	while( p < end ) {
+		p = (const char *)memchr( p, delim[0], end - p );
+		if( p == NULL )
+			return -1;
+		if( memcmp( p + 1, delim + 1, delim_len - 1 ) == 0 )
+			return (int)( p - buf );
+		++p;
+	}
+	return -1;
+}
+
+// CStr::Assign() stop at '\0', data may be binary
+static void assign_bin( CStr * s, const char * buf, int len )
+{
+	s->Reserve( len + 1 );
+	memcpy( s->GetRaw(), buf, len );
+	s->ReleaseRaw( len );
+	return;
+}
+
+BufferedSocket::BufferedSocket( Stream * sk, int rbuf_size, int flush_size )
+	: m_sk( sk ), m_rbuf( NULL ), m_rcap( 0 ), m_rhead( 0 ), m_rtail( 0 )
+	, m_rbuf_size( rbuf_size <= 0 ? DGN_BUFSOCK_MIN_RECV : rbuf_size )
+	, m_wbuf( NULL ), m_wcap( 0 ), m_wlen( 0 ), m_flush_size( flush_size < 0 ? 0 : flush_size )
+{
+}
+
+BufferedSocket::~BufferedSocket()
+{
+	delete[] m_rbuf, m_rbuf = NULL;
+	delete[] m_wbuf, m_wbuf = NULL;
+}
+
+void BufferedSocket::Attach( Stream * sk )
+{
+	m_sk = sk;
+	m_rhead = m_rtail = 0;
+	m_wlen = 0;
+	return;
+}
+
+int BufferedSocket::Read( char * buf, int len )
+{
+	if( len <= 0 )
+		return -1;
+	if( m_rtail == m_rhead ) {
+		// large read bypass buffer
+		if( len >= m_rbuf_size )
+			return m_sk == NULL ? -1 : m_sk->Recv( buf, 1, len );
+		int ret = recv_more( 1 );
+		if( ret <= 0 )
+			return ret;
+	}
+	int n = m_rtail - m_rhead;
+	if( n > len )
+		n = len;
+	memcpy( buf, m_rbuf + m_rhead, n );
+	Consume( n );
+	return n;
+}
+
+int BufferedSocket::ReadExact( char * buf, int len )
+{
+	if( len <= 0 )
+		return -1;
+	int ret = recv_more( len );
+	if( ret <= 0 )
+		return ret;
+	memcpy( buf, m_rbuf + m_rhead, len );
+	Consume( len );
+	return len;
+}
+
+int BufferedSocket::ReadLine( CStr * line, int maxlen )
+{
+	int ret = ReadUntil( "\n", 1, line, maxlen );
+	if( ret > 0 && line->Len() > 0 && line->Str()[line->Len() - 1] == '\r' )
+		line->ReleaseRaw( line->Len() - 1 );
+	return ret;
+}
+
+int BufferedSocket::ReadUntil( const char * delim, int delim_len, CStr * data, int maxlen )
+{
+	if( delim == NULL || delim_len <= 0 )
+		return -1;
+
+	int scanned = 0; // no delim start before this
+	while( 1 ) {
+		int pending = m_rtail - m_rhead;
+		int off = find_delim( m_rbuf + m_rhead + scanned, pending - scanned, delim, delim_len );
+		if( off >= 0 ) {
+			off += scanned;
+			if( off > maxlen )
+				break;
+			assign_bin( data, m_rbuf + m_rhead, off );
+			Consume( off + delim_len );
+			return off + delim_len;
+		}
+		if( pending >= maxlen + delim_len )
+			break;
+		scanned = pending - delim_len + 1;
+		if( scanned < 0 )
+			scanned = 0;
+
+		int ret = recv_more( pending + 1 );
+		if( ret <= 0 )
+			return ret;
+	}
+	PR_DEBUG( "read until delim exceed max len %d", maxlen );
+	return -1;
+}
+
+int BufferedSocket::ReadFrame( CStr * frame, int maxlen )
+{
+	int ret = recv_more( 4 );
+	if( ret <= 0 )
+		return ret;
+	const unsigned char * p = (const unsigned char *)m_rbuf + m_rhead;
+	uint32_t len = ( (uint32_t)p[0] << 24 ) | ( (uint32_t)p[1] << 16 ) | ( (uint32_t)p[2] << 8 ) | p[3];
+	if( len > (uint32_t)maxlen ) {
+		PR_DEBUG( "frame len %u exceed max len %d", len, maxlen );
+		return -1;
+	}
+	ret = recv_more( 4 + (int)len );
+	if( ret <= 0 )
+		return ret;
+	assign_bin( frame, m_rbuf + m_rhead + 4, (int)len );
+	Consume( 4 + (int)len );
+	return 4 + (int)len;
+}
+
+int BufferedSocket::Fill( int minlen )
+{
+	if( minlen <= 0 )
+		return m_rtail - m_rhead;
+	return recv_more( minlen );
+}
+
+void BufferedSocket::Consume( int len )
+{
+	m_rhead += len;
+	if( m_rhead >= m_rtail )
+		m_rhead = m_rtail = 0;
+	return;
+}
+
+int BufferedSocket::Write( const char * buf, int len )
+{
+	if( m_sk == NULL || len < 0 )
+		return -1;
+	if( m_wlen + len > m_flush_size && m_wlen > 0 ) {
+		int ret = Flush();
+		if( ret != 0 )
+			return ret < 0 ? -1 : 0;
+	}
+	if( m_wlen + len <= m_flush_size )
+		return append_write( buf, len );
+
+	// large write send directly, keep unsent part
+	int ret = m_sk->Send( buf, len );
+	if( ret < 0 )
+		return -1;
+	if( ret < len && append_write( buf + ret, len - ret ) < 0 )
+		return -1;
+	return len;
+}
+
+int BufferedSocket::WriteFrame( const char * buf, int len )
+{
+	if( m_sk == NULL || len < 0 )
+		return -1;
+	if( m_wlen + 4 + len > m_flush_size && m_wlen > 0 ) {
+		int ret = Flush();
+		if( ret != 0 )
+			return ret < 0 ? -1 : 0;
+	}
+	unsigned char hdr[4];
+	hdr[0] = (unsigned char)( (uint32_t)len >> 24 );
+	hdr[1] = (unsigned char)( (uint32_t)len >> 16 );
+	hdr[2] = (unsigned char)( (uint32_t)len >> 8 );
+	hdr[3] = (unsigned char)( (uint32_t)len );
+	// header and data always buffered together, never split by a flush timeout
+	if( append_write( (const char *)hdr, 4 ) < 0 || append_write( buf, len ) < 0 )
+		return -1;
+	if( m_wlen >= m_flush_size && Flush() < 0 )
+		return -1;
+	return 4 + len;
+}
+
+int BufferedSocket::Flush()
+{
+	if( m_sk == NULL )
+		return -1;
+	if( m_wlen == 0 )
+		return 0;
+	int ret = m_sk->Send( m_wbuf, m_wlen );
+	if( ret < 0 )
+		return -1;
+	if( ret < m_wlen )
+		memmove( m_wbuf, m_wbuf + ret, m_wlen - ret );
+	m_wlen -= ret;
+	return m_wlen;
+}
+
+int BufferedSocket::reserve_read( int len )
+{
+	int pending = m_rtail - m_rhead;
+	if( m_rcap - m_rtail >= len )
+		return 0;
+	if( m_rcap - pending >= len ) {
+		// compact
+		memmove( m_rbuf, m_rbuf + m_rhead, pending );
+		m_rhead = 0, m_rtail = pending;
+		return 0;
+	}
+
+	int newcap = m_rcap > 0 ? m_rcap * 2 : m_rbuf_size;
+	if( newcap < pending + len )
+		newcap = pending + len;
+	char * buf = new char[newcap];
+	if( buf == NULL )
+		return -1;
+	if( pending > 0 )
+		memcpy( buf, m_rbuf + m_rhead, pending );
+	delete[] m_rbuf;
+	m_rbuf = buf, m_rcap = newcap;
+	m_rhead = 0, m_rtail = pending;
+	return 0;
+}
+
+int BufferedSocket::recv_more( int minlen )
+{
+	int pending = m_rtail - m_rhead;
+	if( pending >= minlen )
+		return pending;
+	if( m_sk == NULL )
+		return -1;
+
+	int need = minlen - pending;
+	if( reserve_read( need < DGN_BUFSOCK_MIN_RECV ? DGN_BUFSOCK_MIN_RECV : need ) < 0 )
+		return -1;
+	// one Recv() wait for all needed bytes, and take whatever more already arrived
+	int ret = m_sk->Recv( m_rbuf + m_rtail, need, m_rcap - m_rtail );
+	if( ret < 0 )
+		return -1;
+	m_rtail += ret;
+	pending += ret;
+	return pending >= minlen ? pending : 0;
+}
+
+int BufferedSocket::append_write( const char * buf, int len )
+{
+	if( m_wlen + len > m_wcap ) {
+		int newcap = m_wcap > 0 ? m_wcap * 2 : m_flush_size;
+		if( newcap < m_wlen + len )
+			newcap = m_wlen + len;
+		char * nbuf = new char[newcap];
+		if( nbuf == NULL )
+			return -1;
+		if( m_wlen > 0 )
+			memcpy( nbuf, m_wbuf, m_wlen );
+		delete[] m_wbuf;
+		m_wbuf = nbuf, m_wcap = newcap;
+	}
+	if( len > 0 )
+		memcpy( m_wbuf + m_wlen, buf, len );
+	m_wlen += len;
+	return len;
+}
+
+////////////////
+END_NS_DGN
+
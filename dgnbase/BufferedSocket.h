@@ -0,0 +1,97 @@
+// BufferedSocket.h : buffered read/write and message framing over Socket
+// Copyright (C) 2011 ~ 2023 drangon <drangon.zhou (at) gmail.com>
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+
+#ifndef INCLUDED_DGN_BUFFEREDSOCKET_H
+#define INCLUDED_DGN_BUFFEREDSOCKET_H
+
+#include <dgn/CStr.h>
+#include <dgn/Stream.h>
+#include <dgn/Socket.h>
+
+BEGIN_NS_DGN
+////////////////
+
+// Note :
+// stream ( Socket or TlsStream ) is not owned, timeout follow Socket::SetTimeout(),
+// each wait for more data use one timeout
+// read buffer grow on demand ( up to the maxlen of the call ), consumed space reused by compact
+// small writes coalesced in write buffer, flushed when reach flush_size or by Flush(),
+// pending data not flushed when destroy
+// all read return > 0 for bytes consumed from stream, = 0 when timeout ( data kept in buffer ),
+// < 0 if error, peer closed, or message longer than maxlen
+
+class DGN_LIB_API BufferedSocket
+{
+public:
+	BufferedSocket( Stream * sk = NULL, int rbuf_size = 16384, int flush_size = 16384 );
+	~BufferedSocket();
+
+	BufferedSocket( const BufferedSocket & bs ) = delete;
+	BufferedSocket & operator = ( const BufferedSocket & bs ) = delete;
+
+	void Attach( Stream * sk ); // drop buffered data
+	Stream * GetStream() const { return m_sk; }
+
+public:
+	// read at least 1 byte, at most len
+	int Read( char * buf, int len );
+	int ReadExact( char * buf, int len );
+	// line without "\n" or "\r\n"
+	int ReadLine( CStr * line, int maxlen = 65536 );
+	// data without delim
+	int ReadUntil( const char * delim, int delim_len, CStr * data, int maxlen = 65536 );
+	// 4 bytes big endian length + data
+	int ReadFrame( CStr * frame, int maxlen = 16 * 1024 * 1024 );
+
+	// zero copy access, make at least minlen bytes buffered, return buffered len
+	int Fill( int minlen );
+	const char * Peek( int * len ) const { *len = m_rtail - m_rhead; return m_rbuf + m_rhead; }
+	void Consume( int len );
+	int GetReadPending() const { return m_rtail - m_rhead; }
+
+public:
+	// return len if all buffered or sent, 0 when flush timeout and nothing taken, < 0 if error
+	int Write( const char * buf, int len );
+	int WriteFrame( const char * buf, int len );
+	// return 0 when write buffer empty, > 0 for bytes still pending after timeout, < 0 if error
+	int Flush();
+	int GetWritePending() const { return m_wlen; }
+
+protected:
+	int reserve_read( int len ); // make room for len more bytes
+	int recv_more( int minlen ); // make at least minlen bytes buffered
+	int append_write( const char * buf, int len );
+
+protected:
+	Stream * m_sk;
+
+	char * m_rbuf;
+	int m_rcap;
+	int m_rhead; // first unread
+	int m_rtail; // end of data
+	int m_rbuf_size; // initial size
+
+	char * m_wbuf;
+	int m_wcap;
+	int m_wlen;
+	int m_flush_size;
+};
+
+////////////////
+END_NS_DGN
+
+#endif // INCLUDED_DGN_BUFFEREDSOCKET_H
+
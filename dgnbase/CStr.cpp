@@ -250,7 +250,7 @@ int CStr::Append( const char * str, int len )
 		// NOTE : str may not end with '\0', or has '\0' less than len
 		blen = len + 1;
 		const char * p = str;
-		while( *p != '\0' && p < str + len )
+		while( p < str + len && *p != '\0' )
 			p++;
 		slen = (int)(p - str);
 	}
@@ -0,0 +1,261 @@
+// ConnPool.cpp : outbound tcp connection pool
+// Copyright (C) 2011 ~ 2023 drangon <drangon.zhou (at) gmail.com>
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+
+#include <dgn/ConnPool.h>
+#include <dgn/Resolver.h>
+#include <dgn/Time.h>
+#include <dgn/Logger.h>
+
+BEGIN_NS_DGN
+////////////////
+
+ConnPool::ConnPool()
+	: m_resolver( NULL ), m_max_per_host( 16 ), m_max_idle_per_host( 8 )
+	, m_idle_timeout_ms( 60000 ), m_check_interval_ms( 0 ), m_connect_timeout_ms( 3000 )
+{
+	m_checker.SetFunc( &ConnPool::run_check, this );
+}
+
+ConnPool::~ConnPool()
+{
+	Fini();
+}
+
+int ConnPool::Init( int max_per_host, int max_idle_per_host, int idle_timeout_ms,
+		int check_interval_ms, int connect_timeout_ms )
+{
+	m_max_per_host = max_per_host < 0 ? 0 : max_per_host;
+	m_max_idle_per_host = max_idle_per_host < 0 ? 0 : max_idle_per_host;
+	m_idle_timeout_ms = idle_timeout_ms;
+	m_check_interval_ms = check_interval_ms;
+	m_connect_timeout_ms = connect_timeout_ms;
+
+	if( m_check_interval_ms > 0 && m_checker.GetState() < THREAD_STATE_RUNNING ) {
+		if( m_checker.Start() < 0 ) {
+			PR_ERR( "start conn pool check thread failed" );
+			return -1;
+		}
+	}
+	return 0;
+}
+
+void ConnPool::Fini()
+{
+	m_checker.WaitStop();
+
+	std::vector< Socket * > socks;
+	m_lock.Lock();
+	std::map< CStr, host_pool_t >::iterator it;
+	for( it = m_hosts.begin(); it != m_hosts.end(); ++it ) {
+		int i;
+		for( i = 0; i < (int)it->second.m_idle.size(); ++i )
+			socks.push_back( it->second.m_idle[i].m_sk );
+	}
+	m_hosts.clear();
+	m_busy.clear();
+	m_lock.UnLock();
+
+	int i;
+	for( i = 0; i < (int)socks.size(); ++i )
+		delete socks[i];
+	return;
+}
+
+Socket * ConnPool::Get( const char * host, int port )
+{
+	if( host == NULL || host[0] == '\0' )
+		return NULL;
+
+	CStr key;
+	key.AssignFmt( "%s:%d", host, port );
+
+	std::vector< Socket * > dead;
+	Socket * sk = NULL;
+	Endpoint ep;
+	int i;
+
+	for( ;; ) {
+		m_lock.Lock();
+		host_pool_t & hp = m_hosts[key];
+		uint32_t now = Time::Tick();
+		while( ! hp.m_idle.empty() ) {
+			idle_conn_t ic = hp.m_idle.back();
+			hp.m_idle.pop_back();
+			if( (int)( now - ic.m_tick ) >= m_idle_timeout_ms ) {
+				dead.push_back( ic.m_sk );
+				continue;
+			}
+			sk = ic.m_sk;
+			break;
+		}
+		if( sk == NULL && m_max_per_host > 0 && hp.m_busy + (int)hp.m_idle.size() >= m_max_per_host ) {
+			m_lock.UnLock();
+			PR_DEBUG( "conn pool [%s] reach max %d", key.Str(), m_max_per_host );
+			for( i = 0; i < (int)dead.size(); ++i )
+				delete dead[i];
+			return NULL;
+		}
+		hp.m_busy++; // reserve before connect or probe
+		if( sk == NULL ) {
+			ep = hp.m_ep;
+			m_lock.UnLock();
+			break;
+		}
+		m_busy[sk] = key;
+		m_lock.UnLock();
+
+		for( i = 0; i < (int)dead.size(); ++i )
+			delete dead[i];
+		dead.clear();
+		// probe out of lock, peer closed one released and try next
+		if( sk->PeekAlive() > 0 )
+			return sk;
+		Put( sk, 0 ), sk = NULL;
+	}
+
+	for( i = 0; i < (int)dead.size(); ++i )
+		delete dead[i];
+
+	int ret = 0;
+	if( ! ep.IsValid() ) {
+		if( m_resolver != NULL )
+			ret = m_resolver->Resolve( host, port, &ep );
+		else
+			ret = ep.Set( host, port );
+	}
+
+	if( ret == 0 ) {
+		sk = new Socket();
+		sk->SetTimeout( m_connect_timeout_ms );
+		if( sk->Connect( ep ) != DGN_SOCKET_CONNECT_OK ) {
+			PR_DEBUG( "conn pool connect [%s] failed", key.Str() );
+			delete sk, sk = NULL;
+		}
+	}
+
+	MutexGuard guard( &m_lock );
+	host_pool_t & hp2 = m_hosts[key];
+	if( sk == NULL ) {
+		hp2.m_busy--;
+		hp2.m_ep.Clear(); // resolve again next time
+		return NULL;
+	}
+	hp2.m_ep = ep;
+	m_busy[sk] = key;
+	return sk;
+}
+
+void ConnPool::Put( Socket * sk, int reuse )
+{
+	if( sk == NULL )
+		return;
+
+	m_lock.Lock();
+	std::map< Socket *, CStr >::iterator bit = m_busy.find( sk );
+	if( bit == m_busy.end() ) {
+		m_lock.UnLock();
+		delete sk;
+		return;
+	}
+	std::map< CStr, host_pool_t >::iterator it = m_hosts.find( bit->second );
+	m_busy.erase( bit );
+	if( it == m_hosts.end() ) {
+		m_lock.UnLock();
+		delete sk;
+		return;
+	}
+	host_pool_t & hp = it->second;
+	hp.m_busy--;
+	if( reuse && sk->IsValid() && (int)hp.m_idle.size() < m_max_idle_per_host ) {
+		idle_conn_t ic;
+		ic.m_sk = sk;
+		ic.m_tick = Time::Tick();
+		hp.m_idle.push_back( ic );
+		sk = NULL;
+	}
+	m_lock.UnLock();
+
+	if( sk != NULL )
+		delete sk;
+	return;
+}
+
+int ConnPool::CheckIdle()
+{
+	std::vector< Socket * > dead;
+	uint32_t now = Time::Tick();
+
+	m_lock.Lock();
+	std::map< CStr, host_pool_t >::iterator it;
+	for( it = m_hosts.begin(); it != m_hosts.end(); ) {
+		std::vector< idle_conn_t > & idle = it->second.m_idle;
+		// oldest at front, keep order
+		int i, n = 0;
+		for( i = 0; i < (int)idle.size(); ++i ) {
+			if( (int)( now - idle[i].m_tick ) >= m_idle_timeout_ms )
+				dead.push_back( idle[i].m_sk );
+			else
+				idle[n++] = idle[i];
+		}
+		idle.resize( n );
+		if( idle.empty() && it->second.m_busy == 0 )
+			m_hosts.erase( it++ );
+		else
+			++it;
+	}
+	m_lock.UnLock();
+
+	int i;
+	for( i = 0; i < (int)dead.size(); ++i )
+		delete dead[i];
+	return (int)dead.size();
+}
+
+int ConnPool::GetIdleNum()
+{
+	MutexGuard guard( &m_lock );
+	int num = 0;
+	std::map< CStr, host_pool_t >::iterator it;
+	for( it = m_hosts.begin(); it != m_hosts.end(); ++it )
+		num += (int)it->second.m_idle.size();
+	return num;
+}
+
+int ConnPool::GetBusyNum()
+{
+	MutexGuard guard( &m_lock );
+	return (int)m_busy.size();
+}
+
+int ConnPool::run_check( Thread * th, void * arg )
+{
+	uint32_t last = Time::Tick();
+	while( ! th->HasStopFlag() ) {
+		Time::SleepMs( m_check_interval_ms < 100 ? m_check_interval_ms : 100 );
+		uint32_t now = Time::Tick();
+		if( (int)( now - last ) < m_check_interval_ms )
+			continue;
+		last = now;
+		int num = CheckIdle();
+		if( num > 0 )
+			PR_DEBUG( "conn pool close %d idle connections", num );
+	}
+	return 0;
+}
+
+////////////////
+END_NS_DGN
+
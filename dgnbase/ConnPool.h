@@ -0,0 +1,99 @@
+// ConnPool.h : outbound tcp connection pool
+// Copyright (C) 2011 ~ 2023 drangon <drangon.zhou (at) gmail.com>
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+
+#ifndef INCLUDED_DGN_CONNPOOL_H
+#define INCLUDED_DGN_CONNPOOL_H
+
+#include <dgn/CStr.h>
+#include <dgn/Socket.h>
+#include <dgn/Thread.h>
+
+#include <map>
+#include <vector>
+
+BEGIN_NS_DGN
+////////////////
+
+class Resolver;
+
+// Note :
+// connections keyed by "host:port", Get() reuse the most recent idle one,
+// idle connection checked by Socket::PeekAlive() before reuse
+// Socket got from Get() must give back by Put(), never delete it outside
+
+class DGN_LIB_API ConnPool
+{
+public:
+	ConnPool();
+	~ConnPool();
+
+	ConnPool( const ConnPool & pool ) = delete;
+	ConnPool & operator = ( const ConnPool & pool ) = delete;
+
+	// max_per_host : idle + in use connections per host, 0 means no limit
+	// max_idle_per_host : idle connections kept per host
+	// idle_timeout_ms : idle longer than this will be closed
+	// check_interval_ms : > 0 start a thread to close timeout idle connections
+	int Init( int max_per_host = 16, int max_idle_per_host = 8, int idle_timeout_ms = 60000,
+			int check_interval_ms = 5000, int connect_timeout_ms = 3000 );
+	void Fini(); // close all idle connections, in use ones closed when Put()
+
+	// use resolver cache instead of resolve on first connect of each host
+	void SetResolver( Resolver * rs ) { m_resolver = rs; }
+
+	// return idle or new connected Socket, NULL if connect failed or reach max_per_host
+	Socket * Get( const char * host, int port );
+	// give back Socket, reuse = 0 means close it ( e.g. error or half read response )
+	void Put( Socket * sk, int reuse = 1 );
+
+	int CheckIdle(); // close timeout idle connections, return closed number
+	int GetIdleNum();
+	int GetBusyNum();
+
+protected:
+	struct idle_conn_t {
+		Socket * m_sk;
+		uint32_t m_tick; // last Put() time
+	};
+	struct host_pool_t {
+		host_pool_t() : m_busy( 0 ) {}
+
+		Endpoint m_ep; // resolved at first connect, clear when connect failed
+		int m_busy;
+		std::vector< idle_conn_t > m_idle; // LIFO, back is the most recent
+	};
+
+	int run_check( Thread * th, void * arg );
+
+protected:
+	Mutex m_lock;
+	std::map< CStr, host_pool_t > m_hosts;
+	std::map< Socket *, CStr > m_busy; // in use Socket -> host key
+
+	Resolver * m_resolver;
+	ThreadObjTP< ConnPool > m_checker;
+	int m_max_per_host;
+	int m_max_idle_per_host;
+	int m_idle_timeout_ms;
+	int m_check_interval_ms;
+	int m_connect_timeout_ms;
+};
+
+////////////////
+END_NS_DGN
+
+#endif // INCLUDED_DGN_CONNPOOL_H
+
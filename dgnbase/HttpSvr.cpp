@@ -0,0 +1,997 @@
+// HttpSvr.cpp : http/1.1 server driven by Reactor
+// Copyright (C) 2011 ~ 2023 drangon <drangon.zhou (at) gmail.com>
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+
+#include <dgn/HttpSvr.h>
+#include <dgn/Time.h>
+#include <dgn/Logger.h>
+
+#include <string.h>
+
+#define DGN_HTTP_RBUF_SIZE	4096
+#define DGN_HTTP_MAX_PENDING_OUT	( 256 * 1024 ) // stop handle pipelined requests until flushed
+#define DGN_HTTP_MAX_CHUNK_LINE	1024
+#define DGN_HTTP_ACCEPT_PER_EVENT	64
+#define DGN_HTTP_MAX_FREE_CONN	256 // closed connections kept for reuse
+
+BEGIN_NS_DGN
+////////////////
+
+struct http_tok_t
+{
+	int m_off; // relative to request start
+	int m_len;
+};
+
+struct HttpSvr::conn_t
+{
+	conn_t( HttpSvr * svr ) : m_svr( svr ), m_prev( NULL ), m_next( NULL ), m_tick( 0 )
+		, m_rbuf( NULL ), m_rcap( 0 ), m_rhead( 0 ), m_rtail( 0 ), m_out_off( 0 ), m_peer_closed( 0 ), m_close_after( 0 ), m_evt( DGN_POLLIN )
+	{
+		reset_req();
+	}
+	~conn_t()
+	{
+		delete[] m_rbuf, m_rbuf = NULL;
+	}
+
+	// back to just constructed state for reuse, keep normal size buffers
+	void reset_conn()
+	{
+		m_sk.Close();
+		m_prev = m_next = NULL;
+		m_tick = 0;
+		if( m_rcap > DGN_HTTP_RBUF_SIZE )
+			delete[] m_rbuf, m_rbuf = NULL, m_rcap = 0;
+		m_rhead = m_rtail = 0;
+		if( m_out.Len() > DGN_HTTP_MAX_PENDING_OUT )
+			m_out = CStr();
+		else
+			m_out.ReleaseRaw( 0 );
+		m_out_off = 0;
+		m_peer_closed = 0;
+		m_close_after = 0;
+		m_evt = DGN_POLLIN;
+		reset_req();
+	}
+
+	void reset_req()
+	{
+		m_scanned = 0;
+		m_hdr_len = 0;
+		m_body_type = 0;
+		m_content_len = 0;
+		m_chunk_pos = 0;
+		m_chunk_decoded = 0;
+		m_req_len = 0;
+		m_expect_continue = 0;
+		m_version = 11;
+		m_keep_alive = 1;
+		m_hdr_num = 0;
+	}
+
+	HttpSvr * m_svr;
+	conn_t * m_prev;
+	conn_t * m_next;
+	Socket m_sk; // accepted in place, no allocation per connection
+	uint32_t m_tick; // last active
+
+	char * m_rbuf;
+	int m_rcap;
+	int m_rhead;
+	int m_rtail;
+
+	CStr m_out;
+	int m_out_off;
+	int m_peer_closed; // read end closed, answer requests already received
+	int m_close_after; // close after output flushed, no more request parsed
+	int m_evt;
+
+	// current request, all offsets relative to m_rhead
+	int m_scanned; // no "\r\n\r\n" before this
+	int m_hdr_len; // 0 if head not complete
+	int m_body_type; // 0 : none, 1 : content-length, 2 : chunked
+	int m_content_len;
+	int m_chunk_pos; // next chunk size line
+	int m_chunk_decoded;
+	int m_req_len; // 0 if body not complete
+	int m_expect_continue; // 1 : need send, 2 : sent
+	int m_version;
+	int m_keep_alive;
+
+	http_tok_t m_method;
+	http_tok_t m_path;
+	http_tok_t m_query;
+	int m_hdr_num;
+	http_tok_t m_hdr_name[DGN_HTTP_MAX_HEADERS];
+	http_tok_t m_hdr_val[DGN_HTTP_MAX_HEADERS];
+};
+
+static const char * get_reason( int code )
+{
+	switch( code ) {
+	case 100 : return "Continue";
+	case 200 : return "OK";
+	case 201 : return "Created";
+	case 204 : return "No Content";
+	case 206 : return "Partial Content";
+	case 301 : return "Moved Permanently";
+	case 302 : return "Found";
+	case 304 : return "Not Modified";
+	case 400 : return "Bad Request";
+	case 401 : return "Unauthorized";
+	case 403 : return "Forbidden";
+	case 404 : return "Not Found";
+	case 405 : return "Method Not Allowed";
+	case 408 : return "Request Timeout";
+	case 413 : return "Payload Too Large";
+	case 431 : return "Request Header Fields Too Large";
+	case 500 : return "Internal Server Error";
+	case 501 : return "Not Implemented";
+	case 502 : return "Bad Gateway";
+	case 503 : return "Service Unavailable";
+	default : break;
+	}
+	return "Unknown";
+}
+
+// CStr::Append() stop at '\0', body may be binary
+static void append_bin( CStr * s, const char * buf, int len )
+{
+	int old = s->Len();
+	s->Reserve( old + len + 1 );
+	memcpy( s->GetRaw() + old, buf, len );
+	s->ReleaseRaw( old + len );
+	return;
+}
+
+// faster than AppendFmt( "%d" ) in hot path
+static void append_int( CStr * s, int val, int base = 10 )
+{
+	char buf[16];
+	int pos = (int)sizeof(buf);
+	unsigned int v = (unsigned int)( val < 0 ? -val : val );
+	do {
+		buf[--pos] = "0123456789abcdef"[v % base];
+		v /= base;
+	} while( v > 0 );
+	if( val < 0 )
+		buf[--pos] = '-';
+	s->Append( buf + pos, (int)sizeof(buf) - pos );
+	return;
+}
+
+static int find_crlf( const char * buf, int len )
+{
+	if( len < 2 )
+		return -1;
+	const char * p = buf;
+	const char * end = buf + len - 1;
+	while( p < end ) {
+		p = (const char *)memchr( p, '\r', end - p );
+		if( p == NULL )
+			return -1;
+		if( p[1] == '\n' )
+			return (int)( p - buf );
+		++p;
+	}
+	return -1;
+}
+
+static int tok_equal( const char * base, const http_tok_t & tok, const char * s, int slen )
+{
+	return tok.m_len == slen && CStr::CaseCmp( base + tok.m_off, s, slen ) == 0;
+}
+
+// parse hex chunk size, ignore chunk extension, < 0 if invalid
+static int parse_chunk_size( const char * p, int len )
+{
+	int size = 0, i;
+	for( i = 0; i < len; ++i ) {
+		char ch = p[i];
+		int v;
+		if( ch >= '0' && ch <= '9' )
+			v = ch - '0';
+		else if( ch >= 'a' && ch <= 'f' )
+			v = ch - 'a' + 10;
+		else if( ch >= 'A' && ch <= 'F' )
+			v = ch - 'A' + 10;
+		else
+			break;
+		if( size > ( 0x7fffffff >> 4 ) )
+			return -1;
+		size = ( size << 4 ) | v;
+	}
+	if( i == 0 || ( i < len && p[i] != ';' && p[i] != ' ' && p[i] != '\t' ) )
+		return -1;
+	return size;
+}
+
+//////// HttpRequest
+
+const CStr * HttpRequest::GetHeader( const char * name ) const
+{
+	int i;
+	for( i = 0; i < m_header_num; ++i ) {
+		if( m_headers[i].m_name.CaseCmp( name ) == 0 )
+			return &m_headers[i].m_value;
+	}
+	return NULL;
+}
+
+//////// HttpResponse
+
+HttpResponse::HttpResponse()
+	: m_svr( NULL ), m_out( NULL ), m_code( 200 ), m_reason( NULL ), m_version( 11 )
+	, m_keep_alive( 1 ), m_is_head( 0 ), m_chunked( 0 ), m_head_sent( 0 )
+{
+}
+
+void HttpResponse::SetStatus( int code, const char * reason )
+{
+	m_code = code;
+	m_reason = reason;
+	return;
+}
+
+int HttpResponse::AddHeader( const char * name, const char * value )
+{
+	if( m_head_sent )
+		return -1;
+	m_headers.Append( name );
+	m_headers.Append( ": ", 2 );
+	m_headers.Append( value );
+	m_headers.Append( "\r\n", 2 );
+	return 0;
+}
+
+int HttpResponse::SetBody( const char * buf, int len )
+{
+	if( m_chunked ) {
+		m_body.ReleaseRaw( 0 );
+		return AppendBody( buf, len );
+	}
+	m_body.ReleaseRaw( 0 );
+	append_bin( &m_body, buf, len );
+	return len;
+}
+
+int HttpResponse::AppendBody( const char * buf, int len )
+{
+	if( len < 0 )
+		len = (int)strlen( buf );
+	if( ! m_chunked ) {
+		append_bin( &m_body, buf, len );
+		return len;
+	}
+
+	if( ! m_head_sent )
+		write_head( -1 );
+	if( len == 0 || m_is_head )
+		return 0; // zero chunk means end, send by finish()
+	append_int( m_out, len, 16 );
+	m_out->Append( "\r\n", 2 );
+	append_bin( m_out, buf, len );
+	m_out->Append( "\r\n", 2 );
+	return len;
+}
+
+void HttpResponse::SetChunked( int chunked )
+{
+	if( m_head_sent || m_version < 11 )
+		return;
+	m_chunked = chunked;
+	return;
+}
+
+void HttpResponse::reset( HttpSvr * svr, CStr * out, int version, int keep_alive, int is_head )
+{
+	m_svr = svr;
+	m_out = out;
+	m_code = 200;
+	m_reason = NULL;
+	m_version = version;
+	m_keep_alive = keep_alive;
+	m_is_head = is_head;
+	m_chunked = 0;
+	m_head_sent = 0;
+	m_headers.ReleaseRaw( 0 );
+	m_body.ReleaseRaw( 0 );
+	return;
+}
+
+int HttpResponse::write_head( int content_len )
+{
+	CStr * out = m_out;
+	out->Append( m_version >= 11 ? "HTTP/1.1 " : "HTTP/1.0 ", 9 );
+	append_int( out, m_code );
+	out->Append( " ", 1 );
+	out->Append( m_reason != NULL ? m_reason : get_reason( m_code ) );
+	out->Append( "\r\n", 2 );
+	out->Append( m_svr->GetDateLine() );
+	if( content_len >= 0 ) {
+		out->Append( "Content-Length: ", 16 );
+		append_int( out, content_len );
+		out->Append( "\r\n", 2 );
+	}
+	else {
+		out->Append( "Transfer-Encoding: chunked\r\n", 28 );
+	}
+	if( ! m_keep_alive )
+		out->Append( "Connection: close\r\n", 19 );
+	else if( m_version < 11 )
+		out->Append( "Connection: keep-alive\r\n", 24 );
+	out->Append( m_headers );
+	out->Append( "\r\n", 2 );
+	m_head_sent = 1;
+	return 0;
+}
+
+int HttpResponse::finish()
+{
+	if( m_chunked ) {
+		if( ! m_head_sent )
+			write_head( -1 );
+		if( ! m_is_head )
+			m_out->Append( "0\r\n\r\n", 5 );
+		return 0;
+	}
+	write_head( m_body.Len() );
+	if( ! m_is_head )
+		append_bin( m_out, m_body.Str(), m_body.Len() );
+	return 0;
+}
+
+//////// HttpSvr
+
+HttpSvr::HttpSvr()
+	: m_reactor( NULL ), m_own_reactor( 0 ), m_cb( NULL ), m_arg( NULL )
+	, m_max_header_size( 65536 ), m_max_body_size( 16 * 1024 * 1024 ), m_idle_timeout_ms( 60000 )
+	, m_lru_head( NULL ), m_lru_tail( NULL ), m_conn_num( 0 ), m_free_head( NULL ), m_free_num( 0 ), m_date_sec( 0 )
+{
+	m_thread.SetFunc( &HttpSvr::run_loop, this );
+	m_opt.m_nodelay = 1; // small responses, never wait for ack
+	m_opt.m_backlog = 1024;
+}
+
+HttpSvr::~HttpSvr()
+{
+	Fini();
+}
+
+int HttpSvr::Init( const char * host, int port, http_handler_t cb, void * arg, Reactor * reactor )
+{
+	Endpoint ep;
+	if( ep.Set( host, port ) < 0 ) {
+		PR_ERR( "resolve [%s] failed", host );
+		return -1;
+	}
+	return Init( ep, cb, arg, reactor );
+}
+
+int HttpSvr::Init( const Endpoint & ep, http_handler_t cb, void * arg, Reactor * reactor )
+{
+	if( m_reactor != NULL || cb == NULL ) {
+		PR_ERR( "http svr already init or no handler" );
+		return -1;
+	}
+	if( m_listen.TcpSvr( ep, m_opt ) < 0 ) {
+		PR_ERR( "http svr listen [%s] failed", ep.ToStr().Str() );
+		return -1;
+	}
+
+	m_cb = cb;
+	m_arg = arg;
+	if( reactor == NULL ) {
+		m_reactor = new Reactor();
+		m_own_reactor = 1;
+		if( m_reactor->Init() < 0 ) {
+			Fini();
+			return -1;
+		}
+	}
+	else {
+		m_reactor = reactor;
+		m_own_reactor = 0;
+	}
+	if( m_reactor->Add( m_listen.GetRawSock(), DGN_POLLIN, on_accept, this ) < 0 ) {
+		PR_ERR( "http svr add listen socket failed" );
+		Fini();
+		return -1;
+	}
+	return 0;
+}
+
+void HttpSvr::Fini()
+{
+	Stop();
+	while( m_lru_head != NULL )
+		close_conn( m_lru_head );
+	if( m_reactor != NULL ) {
+		if( m_listen.IsValid() )
+			m_reactor->Del( m_listen.GetRawSock() );
+		if( m_own_reactor )
+			delete m_reactor;
+		m_reactor = NULL;
+	}
+	m_listen.Close();
+	m_cb = NULL;
+	while( m_free_head != NULL ) {
+		conn_t * c = m_free_head;
+		m_free_head = c->m_next;
+		delete c;
+	}
+	m_free_num = 0;
+	return;
+}
+
+void HttpSvr::SetLimit( int max_header_size, int max_body_size, int idle_timeout_ms )
+{
+	m_max_header_size = max_header_size;
+	m_max_body_size = max_body_size;
+	m_idle_timeout_ms = idle_timeout_ms;
+	return;
+}
+
+int HttpSvr::GetPort()
+{
+	char ip[DGN_IP_LEN];
+	int port = 0;
+	if( m_listen.LocalAddr( ip, &port ) < 0 )
+		return -1;
+	return port;
+}
+
+int HttpSvr::Start()
+{
+	if( ! m_own_reactor ) {
+		PR_ERR( "http svr start without own reactor" );
+		return -1;
+	}
+	return m_thread.Start();
+}
+
+void HttpSvr::Stop()
+{
+	m_thread.SignalStop();
+	if( m_reactor != NULL )
+		m_reactor->Wakeup();
+	m_thread.WaitStop();
+	return;
+}
+
+int HttpSvr::RunOnce( int timeout_ms )
+{
+	if( m_reactor == NULL )
+		return -1;
+	int ret = m_reactor->RunOnce( timeout_ms );
+	CheckIdle();
+	return ret;
+}
+
+int HttpSvr::CheckIdle()
+{
+	if( m_idle_timeout_ms <= 0 )
+		return 0;
+	int num = 0;
+	uint32_t now = Time::Tick();
+	while( m_lru_head != NULL && (int)( now - m_lru_head->m_tick ) >= m_idle_timeout_ms ) {
+		close_conn( m_lru_head );
+		num++;
+	}
+	return num;
+}
+
+const CStr & HttpSvr::GetDateLine()
+{
+	long now = Time::NowSec();
+	if( now != m_date_sec ) {
+		m_date_sec = now;
+		Time t;
+		t.SetNow_GMT();
+		m_date_line = "Date: ";
+		t.ToRfc( &m_date_line );
+		m_date_line.Append( "\r\n", 2 );
+	}
+	return m_date_line;
+}
+
+int HttpSvr::run_loop( Thread * th, void * arg )
+{
+	while( ! th->HasStopFlag() ) {
+		if( RunOnce( 1000 ) < 0 ) {
+			PR_ERR( "http svr reactor failed" );
+			return -1;
+		}
+	}
+	return 0;
+}
+
+void HttpSvr::on_accept( sock_t fd, int evt, void * arg )
+{
+	HttpSvr * svr = (HttpSvr *)arg;
+	int i;
+	for( i = 0; i < DGN_HTTP_ACCEPT_PER_EVENT; ++i ) {
+		conn_t * c = svr->alloc_conn();
+		if( svr->m_listen.Accept( &c->m_sk ) <= 0 ) {
+			svr->free_conn( c );
+			break;
+		}
+		// others inherited from listen socket
+		if( svr->m_opt.m_quickack >= 0 )
+			c->m_sk.SetQuickAck( svr->m_opt.m_quickack );
+
+		if( svr->m_reactor->Add( c->m_sk.GetRawSock(), DGN_POLLIN, on_conn, c ) < 0 ) {
+			svr->free_conn( c );
+			continue;
+		}
+		svr->touch( c );
+		svr->m_conn_num++;
+	}
+	return;
+}
+
+void HttpSvr::on_conn( sock_t fd, int evt, void * arg )
+{
+	conn_t * c = (conn_t *)arg;
+	c->m_svr->handle_conn( c, evt );
+	return;
+}
+
+void HttpSvr::handle_conn( conn_t * c, int evt )
+{
+	touch( c );
+
+	if( ( evt & DGN_POLLIN ) && ! c->m_peer_closed && ! c->m_close_after ) {
+		while( 1 ) {
+			if( c->m_rtail == c->m_rcap ) {
+				if( c->m_rhead > 0 ) {
+					memmove( c->m_rbuf, c->m_rbuf + c->m_rhead, c->m_rtail - c->m_rhead );
+					c->m_rtail -= c->m_rhead;
+					c->m_rhead = 0;
+				}
+				else {
+					// request size already limited by parse
+					int newcap = c->m_rcap > 0 ? c->m_rcap * 2 : DGN_HTTP_RBUF_SIZE;
+					char * buf = new char[newcap];
+					if( c->m_rtail > 0 )
+						memcpy( buf, c->m_rbuf, c->m_rtail );
+					delete[] c->m_rbuf;
+					c->m_rbuf = buf, c->m_rcap = newcap;
+				}
+			}
+			int space = c->m_rcap - c->m_rtail;
+			int ret = c->m_sk.Recv( c->m_rbuf + c->m_rtail, 1, space );
+			if( ret < 0 ) {
+				// peer closed or error, answer what already received
+				c->m_peer_closed = 1;
+				if( c->m_rtail == c->m_rhead ) {
+					close_conn( c );
+					return;
+				}
+				break;
+			}
+			c->m_rtail += ret;
+			if( ret < space )
+				break;
+		}
+	}
+
+	while( 1 ) {
+		int ret = process( c );
+		if( ret < 0 || flush( c ) < 0 ) {
+			close_conn( c );
+			return;
+		}
+		// stopped by pending output limit but all flushed, go on
+		if( ret == 0 || c->m_out_off < c->m_out.Len() )
+			break;
+	}
+
+	int want = DGN_POLLIN;
+	if( c->m_out_off < c->m_out.Len() )
+		want = DGN_POLLOUT; // stop reading until flushed
+	else if( c->m_peer_closed || c->m_close_after ) {
+		close_conn( c );
+		return;
+	}
+	if( want != c->m_evt ) {
+		m_reactor->Mod( c->m_sk.GetRawSock(), want );
+		c->m_evt = want;
+	}
+	return;
+}
+
+int HttpSvr::process( conn_t * c )
+{
+	while( 1 ) {
+		if( c->m_close_after ) {
+			// drop pipelined requests after a closing response, even when re-entered on POLLOUT
+			c->m_rhead = c->m_rtail = 0;
+			c->reset_req();
+			break;
+		}
+		if( c->m_out.Len() - c->m_out_off >= DGN_HTTP_MAX_PENDING_OUT )
+			return 1;
+		if( c->m_hdr_len == 0 ) {
+			// skip empty lines between requests
+			while( c->m_rhead < c->m_rtail && ( c->m_rbuf[c->m_rhead] == '\r' || c->m_rbuf[c->m_rhead] == '\n' ) )
+				c->m_rhead++;
+		}
+		if( c->m_rhead == c->m_rtail ) {
+			c->m_rhead = c->m_rtail = 0;
+			break;
+		}
+
+		int ret;
+		if( c->m_hdr_len == 0 ) {
+			ret = parse_head( c );
+			if( ret < 0 ) {
+				reply_error( c, -ret );
+				break;
+			}
+			if( ret == 0 )
+				break;
+		}
+		ret = check_body( c );
+		if( ret < 0 ) {
+			reply_error( c, -ret );
+			break;
+		}
+		if( ret == 0 ) {
+			if( c->m_expect_continue == 1 ) {
+				c->m_out.Append( "HTTP/1.1 100 Continue\r\n\r\n" );
+				c->m_expect_continue = 2;
+			}
+			break;
+		}
+		call_handler( c );
+	}
+	return 0;
+}
+
+int HttpSvr::parse_head( conn_t * c )
+{
+	const char * base = c->m_rbuf + c->m_rhead;
+	int pending = c->m_rtail - c->m_rhead;
+
+	int start = c->m_scanned > 3 ? c->m_scanned - 3 : 0;
+	int off = -1;
+	while( start < pending ) {
+		int pos = find_crlf( base + start, pending - start );
+		if( pos < 0 )
+			break;
+		pos += start;
+		if( pos + 3 < pending && base[pos + 2] == '\r' && base[pos + 3] == '\n' ) {
+			off = pos;
+			break;
+		}
+		start = pos + 2;
+	}
+	if( off < 0 ) {
+		c->m_scanned = pending;
+		return pending > m_max_header_size ? -431 : 0;
+	}
+	if( off + 4 > m_max_header_size )
+		return -431;
+
+	// request line : method SP uri SP version CRLF
+	int p = 0;
+	c->m_method.m_off = p;
+	while( p < off && base[p] != ' ' )
+		p++;
+	c->m_method.m_len = p;
+	if( p == 0 || p >= off )
+		return -400;
+	p++;
+	c->m_path.m_off = p;
+	while( p < off && base[p] != ' ' && base[p] != '?' )
+		p++;
+	c->m_path.m_len = p - c->m_path.m_off;
+	c->m_query.m_off = p;
+	c->m_query.m_len = 0;
+	if( p < off && base[p] == '?' ) {
+		c->m_query.m_off = ++p;
+		while( p < off && base[p] != ' ' )
+			p++;
+		c->m_query.m_len = p - c->m_query.m_off;
+	}
+	if( c->m_path.m_len == 0 || p >= off )
+		return -400;
+	p++;
+	int line_end = find_crlf( base + p, off + 2 - p ) + p;
+	if( line_end - p != 8 || memcmp( base + p, "HTTP/1.", 7 ) != 0 )
+		return -400;
+	if( base[p + 7] == '1' )
+		c->m_version = 11, c->m_keep_alive = 1;
+	else if( base[p + 7] == '0' )
+		c->m_version = 10, c->m_keep_alive = 0;
+	else
+		return -400;
+
+	// header : name ":" OWS value OWS CRLF
+	c->m_hdr_num = 0;
+	p = line_end + 2;
+	while( p < off + 2 ) {
+		line_end = find_crlf( base + p, off + 4 - p ) + p;
+		if( base[p] == ' ' || base[p] == '\t' )
+			return -400; // obsolete line folding
+		if( c->m_hdr_num >= DGN_HTTP_MAX_HEADERS )
+			return -431;
+		http_tok_t & name = c->m_hdr_name[c->m_hdr_num];
+		http_tok_t & val = c->m_hdr_val[c->m_hdr_num];
+		const char * colon = (const char *)memchr( base + p, ':', line_end - p );
+		if( colon == NULL || colon == base + p || colon[-1] == ' ' || colon[-1] == '\t' )
+			return -400;
+		name.m_off = p;
+		name.m_len = (int)( colon - base ) - p;
+		int vs = (int)( colon - base ) + 1, ve = line_end;
+		while( vs < ve && ( base[vs] == ' ' || base[vs] == '\t' ) )
+			vs++;
+		while( ve > vs && ( base[ve - 1] == ' ' || base[ve - 1] == '\t' ) )
+			ve--;
+		val.m_off = vs;
+		val.m_len = ve - vs;
+		c->m_hdr_num++;
+
+		if( tok_equal( base, name, "Content-Length", 14 ) ) {
+			if( c->m_body_type != 0 || val.m_len == 0 || val.m_len > 10 )
+				return -400;
+			int64_t len = 0;
+			int i;
+			for( i = 0; i < val.m_len; ++i ) {
+				char ch = base[val.m_off + i];
+				if( ch < '0' || ch > '9' )
+					return -400;
+				len = len * 10 + ( ch - '0' );
+			}
+			if( len > m_max_body_size )
+				return -413;
+			c->m_body_type = 1;
+			c->m_content_len = (int)len;
+		}
+		else if( tok_equal( base, name, "Transfer-Encoding", 17 ) ) {
+			if( c->m_body_type != 0 )
+				return -400;
+			if( ! tok_equal( base, val, "chunked", 7 ) )
+				return -501;
+			c->m_body_type = 2;
+		}
+		else if( tok_equal( base, name, "Connection", 10 ) ) {
+			if( tok_equal( base, val, "close", 5 ) )
+				c->m_keep_alive = 0;
+			else if( tok_equal( base, val, "keep-alive", 10 ) )
+				c->m_keep_alive = 1;
+		}
+		else if( tok_equal( base, name, "Expect", 6 ) ) {
+			if( tok_equal( base, val, "100-continue", 12 ) && c->m_version >= 11 )
+				c->m_expect_continue = 1;
+		}
+		p = line_end + 2;
+	}
+
+	c->m_hdr_len = off + 4;
+	c->m_chunk_pos = c->m_hdr_len;
+	return 1;
+}
+
+int HttpSvr::check_body( conn_t * c )
+{
+	const char * base = c->m_rbuf + c->m_rhead;
+	int pending = c->m_rtail - c->m_rhead;
+
+	if( c->m_body_type == 0 ) {
+		c->m_req_len = c->m_hdr_len;
+		return 1;
+	}
+	if( c->m_body_type == 1 ) {
+		if( pending < c->m_hdr_len + c->m_content_len )
+			return 0;
+		c->m_req_len = c->m_hdr_len + c->m_content_len;
+		return 1;
+	}
+
+	// chunked, only scan here, decode in place when complete
+	while( 1 ) {
+		int p = c->m_chunk_pos;
+		int pos = find_crlf( base + p, pending - p );
+		if( pos < 0 )
+			return pending - p > DGN_HTTP_MAX_CHUNK_LINE ? -400 : 0;
+		int size = parse_chunk_size( base + p, pos );
+		if( size < 0 )
+			return -400;
+		p += pos + 2;
+		if( size == 0 ) {
+			// trailer lines until empty line
+			while( 1 ) {
+				pos = find_crlf( base + p, pending - p );
+				if( pos < 0 )
+					return pending - p > m_max_header_size ? -431 : 0;
+				p += pos + 2;
+				if( pos == 0 )
+					break;
+			}
+			c->m_req_len = p;
+			return 1;
+		}
+		if( (int64_t)c->m_chunk_decoded + size > m_max_body_size )
+			return -413;
+		if( pending - p < size + 2 )
+			return 0;
+		if( base[p + size] != '\r' || base[p + size + 1] != '\n' )
+			return -400;
+		c->m_chunk_decoded += size;
+		c->m_chunk_pos = p + size + 2;
+	}
+	return 0;
+}
+
+void HttpSvr::call_handler( conn_t * c )
+{
+	char * base = c->m_rbuf + c->m_rhead;
+	HttpRequest & req = m_req;
+
+	// zero copy : terminate tokens in place, separators no longer needed
+	base[c->m_method.m_off + c->m_method.m_len] = '\0';
+	req.m_method.AttachConst( base + c->m_method.m_off, c->m_method.m_len );
+	base[c->m_path.m_off + c->m_path.m_len] = '\0';
+	req.m_path.AttachConst( base + c->m_path.m_off, c->m_path.m_len );
+	if( c->m_query.m_len > 0 ) {
+		base[c->m_query.m_off + c->m_query.m_len] = '\0';
+		req.m_query.AttachConst( base + c->m_query.m_off, c->m_query.m_len );
+	}
+	else {
+		req.m_query.AttachConst( "", 0 );
+	}
+	req.m_version = c->m_version;
+	req.m_keep_alive = c->m_keep_alive;
+	req.m_header_num = c->m_hdr_num;
+	int i;
+	for( i = 0; i < c->m_hdr_num; ++i ) {
+		const http_tok_t & name = c->m_hdr_name[i];
+		const http_tok_t & val = c->m_hdr_val[i];
+		base[name.m_off + name.m_len] = '\0';
+		base[val.m_off + val.m_len] = '\0';
+		req.m_headers[i].m_name.AttachConst( base + name.m_off, name.m_len );
+		req.m_headers[i].m_value.AttachConst( base + val.m_off, val.m_len );
+	}
+
+	req.m_body = base + c->m_hdr_len;
+	req.m_body_len = 0;
+	if( c->m_body_type == 1 ) {
+		req.m_body_len = c->m_content_len;
+	}
+	else if( c->m_body_type == 2 ) {
+		// move chunk data together, already validated by check_body()
+		int p = c->m_hdr_len, dst = c->m_hdr_len;
+		while( 1 ) {
+			int pos = find_crlf( base + p, c->m_req_len - p );
+			int size = parse_chunk_size( base + p, pos );
+			p += pos + 2;
+			if( size == 0 )
+				break;
+			memmove( base + dst, base + p, size );
+			dst += size;
+			p += size + 2;
+		}
+		req.m_body_len = dst - c->m_hdr_len;
+	}
+
+	int is_head = c->m_method.m_len == 4 && memcmp( base + c->m_method.m_off, "HEAD", 4 ) == 0;
+	m_rsp.reset( this, &c->m_out, c->m_version, c->m_keep_alive, is_head );
+	(*m_cb)( &req, &m_rsp, m_arg );
+	m_rsp.finish();
+	if( ! m_rsp.m_keep_alive )
+		c->m_close_after = 1;
+
+	c->m_rhead += c->m_req_len;
+	c->reset_req();
+	return;
+}
+
+void HttpSvr::reply_error( conn_t * c, int code )
+{
+	PR_DEBUG( "http request error %d, close connection", code );
+	m_rsp.reset( this, &c->m_out, c->m_version, 0, 0 );
+	m_rsp.SetStatus( code );
+	m_rsp.finish();
+	c->m_close_after = 1;
+	c->m_rhead = c->m_rtail = 0;
+	c->reset_req();
+	return;
+}
+
+int HttpSvr::flush( conn_t * c )
+{
+	int len = c->m_out.Len() - c->m_out_off;
+	if( len == 0 )
+		return 0;
+	int ret = c->m_sk.Send( c->m_out.Str() + c->m_out_off, len );
+	if( ret < 0 )
+		return -1;
+	c->m_out_off += ret;
+	if( c->m_out_off == c->m_out.Len() ) {
+		c->m_out.ReleaseRaw( 0 );
+		c->m_out_off = 0;
+	}
+	return 0;
+}
+
+void HttpSvr::close_conn( conn_t * c )
+{
+	m_reactor->Del( c->m_sk.GetRawSock() );
+	if( c->m_prev != NULL )
+		c->m_prev->m_next = c->m_next;
+	else
+		m_lru_head = c->m_next;
+	if( c->m_next != NULL )
+		c->m_next->m_prev = c->m_prev;
+	else
+		m_lru_tail = c->m_prev;
+	free_conn( c );
+	m_conn_num--;
+	return;
+}
+
+HttpSvr::conn_t * HttpSvr::alloc_conn()
+{
+	if( m_free_head == NULL )
+		return new conn_t( this );
+	conn_t * c = m_free_head;
+	m_free_head = c->m_next;
+	c->m_next = NULL;
+	m_free_num--;
+	return c;
+}
+
+void HttpSvr::free_conn( conn_t * c )
+{
+	if( m_free_num >= DGN_HTTP_MAX_FREE_CONN ) {
+		delete c;
+		return;
+	}
+	c->reset_conn();
+	c->m_next = m_free_head;
+	m_free_head = c;
+	m_free_num++;
+	return;
+}
+
+void HttpSvr::touch( conn_t * c )
+{
+	c->m_tick = Time::Tick();
+	if( c == m_lru_tail )
+		return;
+	// unlink if already in list
+	if( c->m_prev != NULL || c == m_lru_head ) {
+		if( c->m_prev != NULL )
+			c->m_prev->m_next = c->m_next;
+		else
+			m_lru_head = c->m_next;
+		c->m_next->m_prev = c->m_prev;
+	}
+	c->m_prev = m_lru_tail;
+	c->m_next = NULL;
+	if( m_lru_tail != NULL )
+		m_lru_tail->m_next = c;
+	else
+		m_lru_head = c;
+	m_lru_tail = c;
+	return;
+}
+
+////////////////
+END_NS_DGN
+
@@ -0,0 +1,184 @@
+// HttpSvr.h : http/1.1 server driven by Reactor
+// Copyright (C) 2011 ~ 2023 drangon <drangon.zhou (at) gmail.com>
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+
+#ifndef INCLUDED_DGN_HTTPSVR_H
+#define INCLUDED_DGN_HTTPSVR_H
+
+#include <dgn/CStr.h>
+#include <dgn/Socket.h>
+#include <dgn/Reactor.h>
+#include <dgn/Thread.h>
+
+BEGIN_NS_DGN
+////////////////
+
+#define DGN_HTTP_MAX_HEADERS	64
+
+struct HttpHeader
+{
+	CStr m_name;
+	CStr m_value;
+};
+
+// Note :
+// all CStr are const views into connection read buffer, only valid inside handler,
+// copy them ( CStr copy create normal one ) if need keep
+class DGN_LIB_API HttpRequest
+{
+public:
+	HttpRequest() : m_version( 11 ), m_keep_alive( 1 ), m_header_num( 0 ), m_body( NULL ), m_body_len( 0 ) {}
+
+	// case insensitive, NULL if not exist
+	const CStr * GetHeader( const char * name ) const;
+
+public:
+	CStr m_method;
+	CStr m_path;  // uri before '?'
+	CStr m_query; // uri after '?', empty if none
+	int m_version; // 10 or 11
+	int m_keep_alive;
+
+	int m_header_num;
+	HttpHeader m_headers[DGN_HTTP_MAX_HEADERS];
+
+	const char * m_body; // not end with '\0', chunked body already decoded
+	int m_body_len;
+};
+
+class HttpSvr;
+
+class DGN_LIB_API HttpResponse
+{
+public:
+	HttpResponse();
+
+	void SetStatus( int code, const char * reason = NULL ); // default 200, reason NULL use standard one
+	int AddHeader( const char * name, const char * value ); // Date, Content-Length, Connection are auto added
+	void SetKeepAlive( int keep_alive ) { if( ! keep_alive ) m_keep_alive = 0; } // can only turn off
+
+	int SetBody( const char * buf, int len );
+	int AppendBody( const char * buf, int len );
+	// chunked : status and headers sent at first AppendBody(), each AppendBody() send a chunk
+	// ignored for http/1.0 request
+	void SetChunked( int chunked = 1 );
+
+protected:
+	friend class HttpSvr;
+
+	void reset( HttpSvr * svr, CStr * out, int version, int keep_alive, int is_head );
+	int write_head( int content_len ); // content_len < 0 for chunked
+	int finish();
+
+protected:
+	HttpSvr * m_svr;
+	CStr * m_out; // connection output buffer
+	int m_code;
+	const char * m_reason;
+	int m_version;
+	int m_keep_alive;
+	int m_is_head;
+	int m_chunked;
+	int m_head_sent;
+	CStr m_headers; // "name: value\r\n" lines
+	CStr m_body;
+};
+
+typedef void (* http_handler_t)( HttpRequest * req, HttpResponse * rsp, void * arg );
+
+// Note :
+// keep-alive and pipelining, responses of pipelined requests coalesced into one send
+// handler called in reactor thread, should not block
+// with own reactor ( Init() reactor = NULL ), use Start() thread or loop RunOnce()
+// with shared reactor, caller run it and call CheckIdle() periodically
+class DGN_LIB_API HttpSvr
+{
+public:
+	HttpSvr();
+	~HttpSvr();
+
+	HttpSvr( const HttpSvr & svr ) = delete;
+	HttpSvr & operator = ( const HttpSvr & svr ) = delete;
+
+	int Init( const char * host, int port, http_handler_t cb, void * arg, Reactor * reactor = NULL );
+	int Init( const Endpoint & ep, http_handler_t cb, void * arg, Reactor * reactor = NULL );
+	void Fini();
+
+	// call before Init()
+	void SetLimit( int max_header_size = 65536, int max_body_size = 16 * 1024 * 1024, int idle_timeout_ms = 60000 );
+	// listen and accepted socket options, default nodelay and backlog 1024
+	void SetSockOpt( const SockOpt & opt ) { m_opt = opt; }
+
+	int GetPort();
+	int GetConnNum() const { return m_conn_num; }
+
+	int Start(); // start thread to run own reactor
+	void Stop();
+	int RunOnce( int timeout_ms ); // run own reactor once, and check idle
+	int CheckIdle(); // close idle connections, return closed number
+
+	// "Date: xxx\r\n" of current second
+	const CStr & GetDateLine();
+
+protected:
+	struct conn_t;
+
+	static void on_accept( sock_t fd, int evt, void * arg );
+	static void on_conn( sock_t fd, int evt, void * arg );
+	int run_loop( Thread * th, void * arg );
+
+	void handle_conn( conn_t * c, int evt );
+	int process( conn_t * c ); // handle complete requests, return 1 if stopped by pending output limit
+	int parse_head( conn_t * c );
+	int check_body( conn_t * c );
+	void call_handler( conn_t * c );
+	void reply_error( conn_t * c, int code );
+	int flush( conn_t * c );
+	void close_conn( conn_t * c );
+	conn_t * alloc_conn(); // from free list if any
+	void free_conn( conn_t * c ); // close socket and keep for reuse
+	void touch( conn_t * c ); // move to lru tail
+
+protected:
+	Socket m_listen;
+	Reactor * m_reactor;
+	int m_own_reactor;
+	ThreadObjTP< HttpSvr > m_thread;
+	http_handler_t m_cb;
+	void * m_arg;
+	SockOpt m_opt;
+
+	int m_max_header_size;
+	int m_max_body_size;
+	int m_idle_timeout_ms;
+
+	conn_t * m_lru_head; // least recently active
+	conn_t * m_lru_tail;
+	int m_conn_num;
+	conn_t * m_free_head; // closed connections, linked by m_next
+	int m_free_num;
+
+	long m_date_sec;
+	CStr m_date_line;
+
+	HttpRequest m_req;
+	HttpResponse m_rsp;
+};
+
+////////////////
+END_NS_DGN
+
+#endif // INCLUDED_DGN_HTTPSVR_H
+
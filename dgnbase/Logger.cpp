@@ -21,6 +21,10 @@
 #include <string.h>
 #include <stdarg.h>
 #include <stdlib.h> // abort()
+#include <math.h> // isfinite()
+
+#include <vector>
+#include <algorithm>
 
 #ifdef _WIN32
 #include <windows.h>
@@ -29,30 +33,888 @@
 #define open _open
 #define lseek _lseek
 #define close _close
+#define read _read
 #define write _write
 #define unlink _unlink
+#define dup2 _dup2
 #define snprintf _snprintf
 #else
 #include <unistd.h>
 #include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/mman.h>
 #include <fcntl.h>
 #include <syslog.h>
+#include <limits.h>
+#include <errno.h>
+#include <time.h>
+#endif
+
+#ifdef DGN_WITH_ZLIB
+#include <zlib.h>
+#endif
+
+#ifndef IOV_MAX
+#define IOV_MAX	1024
+#endif
+
+#ifdef _WIN32
+struct iovec
+{
+	void * iov_base;
+	size_t iov_len;
+};
+// msvc volatile access has acquire / release semantics
+#define LOG_LOAD_ACQUIRE( p )	( *(p) )
+#define LOG_STORE_RELEASE( p, v )	( *(p) = (v) )
+#define LOG_ADD_FETCH( p, v )	InterlockedAdd64( (volatile LONG64 *)(p), (v) )
+#define LOG_OPEN_FLAG	( _O_CREAT | _O_APPEND | _O_WRONLY | _O_BINARY )
+#else
+#define LOG_LOAD_ACQUIRE( p )	__atomic_load_n( (p), __ATOMIC_ACQUIRE )
+#define LOG_STORE_RELEASE( p, v )	__atomic_store_n( (p), (v), __ATOMIC_RELEASE )
+#define LOG_ADD_FETCH( p, v )	__atomic_add_fetch( (p), (v), __ATOMIC_RELAXED )
+#define LOG_OPEN_FLAG	( O_CREAT | O_APPEND | O_WRONLY )
 #endif
 
+#define LOG_TIME_NEVER	0x7fffffffffffffffLL
+#define LOG_SIZE_UNLIMITED	0x7fffffffffffffffLL
+
+#define DGN_LOG_MIN_RING	( 64 * 1024 )
+#define DGN_LOG_TLS_NUM	8 // async loggers one thread can use, more go sync
+#define DGN_LOG_SCRATCH_SIZE	( 256 * 1024 ) // writer text of deferred records per writev
+#define DGN_LOG_BIN_FLUSH	( 256 * 1024 )
+
 BEGIN_NS_DGN
 ////////////////
 
+////////////////
+////	async ring
+
+enum {
+	LOG_REC_NORMAL = 0,
+	LOG_REC_PAD = 1, // skip to ring end
+	LOG_REC_DEFER = 2, // LogSite pointer and encoded arguments
+};
+
+// record in ring, text follow, whole record aligned to 16 so pad header always fit
+struct log_rec_t
+{
+	uint32_t m_len; // text length
+	uint16_t m_level;
+	uint16_t m_flag;
+	int64_t m_ts; // Time::Now()
+};
+
+#define LOG_REC_SIZE( len )	( ( (uint32_t)sizeof(log_rec_t) + (uint32_t)(len) + 15 ) & ~15u )
+
+// single producer ( owner thread ) single consumer ( writer thread )
+// hold by owner thread and logger, freed by the last release
+struct log_ring_t
+{
+	log_ring_t( uint32_t size ) : m_buf( new char[size] ), m_size( size ), m_head( 0 ), m_tail( 0 )
+		, m_pending( 0 ), m_end( 0 ), m_dropped( 0 ), m_refs( 2 ), m_exited( 0 ), m_orphan( 0 ), m_next( NULL ) {}
+	~log_ring_t() { delete[] m_buf, m_buf = NULL; }
+
+	char * m_buf;
+	uint32_t m_size; // power of 2
+	volatile uint32_t m_head; // write position, by owner
+	volatile uint32_t m_tail; // read position, by writer
+	uint32_t m_pending; // writer only, read but not written yet
+	uint32_t m_end; // writer only, head when current drain start
+	volatile int64_t m_dropped; // by owner
+	Atomic m_refs;
+	volatile int m_exited; // owner thread exited
+	volatile int m_orphan; // logger gone
+	log_ring_t * m_next;
+};
+
+// writer only, position of next record or m_end
+static uint32_t ring_skip_pad( log_ring_t * r, uint32_t pos )
+{
+	if( pos != r->m_end ) {
+		uint32_t off = pos & ( r->m_size - 1 );
+		if( ( (log_rec_t *)( r->m_buf + off ) )->m_flag == LOG_REC_PAD )
+			pos += r->m_size - off;
+	}
+	return pos;
+}
+
+static log_rec_t * ring_rec( log_ring_t * r )
+{
+	return (log_rec_t *)( r->m_buf + ( r->m_pending & ( r->m_size - 1 ) ) );
+}
+
+// min-heap of next record time of rings with records, for merge in drain()
+struct log_head_t
+{
+	int64_t m_ts;
+	log_ring_t * m_ring;
+};
+
+static bool log_head_later( const log_head_t & a, const log_head_t & b )
+{
+	return a.m_ts > b.m_ts;
+}
+
+struct log_merge_t
+{
+	std::vector< log_head_t > m_heap;
+};
+
+static void ring_release( log_ring_t * r )
+{
+	if( r->m_refs.Dec() == 0 )
+		delete r;
+	return;
+}
+
+// release rings at thread exit, writer remove them after drained
+struct log_tls_t
+{
+	log_tls_t() : m_num( 0 ) {}
+	~log_tls_t()
+	{
+		int i;
+		for( i = 0; i < m_num; ++i ) {
+			m_rings[i]->m_exited = 1;
+			ring_release( m_rings[i] );
+		}
+		m_num = 0;
+	}
+
+	int m_num;
+	uint32_t m_ids[DGN_LOG_TLS_NUM];
+	log_ring_t * m_rings[DGN_LOG_TLS_NUM];
+};
+
+static thread_local log_tls_t s_log_tls;
+static Atomic s_logger_id;
+
+// iov not changed, may write to next fd
+static void write_all( int fd, const struct iovec * iov, int num )
+{
+#ifdef _WIN32
+	int i;
+	for( i = 0; i < num; ++i )
+		write( fd, iov[i].iov_base, (unsigned int)iov[i].iov_len );
+#else
+	struct iovec left[IOV_MAX];
+	while( num > 0 ) {
+		ssize_t ret = writev( fd, iov, num );
+		if( ret < 0 ) {
+			if( errno == EINTR )
+				continue;
+			return;
+		}
+		// partial write, skip written part
+		while( num > 0 && (size_t)ret >= iov->iov_len ) {
+			ret -= iov->iov_len;
+			iov++, num--;
+		}
+		if( num > 0 ) {
+			if( iov != left )
+				memcpy( left, iov, num * sizeof(struct iovec) );
+			left[0].iov_base = (char *)left[0].iov_base + ret;
+			left[0].iov_len -= ret;
+			iov = left;
+		}
+	}
+#endif
+	return;
+}
+
+////////////////
+////	line prefix
+
+// "MMDD HH:MM:SS." of current second, localtime_r() once per second per thread
+struct log_time_cache_t
+{
+	int64_t m_sec;
+	char m_prefix[16];
+};
+
+static thread_local log_time_cache_t s_log_time = { -1, { 0 } };
+
+static int64_t log_now( int coarse )
+{
+#if defined( _WIN32 ) || ! defined( CLOCK_REALTIME_COARSE )
+	return Time::Now();
+#else
+	if( ! coarse )
+		return Time::Now();
+	// vdso read without syscall, resolution of kernel tick
+	struct timespec ts;
+	clock_gettime( CLOCK_REALTIME_COARSE, &ts );
+	return (int64_t)ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+#endif
+}
+
+// write val as width digits with leading zero
+static void put_digits( char * p, unsigned int val, int width )
+{
+	while( width-- > 0 ) {
+		p[width] = (char)( '0' + val % 10 );
+		val /= 10;
+	}
+	return;
+}
+
+// "MMDD HH:MM:SS.uuuuuu|file:line|LEVEL ", return length
+static const char * s_level_str[8] = { "0", "1", "DBG", "3", "INFO", "5", "ERR", "7" };
+
+static const char * log_basename( const char * file )
+{
+	const char * sf = file;
+	const char * p;
+	for( p = file; *p != '\0'; p++ ) {
+		if( *p == '/' || *p == '\\' )
+			sf = p + 1;
+	}
+	return sf;
+}
+
+// decimal of v, return length, buf at least 20 bytes
+static int put_uint64( char * buf, uint64_t v )
+{
+	char digits[20];
+	int n = 0;
+	do {
+		digits[n++] = (char)( '0' + v % 10 );
+		v /= 10;
+	} while( v > 0 );
+	int len = 0;
+	while( n > 0 )
+		buf[len++] = digits[--n];
+	return len;
+}
+
+static int format_prefix( char * buf, int64_t now, int level, const char * file, int line )
+{
+	int64_t sec = now / 1000000LL;
+	log_time_cache_t & tc = s_log_time;
+	if( sec != tc.m_sec ) {
+		Time tm;
+		tm.FromTUS( sec * 1000000LL );
+		char * p = tc.m_prefix;
+		put_digits( p, tm.m_month, 2 ), put_digits( p + 2, tm.m_day, 2 );
+		p[4] = ' ';
+		put_digits( p + 5, tm.m_hour, 2 ), p[7] = ':';
+		put_digits( p + 8, tm.m_minute, 2 ), p[10] = ':';
+		put_digits( p + 11, tm.m_sec, 2 ), p[13] = '.';
+		tc.m_sec = sec;
+	}
+	memcpy( buf, tc.m_prefix, 14 );
+	put_digits( buf + 14, (unsigned int)( now % 1000000LL ), 6 );
+	int len = 20;
+	buf[len++] = '|';
+
+	const char * sf = log_basename( file );
+	int n = (int)strlen( sf );
+	if( n > 256 )
+		n = 256;
+	memcpy( buf + len, sf, n );
+	len += n;
+	buf[len++] = ':';
+	len += put_uint64( buf + len, line < 0 ? 0 : (uint64_t)line );
+	buf[len++] = '|';
+
+	n = (int)strlen( s_level_str[level] );
+	memcpy( buf + len, s_level_str[level], n );
+	len += n;
+	buf[len++] = ' ';
+	buf[len] = '\0';
+	return len;
+}
+
+// json string content of s, stop before exceed cap, *used set to bytes of s consumed
+static int json_escape( char * buf, int cap, const char * s, int len, int * used )
+{
+	static const char s_hex[] = "0123456789abcdef";
+	int n = 0;
+	int i;
+	for( i = 0; i < len; ++i ) {
+		unsigned char c = (unsigned char)s[i];
+		if( c >= 0x20 && c != '"' && c != '\\' ) {
+			if( n + 1 > cap )
+				break;
+			buf[n++] = (char)c;
+			continue;
+		}
+		if( n + 6 > cap )
+			break;
+		buf[n++] = '\\';
+		switch( c ) {
+		case '"' : buf[n++] = '"'; break;
+		case '\\' : buf[n++] = '\\'; break;
+		case '\n' : buf[n++] = 'n'; break;
+		case '\r' : buf[n++] = 'r'; break;
+		case '\t' : buf[n++] = 't'; break;
+		default :
+			buf[n++] = 'u', buf[n++] = '0', buf[n++] = '0';
+			buf[n++] = s_hex[c >> 4], buf[n++] = s_hex[c & 0xf];
+			break;
+		}
+	}
+	*used = i;
+	return n;
+}
+
+static int put_str( char * buf, const char * s )
+{
+	int n = (int)strlen( s );
+	memcpy( buf, s, n );
+	return n;
+}
+
+// {"ts":..,"level":..,"file":..,"line":..,"msg":"<msg>" without closing '}', line end of msg stripped
+static int format_json( char * buf, int cap, int64_t now, int level, const char * file, int line, const char * msg, int msg_len )
+{
+	int used;
+	int len = put_str( buf, "{\"ts\":" );
+	len += put_uint64( buf + len, now < 0 ? 0 : (uint64_t)now );
+	len += put_str( buf + len, ",\"level\":\"" );
+	len += put_str( buf + len, s_level_str[level] );
+	len += put_str( buf + len, "\",\"file\":\"" );
+	const char * sf = log_basename( file );
+	int n = (int)strlen( sf );
+	len += json_escape( buf + len, 256, sf, n, &used );
+	len += put_str( buf + len, "\",\"line\":" );
+	len += put_uint64( buf + len, line < 0 ? 0 : (uint64_t)line );
+	len += put_str( buf + len, ",\"msg\":\"" );
+	while( msg_len > 0 && ( msg[msg_len - 1] == '\n' || msg[msg_len - 1] == '\r' ) )
+		msg_len--;
+	len += json_escape( buf + len, cap - len - 1, msg, msg_len, &used );
+	buf[len++] = '"';
+	return len;
+}
+
+// close json object and end line, need 4 bytes
+static int json_close( char * buf, int len )
+{
+	buf[len++] = '}';
+	len += put_str( buf + len, DGN_LOG_LINE_END );
+	buf[len] = '\0';
+	return len;
+}
+
+////////////////
+////	deferred records
+
+static Mutex s_site_lock;
+static std::vector< LogSite * > s_sites; // index by id - 1
+
+static int register_site( LogSite * site )
+{
+	MutexGuard guard( &s_site_lock );
+	if( site->m_id == 0 ) {
+		s_sites.push_back( site );
+		site->m_id = (int)s_sites.size();
+	}
+	return site->m_id;
+}
+
+void LogArgs::Put( const char * v )
+{
+	if( v == NULL )
+		v = "(null)";
+	int n = (int)strlen( v );
+	if( m_len + 3 > m_cap )
+		return;
+	if( n > m_cap - m_len - 3 )
+		n = m_cap - m_len - 3; // truncate
+	if( n > 0xffff )
+		n = 0xffff;
+	uint16_t n16 = (uint16_t)n;
+	m_buf[m_len] = DGN_LOG_ARG_STR;
+	memcpy( m_buf + m_len + 1, &n16, 2 );
+	memcpy( m_buf + m_len + 3, v, n );
+	m_len += 3 + n;
+	return;
+}
+
+struct log_arg_t
+{
+	int m_type;
+	int64_t m_int;
+	double m_dbl;
+	const char * m_str;
+	int m_str_len;
+};
+
+// return 0 if ok, < 0 if no more argument
+static int read_arg( const char ** pp, const char * end, log_arg_t * a )
+{
+	const char * p = *pp;
+	if( p >= end )
+		return -1;
+	a->m_type = (unsigned char)*p++;
+	int32_t i32;
+	uint16_t n16;
+	switch( a->m_type ) {
+	case DGN_LOG_ARG_I32 :
+		if( end - p < 4 )
+			return -1;
+		memcpy( &i32, p, 4 ), p += 4;
+		a->m_int = i32;
+		break;
+	case DGN_LOG_ARG_I64 :
+	case DGN_LOG_ARG_PTR :
+		if( end - p < 8 )
+			return -1;
+		memcpy( &a->m_int, p, 8 ), p += 8;
+		break;
+	case DGN_LOG_ARG_F64 :
+		if( end - p < 8 )
+			return -1;
+		memcpy( &a->m_dbl, p, 8 ), p += 8;
+		break;
+	case DGN_LOG_ARG_STR :
+		if( end - p < 2 )
+			return -1;
+		memcpy( &n16, p, 2 ), p += 2;
+		if( end - p < n16 )
+			return -1;
+		a->m_str = p;
+		a->m_str_len = n16;
+		p += n16;
+		break;
+	default :
+		return -1;
+	}
+	*pp = p;
+	return 0;
+}
+
+int Logger::FormatArgs( char * buf, int cap, const char * fmt, const char * args, int args_len )
+{
+	const char * ap = args;
+	const char * aend = args + args_len;
+	int len = 0;
+	const char * p = fmt;
+	while( *p != '\0' && len < cap - 1 ) {
+		if( *p != '%' ) {
+			buf[len++] = *p++;
+			continue;
+		}
+		if( p[1] == '%' ) {
+			buf[len++] = '%';
+			p += 2;
+			continue;
+		}
+
+		// %[flags][width][.precision][length]conv, '*' take int argument
+		char spec[64];
+		int n = 0;
+		log_arg_t a;
+		spec[n++] = *p++;
+		while( *p != '\0' && strchr( "-+ #0'", *p ) != NULL && n < 8 )
+			spec[n++] = *p++;
+		int part;
+		for( part = 0; part < 2; ++part ) {
+			if( part == 1 ) {
+				if( *p != '.' )
+					break;
+				spec[n++] = *p++;
+			}
+			if( *p == '*' ) {
+				p++;
+				int w = read_arg( &ap, aend, &a ) == 0 ? (int)a.m_int : 0;
+				n += snprintf( spec + n, 16, "%d", w );
+			}
+			else {
+				while( *p >= '0' && *p <= '9' && n < 40 )
+					spec[n++] = *p++;
+			}
+		}
+		while( *p != '\0' && strchr( "hlLqjzt", *p ) != NULL )
+			p++;
+		char conv = *p;
+		if( conv == '\0' )
+			break;
+		p++;
+
+		int room = cap - len;
+		int ret = -1;
+		if( conv == 'n' )
+			continue;
+		if( read_arg( &ap, aend, &a ) == 0 ) {
+			if( strchr( "diouxXc", conv ) != NULL && a.m_type != DGN_LOG_ARG_STR ) {
+				int64_t v = a.m_type == DGN_LOG_ARG_F64 ? (int64_t)a.m_dbl : a.m_int;
+				if( a.m_type == DGN_LOG_ARG_I32 || conv == 'c' ) {
+					spec[n++] = conv, spec[n] = '\0';
+					ret = snprintf( buf + len, room, spec, (int)v );
+				}
+				else {
+					spec[n++] = 'l', spec[n++] = 'l', spec[n++] = conv, spec[n] = '\0';
+					ret = snprintf( buf + len, room, spec, (long long)v );
+				}
+			}
+			else if( strchr( "eEfFgGaA", conv ) != NULL && a.m_type != DGN_LOG_ARG_STR ) {
+				double v = a.m_type == DGN_LOG_ARG_F64 ? a.m_dbl : (double)a.m_int;
+				spec[n++] = conv, spec[n] = '\0';
+				ret = snprintf( buf + len, room, spec, v );
+			}
+			else if( conv == 's' && a.m_type == DGN_LOG_ARG_STR ) {
+				// not '\0' ended, limit by precision, length from file may be corrupted
+				char str[DGN_LOG_ARGS_MAX];
+				int slen = a.m_str_len < (int)sizeof(str) - 1 ? a.m_str_len : (int)sizeof(str) - 1;
+				memcpy( str, a.m_str, slen );
+				str[slen] = '\0';
+				spec[n++] = 's', spec[n] = '\0';
+				ret = snprintf( buf + len, room, spec, str );
+			}
+			else if( conv == 'p' && a.m_type == DGN_LOG_ARG_PTR ) {
+				spec[n++] = 'p', spec[n] = '\0';
+				ret = snprintf( buf + len, room, spec, (void *)(uintptr_t)a.m_int );
+			}
+		}
+		if( ret < 0 )
+			ret = snprintf( buf + len, room, "<?>" );
+		len += ret < room ? ret : room - 1;
+	}
+	buf[len] = '\0';
+	return len;
+}
+
+////////////////
+////	rolled file compression
+
+struct log_gz_job_t
+{
+	int m_fd; // read from start, file may be renamed
+	int m_idx; // now name.N, <= 0 if rolled out
+};
+
+// jobs and cond use Logger::m_lock
+struct log_gz_t
+{
+	ThreadObjTP< Logger > m_thread;
+	CondVal m_cond;
+	std::vector< log_gz_job_t > m_jobs; // first one in progress
+
+	void push( int fd )
+	{
+		log_gz_job_t job = { fd, 1 };
+		m_jobs.push_back( job );
+		m_cond.Signal();
+		return;
+	}
+
+	// after rotation
+	void shift( int max_roll )
+	{
+		size_t i;
+		for( i = 0; i < m_jobs.size(); ++i ) {
+			if( m_jobs[i].m_idx > 0 && ++m_jobs[i].m_idx >= max_roll )
+				m_jobs[i].m_idx = 0;
+		}
+		return;
+	}
+};
+
+// gzip fd from start into path, return < 0 if failed
+static int gz_file( int fd, const char * path )
+{
+#ifdef DGN_WITH_ZLIB
+	gzFile gz = gzopen( path, "wb6" );
+	if( gz == NULL )
+		return -1;
+	char buf[65536];
+	int ret = 0;
+	while( 1 ) {
+		int n = (int)read( fd, buf, sizeof(buf) );
+		if( n <= 0 ) {
+			ret = n < 0 ? -1 : 0;
+			break;
+		}
+		if( gzwrite( gz, buf, n ) != n ) {
+			ret = -1;
+			break;
+		}
+	}
+	if( gzclose( gz ) != Z_OK )
+		ret = -1;
+	return ret;
+#else
+	return -1;
+#endif
+}
+
+////////////////
+////	mmap ring file
+
+struct log_mmap_t
+{
+	int m_fd;
+	char * m_base;
+	size_t m_map_size;
+	LogMmapHeader * m_hdr;
+	char * m_data;
+	uint32_t m_size;
+};
+
+// lock-free, concurrent writers reserve by add on head
+static void mmap_write( log_mmap_t * mm, const char * buf, int len )
+{
+#ifndef _WIN32
+	if( (uint32_t)len > mm->m_size ) {
+		buf += len - mm->m_size;
+		len = (int)mm->m_size;
+	}
+	uint64_t pos = __atomic_fetch_add( &mm->m_hdr->m_head, (uint64_t)len, __ATOMIC_RELAXED );
+	uint32_t off = (uint32_t)( pos % mm->m_size );
+	uint32_t n = mm->m_size - off;
+	if( n > (uint32_t)len )
+		n = (uint32_t)len;
+	memcpy( mm->m_data + off, buf, n );
+	if( n < (uint32_t)len )
+		memcpy( mm->m_data, buf + n, len - n );
+#endif
+	return;
+}
+
+static void mmap_close( log_mmap_t * mm )
+{
+#ifndef _WIN32
+	munmap( mm->m_base, mm->m_map_size );
+	close( mm->m_fd );
+#endif
+	delete mm;
+	return;
+}
+
+////////////////
+////	LogFields
+
+void LogFields::Key( const char * key )
+{
+	m_mark = m_len;
+	int n = (int)strlen( key );
+	if( m_json ) {
+		int used;
+		if( m_len + 2 > m_cap )
+			return drop();
+		m_buf[m_len++] = ',', m_buf[m_len++] = '"';
+		m_len += json_escape( m_buf + m_len, m_cap - m_len - 2, key, n, &used );
+		if( used < n )
+			return drop();
+		m_buf[m_len++] = '"', m_buf[m_len++] = ':';
+	}
+	else {
+		if( m_len + n + 2 > m_cap )
+			return drop();
+		m_buf[m_len++] = ' ';
+		memcpy( m_buf + m_len, key, n );
+		m_len += n;
+		m_buf[m_len++] = '=';
+	}
+	return;
+}
+
+void LogFields::Put( double v )
+{
+	if( m_json && ! isfinite( v ) )
+		return put_raw( "null", 4 );
+	char tmp[32];
+	int n = snprintf( tmp, sizeof(tmp), "%.15g", v );
+	put_raw( tmp, n );
+	return;
+}
+
+void LogFields::Put( const char * v )
+{
+	if( v == NULL )
+		return m_json ? put_raw( "null", 4 ) : put_raw( "(null)", 6 );
+	int n = (int)strlen( v );
+	if( ! m_json ) {
+		// quote only if needed
+		int i;
+		for( i = 0; i < n; ++i ) {
+			unsigned char c = (unsigned char)v[i];
+			if( c <= ' ' || c == '"' || c == '=' )
+				break;
+		}
+		if( i == n && n > 0 )
+			return put_raw( v, n );
+	}
+	int used;
+	if( m_len + 2 > m_cap )
+		return drop();
+	m_buf[m_len++] = '"';
+	m_len += json_escape( m_buf + m_len, m_cap - m_len - 1, v, n, &used );
+	if( used < n )
+		return drop();
+	m_buf[m_len++] = '"';
+	return;
+}
+
+void LogFields::put_int( int64_t v )
+{
+	char tmp[24];
+	if( v >= 0 )
+		return put_raw( tmp, put_uint64( tmp, (uint64_t)v ) );
+	tmp[0] = '-';
+	put_raw( tmp, 1 + put_uint64( tmp + 1, 0 - (uint64_t)v ) );
+	return;
+}
+
+void LogFields::put_uint( uint64_t v )
+{
+	char tmp[24];
+	put_raw( tmp, put_uint64( tmp, v ) );
+	return;
+}
+
+void LogFields::put_ptr( const void * v )
+{
+	static const char s_hex[] = "0123456789abcdef";
+	char tmp[24];
+	int n = 0;
+	uintptr_t p = (uintptr_t)v;
+	int shift = (int)sizeof(p) * 8 - 4;
+	while( shift > 0 && ( ( p >> shift ) & 0xf ) == 0 )
+		shift -= 4;
+	if( m_json )
+		tmp[n++] = '"';
+	tmp[n++] = '0', tmp[n++] = 'x';
+	for( ; shift >= 0; shift -= 4 )
+		tmp[n++] = s_hex[( p >> shift ) & 0xf];
+	if( m_json )
+		tmp[n++] = '"';
+	put_raw( tmp, n );
+	return;
+}
+
+void LogFields::put_raw( const char * v, int n )
+{
+	if( m_len + n > m_cap )
+		return drop();
+	memcpy( m_buf + m_len, v, n );
+	m_len += n;
+	return;
+}
+
+void LogFields::drop()
+{
+	// keep fields in order, later ones dropped too
+	m_len = m_mark;
+	m_cap = m_mark;
+	return;
+}
+
+////////////////
+////	Logger
+
+int Logger::FormatPrefix( char * buf, int64_t time_us, int level, const char * file, int line )
+{
+	return format_prefix( buf, time_us, level < 0 ? 0 : ( level > 7 ? 7 : level ), file, line );
+}
+
+// grow *buf to append
+static void bin_append( char ** buf, int * len, int * cap, const char * p, int n )
+{
+	if( *len + n > *cap ) {
+		int newcap = *cap > 0 ? *cap * 2 : 65536;
+		while( newcap < *len + n )
+			newcap *= 2;
+		char * nbuf = new char[newcap];
+		if( *len > 0 )
+			memcpy( nbuf, *buf, *len );
+		delete[] *buf;
+		*buf = nbuf, *cap = newcap;
+	}
+	memcpy( *buf + *len, p, n );
+	*len += n;
+	return;
+}
+
+static void bin_entry( char ** buf, int * len, int * cap, int type, const char * p1, int len1,
+		const char * p2, int len2, const char * p3, int len3 )
+{
+	char hdr[5];
+	hdr[0] = (char)type;
+	uint32_t plen = (uint32_t)( len1 + len2 + len3 );
+	memcpy( hdr + 1, &plen, 4 );
+	bin_append( buf, len, cap, hdr, 5 );
+	bin_append( buf, len, cap, p1, len1 );
+	bin_append( buf, len, cap, p2, len2 );
+	bin_append( buf, len, cap, p3, len3 );
+	return;
+}
+
+// definitions of site id in [from, to]
+static void bin_sites( char ** buf, int * len, int * cap, int from, int to )
+{
+	MutexGuard guard( &s_site_lock );
+	int id;
+	for( id = from; id <= to && id <= (int)s_sites.size(); ++id ) {
+		const LogSite * site = s_sites[id - 1];
+		char head[11];
+		uint32_t v = (uint32_t)id;
+		memcpy( head, &v, 4 );
+		head[4] = (char)site->m_level;
+		v = (uint32_t)site->m_line;
+		memcpy( head + 5, &v, 4 );
+		uint16_t flen = (uint16_t)strlen( site->m_file );
+		memcpy( head + 9, &flen, 2 );
+		char mid[2];
+		uint16_t mlen = (uint16_t)strlen( site->m_fmt );
+		memcpy( mid, &mlen, 2 );
+		// fmt after file, two pieces joined by bin_entry
+		char * tmp = new char[flen + 2 + mlen];
+		memcpy( tmp, site->m_file, flen );
+		memcpy( tmp + flen, mid, 2 );
+		memcpy( tmp + flen + 2, site->m_fmt, mlen );
+		bin_entry( buf, len, cap, DGN_LOG_BIN_SITE, head, 11, tmp, flen + 2 + mlen, NULL, 0 );
+		delete[] tmp;
+	}
+	return;
+}
+
+////////////////
+////	Logger
+
+static Atomic s_level_gen;
+
+// 24 bits, never 0 as site cache not resolved
+static uint32_t next_level_gen()
+{
+	uint32_t gen;
+	do {
+		gen = (uint32_t)s_level_gen.Inc() & 0xffffff;
+	} while( gen == 0 );
+	return gen;
+}
+
 Logger::Logger() 
-	: m_level( DGN_LOG_LEVEL_INFO ), m_syslog_enable(0), m_stderr_enable(0)
-	, m_fname_len(0), m_max_size_mb(200), m_max_roll(10), m_fd( -1 ), m_file_size(0)
+	: m_level( DGN_LOG_LEVEL_INFO ), m_level_gen( next_level_gen() ), m_syslog_enable(0), m_stderr_enable(0)
+	, m_fname_len(0), m_max_size( 200 * 1024 * 1024 ), m_max_roll(10), m_fd( -1 ), m_file_size(0)
+	, m_rotate_sec( 0 ), m_rotate_at( LOG_TIME_NEVER ), m_compress( 0 ), m_gz( NULL ), m_mmap( NULL ), m_merge( NULL )
+	, m_id( (uint32_t)s_logger_id.Inc() ), m_async( 0 ), m_ring_size( DGN_LOG_RING_SIZE ), m_flush_ms( 10 )
+	, m_rings( NULL ), m_dropped_exited( 0 ), m_flush_done( 0 ), m_coarse_time( 0 ), m_json( 0 )
+	, m_deferred( 0 ), m_binary( 0 ), m_scratch( NULL ), m_scratch_len( 0 ), m_bin( NULL ), m_bin_len( 0 ), m_bin_cap( 0 )
+	, m_sites_emitted( 0 ), m_file_gen( 0 ), m_bin_gen( 0 )
 {
 	m_fname[0] = '\0';
+	m_writer.SetFunc( &Logger::write_loop, this );
 }
 
 Logger::~Logger()
 {
+	InitAsync( 0 );
+	while( m_rings != NULL ) {
+		log_ring_t * r = m_rings;
+		m_rings = r->m_next;
+		r->m_orphan = 1;
+		ring_release( r );
+	}
+	delete[] m_scratch, m_scratch = NULL;
+	delete[] m_bin, m_bin = NULL;
+	delete m_merge, m_merge = NULL;
 	m_syslog_enable = 0;
 	m_stderr_enable = 0;
+	stop_gz();
+	InitMmapRing( NULL );
 	m_fname[0] = '\0';
 	if( m_fd >= 0 ) {
 		close( m_fd ), m_fd = -1;
@@ -64,11 +926,56 @@ int Logger::InitLevel( int level )
 	if( level < DGN_LOG_LEVEL_DEBUG || level > DGN_LOG_LEVEL_ERR )
 		return -1;
 	m_level = level;
+	m_level_gen = next_level_gen();
 	return 0;
 }
 
+int Logger::SetModuleLevel( const char * module, int level )
+{
+	if( module == NULL || module[0] == '\0' || level > 0xff )
+		return -1;
+	MutexGuard guard( &m_module_lock );
+	if( level < 0 )
+		m_modules.erase( module );
+	else
+		m_modules[module] = level;
+	m_level_gen = next_level_gen();
+	return 0;
+}
+
+int Logger::GetLevel( const LogSite * site )
+{
+	MutexGuard guard( &m_module_lock );
+	if( m_modules.empty() )
+		return m_level;
+	std::map< CStr, int >::iterator it;
+	if( site->m_module != NULL && ( it = m_modules.find( site->m_module ) ) != m_modules.end() )
+		return it->second;
+	const char * sf = log_basename( site->m_file );
+	if( ( it = m_modules.find( sf ) ) != m_modules.end() )
+		return it->second;
+	const char * dot = strrchr( sf, '.' );
+	if( dot != NULL ) {
+		CStr name;
+		name.Assign( sf, (int)( dot - sf ) );
+		if( ( it = m_modules.find( name ) ) != m_modules.end() )
+			return it->second;
+	}
+	return m_level;
+}
+
+int Logger::resolve_level( LogSite * site )
+{
+	// gen read first, changed meanwhile resolve again next time
+	uint32_t gen = m_level_gen;
+	int min = GetLevel( site );
+	site->m_cache = ( gen << 8 ) | (uint32_t)min;
+	return min;
+}
+
 int Logger::InitLogFile( const char * logfile, int max_size_mb, int max_roll )
 {
+	stop_gz();
 	if( m_fd >= 0 ) {
 		close( m_fd ), m_fd = -1;
 	}
@@ -82,8 +989,27 @@ int Logger::InitLogFile( const char * logfile, int max_size_mb, int max_roll )
 		m_fname_len = MAX_LOG_FILENAME_LEN;
 	memcpy( m_fname, logfile, m_fname_len );
 	m_fname[m_fname_len] = '\0';
-	m_max_size_mb = max_size_mb <= 1 ? 2 : max_size_mb;
+	m_max_size = (int64_t)( max_size_mb <= 1 ? 2 : max_size_mb ) * 1024 * 1024;
 	m_max_roll = max_roll <= 1 ? 2 : max_roll;
+	if( m_compress )
+		start_gz();
+	return 0;
+}
+
+int Logger::InitRotate( int64_t max_size, int interval_sec, int compress )
+{
+#ifndef DGN_WITH_ZLIB
+	if( compress )
+		return -1;
+#endif
+	m_max_size = max_size > 0 ? max_size : LOG_SIZE_UNLIMITED;
+	m_rotate_sec = interval_sec > 0 ? interval_sec : 0;
+	m_rotate_at = m_fd >= 0 ? next_rotate( log_now( 1 ) ) : LOG_TIME_NEVER;
+	m_compress = compress ? 1 : 0;
+	if( ! m_compress )
+		stop_gz();
+	else if( m_fname[0] != '\0' && start_gz() < 0 )
+		return -1;
 	return 0;
 }
 
@@ -99,62 +1025,589 @@ int Logger::InitStderr( int enable )
 	return 0;
 }
 
+int Logger::InitCoarseTime( int enable )
+{
+	m_coarse_time = enable;
+	return 0;
+}
+
+int Logger::InitAsync( int enable, int ring_size, int flush_ms )
+{
+	if( ! enable ) {
+		if( m_async ) {
+			m_async = 0;
+			// writer drain once more after stop flag
+			m_writer.SignalStop();
+			{
+				MutexGuard guard( &m_wake_lock );
+				m_wake.Signal();
+			}
+			m_writer.WaitStop();
+		}
+		return 0;
+	}
+	if( m_async )
+		return 0;
+
+	uint32_t size = DGN_LOG_MIN_RING;
+	while( (int)size < ring_size && size < 0x40000000 )
+		size <<= 1;
+	m_ring_size = (int)size;
+	m_flush_ms = flush_ms <= 0 ? 10 : flush_ms;
+	if( m_scratch == NULL )
+		m_scratch = new char[DGN_LOG_SCRATCH_SIZE];
+	if( m_writer.Start() < 0 )
+		return -1;
+	m_async = 1;
+	return 0;
+}
+
+int Logger::InitDeferred( int enable, int binary_file )
+{
+	m_binary = enable && binary_file ? 1 : 0;
+	m_deferred = enable ? 1 : 0;
+	return 0;
+}
+
+#ifdef _WIN32
+
+int Logger::InitMmapRing( const char * path, int size )
+{
+	return path == NULL ? 0 : -1;
+}
+
+int Logger::ReadMmapRing( const char * path, CStr * text )
+{
+	return -1;
+}
+
+#else // _WIN32
+
+int Logger::InitMmapRing( const char * path, int size )
+{
+	if( m_mmap != NULL )
+		mmap_close( m_mmap ), m_mmap = NULL;
+	if( path == NULL || path[0] == '\0' )
+		return 0;
+	if( size < 4096 )
+		return -1;
+
+	log_mmap_t * mm = new log_mmap_t;
+	mm->m_map_size = DGN_LOG_MMAP_HDR_SIZE + (size_t)size;
+	mm->m_fd = open( path, O_RDWR | O_CREAT, 0660 );
+	if( mm->m_fd < 0 ) {
+		delete mm;
+		return -1;
+	}
+	struct stat st;
+	if( fstat( mm->m_fd, &st ) < 0 || ( (size_t)st.st_size != mm->m_map_size && ftruncate( mm->m_fd, mm->m_map_size ) < 0 ) ) {
+		close( mm->m_fd );
+		delete mm;
+		return -1;
+	}
+	void * p = mmap( NULL, mm->m_map_size, PROT_READ | PROT_WRITE, MAP_SHARED, mm->m_fd, 0 );
+	if( p == MAP_FAILED ) {
+		close( mm->m_fd );
+		delete mm;
+		return -1;
+	}
+	mm->m_base = (char *)p;
+	mm->m_hdr = (LogMmapHeader *)p;
+	mm->m_data = mm->m_base + DGN_LOG_MMAP_HDR_SIZE;
+	mm->m_size = (uint32_t)size;
+	if( memcmp( mm->m_hdr->m_magic, DGN_LOG_MMAP_MAGIC, 8 ) != 0 || mm->m_hdr->m_hdr_size != DGN_LOG_MMAP_HDR_SIZE
+			|| mm->m_hdr->m_data_size != (uint32_t)size ) {
+		memset( mm->m_base, 0, DGN_LOG_MMAP_HDR_SIZE );
+		memcpy( mm->m_hdr->m_magic, DGN_LOG_MMAP_MAGIC, 8 );
+		mm->m_hdr->m_hdr_size = DGN_LOG_MMAP_HDR_SIZE;
+		mm->m_hdr->m_data_size = (uint32_t)size;
+	}
+	m_mmap = mm;
+	return 0;
+}
+
+int Logger::ReadMmapRing( const char * path, CStr * text )
+{
+	int fd = open( path, O_RDONLY, 0 );
+	if( fd < 0 )
+		return -1;
+	struct stat st;
+	void * p = MAP_FAILED;
+	if( fstat( fd, &st ) == 0 && st.st_size >= DGN_LOG_MMAP_HDR_SIZE )
+		p = mmap( NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0 );
+	close( fd );
+	if( p == MAP_FAILED )
+		return -1;
+
+	const LogMmapHeader * hdr = (const LogMmapHeader *)p;
+	if( memcmp( hdr->m_magic, DGN_LOG_MMAP_MAGIC, 8 ) != 0 || hdr->m_hdr_size != DGN_LOG_MMAP_HDR_SIZE
+			|| hdr->m_data_size == 0 || (uint64_t)st.st_size < DGN_LOG_MMAP_HDR_SIZE + (uint64_t)hdr->m_data_size ) {
+		munmap( p, st.st_size );
+		return -1;
+	}
+	const char * data = (const char *)p + DGN_LOG_MMAP_HDR_SIZE;
+	uint32_t size = hdr->m_data_size;
+	uint64_t head = hdr->m_head;
+	uint32_t len = head < size ? (uint32_t)head : size;
+	uint32_t start = head < size ? 0 : (uint32_t)( head % size );
+
+	// text is not binary safe, copy raw
+	text->Reserve( len + 1 );
+	char * out = text->GetRaw();
+	memcpy( out, data + start, size - start < len ? size - start : len );
+	if( size - start < len )
+		memcpy( out + ( size - start ), data, len - ( size - start ) );
+	uint32_t skip = 0;
+	if( head > size ) {
+		while( skip < len && out[skip] != '\n' )
+			skip++;
+		if( skip < len )
+			skip++;
+		memmove( out, out + skip, len - skip );
+	}
+	text->ReleaseRaw( len - skip );
+	munmap( p, st.st_size );
+	return 0;
+}
+
+#endif // _WIN32
+
+int Logger::InitJson( int enable )
+{
+	m_json = enable;
+	return 0;
+}
+
+int Logger::Flush( int timeout_ms )
+{
+	if( ! m_async )
+		return 0;
+	int req = m_flush_req.Inc();
+	{
+		MutexGuard guard( &m_wake_lock );
+		m_wake.Signal();
+	}
+	uint32_t start = Time::Tick();
+	while( m_flush_done - req < 0 ) {
+		if( (int)( Time::Tick() - start ) >= timeout_ms )
+			return -1;
+		Time::SleepMs( 1 );
+	}
+	return 0;
+}
+
+int64_t Logger::GetDropped()
+{
+	MutexGuard guard( &m_ring_lock );
+	int64_t num = m_dropped_exited;
+	log_ring_t * r;
+	for( r = m_rings; r != NULL; r = r->m_next )
+		num += r->m_dropped;
+	return num;
+}
+
 void Logger::Log( int level, const char * file, int line, const char * fmt, ... )
 {
 	if( level < m_level )
 		return;
+	va_list ap;
+	va_start( ap, fmt );
+	log_v( level, file, line, fmt, ap );
+	va_end( ap );
+	return;
+}
+
+void Logger::LogSuppressed( LogSite * site, int num )
+{
+	log_format( site->m_level, site->m_file, site->m_line, "%d records suppressed by rate limit" DGN_LOG_LINE_END, num );
+	return;
+}
+
+void Logger::log_format( int level, const char * file, int line, const char * fmt, ... )
+{
+	va_list ap;
+	va_start( ap, fmt );
+	log_v( level, file, line, fmt, ap );
+	va_end( ap );
+	return;
+}
+
+void Logger::log_v( int level, const char * file, int line, const char * fmt, va_list ap )
+{
 	if( level > 7 )
 		level = 7;
-	if( m_fname[0] == '\0' && m_syslog_enable == 0 && m_stderr_enable == 0 )
+	if( m_fname[0] == '\0' && m_syslog_enable == 0 && m_stderr_enable == 0 && m_mmap == NULL )
 		return;
 
-	// TODO : get time improve
-	Time tm;
-	tm.SetNow();
-
-	const char * sf = file;
-	const char * p;
-	for( p = file; *p != '\0'; p++ ) {
-		if( *p == '/' || *p == '\\' )
-			sf = p + 1;
-	}
-
-	static const char * s_level_str[8] = { "0", "1", "DBG", "3", "INFO", "5", "ERR", "7" };
-	va_list ap;
+	int64_t now = log_now( m_coarse_time );
 	int len;
 	int ret;
-	char buf[2048];
-	len = snprintf( buf, sizeof(buf) - 1, "%02d%02d %02d:%02d:%02d.%06d|%s:%d|%s ",
-			tm.m_month, tm.m_day, tm.m_hour, tm.m_minute, tm.m_sec, tm.m_usec, sf, line, s_level_str[level] );
-	va_start( ap, fmt );
-	ret = vsnprintf( buf + len, sizeof(buf) - len - 1, fmt, ap );
-	va_end( ap );
-	buf[sizeof(buf) - 1] = '\0';
-	if( ret >= 0 && ret <= (int)sizeof(buf) - len - 1 )
-		len += ret;
-	else
-		len = (int)strlen( buf );
+	char buf[DGN_LOG_LINE_MAX];
+	if( m_json ) {
+		char msg[DGN_LOG_LINE_MAX];
+		ret = vsnprintf( msg, sizeof(msg), fmt, ap );
+		len = format_json( buf, sizeof(buf) - 8, now, level, file, line, msg, ret < 0 ? 0 : ( ret < (int)sizeof(msg) ? ret : (int)sizeof(msg) - 1 ) );
+		len = json_close( buf, len );
+	}
+	else {
+		len = format_prefix( buf, now, level, file, line );
+		ret = vsnprintf( buf + len, sizeof(buf) - len - 1, fmt, ap );
+		buf[sizeof(buf) - 1] = '\0';
+		if( ret >= 0 && ret <= (int)sizeof(buf) - len - 1 )
+			len += ret;
+		else
+			len = (int)strlen( buf );
+	}
+
+	if( m_mmap != NULL )
+		mmap_write( m_mmap, buf, len );
+	if( m_async && push_async( level, now, LOG_REC_NORMAL, NULL, 0, buf, len ) == 0 )
+		return;
+	output( level, now, buf, len );
+	return;
+}
+
+// buf end with '\0'
+// text line skip time, syslog has its own
+static void output_syslog( int level, const char * buf, int json )
+{
+#ifdef _WIN32
+	OutputDebugStringA( buf );
+#else
+	static const int s_syslog_level[8] = { LOG_DEBUG, LOG_DEBUG, LOG_DEBUG, LOG_INFO, LOG_INFO, LOG_WARNING, LOG_ERR, LOG_CRIT };
+	syslog( LOG_LOCAL3 | s_syslog_level[level], "%s", json ? buf : buf + 14 );
+#endif
+	return;
+}
+
+int Logger::kv_begin( char * buf, int64_t * now, int level, const char * file, int line, const char * msg )
+{
+	*now = log_now( m_coarse_time );
+	int msg_len = (int)strlen( msg );
+	if( m_json )
+		return format_json( buf, DGN_LOG_LINE_MAX - 8, *now, level, file, line, msg, msg_len );
+	int len = format_prefix( buf, *now, level, file, line );
+	if( msg_len > DGN_LOG_LINE_MAX - 8 - len )
+		msg_len = DGN_LOG_LINE_MAX - 8 - len;
+	memcpy( buf + len, msg, msg_len );
+	return len + msg_len;
+}
+
+void Logger::kv_end( char * buf, int len, int64_t now, int level )
+{
+	if( m_json ) {
+		len = json_close( buf, len );
+	}
+	else {
+		len += put_str( buf + len, DGN_LOG_LINE_END );
+		buf[len] = '\0';
+	}
+	if( m_mmap != NULL )
+		mmap_write( m_mmap, buf, len );
+	if( m_async && push_async( level, now, LOG_REC_NORMAL, NULL, 0, buf, len ) == 0 )
+		return;
+	output( level, now, buf, len );
+	return;
+}
 
-	if( m_fname[0] != '\0' ) {
-		if( check_log_file() >= 0 ) {
-			write( m_fd, buf, len );
-			m_file_size += len;
+void Logger::output( int level, int64_t ts, const char * buf, int len )
+{
+	if( m_fname[0] != '\0' && ! m_binary ) {
+		int fd = get_log_fd();
+		if( fd >= 0 ) {
+			write( fd, buf, len );
+			add_written( len );
 		}
 	}
+	else if( m_fname[0] != '\0' ) {
+		// binary file after InitAsync( 0 ) or no ring left, text entry as writer does
+		char head[14];
+		uint32_t plen = (uint32_t)( 9 + len );
+		head[0] = (char)DGN_LOG_BIN_TEXT;
+		memcpy( head + 1, &plen, 4 );
+		head[5] = (char)level;
+		memcpy( head + 6, &ts, 8 );
+		write_bin( head, sizeof(head), buf, len );
+	}
 	
 	if( m_stderr_enable != 0 ) {
 		fprintf( stderr, "%s", buf );
 	}
 	
-	if( m_syslog_enable != 0 ) {
-#ifdef _WIN32
-		OutputDebugStringA( buf );
-#else
-		static const int s_syslog_level[8] = { LOG_DEBUG, LOG_DEBUG, LOG_DEBUG, LOG_INFO, LOG_INFO, LOG_WARNING, LOG_ERROR, LOG_CRIT };
-		syslog( LOG_LOCAL3 | s_syslog_level[level], "%s", buf + 14 );
-#endif
+	if( m_syslog_enable != 0 )
+		output_syslog( level, buf, m_json );
+
+	return;
+}
+
+log_ring_t * Logger::get_ring()
+{
+	log_tls_t & tls = s_log_tls;
+	int i;
+	int slot = -1;
+	for( i = 0; i < tls.m_num; ++i ) {
+		if( tls.m_ids[i] == m_id )
+			return tls.m_rings[i];
+		if( tls.m_rings[i]->m_orphan )
+			slot = i;
+	}
+	if( slot >= 0 )
+		ring_release( tls.m_rings[slot] );
+	else if( tls.m_num < DGN_LOG_TLS_NUM )
+		slot = tls.m_num++;
+	else
+		return NULL;
+
+	log_ring_t * r = new log_ring_t( (uint32_t)m_ring_size );
+	tls.m_ids[slot] = m_id;
+	tls.m_rings[slot] = r;
+	MutexGuard guard( &m_ring_lock );
+	r->m_next = m_rings;
+	m_rings = r;
+	return r;
+}
+
+int Logger::push_async( int level, int64_t ts, int flag, const char * head, int head_len, const char * buf, int len )
+{
+	log_ring_t * r = get_ring();
+	if( r == NULL )
+		return -1;
+
+	uint32_t need = LOG_REC_SIZE( head_len + len );
+	uint32_t pos = r->m_head;
+	uint32_t tail = LOG_LOAD_ACQUIRE( &r->m_tail );
+	uint32_t off = pos & ( r->m_size - 1 );
+	uint32_t room = r->m_size - off; // contiguous to ring end
+	uint32_t total = need <= room ? need : room + need;
+	if( r->m_size - ( pos - tail ) < total ) {
+		r->m_dropped++;
+		return 0;
+	}
+
+	log_rec_t * rec;
+	if( need > room ) {
+		rec = (log_rec_t *)( r->m_buf + off );
+		rec->m_len = 0;
+		rec->m_flag = LOG_REC_PAD;
+		pos += room;
+		off = 0;
+	}
+	rec = (log_rec_t *)( r->m_buf + off );
+	rec->m_len = (uint32_t)( head_len + len );
+	rec->m_level = (uint16_t)level;
+	rec->m_flag = (uint16_t)flag;
+	rec->m_ts = ts;
+	if( head_len > 0 )
+		memcpy( rec + 1, head, head_len );
+	memcpy( (char *)( rec + 1 ) + head_len, buf, len );
+	LOG_STORE_RELEASE( &r->m_head, pos + need );
+	return 0;
+}
+
+int Logger::push_deferred( LogSite * site, const char * args, int args_len )
+{
+	if( site->m_id == 0 && register_site( site ) < 0 )
+		return -1;
+	return push_async( site->m_level, log_now( m_coarse_time ), LOG_REC_DEFER, (const char *)&site, (int)sizeof(site), args, args_len );
+}
+
+int Logger::write_loop( Thread * th, void * arg )
+{
+	while( 1 ) {
+		int stop = th->HasStopFlag();
+		int req = m_flush_req.Get();
+		int num = drain();
+		m_flush_done = req;
+		if( stop )
+			break;
+		if( num == 0 ) {
+			MutexGuard guard( &m_wake_lock );
+			m_wake.Wait( &m_wake_lock, m_flush_ms );
+		}
+	}
+	return 0;
+}
+
+int Logger::drain()
+{
+	log_ring_t * rings;
+	{
+		MutexGuard guard( &m_ring_lock );
+		rings = m_rings;
+	}
+
+	int to_file = m_fname[0] != '\0';
+	int need_text = ( to_file && ! m_binary ) || m_stderr_enable != 0 || m_syslog_enable != 0 || m_mmap != NULL;
+	int need_bin = to_file && m_binary;
+	struct iovec iov[IOV_MAX];
+	int iov_num = 0;
+	int num = 0;
+	if( m_merge == NULL )
+		m_merge = new log_merge_t;
+	std::vector< log_head_t > & heap = m_merge->m_heap;
+	heap.clear();
+	log_ring_t * r;
+	for( r = rings; r != NULL; r = r->m_next ) {
+		r->m_end = LOG_LOAD_ACQUIRE( &r->m_head );
+		r->m_pending = ring_skip_pad( r, r->m_tail );
+		if( r->m_pending != r->m_end ) {
+			log_head_t h = { ring_rec( r )->m_ts, r };
+			heap.push_back( h );
+		}
+	}
+	std::make_heap( heap.begin(), heap.end(), log_head_later );
+	// merge records of all threads by time, each ring already in order,
+	// later ones of this round may still be earlier than pushed after head taken
+	while( ! heap.empty() ) {
+		std::pop_heap( heap.begin(), heap.end(), log_head_later );
+		log_ring_t * best = heap.back().m_ring;
+		heap.pop_back();
+		log_rec_t * rec = ring_rec( best );
+		if( iov_num == IOV_MAX || m_bin_len >= DGN_LOG_BIN_FLUSH || m_scratch_len > DGN_LOG_SCRATCH_SIZE - DGN_LOG_LINE_MAX ) {
+			write_iov( iov, iov_num );
+			iov_num = 0;
+		}
+
+		char * text = (char *)( rec + 1 );
+		int text_len = (int)rec->m_len;
+		if( rec->m_flag == LOG_REC_DEFER ) {
+			LogSite * site;
+			memcpy( &site, rec + 1, sizeof(site) );
+			const char * args = (const char *)( rec + 1 ) + sizeof(site);
+			int args_len = (int)( rec->m_len - sizeof(site) );
+			if( need_text ) {
+				text = m_scratch + m_scratch_len;
+				if( m_json ) {
+					char msg[DGN_LOG_LINE_MAX];
+					int msg_len = FormatArgs( msg, sizeof(msg), site->m_fmt, args, args_len );
+					text_len = format_json( text, DGN_LOG_LINE_MAX - 8, rec->m_ts, site->m_level, site->m_file, site->m_line, msg, msg_len );
+					text_len = json_close( text, text_len );
+				}
+				else {
+					text_len = format_prefix( text, rec->m_ts, site->m_level, site->m_file, site->m_line );
+					text_len += FormatArgs( text + text_len, DGN_LOG_LINE_MAX - text_len, site->m_fmt, args, args_len );
+				}
+				m_scratch_len += text_len + 1;
+				if( m_mmap != NULL )
+					mmap_write( m_mmap, text, text_len );
+			}
+			if( need_bin ) {
+				if( site->m_id > m_sites_emitted ) {
+					bin_sites( &m_bin, &m_bin_len, &m_bin_cap, m_sites_emitted + 1, site->m_id );
+					m_sites_emitted = site->m_id;
+				}
+				uint32_t id = (uint32_t)site->m_id;
+				bin_entry( &m_bin, &m_bin_len, &m_bin_cap, DGN_LOG_BIN_LOG, (const char *)&id, 4, (const char *)&rec->m_ts, 8, args, args_len );
+			}
+		}
+		else if( need_bin ) {
+			uint8_t level = (uint8_t)rec->m_level;
+			bin_entry( &m_bin, &m_bin_len, &m_bin_cap, DGN_LOG_BIN_TEXT, (const char *)&level, 1, (const char *)&rec->m_ts, 8, text, text_len );
+		}
+
+		if( need_text ) {
+			if( m_syslog_enable != 0 ) {
+				// text not end with '\0' in ring
+				char line[DGN_LOG_LINE_MAX];
+				memcpy( line, text, text_len );
+				line[text_len] = '\0';
+				output_syslog( rec->m_level, line, m_json );
+			}
+			iov[iov_num].iov_base = text;
+			iov[iov_num].iov_len = text_len;
+			iov_num++;
+		}
+		num++;
+		best->m_pending = ring_skip_pad( best, best->m_pending + LOG_REC_SIZE( rec->m_len ) );
+		if( best->m_pending != best->m_end ) {
+			log_head_t h = { ring_rec( best )->m_ts, best };
+			heap.push_back( h );
+			std::push_heap( heap.begin(), heap.end(), log_head_later );
+		}
+	}
+	write_iov( iov, iov_num );
+
+	// remove drained rings of exited threads
+	int exited = 0;
+	for( r = rings; r != NULL; r = r->m_next )
+		exited += r->m_exited;
+	if( exited > 0 ) {
+		MutexGuard guard( &m_ring_lock );
+		log_ring_t ** pr = &m_rings;
+		while( *pr != NULL ) {
+			r = *pr;
+			if( r->m_exited && r->m_tail == LOG_LOAD_ACQUIRE( &r->m_head ) ) {
+				*pr = r->m_next;
+				m_dropped_exited += r->m_dropped;
+				ring_release( r );
+				continue;
+			}
+			pr = &r->m_next;
+		}
+	}
+	return num;
+}
+
+// write records then give ring space back
+void Logger::write_iov( void * iov_ptr, int num )
+{
+	struct iovec * iov = (struct iovec *)iov_ptr;
+	if( num > 0 ) {
+		int fd = m_fname[0] != '\0' && ! m_binary ? get_log_fd() : -1;
+		if( fd >= 0 ) {
+			int64_t len = 0;
+			int i;
+			for( i = 0; i < num; ++i )
+				len += iov[i].iov_len;
+			write_all( fd, iov, num );
+			add_written( len );
+		}
+		if( m_stderr_enable != 0 )
+			write_all( 2, iov, num );
 	}
+	if( m_bin_len > 0 ) {
+		if( m_fname[0] != '\0' )
+			write_bin( m_bin, m_bin_len, NULL, 0 );
+		m_bin_len = 0;
+	}
+	m_scratch_len = 0;
 
+	log_ring_t * r;
+	{
+		MutexGuard guard( &m_ring_lock );
+		r = m_rings;
+	}
+	for( ; r != NULL; r = r->m_next ) {
+		if( r->m_pending != r->m_tail )
+			LOG_STORE_RELEASE( &r->m_tail, r->m_pending );
+	}
+	return;
+}
+
+// binary entries, magic and all known sites first in a new file
+void Logger::write_bin( const char * head, int head_len, const char * buf, int len )
+{
+	int fd = get_log_fd();
+	if( fd < 0 )
+		return;
+	// rotate under the lock too, header and entries in same file
+	MutexGuard guard( &m_bin_lock );
+	int64_t total = head_len + len;
+	if( m_bin_gen != m_file_gen ) {
+		char * hdr = NULL;
+		int hdr_len = 0, hdr_cap = 0;
+		bin_append( &hdr, &hdr_len, &hdr_cap, DGN_LOG_BIN_MAGIC, DGN_LOG_BIN_MAGIC_LEN );
+		if( m_sites_emitted > 0 )
+			bin_sites( &hdr, &hdr_len, &hdr_cap, 1, m_sites_emitted );
+		struct iovec hv = { hdr, (size_t)hdr_len };
+		write_all( fd, &hv, 1 );
+		total += hdr_len;
+		delete[] hdr;
+		m_bin_gen = m_file_gen;
+	}
+	struct iovec iov[2] = { { (char *)head, (size_t)head_len }, { (char *)buf, (size_t)len } };
+	write_all( fd, iov, len > 0 ? 2 : 1 );
+	add_written( total );
 	return;
 }
 
@@ -165,61 +1618,193 @@ void Logger::DoAssert( const char * file, int line, const char * msg )
 	return; // never come here
 }
 
-int Logger::check_log_file()
+int Logger::get_log_fd()
 {
-	if( m_fd >= 0 && m_file_size < (int64_t)m_max_size_mb * 1024 * 1024 ) {
-		return 0;
-	}
-
+	int fd = LOG_LOAD_ACQUIRE( &m_fd );
+	if( fd >= 0 )
+		return fd;
 	MutexGuard guard( &m_lock );
+	if( m_fd < 0 )
+		open_log_file();
+	return m_fd;
+}
 
-	if( m_fd >= 0 && m_file_size < (int64_t)m_max_size_mb * 1024 * 1024 ) {
-		return 0;
-	}
+void Logger::add_written( int64_t len )
+{
+	int64_t size = LOG_ADD_FETCH( &m_file_size, len );
+	if( size < m_max_size && ( m_rotate_at == LOG_TIME_NEVER || log_now( 1 ) < m_rotate_at ) )
+		return;
+	// one rotate, others go on with current file
+	if( m_lock.TryLock() < 0 )
+		return;
+	rotate();
+	m_lock.UnLock();
+	return;
+}
 
-#ifdef _WIN32
-	const int flag = _O_CREAT | _O_APPEND | _O_WRONLY | _O_BINARY;
-#else
-	const int flag = O_CREAT | O_APPEND | O_WRONLY;
+// m_lock locked
+int Logger::open_log_file()
+{
+	int fd = open( m_fname, LOG_OPEN_FLAG, 0660 );
+	if( fd < 0 )
+		return -1;
+	m_file_size = lseek( fd, 0, SEEK_END );
+	m_file_gen++;
+	m_rotate_at = next_rotate( log_now( 1 ) );
+	LOG_STORE_RELEASE( &m_fd, fd );
+	return 0;
+}
+
+int64_t Logger::next_rotate( int64_t now )
+{
+	if( m_rotate_sec <= 0 )
+		return LOG_TIME_NEVER;
+	int64_t sec = now / 1000000LL;
+	int64_t off = 0; // align to local time
+#ifndef _WIN32
+	time_t t = (time_t)sec;
+	struct tm tm;
+	if( localtime_r( &t, &tm ) != NULL )
+		off = tm.tm_gmtoff;
 #endif
+	int64_t local = sec + off;
+	return ( local - local % m_rotate_sec + m_rotate_sec - off ) * 1000000LL;
+}
 
-	if( m_fd >= 0 ) {
-		close( m_fd ), m_fd = -1;
+// name.N or name.N.gz, N = 0 for current file
+static void roll_name( char * buf, const char * fname, int idx, int gz )
+{
+	int len = (int)strlen( fname );
+	memcpy( buf, fname, len );
+	if( idx > 0 )
+		len += snprintf( buf + len, 16, ".%d", idx );
+	if( gz )
+		memcpy( buf + len, ".gz", 3 ), len += 3;
+	buf[len] = '\0';
+	return;
+}
+
+// m_lock locked
+void Logger::rotate()
+{
+	int64_t now = log_now( 1 );
+	if( m_fd < 0 || ( m_file_size < m_max_size && now < m_rotate_at ) )
+		return;
+
+	// swap in new file first, writers go on with renamed one only for a moment
+	char from[MAX_LOG_FILENAME_LEN + 48];
+	char to[MAX_LOG_FILENAME_LEN + 48];
+	snprintf( from, sizeof(from), "%s.rolling", m_fname );
+	m_rotate_at = next_rotate( now );
+	// left by a crash in the middle of last rotation, keep it out of the way
+	snprintf( to, sizeof(to), "%s.rolling.%lld", m_fname, (long long)( now / 1000000 ) );
+	rename( from, to );
+#ifdef _WIN32
+	// can not rename opened file, lines written meanwhile lost
+	close( m_fd );
+#endif
+	int renamed = rename( m_fname, from ) == 0;
+	int fd = open( m_fname, LOG_OPEN_FLAG, 0660 );
+	if( fd >= 0 ) {
+		// no fd closed under writers
+		dup2( fd, m_fd );
+		close( fd );
 	}
-	else {
-		m_fd = open( m_fname, flag, 0660 );
-		if( m_fd < 0 )
-			return -1;
-		m_file_size = lseek( m_fd, SEEK_END, 0 );
-		if( m_file_size < (int64_t)m_max_size_mb * 1024 * 1024 ) {
-			return 0;
+	m_file_size = 0;
+	if( ! renamed )
+		return; // retry after another max size
+	m_file_gen++;
+
+	// TODO : check dir exist
+	int i, gz;
+	for( i = m_max_roll - 1; i >= 1; --i ) {
+		for( gz = 0; gz < 2; ++gz ) {
+			roll_name( to, m_fname, i, gz );
+			unlink( to );
+			if( i == 1 && gz )
+				continue;
+			if( i == 1 )
+				snprintf( from, sizeof(from), "%s.rolling", m_fname );
+			else
+				roll_name( from, m_fname, i - 1, gz );
+			rename( from, to );
 		}
-		close( m_fd ), m_fd = -1;
 	}
 
-	// TODO : check dir exist
-	char buf[MAX_LOG_FILENAME_LEN + 16];
-	memcpy( buf, m_fname, m_fname_len + 1 );
-	int i = 0;
-	for( i = m_max_roll - 1; i >= 1; ++i ) {
-		snprintf( buf + m_fname_len, 16 - 1, ".%d", i );
-		if( i - 1 == 0 )
-			m_fname[m_fname_len] = '\0';
-		else
-			snprintf( m_fname + m_fname_len, 16 - 1, ".%d", i - 1 );
-		unlink( buf );
-		rename( m_fname, buf );
+	if( m_gz != NULL ) {
+		roll_name( to, m_fname, 1, 0 );
+		fd = open( to, O_RDONLY, 0 );
+		m_gz->shift( m_max_roll );
+		if( fd >= 0 )
+			m_gz->push( fd );
 	}
+	return;
+}
 
-	m_fname[m_fname_len] = '\0';
-	int fd = open( m_fname, flag, 0660 );
-	if( fd < 0 ) {
+int Logger::start_gz()
+{
+	if( m_gz != NULL )
+		return 0;
+	m_gz = new log_gz_t;
+	m_gz->m_thread.SetFunc( &Logger::gz_loop, this );
+	if( m_gz->m_thread.Start() < 0 ) {
+		delete m_gz, m_gz = NULL;
 		return -1;
 	}
+	return 0;
+}
 
-	m_fd = fd;
-	m_file_size = 0;
+// files not compressed yet left as is
+void Logger::stop_gz()
+{
+	if( m_gz == NULL )
+		return;
+	m_gz->m_thread.SignalStop();
+	m_lock.Lock();
+	m_gz->m_cond.Signal();
+	m_lock.UnLock();
+	m_gz->m_thread.WaitStop();
+	size_t i;
+	for( i = 0; i < m_gz->m_jobs.size(); ++i )
+		close( m_gz->m_jobs[i].m_fd );
+	delete m_gz, m_gz = NULL;
+	return;
+}
 
+int Logger::gz_loop( Thread * th, void * arg )
+{
+	log_gz_t * gz = m_gz;
+	char tmp[MAX_LOG_FILENAME_LEN + 32];
+	char to[MAX_LOG_FILENAME_LEN + 32];
+	snprintf( tmp, sizeof(tmp), "%s.gz.tmp", m_fname );
+	while( ! th->HasStopFlag() ) {
+		m_lock.Lock();
+		if( gz->m_jobs.empty() ) {
+			gz->m_cond.Wait( &m_lock, 1000 );
+			m_lock.UnLock();
+			continue;
+		}
+		int fd = gz->m_jobs[0].m_fd;
+		m_lock.UnLock();
+
+		int ret = gz_file( fd, tmp );
+		close( fd );
+
+		// file may be rolled further meanwhile
+		m_lock.Lock();
+		int idx = gz->m_jobs[0].m_idx;
+		gz->m_jobs.erase( gz->m_jobs.begin() );
+		if( ret == 0 && idx > 0 ) {
+			roll_name( to, m_fname, idx, 1 );
+			rename( tmp, to );
+			roll_name( to, m_fname, idx, 0 );
+			unlink( to );
+		}
+		else {
+			unlink( tmp );
+		}
+		m_lock.UnLock();
+	}
 	return 0;
 }
 
@@ -19,6 +19,16 @@
 
 #include <dgn/dgn.h>
 #include <dgn/Thread.h>  // Mutex
+#include <dgn/Atomic.h>
+#include <dgn/CStr.h>
+
+#include <string.h>
+
+#include <stdarg.h>
+#include <time.h>
+
+#include <type_traits>
+#include <map>
 
 enum {
 	DGN_LOG_LEVEL_DEBUG = 2,
@@ -32,11 +42,80 @@ enum {
 #define DGN_LOG_LINE_END "\n"
 #endif
 
+// records below it compiled out, arguments never evaluated, e.g. -DDGN_LOG_MIN_LEVEL=4 drop PR_DEBUG
+#ifndef DGN_LOG_MIN_LEVEL
+#define DGN_LOG_MIN_LEVEL	0
+#endif
+
+// module name of call sites in a file for Logger::SetModuleLevel(), define before any include,
+// default match file name
+#ifndef DGN_LOG_MODULE
+#define DGN_LOG_MODULE	NULL
+#endif
+
 // fmt must be string literals, and should not end with \r\n ( will auto add )
 #define PR_DEBUG( fmt, ... ) DGN_PR_LOG( DGN_LOG_LEVEL_DEBUG, fmt, ##__VA_ARGS__ )
 #define PR_INFO( fmt, ... ) DGN_PR_LOG( DGN_LOG_LEVEL_INFO, fmt, ##__VA_ARGS__ )
 #define PR_ERR( fmt, ... ) DGN_PR_LOG( DGN_LOG_LEVEL_ERR, fmt, ##__VA_ARGS__ )
-#define DGN_PR_LOG( level, fmt, ... ) dgn::DgnLib::GetLogger()->Log( level, __FILE__, __LINE__, fmt DGN_LOG_LINE_END, ##__VA_ARGS__ )
+#define DGN_PR_LOG( level, fmt, ... ) DGN_PR_LOG_TO( dgn::DgnLib::GetLogger(), level, fmt, ##__VA_ARGS__ )
+// to another Logger, e.g. one from DgnLib::GetLogger( "access" )
+#define PR_DEBUG_TO( logger, fmt, ... ) DGN_PR_LOG_TO( logger, DGN_LOG_LEVEL_DEBUG, fmt, ##__VA_ARGS__ )
+#define PR_INFO_TO( logger, fmt, ... ) DGN_PR_LOG_TO( logger, DGN_LOG_LEVEL_INFO, fmt, ##__VA_ARGS__ )
+#define PR_ERR_TO( logger, fmt, ... ) DGN_PR_LOG_TO( logger, DGN_LOG_LEVEL_ERR, fmt, ##__VA_ARGS__ )
+// call site kept in static LogSite, arguments checked against fmt at compile time,
+// and only evaluated after level check passed
+#define DGN_PR_LOG_TO( logger, level, fmt, ... ) \
+	do { \
+		if( (level) >= DGN_LOG_MIN_LEVEL ) { \
+			static dgn::LogSite s_dgn_log_site = { level, __FILE__, __LINE__, fmt DGN_LOG_LINE_END, DGN_LOG_MODULE, 0, 0 }; \
+			dgn::Logger * dgn_logger = (logger); \
+			if( 0 ) \
+				dgn::log_check_fmt( fmt, ##__VA_ARGS__ ); \
+			if( dgn_logger->IsEnabled( &s_dgn_log_site ) ) \
+				dgn_logger->LogD( &s_dgn_log_site, ##__VA_ARGS__ ); \
+		} \
+	} while( 0 )
+
+// sampled : first of every n calls of the call site
+#define PR_DEBUG_EVERY_N( n, fmt, ... ) DGN_PR_LOG_LIMIT( DGN_LOG_LEVEL_DEBUG, dgn::log_every_n, n, fmt, ##__VA_ARGS__ )
+#define PR_INFO_EVERY_N( n, fmt, ... ) DGN_PR_LOG_LIMIT( DGN_LOG_LEVEL_INFO, dgn::log_every_n, n, fmt, ##__VA_ARGS__ )
+#define PR_ERR_EVERY_N( n, fmt, ... ) DGN_PR_LOG_LIMIT( DGN_LOG_LEVEL_ERR, dgn::log_every_n, n, fmt, ##__VA_ARGS__ )
+// rate limited : at most per_sec records of the call site each second, number suppressed
+// logged as a separate line before the next one passed
+#define PR_DEBUG_RATELIMIT( per_sec, fmt, ... ) DGN_PR_LOG_LIMIT( DGN_LOG_LEVEL_DEBUG, dgn::log_ratelimit, per_sec, fmt, ##__VA_ARGS__ )
+#define PR_INFO_RATELIMIT( per_sec, fmt, ... ) DGN_PR_LOG_LIMIT( DGN_LOG_LEVEL_INFO, dgn::log_ratelimit, per_sec, fmt, ##__VA_ARGS__ )
+#define PR_ERR_RATELIMIT( per_sec, fmt, ... ) DGN_PR_LOG_LIMIT( DGN_LOG_LEVEL_ERR, dgn::log_ratelimit, per_sec, fmt, ##__VA_ARGS__ )
+#define DGN_PR_LOG_LIMIT( level, check, n, fmt, ... ) \
+	do { \
+		if( (level) >= DGN_LOG_MIN_LEVEL ) { \
+			static dgn::LogSite s_dgn_log_site = { level, __FILE__, __LINE__, fmt DGN_LOG_LINE_END, DGN_LOG_MODULE, 0, 0 }; \
+			static dgn::LogLimit s_dgn_log_limit; \
+			dgn::Logger * dgn_logger = dgn::DgnLib::GetLogger(); \
+			int dgn_suppressed = 0; \
+			if( 0 ) \
+				dgn::log_check_fmt( fmt, ##__VA_ARGS__ ); \
+			if( dgn_logger->IsEnabled( &s_dgn_log_site ) && check( &s_dgn_log_limit, n, &dgn_suppressed ) ) { \
+				if( dgn_suppressed > 0 ) \
+					dgn_logger->LogSuppressed( &s_dgn_log_site, dgn_suppressed ); \
+				dgn_logger->LogD( &s_dgn_log_site, ##__VA_ARGS__ ); \
+			} \
+		} \
+	} while( 0 )
+
+// structured : msg then key, value pairs, PR_INFO_KV( "login", "user", uid, "lat_us", t )
+// keys must be string literals, text "msg key=value ..." or a json line ( InitJson() )
+#define PR_DEBUG_KV( msg, ... ) DGN_PR_LOG_KV( DGN_LOG_LEVEL_DEBUG, msg, ##__VA_ARGS__ )
+#define PR_INFO_KV( msg, ... ) DGN_PR_LOG_KV( DGN_LOG_LEVEL_INFO, msg, ##__VA_ARGS__ )
+#define PR_ERR_KV( msg, ... ) DGN_PR_LOG_KV( DGN_LOG_LEVEL_ERR, msg, ##__VA_ARGS__ )
+#define DGN_PR_LOG_KV( level, msg, ... ) \
+	do { \
+		if( (level) >= DGN_LOG_MIN_LEVEL ) { \
+			static dgn::LogSite s_dgn_log_site = { level, __FILE__, __LINE__, msg, DGN_LOG_MODULE, 0, 0 }; \
+			dgn::Logger * dgn_logger = dgn::DgnLib::GetLogger(); \
+			if( dgn_logger->IsEnabled( &s_dgn_log_site ) ) \
+				dgn_logger->LogKV( &s_dgn_log_site, ##__VA_ARGS__ ); \
+		} \
+	} while( 0 )
 
 #define ASSERT(x) \
 	do { \
@@ -50,36 +129,392 @@ BEGIN_NS_DGN
 ////////////////
 
 #define MAX_LOG_FILENAME_LEN	512
+#define DGN_LOG_RING_SIZE	( 1024 * 1024 ) // default async ring size of each thread
+#define DGN_LOG_LINE_MAX	2048 // one formatted line, longer truncated
+#define DGN_LOG_ARGS_MAX	1024 // encoded arguments of one deferred record, long string truncated
+
+struct log_ring_t;
+struct log_gz_t;
+struct log_mmap_t;
+struct log_merge_t;
+
+// static data of one PR_xxx call site, registered at first deferred use
+struct LogSite
+{
+	int m_level;
+	const char * m_file;
+	int m_line;
+	const char * m_fmt;
+	const char * m_module; // NULL use file name
+	volatile int m_id; // > 0 after registered
+	volatile uint32_t m_cache; // level generation << 8 | min level, of last logger checked it
+};
+
+// lock-free state of a rate limited or sampled call site
+struct LogLimit
+{
+	Atomic m_count; // calls, for every n
+	Atomic m_sec; // current window
+	Atomic m_passed; // in current window
+	Atomic m_suppressed; // not reported yet
+};
+
+// return true if this call should log
+inline bool log_every_n( LogLimit * lim, int n, int * suppressed )
+{
+	unsigned int c = (unsigned int)lim->m_count.Inc() - 1;
+	return n <= 1 || c % (unsigned int)n == 0;
+}
+
+// *suppressed set when a new window start
+inline bool log_ratelimit( LogLimit * lim, int per_sec, int * suppressed )
+{
+	int sec = (int)time( NULL );
+	int old = lim->m_sec.Get();
+	int num = 0;
+	if( sec != old && lim->m_sec.CompareSet( old, sec ) ) {
+		lim->m_passed.Set( 0 );
+		num = lim->m_suppressed.Exchange( 0 );
+	}
+	if( lim->m_passed.Inc() <= per_sec ) {
+		*suppressed = num;
+		return true;
+	}
+	lim->m_suppressed.Add( num + 1 );
+	return false;
+}
+
+void log_check_fmt( const char * fmt, ... ) DGN_ATTR_PRINTF(1,2);
+inline void log_check_fmt( const char * fmt, ... ) {}
+
+// deferred argument : type 1 byte, then value in host byte order
+enum {
+	DGN_LOG_ARG_I32 = 1, // 4 bytes, char / short / int / bool / enum, long if 32 bits
+	DGN_LOG_ARG_I64 = 2, // 8 bytes
+	DGN_LOG_ARG_F64 = 3, // 8 bytes double
+	DGN_LOG_ARG_STR = 4, // 2 bytes length, then chars without '\0'
+	DGN_LOG_ARG_PTR = 5, // 8 bytes
+};
+
+class DGN_LIB_API LogArgs
+{
+public:
+	LogArgs( char * buf, int cap ) : m_buf( buf ), m_len( 0 ), m_cap( cap ) {}
+
+	const char * Buf() const { return m_buf; }
+	int Len() const { return m_len; }
 
+	void Put( bool v ) { Put( (int)v ); }
+	void Put( char v ) { Put( (int)v ); }
+	void Put( signed char v ) { Put( (int)v ); }
+	void Put( unsigned char v ) { Put( (int)v ); }
+	void Put( short v ) { Put( (int)v ); }
+	void Put( unsigned short v ) { Put( (int)v ); }
+	void Put( int v ) { put_raw( DGN_LOG_ARG_I32, &v, 4 ); }
+	void Put( unsigned int v ) { put_raw( DGN_LOG_ARG_I32, &v, 4 ); }
+	void Put( long v ) { put_raw( sizeof(v) == 8 ? DGN_LOG_ARG_I64 : DGN_LOG_ARG_I32, &v, sizeof(v) ); }
+	void Put( unsigned long v ) { put_raw( sizeof(v) == 8 ? DGN_LOG_ARG_I64 : DGN_LOG_ARG_I32, &v, sizeof(v) ); }
+	void Put( long long v ) { put_raw( DGN_LOG_ARG_I64, &v, 8 ); }
+	void Put( unsigned long long v ) { put_raw( DGN_LOG_ARG_I64, &v, 8 ); }
+	void Put( float v ) { Put( (double)v ); }
+	void Put( double v ) { put_raw( DGN_LOG_ARG_F64, &v, 8 ); }
+	void Put( long double v ) { Put( (double)v ); }
+	void Put( char * v ) { Put( (const char *)v ); }
+	void Put( const char * v );
+	template< typename T > void Put( T * v ) { uint64_t p = (uint64_t)(uintptr_t)v; put_raw( DGN_LOG_ARG_PTR, &p, 8 ); }
+	template< typename T > typename std::enable_if< std::is_enum< T >::value >::type Put( T v ) { Put( (int)v ); }
+
+protected:
+	void put_raw( int type, const void * v, int n )
+	{
+		if( m_len + 1 + n > m_cap )
+			return;
+		m_buf[m_len] = (char)type;
+		memcpy( m_buf + m_len + 1, v, n );
+		m_len += 1 + n;
+	}
+
+protected:
+	char * m_buf;
+	int m_len;
+	int m_cap;
+};
+
+inline void log_put_args( LogArgs * la ) {}
+
+template< typename T, typename... Args >
+inline void log_put_args( LogArgs * la, T v, Args... args )
+{
+	la->Put( v );
+	log_put_args( la, args... );
+}
+
+// key / value writer of LogKV(), field not fit dropped as a whole
+class DGN_LIB_API LogFields
+{
+public:
+	// buf already has len bytes, cap exclude room for line end
+	LogFields( char * buf, int len, int cap, int json )
+		: m_buf( buf ), m_len( len ), m_cap( cap ), m_json( json ), m_mark( len ) {}
+
+	int Len() const { return m_len; }
+
+	void Key( const char * key );
+
+	void Put( bool v ) { put_raw( v ? "true" : "false", v ? 4 : 5 ); }
+	void Put( char v ) { put_int( v ); }
+	void Put( signed char v ) { put_int( v ); }
+	void Put( unsigned char v ) { put_int( v ); }
+	void Put( short v ) { put_int( v ); }
+	void Put( unsigned short v ) { put_int( v ); }
+	void Put( int v ) { put_int( v ); }
+	void Put( unsigned int v ) { put_int( v ); }
+	void Put( long v ) { put_int( v ); }
+	void Put( unsigned long v ) { put_uint( v ); }
+	void Put( long long v ) { put_int( v ); }
+	void Put( unsigned long long v ) { put_uint( v ); }
+	void Put( float v ) { Put( (double)v ); }
+	void Put( double v );
+	void Put( long double v ) { Put( (double)v ); }
+	void Put( char * v ) { Put( (const char *)v ); }
+	void Put( const char * v );
+	template< typename T > void Put( T * v ) { put_ptr( (const void *)v ); }
+	template< typename T > typename std::enable_if< std::is_enum< T >::value >::type Put( T v ) { put_int( (int64_t)v ); }
+
+protected:
+	void put_int( int64_t v );
+	void put_uint( uint64_t v );
+	void put_ptr( const void * v );
+	void put_raw( const char * v, int n ); // as is, no quote
+	void drop(); // remove current field
+
+protected:
+	char * m_buf;
+	int m_len;
+	int m_cap;
+	int m_json;
+	int m_mark; // start of current field
+};
+
+inline void log_put_kv( LogFields * lf ) {}
+
+template< typename V, typename... Args >
+inline void log_put_kv( LogFields * lf, const char * key, V v, Args... args )
+{
+	lf->Key( key );
+	lf->Put( v );
+	log_put_kv( lf, args... );
+}
+
+// binary log file : DGN_LOG_BIN_MAGIC, then entries of
+//   type 1 byte | payload length 4 bytes | payload, integers in host byte order
+// magic again in middle ( file reopened by another writer ) reset site table
+#define DGN_LOG_BIN_MAGIC	"DGNLOGB1"
+#define DGN_LOG_BIN_MAGIC_LEN	8
+
+enum {
+	DGN_LOG_BIN_SITE = 1, // id 4 | level 1 | line 4 | file len 2 | file | fmt len 2 | fmt
+	DGN_LOG_BIN_LOG = 2,  // site id 4 | time us 8 | encoded arguments
+	DGN_LOG_BIN_TEXT = 3, // level 1 | time us 8 | formatted line
+};
+
+// mmap ring file : header, then data_size bytes of text lines written circularly,
+// head is total bytes ever written, data at head % data_size is the oldest
+#define DGN_LOG_MMAP_MAGIC	"DGNLOGR1"
+#define DGN_LOG_MMAP_HDR_SIZE	64
+
+struct LogMmapHeader
+{
+	char m_magic[8];
+	uint32_t m_hdr_size;
+	uint32_t m_data_size;
+	volatile uint64_t m_head;
+};
+
+// Note :
+// sync mode ( default ) write file / stderr / syslog in caller thread
+// async mode caller push formatted line into ring of its own thread, never block and
+// drop if full, a background thread batch records of all threads into writev
 class DGN_LIB_API Logger
 {
 public:
 	Logger();
 	~Logger();
 
+	Logger( const Logger & logger ) = delete;
+	Logger & operator = ( const Logger & logger ) = delete;
+
 	int InitLevel( int level );
+	// override level of call sites whose DGN_LOG_MODULE, file name, or file name without
+	// extension equal module, level < 0 remove it, take effect at once in any thread
+	int SetModuleLevel( const char * module, int level );
+	int GetLevel( const LogSite * site );
+	// inline check before arguments evaluated, one compare after site cached
+	bool IsEnabled( LogSite * site )
+	{
+		uint32_t c = site->m_cache;
+		int min = ( c >> 8 ) == m_level_gen ? (int)( c & 0xff ) : resolve_level( site );
+		return site->m_level >= min;
+	}
 	int InitSyslog( int enable );
 	int InitStderr( int enable );
 	int InitLogFile( const char * logfile, int max_size_mb = 200, int max_roll = 10 );
+	// call after InitLogFile(), max_size in bytes ( <= 0 no size limit ), interval_sec > 0 also
+	// roll at local time multiple of it ( 3600 hourly, 86400 daily ), compress rolled files to
+	// .N.gz in background thread ( need DGN_WITH_ZLIB, make WITH_ZLIB=1, otherwise return -1 )
+	// rotation never block writers : file renamed and new one dup2() to same fd,
+	// done by writer thread in async mode, or the sync caller who win try lock,
+	// .rolling left by a crash kept as .rolling.<unix sec>
+	int InitRotate( int64_t max_size, int interval_sec = 0, int compress = 0 );
+	// timestamp from CLOCK_REALTIME_COARSE ( linux, a few ms resolution, no syscall )
+	int InitCoarseTime( int enable );
+	// enable before log threads start and disable after they stop, records left in rings
+	// when disable are written at next enable, ring_size rounded up to power of 2
+	int InitAsync( int enable, int ring_size = DGN_LOG_RING_SIZE, int flush_ms = 10 );
+
+	// async mode wait until records logged before written, return < 0 if timeout
+	int Flush( int timeout_ms = 1000 );
+	int64_t GetDropped(); // records dropped by full ring
+
+	// "MMDD HH:MM:SS.uuuuuu|file:line|LEVEL " of local time, return length, buf at least 300 bytes
+	static int FormatPrefix( char * buf, int64_t time_us, int level, const char * file, int line );
+	// printf fmt with encoded arguments, missing or mismatched argument print as "<?>"
+	static int FormatArgs( char * buf, int cap, const char * fmt, const char * args, int args_len );
+
+	// deferred ( need async ) : PR_xxx push format pointer and encoded arguments,
+	// writer thread format them, or write them as binary log file when binary_file
+	// binary file read by tools/log_decode, stderr and syslog still get text,
+	// records not queued ( sync mode, no ring ) written to it as text entries
+	int InitDeferred( int enable, int binary_file = 0 );
+	// flight recorder : every line also copied into a fixed size mmap file used as circular
+	// buffer, kept by page cache when process crash, written by caller thread at format time
+	// ( deferred records by writer thread ), path NULL to disable, existing file of same size
+	// continue from its head, call before log threads start, not support on win32
+	int InitMmapRing( const char * path, int size = 4 * 1024 * 1024 );
+	// lines of mmap ring file, oldest first, partly overwritten oldest line skipped
+	static int ReadMmapRing( const char * path, CStr * text );
+
+	// json lines : {"ts":<us since epoch>,"level":"INFO","file":"x.cpp","line":12,"msg":"...",<fields>}
+	// for all records, PR_xxx format result go to "msg"
+	int InitJson( int enable );
 
 	void Log( int level, const char * file, int line, const char * fmt, ... ) DGN_ATTR_PRINTF(5,6);
+	template< typename... Args >
+	void LogD( LogSite * site, Args... args )
+	{
+		if( ! IsEnabled( site ) )
+			return;
+		if( m_deferred && m_async ) {
+			char buf[DGN_LOG_ARGS_MAX];
+			LogArgs la( buf, sizeof(buf) );
+			log_put_args( &la, args... );
+			if( push_deferred( site, buf, la.Len() ) == 0 )
+				return;
+		}
+		log_format( site->m_level, site->m_file, site->m_line, site->m_fmt, args... );
+	}
+	template< typename... Args >
+	void LogKV( int level, const char * file, int line, const char * msg, Args... args )
+	{
+		if( level >= m_level )
+			log_kv( level, file, line, msg, args... );
+	}
+	template< typename... Args >
+	void LogKV( LogSite * site, Args... args ) // site m_fmt is msg
+	{
+		if( IsEnabled( site ) )
+			log_kv( site->m_level, site->m_file, site->m_line, site->m_fmt, args... );
+	}
+	void LogSuppressed( LogSite * site, int num ); // summary line of rate limited site
 	void DoAssert( const char * file, int line, const char * msg );
 
 protected:
-	int check_log_file();
+	template< typename... Args >
+	void log_kv( int level, const char * file, int line, const char * msg, Args... args )
+	{
+		static_assert( sizeof...(Args) % 2 == 0, "key without value" );
+		if( m_fname[0] == '\0' && m_syslog_enable == 0 && m_stderr_enable == 0 && m_mmap == NULL )
+			return;
+		if( level > 7 )
+			level = 7;
+		char buf[DGN_LOG_LINE_MAX];
+		int64_t now;
+		int len = kv_begin( buf, &now, level, file, line, msg );
+		LogFields lf( buf, len, sizeof(buf) - 8, m_json );
+		log_put_kv( &lf, args... );
+		kv_end( buf, lf.Len(), now, level );
+	}
+	// no level check
+	void log_format( int level, const char * file, int line, const char * fmt, ... ) DGN_ATTR_PRINTF(5,6);
+	void log_v( int level, const char * file, int line, const char * fmt, va_list ap );
+	int resolve_level( LogSite * site );
+	int kv_begin( char * buf, int64_t * now, int level, const char * file, int line, const char * msg );
+	void kv_end( char * buf, int len, int64_t now, int level );
+	void output( int level, int64_t ts, const char * buf, int len );
+	int push_async( int level, int64_t ts, int flag, const char * head, int head_len, const char * buf, int len );
+	int push_deferred( LogSite * site, const char * args, int args_len );
+	log_ring_t * get_ring();
+	int write_loop( Thread * th, void * arg );
+	int drain(); // write all queued records, return record number
+	void write_iov( void * iov, int num );
+	void write_bin( const char * head, int head_len, const char * buf, int len );
+	int get_log_fd(); // open at first use, < 0 if failed
+	void add_written( int64_t len ); // rotate if need
+	int open_log_file();
+	void rotate();
+	int64_t next_rotate( int64_t now );
+	int start_gz();
+	void stop_gz();
+	int gz_loop( Thread * th, void * arg );
 
 protected:
 	int m_level;
+	volatile uint32_t m_level_gen; // changed with any level, unique among loggers
+	Mutex m_module_lock;
+	std::map< CStr, int > m_modules; // module -> level
 	int m_syslog_enable;
 	int m_stderr_enable;
 
 	Mutex m_lock;
 	char m_fname[MAX_LOG_FILENAME_LEN + 16];
 	int m_fname_len;
-	int m_max_size_mb;
+	int64_t m_max_size;
 	int m_max_roll;
-	int m_fd;
-	int64_t m_file_size;
+	volatile int m_fd; // same fd number across rotation
+	volatile int64_t m_file_size;
+	int m_rotate_sec;
+	int64_t m_rotate_at; // us
+	int m_compress;
+	log_gz_t * m_gz;
+	log_mmap_t * m_mmap;
+	log_merge_t * m_merge; // writer, heap of ring heads
+
+	uint32_t m_id; // match thread local ring
+	volatile int m_async;
+	int m_ring_size;
+	int m_flush_ms;
+	ThreadObjTP< Logger > m_writer;
+	Mutex m_ring_lock;
+	log_ring_t * m_rings; // new one added at head, removed by writer only
+	int64_t m_dropped_exited; // dropped of removed rings
+	Mutex m_wake_lock;
+	CondVal m_wake;
+	Atomic m_flush_req;
+	volatile int m_flush_done;
+	int m_coarse_time;
+	int m_json;
+
+	volatile int m_deferred;
+	int m_binary;
+	char * m_scratch; // writer, text of deferred records
+	int m_scratch_len;
+	char * m_bin; // writer, binary entries not written
+	int m_bin_len;
+	int m_bin_cap;
+	int m_sites_emitted; // writer, site definitions appended
+	int m_file_gen; // increase when log file opened
+	int m_bin_gen; // file gen binary header written to
+	Mutex m_bin_lock; // binary file written by writer and by callers fallen back to sync
 };
 
 ////////////////
@@ -0,0 +1,316 @@
+// Reactor.cpp : event loop for non-blocking sockets
+// Copyright (C) 2011 ~ 2023 drangon <drangon.zhou (at) gmail.com>
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+
+#include <dgn/Reactor.h>
+#include <dgn/Logger.h>
+
+#ifndef _WIN32
+#include <unistd.h>
+#include <poll.h>
+#include <errno.h>
+#endif
+
+#ifdef __linux__
+#include <sys/epoll.h>
+#endif
+
+#include <algorithm>
+
+BEGIN_NS_DGN
+////////////////
+
+Reactor::Reactor()
+	: m_fd( -1 ), m_max_events( 0 ), m_events( NULL ), m_stop( 0 )
+{
+}
+
+Reactor::~Reactor()
+{
+	Fini();
+}
+
+#ifdef _WIN32
+
+int Reactor::Init( int max_events )
+{
+	PR_ERR( "reactor not support on win32" );
+	return -1;
+}
+
+void Reactor::Fini()
+{
+	return;
+}
+
+int Reactor::Add( sock_t fd, int evt, reactor_cb_t cb, void * arg )
+{
+	return -1;
+}
+
+int Reactor::Mod( sock_t fd, int evt )
+{
+	return -1;
+}
+
+int Reactor::Del( sock_t fd )
+{
+	return -1;
+}
+
+int Reactor::RunOnce( int timeout_ms )
+{
+	return -1;
+}
+
+#else // _WIN32
+
+int Reactor::Init( int max_events )
+{
+	if( m_notify.IsValid() ) {
+		PR_ERR( "reactor already init" );
+		return -1;
+	}
+	if( m_notify.Open() < 0 ) {
+		PR_ERR( "reactor open notify failed" );
+		return -1;
+	}
+	m_max_events = max_events <= 0 ? 256 : max_events;
+
+#ifdef __linux__
+	m_fd = epoll_create1( EPOLL_CLOEXEC );
+	if( m_fd < 0 ) {
+		PR_ERR( "epoll_create1() failed, errno %d", errno );
+		Fini();
+		return -1;
+	}
+	struct epoll_event ev;
+	ev.events = EPOLLIN;
+	ev.data.fd = m_notify.GetFd();
+	if( epoll_ctl( m_fd, EPOLL_CTL_ADD, m_notify.GetFd(), &ev ) < 0 ) {
+		PR_ERR( "epoll_ctl() add notify failed, errno %d", errno );
+		Fini();
+		return -1;
+	}
+	m_events = new struct epoll_event[m_max_events];
+#else
+	m_events = new struct pollfd[m_max_events];
+#endif
+	m_stop = 0;
+	return 0;
+}
+
+void Reactor::Fini()
+{
+	if( m_fd >= 0 )
+		close( m_fd ), m_fd = -1;
+#ifdef __linux__
+	delete[] (struct epoll_event *)m_events;
+#else
+	delete[] (struct pollfd *)m_events;
+#endif
+	m_events = NULL;
+	m_max_events = 0;
+	m_handlers.clear();
+	m_fds.clear();
+	m_notify.Close();
+	return;
+}
+
+#ifdef __linux__
+static uint32_t to_epoll_evt( int evt )
+{
+	return ( ( evt & DGN_POLLIN ) ? EPOLLIN : 0 ) | ( ( evt & DGN_POLLOUT ) ? EPOLLOUT : 0 );
+}
+#endif
+
+int Reactor::Add( sock_t fd, int evt, reactor_cb_t cb, void * arg )
+{
+	if( ! m_notify.IsValid() || fd < 0 || cb == NULL )
+		return -1;
+	if( get_handler( fd ) != NULL ) {
+		PR_DEBUG( "fd %d already added", fd );
+		return -1;
+	}
+
+#ifdef __linux__
+	struct epoll_event ev;
+	ev.events = to_epoll_evt( evt );
+	ev.data.fd = fd;
+	if( epoll_ctl( m_fd, EPOLL_CTL_ADD, fd, &ev ) < 0 ) {
+		PR_DEBUG( "epoll_ctl() add fd %d failed, errno %d", fd, errno );
+		return -1;
+	}
+#else
+	m_fds.push_back( fd );
+#endif
+
+	if( (size_t)fd >= m_handlers.size() )
+		m_handlers.resize( fd + 1 > (int)m_handlers.size() * 2 ? fd + 1 : m_handlers.size() * 2 );
+	handler_t & h = m_handlers[fd];
+	h.m_cb = cb;
+	h.m_arg = arg;
+	h.m_evt = evt;
+	return 0;
+}
+
+int Reactor::Mod( sock_t fd, int evt )
+{
+	handler_t * h = get_handler( fd );
+	if( h == NULL )
+		return -1;
+	if( h->m_evt == evt )
+		return 0;
+
+#ifdef __linux__
+	struct epoll_event ev;
+	ev.events = to_epoll_evt( evt );
+	ev.data.fd = fd;
+	if( epoll_ctl( m_fd, EPOLL_CTL_MOD, fd, &ev ) < 0 ) {
+		PR_DEBUG( "epoll_ctl() mod fd %d failed, errno %d", fd, errno );
+		return -1;
+	}
+#endif
+	h->m_evt = evt;
+	return 0;
+}
+
+int Reactor::Del( sock_t fd )
+{
+	handler_t * h = get_handler( fd );
+	if( h == NULL )
+		return -1;
+
+#ifdef __linux__
+	struct epoll_event ev;
+	ev.events = 0;
+	ev.data.fd = fd;
+	if( epoll_ctl( m_fd, EPOLL_CTL_DEL, fd, &ev ) < 0 )
+		PR_DEBUG( "epoll_ctl() del fd %d failed, errno %d", fd, errno );
+#else
+	std::vector< sock_t >::iterator it = std::find( m_fds.begin(), m_fds.end(), fd );
+	if( it != m_fds.end() ) {
+		*it = m_fds.back();
+		m_fds.pop_back();
+	}
+#endif
+	h->m_cb = NULL;
+	h->m_arg = NULL;
+	h->m_evt = 0;
+	return 0;
+}
+
+int Reactor::RunOnce( int timeout_ms )
+{
+	if( m_events == NULL )
+		return -1;
+
+	timeout_ms = m_timers.NextTimeout( timeout_ms );
+	int num = 0;
+	int i;
+#ifdef __linux__
+	struct epoll_event * evs = (struct epoll_event *)m_events;
+	int ret = epoll_wait( m_fd, evs, m_max_events, timeout_ms );
+	if( ret < 0 )
+		return errno == EINTR ? 0 : -1;
+	for( i = 0; i < ret; ++i ) {
+		sock_t fd = evs[i].data.fd;
+		if( fd == m_notify.GetFd() ) {
+			m_notify.Drain();
+			continue;
+		}
+		handler_t * h = get_handler( fd );
+		if( h == NULL )
+			continue; // deleted by previous callback
+		int evt = 0;
+		if( evs[i].events & ( EPOLLERR | EPOLLHUP ) )
+			evt = DGN_POLLIN | DGN_POLLOUT;
+		if( evs[i].events & EPOLLIN )
+			evt |= DGN_POLLIN;
+		if( evs[i].events & EPOLLOUT )
+			evt |= DGN_POLLOUT;
+		(*h->m_cb)( fd, evt, h->m_arg );
+		num++;
+	}
+#else
+	if( (int)m_fds.size() + 1 > m_max_events ) {
+		delete[] (struct pollfd *)m_events;
+		m_max_events = ( (int)m_fds.size() + 1 ) * 2;
+		m_events = new struct pollfd[m_max_events];
+	}
+	struct pollfd * pfd = (struct pollfd *)m_events;
+	int n = 0;
+	pfd[n].fd = m_notify.GetFd();
+	pfd[n].events = POLLIN;
+	pfd[n++].revents = 0;
+	for( i = 0; i < (int)m_fds.size(); ++i ) {
+		int evt = m_handlers[m_fds[i]].m_evt;
+		pfd[n].fd = m_fds[i];
+		pfd[n].events = ( ( evt & DGN_POLLIN ) ? POLLIN : 0 ) | ( ( evt & DGN_POLLOUT ) ? POLLOUT : 0 );
+		pfd[n++].revents = 0;
+	}
+	int ret = poll( pfd, n, timeout_ms );
+	if( ret < 0 )
+		return errno == EINTR ? 0 : -1;
+	if( pfd[0].revents != 0 )
+		m_notify.Drain();
+	for( i = 1; i < n && ret > 0; ++i ) {
+		if( pfd[i].revents == 0 )
+			continue;
+		handler_t * h = get_handler( pfd[i].fd );
+		if( h == NULL )
+			continue;
+		int evt = 0;
+		if( pfd[i].revents & ( POLLERR | POLLHUP | POLLNVAL ) )
+			evt = DGN_POLLIN | DGN_POLLOUT;
+		if( pfd[i].revents & POLLIN )
+			evt |= DGN_POLLIN;
+		if( pfd[i].revents & POLLOUT )
+			evt |= DGN_POLLOUT;
+		(*h->m_cb)( pfd[i].fd, evt, h->m_arg );
+		num++;
+	}
+#endif
+	num += m_timers.Expire();
+	return num;
+}
+
+#endif // _WIN32
+
+int Reactor::Run( Thread * th )
+{
+	// stop flag of thread has no wakeup, check it periodically
+	int timeout_ms = th != NULL ? 100 : -1;
+	while( ! m_stop && ( th == NULL || ! th->HasStopFlag() ) ) {
+		if( RunOnce( timeout_ms ) < 0 ) {
+			PR_ERR( "reactor run failed" );
+			m_stop = 0;
+			return -1;
+		}
+	}
+	m_stop = 0;
+	return 0;
+}
+
+void Reactor::Stop()
+{
+	m_stop = 1;
+	m_notify.Notify();
+	return;
+}
+
+////////////////
+END_NS_DGN
+
@@ -0,0 +1,93 @@
+// Reactor.h : event loop for non-blocking sockets
+// Copyright (C) 2011 ~ 2023 drangon <drangon.zhou (at) gmail.com>
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+
+#ifndef INCLUDED_DGN_REACTOR_H
+#define INCLUDED_DGN_REACTOR_H
+
+#include <dgn/Socket.h>
+#include <dgn/Thread.h>
+#include <dgn/TimerWheel.h>
+
+#include <vector>
+
+BEGIN_NS_DGN
+////////////////
+
+// evt is DGN_POLLIN / DGN_POLLOUT, error and hangup reported as both
+typedef void (* reactor_cb_t)( sock_t fd, int evt, void * arg );
+
+// Note :
+// epoll on linux, poll on other unix, not support on win32 ( Init() return -1 )
+// Add/Mod/Del/RunOnce must call in loop thread, Wakeup()/Stop() can call from any thread
+// Del() inside callback is safe, pending events of the deleted fd are dropped
+// timers of GetTimers() called in RunOnce() after fd events, poll timeout shortened to next timer
+
+class DGN_LIB_API Reactor
+{
+public:
+	Reactor();
+	~Reactor();
+
+	Reactor( const Reactor & r ) = delete;
+	Reactor & operator = ( const Reactor & r ) = delete;
+
+	int Init( int max_events = 256 );
+	void Fini();
+
+	// fd not own by reactor, Del() before close it
+	int Add( sock_t fd, int evt, reactor_cb_t cb, void * arg );
+	int Mod( sock_t fd, int evt );
+	int Del( sock_t fd );
+
+	// wait at most timeout_ms ( < 0 for ever ), return callback number ( include timers ), < 0 if error
+	int RunOnce( int timeout_ms );
+	// loop RunOnce() until Stop() or th stop flag, th can be NULL
+	int Run( Thread * th = NULL );
+	void Stop();
+	void Wakeup() { m_notify.Notify(); }
+
+	// use in loop thread only
+	TimerWheel * GetTimers() { return &m_timers; }
+
+protected:
+	struct handler_t {
+		handler_t() : m_cb( NULL ), m_arg( NULL ), m_evt( 0 ) {}
+
+		reactor_cb_t m_cb; // NULL if not added
+		void * m_arg;
+		int m_evt;
+	};
+
+	handler_t * get_handler( sock_t fd ) {
+		return ( (size_t)fd < m_handlers.size() && m_handlers[fd].m_cb != NULL ) ? &m_handlers[fd] : NULL;
+	}
+
+protected:
+	int m_fd; // epoll fd, -1 for poll
+	int m_max_events;
+	void * m_events; // epoll_event or pollfd array
+	std::vector< handler_t > m_handlers; // index by fd
+	std::vector< sock_t > m_fds; // added fds for poll
+	PollNotify m_notify;
+	TimerWheel m_timers;
+	volatile int m_stop;
+};
+
+////////////////
+END_NS_DGN
+
+#endif // INCLUDED_DGN_REACTOR_H
+
@@ -0,0 +1,296 @@
+// Resolver.cpp : async dns resolver with cache
+// Copyright (C) 2011 ~ 2023 drangon <drangon.zhou (at) gmail.com>
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+
+#include <dgn/Resolver.h>
+#include <dgn/Time.h>
+#include <dgn/Logger.h>
+
+#include <utility>
+
+BEGIN_NS_DGN
+////////////////
+
+Resolver::Resolver()
+	: m_threads( NULL ), m_thread_num( 0 )
+	, m_ttl_ms( 60000 ), m_neg_ttl_ms( 5000 ), m_max_cache( 10000 )
+{
+}
+
+Resolver::~Resolver()
+{
+	Fini();
+}
+
+int Resolver::Init( int thread_num, int ttl_ms, int neg_ttl_ms, int max_cache )
+{
+	if( m_threads != NULL ) {
+		PR_ERR( "resolver already init" );
+		return -1;
+	}
+
+	m_thread_num = thread_num <= 0 ? 1 : thread_num;
+	m_ttl_ms = ttl_ms < 0 ? 0 : ttl_ms;
+	m_neg_ttl_ms = neg_ttl_ms < 0 ? 0 : neg_ttl_ms;
+	m_max_cache = max_cache <= 0 ? 1 : max_cache;
+
+	m_threads = new ThreadObjTP< Resolver >[m_thread_num];
+	int i;
+	for( i = 0; i < m_thread_num; ++i ) {
+		m_threads[i].SetFunc( &Resolver::run_resolve, this );
+		if( m_threads[i].Start() < 0 ) {
+			PR_ERR( "start resolve thread failed" );
+			Fini();
+			return -1;
+		}
+	}
+	return 0;
+}
+
+void Resolver::Fini()
+{
+	if( m_threads == NULL )
+		return;
+
+	int i;
+	for( i = 0; i < m_thread_num; ++i )
+		m_threads[i].SignalStop();
+	m_cond.Signal( 1 );
+	for( i = 0; i < m_thread_num; ++i )
+		m_threads[i].WaitStop();
+	delete[] m_threads, m_threads = NULL;
+	m_thread_num = 0;
+
+	// fail all pending request
+	std::vector< std::pair< CStr, std::vector< pending_cb_t > > > pendings;
+	m_lock.Lock();
+	m_queue.clear();
+	std::map< CStr, cache_item_t >::iterator it;
+	for( it = m_cache.begin(); it != m_cache.end(); ) {
+		if( it->second.m_resolving ) {
+			pendings.push_back( std::make_pair( it->first, std::move( it->second.m_cbs ) ) );
+			m_cache.erase( it++ );
+		}
+		else {
+			++it;
+		}
+	}
+	m_lock.UnLock();
+
+	for( i = 0; i < (int)pendings.size(); ++i )
+		do_callback( pendings[i].first, NULL, pendings[i].second );
+	return;
+}
+
+int Resolver::Lookup( const char * host, int port, Endpoint * ep )
+{
+	if( host == NULL || host[0] == '\0' )
+		return -1;
+
+	CStr key( host );
+	MutexGuard guard( &m_lock );
+	int ret = lookup_cache( key, port, ep );
+	if( ret != 0 || m_threads == NULL )
+		return ret;
+	add_pending( key, NULL );
+	return 0;
+}
+
+int Resolver::Resolve( const char * host, int port, Endpoint * ep )
+{
+	if( host == NULL || host[0] == '\0' )
+		return -1;
+
+	CStr key( host );
+	m_lock.Lock();
+	int ret = lookup_cache( key, port, ep );
+	m_lock.UnLock();
+	if( ret != 0 )
+		return ret > 0 ? 0 : -1;
+
+	Endpoint tmp;
+	ret = tmp.Set( host, 0 );
+	std::vector< pending_cb_t > cbs;
+	m_lock.Lock();
+	update_cache( key, ret == 0 ? &tmp : NULL, &cbs );
+	m_lock.UnLock();
+	do_callback( key, ret == 0 ? &tmp : NULL, cbs );
+
+	if( ret < 0 )
+		return -1;
+	*ep = tmp;
+	ep->SetPort( port );
+	return 0;
+}
+
+int Resolver::ResolveAsync( const char * host, int port, resolve_cb_t cb, void * arg )
+{
+	if( host == NULL || host[0] == '\0' || cb == NULL )
+		return -1;
+
+	Endpoint ep;
+	if( m_threads == NULL ) {
+		// not init, resolve at once
+		int ret = Resolve( host, port, &ep );
+		(*cb)( host, ret == 0 ? &ep : NULL, arg );
+		return 0;
+	}
+
+	CStr key( host );
+	m_lock.Lock();
+	int ret = lookup_cache( key, port, &ep );
+	if( ret != 0 ) {
+		m_lock.UnLock();
+		(*cb)( host, ret > 0 ? &ep : NULL, arg );
+		return 0;
+	}
+	pending_cb_t pcb;
+	pcb.m_port = port;
+	pcb.m_cb = cb;
+	pcb.m_arg = arg;
+	add_pending( key, &pcb );
+	m_lock.UnLock();
+	return 0;
+}
+
+void Resolver::ClearCache()
+{
+	MutexGuard guard( &m_lock );
+	std::map< CStr, cache_item_t >::iterator it;
+	for( it = m_cache.begin(); it != m_cache.end(); ) {
+		if( it->second.m_resolving )
+			++it;
+		else
+			m_cache.erase( it++ );
+	}
+	return;
+}
+
+int Resolver::CacheSize()
+{
+	MutexGuard guard( &m_lock );
+	return (int)m_cache.size();
+}
+
+int Resolver::run_resolve( Thread * th, void * arg )
+{
+	m_lock.Lock();
+	while( ! th->HasStopFlag() ) {
+		if( m_queue.empty() ) {
+			m_cond.Wait( &m_lock, 100 );
+			continue;
+		}
+		CStr host = std::move( m_queue.front() );
+		m_queue.pop_front();
+		m_lock.UnLock();
+
+		Endpoint ep;
+		int ret = ep.Set( host.Str(), 0 );
+		if( ret < 0 )
+			PR_DEBUG( "resolve [%s] failed", host.Str() );
+
+		std::vector< pending_cb_t > cbs;
+		m_lock.Lock();
+		update_cache( host, ret == 0 ? &ep : NULL, &cbs );
+		m_lock.UnLock();
+		do_callback( host, ret == 0 ? &ep : NULL, cbs );
+		m_lock.Lock();
+	}
+	m_lock.UnLock();
+	return 0;
+}
+
+// lock must be held, return 1 if hit, -1 if negative hit, 0 if not cached
+int Resolver::lookup_cache( const CStr & host, int port, Endpoint * ep )
+{
+	std::map< CStr, cache_item_t >::iterator it = m_cache.find( host );
+	if( it == m_cache.end() )
+		return 0;
+	cache_item_t & item = it->second;
+	if( item.m_expire == 0 || (int)( item.m_expire - Time::Tick() ) <= 0 )
+		return 0;
+	if( ! item.m_ep.IsValid() )
+		return -1;
+	*ep = item.m_ep;
+	ep->SetPort( port );
+	return 1;
+}
+
+// lock must be held, take out pending callbacks
+void Resolver::update_cache( const CStr & host, const Endpoint * ep, std::vector< pending_cb_t > * cbs )
+{
+	if( (int)m_cache.size() >= m_max_cache ) {
+		// purge expired items first, then any idle item
+		uint32_t now = Time::Tick();
+		std::map< CStr, cache_item_t >::iterator it;
+		for( it = m_cache.begin(); it != m_cache.end(); ) {
+			if( ! it->second.m_resolving && (int)( it->second.m_expire - now ) <= 0 )
+				m_cache.erase( it++ );
+			else
+				++it;
+		}
+		for( it = m_cache.begin(); it != m_cache.end() && (int)m_cache.size() >= m_max_cache; ) {
+			if( ! it->second.m_resolving && it->first != host )
+				m_cache.erase( it++ );
+			else
+				++it;
+		}
+	}
+
+	cache_item_t & item = m_cache[host];
+	item.m_resolving = 0;
+	if( ep != NULL )
+		item.m_ep = *ep;
+	else
+		item.m_ep.Clear();
+	item.m_expire = Time::Tick() + ( ep != NULL ? m_ttl_ms : m_neg_ttl_ms );
+	if( item.m_expire == 0 )
+		item.m_expire = 1;
+	cbs->swap( item.m_cbs );
+	return;
+}
+
+// lock must be held, queue host if not already resolving
+void Resolver::add_pending( const CStr & host, const pending_cb_t * pcb )
+{
+	cache_item_t & item = m_cache[host];
+	if( pcb != NULL )
+		item.m_cbs.push_back( *pcb );
+	if( ! item.m_resolving ) {
+		item.m_resolving = 1;
+		m_queue.push_back( host );
+		m_cond.Signal( 1 );
+	}
+	return;
+}
+
+void Resolver::do_callback( const CStr & host, const Endpoint * ep, std::vector< pending_cb_t > & cbs )
+{
+	int i;
+	for( i = 0; i < (int)cbs.size(); ++i ) {
+		if( ep == NULL ) {
+			(*cbs[i].m_cb)( host.Str(), NULL, cbs[i].m_arg );
+			continue;
+		}
+		Endpoint tmp = *ep;
+		tmp.SetPort( cbs[i].m_port );
+		(*cbs[i].m_cb)( host.Str(), &tmp, cbs[i].m_arg );
+	}
+	return;
+}
+
+////////////////
+END_NS_DGN
+
@@ -0,0 +1,102 @@
+// Resolver.h : async dns resolver with cache
+// Copyright (C) 2011 ~ 2023 drangon <drangon.zhou (at) gmail.com>
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+
+#ifndef INCLUDED_DGN_RESOLVER_H
+#define INCLUDED_DGN_RESOLVER_H
+
+#include <dgn/CStr.h>
+#include <dgn/Socket.h>
+#include <dgn/Thread.h>
+
+#include <map>
+#include <deque>
+#include <vector>
+
+BEGIN_NS_DGN
+////////////////
+
+// Note :
+// resolve by Socket::GetHostAddr() in background threads, cache by host name
+// success result keep ttl_ms, failed result keep neg_ttl_ms ( negative cache )
+// getaddrinfo() does not give record ttl, so ttl is fixed by Init()
+
+// called in resolver thread ( or caller thread when cache hit ), ep is NULL if resolve failed
+typedef void (* resolve_cb_t)( const char * host, const Endpoint * ep, void * arg );
+
+class DGN_LIB_API Resolver
+{
+public:
+	Resolver();
+	~Resolver();
+
+	Resolver( const Resolver & rs ) = delete;
+	Resolver & operator = ( const Resolver & rs ) = delete;
+
+	int Init( int thread_num = 2, int ttl_ms = 60000, int neg_ttl_ms = 5000, int max_cache = 10000 );
+	void Fini(); // pending callback will be called with NULL ep
+
+	// cache only, never block, return 1 if hit, < 0 if negative cached
+	// return 0 if not cached, and start background resolve
+	int Lookup( const char * host, int port, Endpoint * ep );
+	// cache first, resolve in current thread if not cached, return 0 if success
+	int Resolve( const char * host, int port, Endpoint * ep );
+	// cache first, callback at once if cached, or callback in resolver thread later
+	int ResolveAsync( const char * host, int port, resolve_cb_t cb, void * arg );
+
+	void ClearCache();
+	int CacheSize();
+
+protected:
+	struct pending_cb_t {
+		int m_port;
+		resolve_cb_t m_cb;
+		void * m_arg;
+	};
+
+	static void do_callback( const CStr & host, const Endpoint * ep, std::vector< pending_cb_t > & cbs );
+
+	int run_resolve( Thread * th, void * arg );
+	int lookup_cache( const CStr & host, int port, Endpoint * ep );
+	void update_cache( const CStr & host, const Endpoint * ep, std::vector< pending_cb_t > * cbs );
+	void add_pending( const CStr & host, const pending_cb_t * pcb );
+
+protected:
+	struct cache_item_t {
+		cache_item_t() : m_expire( 0 ), m_resolving( 0 ) {}
+
+		Endpoint m_ep; // port 0, valid if resolve success
+		uint32_t m_expire; // Time::Tick()
+		int m_resolving;
+		std::vector< pending_cb_t > m_cbs;
+	};
+
+	Mutex m_lock;
+	CondVal m_cond;
+	std::map< CStr, cache_item_t > m_cache;
+	std::deque< CStr > m_queue;
+
+	ThreadObjTP< Resolver > * m_threads;
+	int m_thread_num;
+	int m_ttl_ms;
+	int m_neg_ttl_ms;
+	int m_max_cache;
+};
+
+////////////////
+END_NS_DGN
+
+#endif // INCLUDED_DGN_RESOLVER_H
+
@@ -0,0 +1,736 @@
+// Rpc.cpp : length-prefixed binary rpc with JsonVal body
+// Copyright (C) 2011 ~ 2023 drangon <drangon.zhou (at) gmail.com>
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+
+
+#include <dgn/Rpc.h>
+#include <dgn/BufferedSocket.h>
+#include <dgn/Time.h>
+#include <dgn/Logger.h>
+
+#include <string.h>
+
+#include <vector>
+
+#define DGN_RPC_CHECK_MS	100 // client timeout check interval
+#define DGN_RPC_RBUF_SIZE	65536
+#define DGN_RPC_MAX_PENDING_OUT	( 256 * 1024 ) // stop handle pipelined requests until flushed
+#define DGN_RPC_ACCEPT_PER_EVENT	64
+
+BEGIN_NS_DGN
+////////////////
+
+static void put_u32( char * p, uint32_t v )
+{
+	p[0] = (char)( v >> 24 );
+	p[1] = (char)( v >> 16 );
+	p[2] = (char)( v >> 8 );
+	p[3] = (char)v;
+	return;
+}
+
+static uint32_t get_u32( const char * buf )
+{
+	const unsigned char * p = (const unsigned char *)buf;
+	return ( (uint32_t)p[0] << 24 ) | ( (uint32_t)p[1] << 16 ) | ( (uint32_t)p[2] << 8 ) | p[3];
+}
+
+// CStr::Append() stop at '\0', data may be binary
+static void append_bin( CStr * s, const char * buf, int len )
+{
+	int old = s->Len();
+	s->Reserve( old + len + 1 );
+	memcpy( s->GetRaw() + old, buf, len );
+	s->ReleaseRaw( old + len );
+	return;
+}
+
+////////////////
+////	RpcFrame
+
+static int pack_frame( CStr * out, const char * hdr, int hdr_len, const char * method, int mlen, const JsonVal & body )
+{
+	int start = out->Len();
+	char len[4] = { 0 }; // patched after body serialized
+	append_bin( out, len, 4 );
+	append_bin( out, hdr, hdr_len );
+	if( mlen > 0 )
+		append_bin( out, method, mlen );
+	if( body.GetType() != JSONVAL_TYPE_NULL && body.ToBuf( out ) < 0 ) {
+		out->ReleaseRaw( start );
+		return -1;
+	}
+	int flen = out->Len() - start - 4;
+	if( flen > DGN_RPC_MAX_FRAME ) {
+		PR_DEBUG( "rpc frame len %d exceed max", flen );
+		out->ReleaseRaw( start );
+		return -1;
+	}
+	put_u32( out->GetRaw() + start, (uint32_t)flen );
+	return 0;
+}
+
+int RpcFrame::PackRequest( CStr * out, uint32_t id, const char * method, const JsonVal & body )
+{
+	int mlen = method != NULL ? (int)strlen( method ) : 0;
+	if( mlen == 0 || mlen > DGN_RPC_MAX_METHOD ) {
+		PR_DEBUG( "invalid rpc method len %d", mlen );
+		return -1;
+	}
+	char hdr[6];
+	hdr[0] = DGN_RPC_TYPE_REQUEST;
+	put_u32( hdr + 1, id );
+	hdr[5] = (char)mlen;
+	return pack_frame( out, hdr, 6, method, mlen, body );
+}
+
+int RpcFrame::PackResponse( CStr * out, uint32_t id, int code, const JsonVal & body )
+{
+	char hdr[9];
+	hdr[0] = DGN_RPC_TYPE_RESPONSE;
+	put_u32( hdr + 1, id );
+	put_u32( hdr + 5, (uint32_t)code );
+	return pack_frame( out, hdr, 9, NULL, 0, body );
+}
+
+int RpcFrame::Unpack( const char * buf, int len, RpcMsg * msg )
+{
+	if( len < 5 )
+		return -1;
+	msg->m_type = (unsigned char)buf[0];
+	msg->m_id = get_u32( buf + 1 );
+	msg->m_code = 0;
+	msg->m_method.ReleaseRaw( 0 );
+	int off;
+	if( msg->m_type == DGN_RPC_TYPE_REQUEST ) {
+		if( len < 6 )
+			return -1;
+		int mlen = (unsigned char)buf[5];
+		if( mlen == 0 || len < 6 + mlen )
+			return -1;
+		msg->m_method.Reserve( mlen + 1 );
+		memcpy( msg->m_method.GetRaw(), buf + 6, mlen );
+		msg->m_method.ReleaseRaw( mlen );
+		off = 6 + mlen;
+	}
+	else if( msg->m_type == DGN_RPC_TYPE_RESPONSE ) {
+		if( len < 9 )
+			return -1;
+		msg->m_code = (int)get_u32( buf + 5 );
+		off = 9;
+	}
+	else
+		return -1;
+
+	if( off == len ) {
+		msg->m_body.SetNull();
+		return 0;
+	}
+	// parser need '\0' terminated string
+	CStr json;
+	json.Reserve( len - off + 1 );
+	memcpy( json.GetRaw(), buf + off, len - off );
+	json.ReleaseRaw( len - off );
+	if( msg->m_body.FromBuf( json ) < 0 ) {
+		PR_DEBUG( "rpc frame id %u bad json body", msg->m_id );
+		return -1;
+	}
+	return 0;
+}
+
+////////////////
+////	RpcClient
+
+struct RpcClient::pending_t
+{
+	pending_t() : m_id( 0 ), m_deadline( 0 ), m_cb( NULL ), m_arg( NULL ), m_code( 0 ), m_done( 0 ) {}
+
+	uint32_t m_id;
+	uint32_t m_deadline; // Time::Tick()
+	rpc_callback_t m_cb; // NULL for sync call
+	void * m_arg;
+	// sync call only, guarded by m_lock
+	CondVal m_cond;
+	int m_code;
+	JsonVal m_rsp;
+	int m_done;
+};
+
+RpcClient::RpcClient()
+	: m_next_id( 1 ), m_broken( 0 )
+{
+	m_thread.SetFunc( &RpcClient::recv_loop, this );
+}
+
+RpcClient::~RpcClient()
+{
+	Close();
+}
+
+int RpcClient::Connect( const char * host, int port, int timeout_ms )
+{
+	Endpoint ep;
+	if( ep.Set( host, port ) < 0 ) {
+		PR_ERR( "resolve [%s] failed", host );
+		return -1;
+	}
+	return Connect( ep, timeout_ms );
+}
+
+int RpcClient::Connect( const Endpoint & ep, int timeout_ms )
+{
+	Close();
+	m_sk.Cancel( 0 );
+	m_sk.EnableNotify(); // Close() wake receive thread at once
+	m_sk.SetTimeout( timeout_ms );
+	if( m_sk.Connect( ep ) != DGN_SOCKET_CONNECT_OK ) {
+		PR_DEBUG( "rpc connect [%s] failed", ep.ToStr().Str() );
+		m_sk.Close();
+		return -1;
+	}
+	m_sk.SetNoDelay( 1 ); // just fail on unix socket
+	m_sk.SetTimeout( DGN_RPC_CHECK_MS );
+	m_broken = 0;
+	if( m_thread.Start() < 0 ) {
+		PR_ERR( "rpc client start receive thread failed" );
+		m_sk.Close();
+		return -1;
+	}
+	return 0;
+}
+
+void RpcClient::Close()
+{
+	m_broken = 1;
+	m_thread.SignalStop();
+	m_sk.Cancel();
+	m_thread.WaitStop();
+	{
+		MutexGuard guard( &m_send_lock );
+		m_sk.Close();
+	}
+	fail_all( DGN_RPC_ERR_CONN );
+	return;
+}
+
+int RpcClient::Call( const char * method, const JsonVal & req, JsonVal * rsp, int timeout_ms )
+{
+	pending_t p;
+	int ret = send_call( &p, method, req, timeout_ms );
+	if( ret < 0 )
+		return ret;
+
+	MutexGuard guard( &m_lock );
+	while( ! p.m_done ) {
+		int left = (int)( p.m_deadline - Time::Tick() );
+		if( left <= 0 ) {
+			if( m_pending.erase( p.m_id ) > 0 )
+				return DGN_RPC_ERR_TIMEOUT;
+			left = DGN_RPC_CHECK_MS; // being finished by receive thread, wait for it
+		}
+		p.m_cond.Wait( &m_lock, left );
+	}
+	if( rsp != NULL )
+		*rsp = std::move( p.m_rsp );
+	return p.m_code;
+}
+
+int RpcClient::CallAsync( const char * method, const JsonVal & req, rpc_callback_t cb, void * arg, int timeout_ms )
+{
+	if( cb == NULL )
+		return -1;
+	pending_t * p = new pending_t();
+	p->m_cb = cb;
+	p->m_arg = arg;
+	int ret = send_call( p, method, req, timeout_ms );
+	if( ret < 0 )
+		delete p;
+	return ret;
+}
+
+int RpcClient::GetPendingNum()
+{
+	MutexGuard guard( &m_lock );
+	return (int)m_pending.size();
+}
+
+int RpcClient::send_call( pending_t * p, const char * method, const JsonVal & req, int timeout_ms )
+{
+	if( ! IsConnected() )
+		return DGN_RPC_ERR_CONN;
+
+	CStr frame;
+	{
+		MutexGuard guard( &m_lock );
+		p->m_id = m_next_id++;
+		if( m_next_id == 0 )
+			m_next_id = 1;
+	}
+	if( RpcFrame::PackRequest( &frame, p->m_id, method, req ) < 0 )
+		return DGN_RPC_ERR_BAD_FRAME;
+	p->m_deadline = Time::Tick() + ( timeout_ms > 0 ? timeout_ms : 0 );
+	{
+		// registered before send, response may come before Send() return
+		MutexGuard guard( &m_lock );
+		m_pending[p->m_id] = p;
+	}
+
+	int ret = 0;
+	{
+		MutexGuard guard( &m_send_lock );
+		int sent = 0;
+		while( sent < frame.Len() && ! m_broken ) {
+			int n = m_sk.Send( frame.Str() + sent, frame.Len() - sent );
+			if( n < 0 )
+				break;
+			sent += n;
+			if( (int)( Time::Tick() - p->m_deadline ) >= 0 )
+				break;
+		}
+		if( sent == 0 )
+			ret = m_broken ? DGN_RPC_ERR_CONN : DGN_RPC_ERR_TIMEOUT;
+		else if( sent < frame.Len() ) {
+			// half frame on the wire, stream can not be used any more
+			PR_DEBUG( "rpc send call id %u broken after %d bytes", p->m_id, sent );
+			m_broken = 1;
+			m_sk.Cancel();
+			ret = DGN_RPC_ERR_CONN;
+		}
+	}
+	if( ret < 0 ) {
+		MutexGuard guard( &m_lock );
+		if( m_pending.erase( p->m_id ) == 0 )
+			return 0; // already finished by receive thread with error
+	}
+	return ret;
+}
+
+void RpcClient::complete( uint32_t id, int code, const JsonVal & rsp )
+{
+	pending_t * p;
+	{
+		MutexGuard guard( &m_lock );
+		std::map< uint32_t, pending_t * >::iterator it = m_pending.find( id );
+		if( it == m_pending.end() ) {
+			PR_DEBUG( "rpc response id %u not pending, maybe timeout", id );
+			return;
+		}
+		p = it->second;
+		m_pending.erase( it );
+	}
+	finish( p, code, rsp );
+	return;
+}
+
+void RpcClient::finish( pending_t * p, int code, const JsonVal & rsp )
+{
+	if( p->m_cb != NULL ) {
+		// outside lock, callback may issue new calls
+		(*p->m_cb)( code, rsp, p->m_arg );
+		delete p;
+		return;
+	}
+	MutexGuard guard( &m_lock );
+	p->m_code = code;
+	p->m_rsp = rsp;
+	p->m_done = 1;
+	p->m_cond.Signal();
+	return;
+}
+
+void RpcClient::check_timeout()
+{
+	// sync calls check their own deadline
+	std::vector< pending_t * > expired;
+	{
+		MutexGuard guard( &m_lock );
+		uint32_t now = Time::Tick();
+		std::map< uint32_t, pending_t * >::iterator it = m_pending.begin();
+		while( it != m_pending.end() ) {
+			pending_t * p = it->second;
+			if( p->m_cb != NULL && (int)( now - p->m_deadline ) >= 0 ) {
+				expired.push_back( p );
+				it = m_pending.erase( it );
+			}
+			else
+				++it;
+		}
+	}
+	for( size_t i = 0; i < expired.size(); ++i )
+		finish( expired[i], DGN_RPC_ERR_TIMEOUT, JsonVal::NullJsonVal() );
+	return;
+}
+
+void RpcClient::fail_all( int code )
+{
+	std::map< uint32_t, pending_t * > all;
+	{
+		MutexGuard guard( &m_lock );
+		all.swap( m_pending );
+	}
+	std::map< uint32_t, pending_t * >::iterator it;
+	for( it = all.begin(); it != all.end(); ++it )
+		finish( it->second, code, JsonVal::NullJsonVal() );
+	return;
+}
+
+int RpcClient::recv_loop( Thread * th, void * arg )
+{
+	BufferedSocket bs( &m_sk, DGN_RPC_RBUF_SIZE );
+	CStr frame;
+	RpcMsg msg;
+	uint32_t last_check = Time::Tick();
+	while( ! th->HasStopFlag() && ! m_broken ) {
+		int ret = bs.ReadFrame( &frame, DGN_RPC_MAX_FRAME );
+		if( ret < 0 ) {
+			PR_DEBUG( "rpc client connection closed" );
+			break;
+		}
+		if( ret > 0 ) {
+			if( RpcFrame::Unpack( frame.Str(), frame.Len(), &msg ) < 0 || msg.m_type != DGN_RPC_TYPE_RESPONSE ) {
+				PR_DEBUG( "rpc client got bad frame" );
+				break;
+			}
+			complete( msg.m_id, msg.m_code, msg.m_body );
+		}
+		uint32_t now = Time::Tick();
+		if( (int)( now - last_check ) >= DGN_RPC_CHECK_MS ) {
+			last_check = now;
+			check_timeout();
+		}
+	}
+	m_broken = 1;
+	fail_all( DGN_RPC_ERR_CONN );
+	return 0;
+}
+
+////////////////
+////	RpcSvr
+
+struct RpcSvr::conn_t
+{
+	conn_t( RpcSvr * svr ) : m_svr( svr ), m_prev( NULL ), m_next( NULL )
+		, m_rbuf( NULL ), m_rcap( 0 ), m_rhead( 0 ), m_rtail( 0 ), m_out_off( 0 ), m_closing( 0 ), m_evt( DGN_POLLIN ) {}
+	~conn_t() { delete[] m_rbuf, m_rbuf = NULL; }
+
+	RpcSvr * m_svr;
+	conn_t * m_prev;
+	conn_t * m_next;
+	Socket m_sk;
+
+	char * m_rbuf;
+	int m_rcap;
+	int m_rhead;
+	int m_rtail;
+
+	CStr m_out;
+	int m_out_off;
+	int m_closing;
+	int m_evt;
+};
+
+RpcSvr::RpcSvr()
+	: m_reactor( NULL ), m_own_reactor( 0 ), m_max_frame_size( DGN_RPC_MAX_FRAME ), m_conn_head( NULL ), m_conn_num( 0 )
+{
+	m_thread.SetFunc( &RpcSvr::run_loop, this );
+}
+
+RpcSvr::~RpcSvr()
+{
+	Fini();
+}
+
+int RpcSvr::Register( const char * method, rpc_handler_t cb, void * arg )
+{
+	int mlen = method != NULL ? (int)strlen( method ) : 0;
+	if( mlen == 0 || mlen > DGN_RPC_MAX_METHOD || cb == NULL )
+		return -1;
+	method_t & m = m_methods[CStr( method )];
+	m.m_cb = cb;
+	m.m_arg = arg;
+	return 0;
+}
+
+int RpcSvr::Init( const char * host, int port, Reactor * reactor )
+{
+	Endpoint ep;
+	if( ep.Set( host, port ) < 0 ) {
+		PR_ERR( "resolve [%s] failed", host );
+		return -1;
+	}
+	return Init( ep, reactor );
+}
+
+int RpcSvr::Init( const Endpoint & ep, Reactor * reactor )
+{
+	if( m_reactor != NULL ) {
+		PR_ERR( "rpc svr already init" );
+		return -1;
+	}
+	SockOpt opt = Socket::GetDefaultOpt();
+	opt.m_nodelay = 1; // inherited by accepted sockets, ignored for unix socket
+	if( m_listen.TcpSvr( ep, opt ) < 0 ) {
+		PR_ERR( "rpc svr listen [%s] failed", ep.ToStr().Str() );
+		return -1;
+	}
+
+	if( reactor == NULL ) {
+		m_reactor = new Reactor();
+		m_own_reactor = 1;
+		if( m_reactor->Init() < 0 ) {
+			Fini();
+			return -1;
+		}
+	}
+	else {
+		m_reactor = reactor;
+		m_own_reactor = 0;
+	}
+	if( m_reactor->Add( m_listen.GetRawSock(), DGN_POLLIN, on_accept, this ) < 0 ) {
+		PR_ERR( "rpc svr add listen socket failed" );
+		Fini();
+		return -1;
+	}
+	return 0;
+}
+
+void RpcSvr::Fini()
+{
+	Stop();
+	while( m_conn_head != NULL )
+		close_conn( m_conn_head );
+	if( m_reactor != NULL ) {
+		if( m_listen.IsValid() )
+			m_reactor->Del( m_listen.GetRawSock() );
+		if( m_own_reactor )
+			delete m_reactor;
+		m_reactor = NULL;
+	}
+	m_listen.Close();
+	return;
+}
+
+int RpcSvr::GetPort()
+{
+	char ip[DGN_IP_LEN];
+	int port = 0;
+	if( m_listen.LocalAddr( ip, &port ) < 0 )
+		return -1;
+	return port;
+}
+
+int RpcSvr::Start()
+{
+	if( ! m_own_reactor ) {
+		PR_ERR( "rpc svr start without own reactor" );
+		return -1;
+	}
+	return m_thread.Start();
+}
+
+void RpcSvr::Stop()
+{
+	m_thread.SignalStop();
+	if( m_reactor != NULL )
+		m_reactor->Wakeup();
+	m_thread.WaitStop();
+	return;
+}
+
+int RpcSvr::RunOnce( int timeout_ms )
+{
+	if( m_reactor == NULL )
+		return -1;
+	return m_reactor->RunOnce( timeout_ms );
+}
+
+int RpcSvr::run_loop( Thread * th, void * arg )
+{
+	while( ! th->HasStopFlag() ) {
+		if( RunOnce( 1000 ) < 0 ) {
+			PR_ERR( "rpc svr reactor failed" );
+			return -1;
+		}
+	}
+	return 0;
+}
+
+void RpcSvr::on_accept( sock_t fd, int evt, void * arg )
+{
+	RpcSvr * svr = (RpcSvr *)arg;
+	int i;
+	for( i = 0; i < DGN_RPC_ACCEPT_PER_EVENT; ++i ) {
+		conn_t * c = new conn_t( svr );
+		if( svr->m_listen.Accept( &c->m_sk ) <= 0 ) {
+			delete c;
+			break;
+		}
+		if( svr->m_reactor->Add( c->m_sk.GetRawSock(), DGN_POLLIN, on_conn, c ) < 0 ) {
+			delete c;
+			continue;
+		}
+		c->m_next = svr->m_conn_head;
+		if( svr->m_conn_head != NULL )
+			svr->m_conn_head->m_prev = c;
+		svr->m_conn_head = c;
+		svr->m_conn_num++;
+	}
+	return;
+}
+
+void RpcSvr::on_conn( sock_t fd, int evt, void * arg )
+{
+	conn_t * c = (conn_t *)arg;
+	c->m_svr->handle_conn( c, evt );
+	return;
+}
+
+void RpcSvr::handle_conn( conn_t * c, int evt )
+{
+	if( ( evt & DGN_POLLIN ) && ! c->m_closing ) {
+		while( 1 ) {
+			if( c->m_rtail == c->m_rcap ) {
+				if( c->m_rhead > 0 ) {
+					memmove( c->m_rbuf, c->m_rbuf + c->m_rhead, c->m_rtail - c->m_rhead );
+					c->m_rtail -= c->m_rhead;
+					c->m_rhead = 0;
+				}
+				else {
+					// frame size already limited by process
+					int newcap = c->m_rcap > 0 ? c->m_rcap * 2 : DGN_RPC_RBUF_SIZE;
+					char * buf = new char[newcap];
+					if( c->m_rtail > 0 )
+						memcpy( buf, c->m_rbuf, c->m_rtail );
+					delete[] c->m_rbuf;
+					c->m_rbuf = buf, c->m_rcap = newcap;
+				}
+			}
+			int space = c->m_rcap - c->m_rtail;
+			int ret = c->m_sk.Recv( c->m_rbuf + c->m_rtail, 1, space );
+			if( ret < 0 ) {
+				// peer closed or error, answer what already received
+				c->m_closing = 1;
+				break;
+			}
+			c->m_rtail += ret;
+			if( ret < space )
+				break;
+		}
+	}
+
+	while( 1 ) {
+		int ret = process( c );
+		if( ret < 0 || flush( c ) < 0 ) {
+			close_conn( c );
+			return;
+		}
+		// stopped by pending output limit but all flushed, go on
+		if( ret == 0 || c->m_out_off < c->m_out.Len() )
+			break;
+	}
+
+	int want = DGN_POLLIN;
+	if( c->m_out_off < c->m_out.Len() )
+		want = DGN_POLLOUT; // stop reading until flushed
+	else if( c->m_closing ) {
+		close_conn( c );
+		return;
+	}
+	if( want != c->m_evt ) {
+		m_reactor->Mod( c->m_sk.GetRawSock(), want );
+		c->m_evt = want;
+	}
+	return;
+}
+
+int RpcSvr::process( conn_t * c )
+{
+	RpcMsg msg;
+	while( c->m_rtail - c->m_rhead >= 4 ) {
+		if( c->m_out.Len() - c->m_out_off >= DGN_RPC_MAX_PENDING_OUT )
+			return 1;
+		const char * p = c->m_rbuf + c->m_rhead;
+		uint32_t len = get_u32( p );
+		if( len > (uint32_t)m_max_frame_size ) {
+			PR_DEBUG( "rpc frame len %u exceed max len %d", len, m_max_frame_size );
+			return -1;
+		}
+		if( c->m_rtail - c->m_rhead < 4 + (int)len )
+			break;
+		if( RpcFrame::Unpack( p + 4, (int)len, &msg ) < 0 || msg.m_type != DGN_RPC_TYPE_REQUEST ) {
+			PR_DEBUG( "rpc svr got bad frame" );
+			return -1;
+		}
+		c->m_rhead += 4 + (int)len;
+		dispatch( c, &msg );
+	}
+	if( c->m_rhead == c->m_rtail )
+		c->m_rhead = c->m_rtail = 0;
+	return 0;
+}
+
+void RpcSvr::dispatch( conn_t * c, RpcMsg * msg )
+{
+	JsonVal rsp;
+	int code;
+	std::map< CStr, method_t >::iterator it = m_methods.find( msg->m_method );
+	if( it == m_methods.end() ) {
+		code = DGN_RPC_ERR_NO_METHOD;
+		rsp.SetString( msg->m_method );
+	}
+	else
+		code = (*it->second.m_cb)( msg->m_body, &rsp, it->second.m_arg );
+
+	if( RpcFrame::PackResponse( &c->m_out, msg->m_id, code, rsp ) < 0 ) {
+		// caller still get an answer instead of waiting timeout
+		PR_DEBUG( "rpc method [%s] response too large", msg->m_method.Str() );
+		RpcFrame::PackResponse( &c->m_out, msg->m_id, DGN_RPC_ERR_BAD_FRAME, JsonVal::NullJsonVal() );
+	}
+	return;
+}
+
+int RpcSvr::flush( conn_t * c )
+{
+	int len = c->m_out.Len() - c->m_out_off;
+	if( len == 0 )
+		return 0;
+	int ret = c->m_sk.Send( c->m_out.Str() + c->m_out_off, len );
+	if( ret < 0 )
+		return -1;
+	c->m_out_off += ret;
+	if( c->m_out_off == c->m_out.Len() ) {
+		c->m_out.ReleaseRaw( 0 );
+		c->m_out_off = 0;
+	}
+	return 0;
+}
+
+void RpcSvr::close_conn( conn_t * c )
+{
+	m_reactor->Del( c->m_sk.GetRawSock() );
+	if( c->m_prev != NULL )
+		c->m_prev->m_next = c->m_next;
+	else
+		m_conn_head = c->m_next;
+	if( c->m_next != NULL )
+		c->m_next->m_prev = c->m_prev;
+	delete c;
+	m_conn_num--;
+	return;
+}
+
+////////////////
+END_NS_DGN
+
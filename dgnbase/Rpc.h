@@ -0,0 +1,192 @@
+// Rpc.h : length-prefixed binary rpc with JsonVal body
+// Copyright (C) 2011 ~ 2023 drangon <drangon.zhou (at) gmail.com>
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+
+
+#ifndef INCLUDED_DGN_RPC_H
+#define INCLUDED_DGN_RPC_H
+
+#include <dgn/CStr.h>
+#include <dgn/JsonVal.h>
+#include <dgn/Socket.h>
+#include <dgn/Reactor.h>
+#include <dgn/Thread.h>
+
+#include <map>
+
+BEGIN_NS_DGN
+////////////////
+
+// frame : 4 bytes big endian length of the rest, then
+//   request  : type 1 | id 4 | method len 1 | method | json body
+//   response : type 2 | id 4 | code 4 | json body
+// all integer big endian, empty body means null
+
+#define DGN_RPC_MAX_FRAME	( 16 * 1024 * 1024 )
+#define DGN_RPC_MAX_METHOD	255
+
+enum {
+	DGN_RPC_TYPE_REQUEST = 1,
+	DGN_RPC_TYPE_RESPONSE = 2,
+};
+
+// library codes are negative, handler use 0 for ok and positive for its own errors
+enum {
+	DGN_RPC_OK = 0,
+	DGN_RPC_ERR_CONN = -1,      // not connected or connection broken
+	DGN_RPC_ERR_TIMEOUT = -2,
+	DGN_RPC_ERR_NO_METHOD = -3,
+	DGN_RPC_ERR_BAD_FRAME = -4,
+};
+
+struct DGN_LIB_API RpcMsg
+{
+	RpcMsg() : m_type( 0 ), m_id( 0 ), m_code( 0 ) {}
+
+	int m_type;
+	uint32_t m_id;
+	int m_code;    // response only
+	CStr m_method; // request only
+	JsonVal m_body;
+};
+
+class DGN_LIB_API RpcFrame
+{
+public:
+	// append whole frame with length prefix to out
+	static int PackRequest( CStr * out, uint32_t id, const char * method, const JsonVal & body );
+	static int PackResponse( CStr * out, uint32_t id, int code, const JsonVal & body );
+	// buf is frame without length prefix, return < 0 if malformed
+	static int Unpack( const char * buf, int len, RpcMsg * msg );
+};
+
+////////////////
+////	client
+
+// called once, in client receive thread, or in caller thread if send failed
+typedef void (* rpc_callback_t)( int code, const JsonVal & rsp, void * arg );
+
+// Note :
+// one connection shared by all caller threads, calls multiplexed by request id,
+// requests pipelined without waiting, responses matched in any order
+// a receive thread read responses, check timeouts and run async callbacks
+class DGN_LIB_API RpcClient
+{
+public:
+	RpcClient();
+	~RpcClient();
+
+	RpcClient( const RpcClient & cli ) = delete;
+	RpcClient & operator = ( const RpcClient & cli ) = delete;
+
+	int Connect( const char * host, int port, int timeout_ms = 3000 );
+	int Connect( const Endpoint & ep, int timeout_ms = 3000 );
+	void Close(); // pending calls fail with DGN_RPC_ERR_CONN
+	bool IsConnected() const { return m_sk.IsValid() && ! m_broken; }
+
+	// return code from handler or DGN_RPC_ERR_xxx, rsp is result or error detail
+	int Call( const char * method, const JsonVal & req, JsonVal * rsp, int timeout_ms = 3000 );
+	// return 0 if sent, cb not called then if < 0 returned
+	int CallAsync( const char * method, const JsonVal & req, rpc_callback_t cb, void * arg, int timeout_ms = 3000 );
+	int GetPendingNum();
+
+protected:
+	struct pending_t;
+
+	int recv_loop( Thread * th, void * arg );
+	int send_call( pending_t * p, const char * method, const JsonVal & req, int timeout_ms );
+	void complete( uint32_t id, int code, const JsonVal & rsp );
+	void finish( pending_t * p, int code, const JsonVal & rsp ); // p already removed from m_pending
+	void check_timeout();
+	void fail_all( int code );
+
+protected:
+	Socket m_sk;
+	ThreadObjTP< RpcClient > m_thread;
+	Mutex m_send_lock; // one frame at a time
+	Mutex m_lock;      // m_pending and sync call wakeup
+	std::map< uint32_t, pending_t * > m_pending;
+	uint32_t m_next_id;
+	volatile int m_broken;
+};
+
+////////////////
+////	server
+
+// return 0 for ok, positive for own error code, rsp sent back in both case
+typedef int (* rpc_handler_t)( const JsonVal & req, JsonVal * rsp, void * arg );
+
+// Note :
+// driven by Reactor like HttpSvr, handler called in reactor thread and should not block
+// pipelined requests of one connection handled in order, responses coalesced into one send
+class DGN_LIB_API RpcSvr
+{
+public:
+	RpcSvr();
+	~RpcSvr();
+
+	RpcSvr( const RpcSvr & svr ) = delete;
+	RpcSvr & operator = ( const RpcSvr & svr ) = delete;
+
+	// call before Init()
+	int Register( const char * method, rpc_handler_t cb, void * arg );
+	void SetLimit( int max_frame_size = DGN_RPC_MAX_FRAME ) { m_max_frame_size = max_frame_size; }
+
+	int Init( const char * host, int port, Reactor * reactor = NULL );
+	int Init( const Endpoint & ep, Reactor * reactor = NULL );
+	void Fini();
+
+	int GetPort();
+	int GetConnNum() const { return m_conn_num; }
+
+	int Start(); // start thread to run own reactor
+	void Stop();
+	int RunOnce( int timeout_ms );
+
+protected:
+	struct conn_t;
+	struct method_t
+	{
+		rpc_handler_t m_cb;
+		void * m_arg;
+	};
+
+	static void on_accept( sock_t fd, int evt, void * arg );
+	static void on_conn( sock_t fd, int evt, void * arg );
+	int run_loop( Thread * th, void * arg );
+
+	void handle_conn( conn_t * c, int evt );
+	int process( conn_t * c );
+	void dispatch( conn_t * c, RpcMsg * msg );
+	int flush( conn_t * c );
+	void close_conn( conn_t * c );
+
+protected:
+	Socket m_listen;
+	Reactor * m_reactor;
+	int m_own_reactor;
+	ThreadObjTP< RpcSvr > m_thread;
+	std::map< CStr, method_t > m_methods;
+	int m_max_frame_size;
+
+	conn_t * m_conn_head;
+	int m_conn_num;
+};
+
+////////////////
+END_NS_DGN
+
+#endif // INCLUDED_DGN_RPC_H
+
@@ -0,0 +1,166 @@
+// SockStat.cpp : socket level counters and connect latency histogram
+// Copyright (C) 2011 ~ 2023 drangon <drangon.zhou (at) gmail.com>
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+
+
+#include <dgn/SockStat.h>
+#include <dgn/JsonVal.h>
+#include <dgn/Thread.h>
+
+#include <string.h>
+
+#include <vector>
+#include <algorithm>
+#include <utility>
+
+BEGIN_NS_DGN
+////////////////
+
+static const char * s_counter_name[DGN_SOCKSTAT_COUNTER_NUM] = {
+	"send_calls", "send_bytes", "send_partial", "send_eagain",
+	"recv_calls", "recv_bytes", "recv_eagain",
+	"poll_loops", "timeouts",
+	"connects", "connect_fails", "accepts",
+};
+
+void SockStatData::Clear()
+{
+	int i;
+	for( i = 0; i < DGN_SOCKSTAT_COUNTER_NUM; ++i )
+		m_cnt[i] = 0;
+	for( i = 0; i < DGN_SOCKSTAT_HIST_NUM; ++i )
+		m_connect_hist[i] = 0;
+	return;
+}
+
+void SockStatData::Add( const SockStatData & sd )
+{
+	int i;
+	for( i = 0; i < DGN_SOCKSTAT_COUNTER_NUM; ++i )
+		m_cnt[i] += sd.m_cnt[i];
+	for( i = 0; i < DGN_SOCKSTAT_HIST_NUM; ++i )
+		m_connect_hist[i] += sd.m_connect_hist[i];
+	return;
+}
+
+void SockStatData::AddConnectUs( int64_t us )
+{
+	int idx = 0;
+	while( us > 0 && idx < DGN_SOCKSTAT_HIST_NUM - 1 ) {
+		us >>= 1;
+		idx++;
+	}
+	m_connect_hist[idx] += 1;
+	return;
+}
+
+void SockStatData::ToJson( JsonVal * jv ) const
+{
+	jv->SetObject();
+	int i;
+	for( i = 0; i < DGN_SOCKSTAT_COUNTER_NUM; ++i )
+		jv->SetItem( s_counter_name[i], JsonVal( (int64_t)m_cnt[i] ) );
+
+	JsonVal hist( JSONVAL_TYPE_ARRAY );
+	for( i = 0; i < DGN_SOCKSTAT_HIST_NUM; ++i ) {
+		if( m_connect_hist[i] == 0 )
+			continue;
+		JsonVal bucket( JSONVAL_TYPE_OBJECT );
+		// upper bound, -1 for the open last bucket
+		bucket.SetItem( "le", JsonVal( i < DGN_SOCKSTAT_HIST_NUM - 1 ? ( (int64_t)1 << i ) - 1 : (int64_t)-1 ) );
+		bucket.SetItem( "n", JsonVal( (int64_t)m_connect_hist[i] ) );
+		hist.SetItem( hist.Size(), std::move( bucket ) );
+	}
+	jv->SetItem( "connect_us", std::move( hist ) );
+	return;
+}
+
+////////////////
+////	SockStat
+
+volatile int SockStat::s_enabled = 0;
+
+static Mutex s_lock; // only for block list change and Collect()
+static std::vector< SockStatData * > s_blocks;
+static SockStatData s_exited; // sum of exited threads
+
+// free thread block at thread exit, counters kept in s_exited
+struct sockstat_local_t
+{
+	sockstat_local_t() : m_sd( NULL ) {}
+	~sockstat_local_t() { if( m_sd != NULL ) SockStat::del_local( m_sd ), m_sd = NULL; }
+
+	SockStatData * m_sd;
+};
+
+static thread_local sockstat_local_t s_local;
+
+void SockStat::Enable( int enable )
+{
+	s_enabled = enable ? 1 : 0;
+	return;
+}
+
+SockStatData * SockStat::Local()
+{
+	SockStatData * sd = s_local.m_sd;
+	if( sd == NULL )
+		sd = s_local.m_sd = new_local();
+	return sd;
+}
+
+void SockStat::Collect( SockStatData * sd )
+{
+	sd->Clear();
+	MutexGuard guard( &s_lock );
+	sd->Add( s_exited );
+	size_t i;
+	for( i = 0; i < s_blocks.size(); ++i )
+		sd->Add( *s_blocks[i] );
+	return;
+}
+
+void SockStat::Reset()
+{
+	MutexGuard guard( &s_lock );
+	s_exited.Clear();
+	size_t i;
+	for( i = 0; i < s_blocks.size(); ++i )
+		s_blocks[i]->Clear();
+	return;
+}
+
+SockStatData * SockStat::new_local()
+{
+	SockStatData * sd = new SockStatData();
+	MutexGuard guard( &s_lock );
+	s_blocks.push_back( sd );
+	return sd;
+}
+
+void SockStat::del_local( SockStatData * sd )
+{
+	MutexGuard guard( &s_lock );
+	s_exited.Add( *sd );
+	std::vector< SockStatData * >::iterator it = std::find( s_blocks.begin(), s_blocks.end(), sd );
+	if( it != s_blocks.end() )
+		s_blocks.erase( it );
+	delete sd;
+	return;
+}
+
+////////////////
+END_NS_DGN
+
@@ -0,0 +1,93 @@
+// SockStat.h : socket level counters and connect latency histogram
+// Copyright (C) 2011 ~ 2023 drangon <drangon.zhou (at) gmail.com>
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+
+
+#ifndef INCLUDED_DGN_SOCKSTAT_H
+#define INCLUDED_DGN_SOCKSTAT_H
+
+#include <dgn/dgn.h>
+
+BEGIN_NS_DGN
+////////////////
+
+class JsonVal;
+
+enum sockstat_counter_e {
+	DGN_SOCKSTAT_SEND_CALLS = 0, // send syscalls, include sendto/sendmsg/sendmmsg
+	DGN_SOCKSTAT_SEND_BYTES,
+	DGN_SOCKSTAT_SEND_PARTIAL,   // Send() first syscall not take all data
+	DGN_SOCKSTAT_SEND_EAGAIN,
+	DGN_SOCKSTAT_RECV_CALLS,
+	DGN_SOCKSTAT_RECV_BYTES,
+	DGN_SOCKSTAT_RECV_EAGAIN,
+	DGN_SOCKSTAT_POLL_LOOPS,     // poll/select syscalls waiting for one socket or Pollex()
+	DGN_SOCKSTAT_TIMEOUTS,       // wait ended by timeout
+	DGN_SOCKSTAT_CONNECTS,
+	DGN_SOCKSTAT_CONNECT_FAILS,
+	DGN_SOCKSTAT_ACCEPTS,
+	DGN_SOCKSTAT_COUNTER_NUM,
+};
+
+// connect latency bucket i count [ 2^(i-1), 2^i ) us, the last one for all larger
+#define DGN_SOCKSTAT_HIST_NUM	24
+
+// one block of counters, written by one thread only, read by any thread without lock
+struct DGN_LIB_API SockStatData
+{
+	SockStatData() { Clear(); }
+
+	void Clear();
+	void Add( const SockStatData & sd );
+	void AddConnectUs( int64_t us );
+	// { "send_calls" : n, ..., "connect_us" : [ { "le" : us, "n" : n }, ... ] }, empty buckets skipped
+	void ToJson( JsonVal * jv ) const;
+
+	volatile int64_t m_cnt[DGN_SOCKSTAT_COUNTER_NUM];
+	volatile int64_t m_connect_hist[DGN_SOCKSTAT_HIST_NUM];
+};
+
+// Note :
+// global counters are per-thread blocks summed on Collect(), no atomic op or lock on update
+// disabled by default, Socket only check one flag then
+// per-socket counters by Socket::SetStat(), counted whether global enabled or not
+class DGN_LIB_API SockStat
+{
+public:
+	static void Enable( int enable );
+	static int IsEnabled() { return s_enabled; }
+
+	// counters of current thread, created at first call
+	static SockStatData * Local();
+	// sum of all threads, include exited ones
+	static void Collect( SockStatData * sd );
+	// not exact if other threads still updating
+	static void Reset();
+	static void Dump( JsonVal * jv ) { SockStatData sd; Collect( &sd ); sd.ToJson( jv ); }
+
+protected:
+	friend struct sockstat_local_t;
+	static SockStatData * new_local();
+	static void del_local( SockStatData * sd );
+
+protected:
+	static volatile int s_enabled;
+};
+
+////////////////
+END_NS_DGN
+
+#endif // INCLUDED_DGN_SOCKSTAT_H
+
@@ -21,6 +21,7 @@
 #endif
 
 #include <dgn/Socket.h>
+#include <dgn/SockStat.h>
 #include <dgn/Time.h>
 #include <dgn/Logger.h>
 
@@ -37,6 +38,9 @@
 #include <netdb.h>
 #include <arpa/inet.h> 
 #include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/un.h>
+#include <sys/stat.h>
 #include <sys/select.h>
 #include <unistd.h>
 #include <stdlib.h>
@@ -44,18 +48,113 @@
 #include <string.h>
 #include <poll.h>
 #include <errno.h>
+#include <stddef.h>
 #define SOCKET int
 #define closesocket close
 #define INVALID_SOCKET (-1)
 #define DGN_SHUT_RDWR   SHUT_RDWR
 #define IS_ERR_EAGAIN() ( errno == EAGAIN || errno == EINTR )
 #define GET_ERRNO() ( errno )
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL	0
 #endif
+#endif
+
+#ifdef __linux__
+#include <sys/eventfd.h>
+#include <sys/uio.h>
+#include <netinet/udp.h>
+#ifndef SOL_UDP
+#define SOL_UDP	17
+#endif
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT	103
+#endif
+#ifndef UDP_GRO
+#define UDP_GRO	104
+#endif
+#ifndef TCP_FASTOPEN_CONNECT
+#define TCP_FASTOPEN_CONNECT	30
+#endif
+#ifndef SO_BUSY_POLL
+#define SO_BUSY_POLL	46
+#endif
+#endif
+
+#define DGN_LISTEN_BACKLOG	7
 
 
 BEGIN_NS_DGN
 ////////////////
 
+#ifndef _WIN32
+// "@name" for abstract namespace, sun_path start with '\0' and addrlen not include trailing '\0'
+static int set_unix_addr( const char * path, struct sockaddr_storage * addr, int * addrlen )
+{
+	struct sockaddr_un * sun = (struct sockaddr_un *)addr;
+	int len = (int)strlen( path );
+	if( len == 0 || len >= (int)sizeof(sun->sun_path) ) {
+		PR_DEBUG( "invalid unix path len %d", len );
+		return -1;
+	}
+	memset( sun, 0, sizeof(*sun) );
+	sun->sun_family = AF_UNIX;
+	memcpy( sun->sun_path, path, len );
+	if( path[0] == '@' ) {
+		sun->sun_path[0] = '\0';
+		*addrlen = (int)( offsetof( struct sockaddr_un, sun_path ) + len );
+	}
+	else {
+		*addrlen = (int)( offsetof( struct sockaddr_un, sun_path ) + len + 1 );
+	}
+	return 0;
+}
+
+// remove socket file left by previous process, or bind() fail with EADDRINUSE,
+// a connect() refused tell nobody serve it, return -1 if still in use
+static int unlink_stale_unix( const struct sockaddr_storage * addr, int addrlen, int type )
+{
+	const struct sockaddr_un * sun = (const struct sockaddr_un *)addr;
+	if( addr->ss_family != AF_UNIX || sun->sun_path[0] == '\0' )
+		return 0;
+	struct stat st;
+	if( stat( sun->sun_path, &st ) != 0 || ! S_ISSOCK( st.st_mode ) )
+		return 0;
+	// non-blocking, full backlog of a live listener give EAGAIN instead of wait
+	int fd = socket( AF_UNIX, type, 0 );
+	if( fd < 0 )
+		return 0;
+	if( Socket::SetNonBlock( fd, 1 ) < 0 ) {
+		close( fd );
+		return 0;
+	}
+	int ret = connect( fd, (const struct sockaddr *)addr, addrlen );
+	int err = errno;
+	close( fd );
+	if( ret < 0 && err == ECONNREFUSED ) {
+		unlink( sun->sun_path );
+		return 0;
+	}
+	if( ret == 0 || err == EAGAIN || err == EINPROGRESS ) {
+		PR_DEBUG( "unix socket [%s] in use", sun->sun_path );
+		errno = EADDRINUSE;
+		return -1;
+	}
+	return 0; // let bind() report
+}
+#else
+static int set_unix_addr( const char * path, struct sockaddr_storage * addr, int * addrlen )
+{
+	PR_DEBUG( "unix socket not support on win32" );
+	return -1;
+}
+
+static int unlink_stale_unix( const struct sockaddr_storage * addr, int addrlen, int type )
+{
+	return 0;
+}
+#endif // _WIN32
+
 int Socket::GetHostAddr( const char * host, int port, struct sockaddr_storage * addr, int * addrlen )
 {
 	if( host == NULL || host[0] == '\0' )
@@ -69,6 +168,37 @@ int Socket::GetHostAddr( const char * host, int port, struct sockaddr_storage *
 	memcpy( &(addr->sin_addr), hptr->h_addr_list[0], sizeof(addr->sin_addr) );
 #endif // if 0
 
+	if( strncmp( host, "unix:", 5 ) == 0 )
+		return set_unix_addr( host + 5, addr, addrlen );
+
+	// "[ipv6]" as in url
+	char tmp[DGN_IP_LEN];
+	if( host[0] == '[' ) {
+		const char * end = strchr( host, ']' );
+		if( end == NULL || end[1] != '\0' || end - host - 1 >= DGN_IP_LEN )
+			return -1;
+		memcpy( tmp, host + 1, end - host - 1 );
+		tmp[end - host - 1] = '\0';
+		host = tmp;
+	}
+
+	// numeric ip fast path, no resolver call
+	memset( addr, 0, sizeof(*addr) );
+	struct sockaddr_in * sin = (struct sockaddr_in *)addr;
+	struct sockaddr_in6 * sin6 = (struct sockaddr_in6 *)addr;
+	if( inet_pton( AF_INET, host, &sin->sin_addr ) == 1 ) {
+		sin->sin_family = AF_INET;
+		sin->sin_port = htons( port );
+		*addrlen = (int)sizeof(*sin);
+		return 0;
+	}
+	if( strchr( host, ':' ) != NULL && inet_pton( AF_INET6, host, &sin6->sin6_addr ) == 1 ) {
+		sin6->sin6_family = AF_INET6;
+		sin6->sin6_port = htons( port );
+		*addrlen = (int)sizeof(*sin6);
+		return 0;
+	}
+
 	struct addrinfo hint;
 	struct addrinfo * res = NULL;
 	memset( &hint, 0, sizeof(hint) );
@@ -107,6 +237,14 @@ int Socket::GetAddrIp( const struct sockaddr_storage * addr, int addrlen, char i
 #endif // if 0
 
 	ip[0] = '\0';
+	if( addr->ss_family == AF_UNIX )
+		return -1; // no ip, use Endpoint::ToStr()
+	Endpoint ep;
+	if( addr->ss_family == AF_INET6 && ep.SetAddr( addr, addrlen ) == 0 && ep.UnmapV4() == 1 ) {
+		// show ipv4 peer of dual-stack socket as plain ipv4
+		addr = ep.GetAddr();
+		addrlen = ep.GetAddrLen();
+	}
 	if( getnameinfo( (const struct sockaddr *)addr, addrlen, ip, DGN_IP_LEN, NULL, 0, NI_NUMERICHOST ) != 0 )
 		return -1;
 	if( port != NULL ) {
@@ -183,7 +321,315 @@ int Socket::SetNonBlock( sock_t sk, int nonblock )
 #endif
 }
 
-Socket::Socket() : m_sock( INVALID_SOCKET ), m_timeout_ms( 0 )
+////////////////
+////	stat
+
+static inline void stat_add( SockStatData * sk_stat, int idx, int64_t val )
+{
+	if( SockStat::IsEnabled() )
+		SockStat::Local()->m_cnt[idx] += val;
+	if( sk_stat != NULL )
+		sk_stat->m_cnt[idx] += val;
+	return;
+}
+
+// one send/recv syscall, call at once after it, before errno changed
+static inline void stat_io( SockStatData * sk_stat, int is_recv, int ret )
+{
+	if( ! SockStat::IsEnabled() && sk_stat == NULL )
+		return;
+	int eagain = ret < 0 && IS_ERR_EAGAIN();
+	stat_add( sk_stat, is_recv ? DGN_SOCKSTAT_RECV_CALLS : DGN_SOCKSTAT_SEND_CALLS, 1 );
+	if( ret > 0 )
+		stat_add( sk_stat, is_recv ? DGN_SOCKSTAT_RECV_BYTES : DGN_SOCKSTAT_SEND_BYTES, ret );
+	if( eagain )
+		stat_add( sk_stat, is_recv ? DGN_SOCKSTAT_RECV_EAGAIN : DGN_SOCKSTAT_SEND_EAGAIN, 1 );
+	return;
+}
+
+void Socket::stat_connect( int ok )
+{
+	if( m_connect_start == 0 )
+		return;
+	if( ! ok ) {
+		stat_add( m_stat, DGN_SOCKSTAT_CONNECT_FAILS, 1 );
+	}
+	else {
+		int64_t us = Time::Now() - m_connect_start;
+		if( SockStat::IsEnabled() )
+			SockStat::Local()->AddConnectUs( us );
+		if( m_stat != NULL )
+			m_stat->AddConnectUs( us );
+	}
+	m_connect_start = 0;
+	return;
+}
+
+////////////////
+////	SockOpt
+
+static SockOpt s_default_opt;
+
+void Socket::SetDefaultOpt( const SockOpt & opt )
+{
+	s_default_opt = opt;
+	return;
+}
+
+const SockOpt & Socket::GetDefaultOpt()
+{
+	return s_default_opt;
+}
+
+int Socket::SetOpt( const SockOpt & opt )
+{
+	if( m_sock == INVALID_SOCKET )
+		return -1;
+	int type = 0;
+	socklen_t len = sizeof(type);
+	if( getsockopt( m_sock, SOL_SOCKET, SO_TYPE, (char *)&type, &len ) < 0 )
+		return -1;
+	return set_opt( m_sock, opt, type == SOCK_STREAM );
+}
+
+int Socket::SetNoDelay( int nodelay )
+{
+	if( m_sock == INVALID_SOCKET )
+		return -1;
+	int val = nodelay ? 1 : 0;
+	return setsockopt( m_sock, IPPROTO_TCP, TCP_NODELAY, (char *)&val, sizeof(val) ) < 0 ? -1 : 0;
+}
+
+int Socket::SetQuickAck( int quickack )
+{
+	if( m_sock == INVALID_SOCKET )
+		return -1;
+#ifdef __linux__
+	int val = quickack ? 1 : 0;
+	return setsockopt( m_sock, IPPROTO_TCP, TCP_QUICKACK, (char *)&val, sizeof(val) ) < 0 ? -1 : 0;
+#else
+	return -1;
+#endif
+}
+
+int Socket::set_v6only( sock_t sk, int v6only )
+{
+	int val = v6only ? 1 : 0;
+	if( setsockopt( sk, IPPROTO_IPV6, IPV6_V6ONLY, (char *)&val, sizeof(val) ) < 0 ) {
+		PR_DEBUG( "setsockopt() IPV6_V6ONLY %d failed, err %d", val, GET_ERRNO() );
+		return -1;
+	}
+	return 0;
+}
+
+static void map_v4( const struct sockaddr_in * sin, struct sockaddr_in6 * sin6 )
+{
+	memset( sin6, 0, sizeof(*sin6) );
+	sin6->sin6_family = AF_INET6;
+	sin6->sin6_port = sin->sin_port;
+	unsigned char * a = (unsigned char *)&sin6->sin6_addr;
+	a[10] = 0xff, a[11] = 0xff;
+	memcpy( a + 12, &sin->sin_addr, 4 );
+	return;
+}
+
+#define DGN_SET_OPT( level, name, val ) do { \
+	int v_ = (val); \
+	if( setsockopt( sk, level, name, (char *)&v_, sizeof(v_) ) < 0 ) { \
+		PR_DEBUG( "setsockopt() " #name " %d failed, err %d", v_, GET_ERRNO() ); \
+		ret = -1; \
+	} \
+} while( 0 )
+
+#define DGN_OPT_UNSUPPORT( name ) do { \
+	PR_DEBUG( "socket option " #name " not support" ); \
+	ret = -1; \
+} while( 0 )
+
+int Socket::set_opt( sock_t sk, const SockOpt & opt, int is_tcp )
+{
+	int ret = 0;
+	if( opt.m_sndbuf >= 0 )
+		DGN_SET_OPT( SOL_SOCKET, SO_SNDBUF, opt.m_sndbuf );
+	if( opt.m_rcvbuf >= 0 )
+		DGN_SET_OPT( SOL_SOCKET, SO_RCVBUF, opt.m_rcvbuf );
+	if( opt.m_busy_poll_us >= 0 ) {
+#ifdef __linux__
+		DGN_SET_OPT( SOL_SOCKET, SO_BUSY_POLL, opt.m_busy_poll_us );
+#else
+		DGN_OPT_UNSUPPORT( SO_BUSY_POLL );
+#endif
+	}
+	if( opt.m_reuseport >= 0 ) {
+#ifdef SO_REUSEPORT
+		DGN_SET_OPT( SOL_SOCKET, SO_REUSEPORT, opt.m_reuseport );
+#else
+		DGN_OPT_UNSUPPORT( SO_REUSEPORT );
+#endif
+	}
+	if( ! is_tcp )
+		return ret;
+
+	if( opt.m_nodelay >= 0 )
+		DGN_SET_OPT( IPPROTO_TCP, TCP_NODELAY, opt.m_nodelay );
+	if( opt.m_keepalive >= 0 )
+		DGN_SET_OPT( SOL_SOCKET, SO_KEEPALIVE, opt.m_keepalive );
+#if defined( TCP_KEEPIDLE ) && defined( TCP_KEEPINTVL ) && defined( TCP_KEEPCNT )
+	if( opt.m_keepidle_s >= 0 )
+		DGN_SET_OPT( IPPROTO_TCP, TCP_KEEPIDLE, opt.m_keepidle_s );
+	if( opt.m_keepintvl_s >= 0 )
+		DGN_SET_OPT( IPPROTO_TCP, TCP_KEEPINTVL, opt.m_keepintvl_s );
+	if( opt.m_keepcnt >= 0 )
+		DGN_SET_OPT( IPPROTO_TCP, TCP_KEEPCNT, opt.m_keepcnt );
+#else
+	if( opt.m_keepidle_s >= 0 || opt.m_keepintvl_s >= 0 || opt.m_keepcnt >= 0 )
+		DGN_OPT_UNSUPPORT( TCP_KEEPIDLE );
+#endif
+#ifdef __linux__
+	if( opt.m_quickack >= 0 )
+		DGN_SET_OPT( IPPROTO_TCP, TCP_QUICKACK, opt.m_quickack );
+	if( opt.m_defer_accept_s >= 0 )
+		DGN_SET_OPT( IPPROTO_TCP, TCP_DEFER_ACCEPT, opt.m_defer_accept_s );
+#else
+	if( opt.m_quickack >= 0 || opt.m_defer_accept_s >= 0 )
+		DGN_OPT_UNSUPPORT( TCP_QUICKACK );
+#endif
+	// m_fastopen differ by listen / connect side, applied in TcpSvr() / Connect()
+	return ret;
+}
+
+////////////////
+////	Endpoint
+
+static_assert( sizeof(struct sockaddr_storage) <= DGN_SOCKADDR_LEN, "DGN_SOCKADDR_LEN too small" );
+
+int Endpoint::Set( const char * host, int port )
+{
+	m_addrlen = 0;
+	int addrlen = 0;
+	if( Socket::GetHostAddr( host, port, GetAddr(), &addrlen ) < 0 )
+		return -1;
+	m_addrlen = addrlen;
+	return 0;
+}
+
+int Endpoint::SetUnix( const char * path )
+{
+	m_addrlen = 0;
+	int addrlen = 0;
+	if( set_unix_addr( path, GetAddr(), &addrlen ) < 0 )
+		return -1;
+	m_addrlen = addrlen;
+	return 0;
+}
+
+int Endpoint::SetAddr( const struct sockaddr_storage * addr, int addrlen )
+{
+	if( addr == NULL || addrlen <= 0 || addrlen > DGN_SOCKADDR_LEN ) {
+		m_addrlen = 0;
+		return -1;
+	}
+	memcpy( m_addr.buf, addr, addrlen );
+	m_addrlen = addrlen;
+	return 0;
+}
+
+int Endpoint::SetPort( int port )
+{
+	if( m_addrlen <= 0 )
+		return -1;
+	struct sockaddr_storage * addr = GetAddr();
+	if( addr->ss_family == AF_INET )
+		((struct sockaddr_in *)addr)->sin_port = htons( port );
+	else if( addr->ss_family == AF_INET6 )
+		((struct sockaddr_in6 *)addr)->sin6_port = htons( port );
+	else
+		return -1;
+	return 0;
+}
+
+int Endpoint::GetFamily() const
+{
+	if( m_addrlen <= 0 )
+		return 0;
+	return GetAddr()->ss_family;
+}
+
+int Endpoint::UnmapV4()
+{
+	if( GetFamily() != AF_INET6 )
+		return 0;
+	const struct sockaddr_in6 * sin6 = (const struct sockaddr_in6 *)GetAddr();
+	const unsigned char * a = (const unsigned char *)&sin6->sin6_addr;
+	static const unsigned char prefix[12] = { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xff, 0xff };
+	if( memcmp( a, prefix, 12 ) != 0 )
+		return 0;
+	struct sockaddr_in sin;
+	memset( &sin, 0, sizeof(sin) );
+	sin.sin_family = AF_INET;
+	sin.sin_port = sin6->sin6_port;
+	memcpy( &sin.sin_addr, a + 12, 4 );
+	memcpy( m_addr.buf, &sin, sizeof(sin) );
+	m_addrlen = (int)sizeof(sin);
+	return 1;
+}
+
+int Endpoint::GetPort() const
+{
+	if( m_addrlen <= 0 )
+		return 0;
+	const struct sockaddr_storage * addr = GetAddr();
+	if( addr->ss_family == AF_INET )
+		return ntohs( ((const struct sockaddr_in *)addr)->sin_port );
+	else if( addr->ss_family == AF_INET6 )
+		return ntohs( ((const struct sockaddr_in6 *)addr)->sin6_port );
+	return 0;
+}
+
+int Endpoint::GetIp( char ip[DGN_IP_LEN] ) const
+{
+	ip[0] = '\0';
+	if( m_addrlen <= 0 )
+		return -1;
+	return Socket::GetAddrIp( GetAddr(), m_addrlen, ip, NULL );
+}
+
+CStr Endpoint::ToStr() const
+{
+	CStr str;
+#ifndef _WIN32
+	if( GetFamily() == AF_UNIX ) {
+		// unnamed ( autobind or socketpair ) has no path
+		const struct sockaddr_un * sun = (const struct sockaddr_un *)GetAddr();
+		int len = m_addrlen - (int)offsetof( struct sockaddr_un, sun_path );
+		if( len <= 0 )
+			return str;
+		if( sun->sun_path[0] == '\0' ) {
+			str.Assign( "unix:@" );
+			str.Append( sun->sun_path + 1, len - 1 );
+		}
+		else {
+			str.Assign( "unix:" );
+			str.Append( sun->sun_path, len );
+		}
+		return str;
+	}
+#endif
+	char ip[DGN_IP_LEN];
+	if( GetIp( ip ) < 0 )
+		return str;
+	if( GetFamily() == AF_INET6 )
+		str.AssignFmt( "[%s]:%d", ip, GetPort() );
+	else
+		str.AssignFmt( "%s:%d", ip, GetPort() );
+	return str;
+}
+
+////////////////
+////	Socket
+
+Socket::Socket() : m_sock( INVALID_SOCKET ), m_family( 0 ), m_timeout_ms( 0 ), m_cancel( 0 ), m_notify( NULL )
+	, m_stat( NULL ), m_connect_start( 0 )
 {
 
 }
@@ -191,6 +637,20 @@ Socket::Socket() : m_sock( INVALID_SOCKET ), m_timeout_ms( 0 )
 Socket::~Socket()
 {
 	Close();
+	delete m_notify, m_notify = NULL;
+}
+
+int Socket::EnableNotify()
+{
+	if( m_notify != NULL )
+		return 0;
+	PollNotify * notify = new PollNotify();
+	if( notify->Open() < 0 ) {
+		delete notify;
+		return -1;
+	}
+	m_notify = notify;
+	return 0;
 }
 
 int Socket::Close()
@@ -200,33 +660,58 @@ int Socket::Close()
 		closesocket( m_sock );
 		m_sock = INVALID_SOCKET;
 	}
+	m_family = 0;
+	m_connect_start = 0;
 	return 0;
 }
 
 enum socket_connect_result_e Socket::Connect( const char * host, int port )
 {
-	int addrlen = 0;
-	struct sockaddr_storage addr;
-	if( GetHostAddr( host, port, &addr, &addrlen ) < 0 ) {
+	Endpoint ep;
+	if( ep.Set( host, port ) < 0 ) {
 		PR_DEBUG( "resolve [%s] failed", host );
 		return DGN_SOCKET_CONNECT_FAILED;
 	}
+	return Connect( ep );
+}
+
+enum socket_connect_result_e Socket::Connect( const Endpoint & ep )
+{
+	if( ! ep.IsValid() ) {
+		PR_DEBUG( "connect to invalid endpoint" );
+		return DGN_SOCKET_CONNECT_FAILED;
+	}
 
 	Close();
 
-	m_sock = socket( AF_INET, SOCK_STREAM, 0 );
+	m_sock = socket( ep.GetFamily(), SOCK_STREAM, 0 );
 	if( m_sock == INVALID_SOCKET ) {
 		PR_DEBUG( "socket() failed" );
 		return DGN_SOCKET_CONNECT_FAILED;
 	}
+	m_family = ep.GetFamily();
 	if( SetNonBlock( m_sock, 1 ) < 0 ) {
 		PR_DEBUG( "SetNonBlock() failed" );
 		Close();
 		return DGN_SOCKET_CONNECT_FAILED;
 	}
+	set_opt( m_sock, s_default_opt, m_family != AF_UNIX );
+#ifdef __linux__
+	if( s_default_opt.m_fastopen > 0 && m_family != AF_UNIX ) {
+		// syn carry data of first send(), connect() return at once
+		int option = 1;
+		if( setsockopt( m_sock, IPPROTO_TCP, TCP_FASTOPEN_CONNECT, (char *)&option, sizeof(option) ) < 0 )
+			PR_DEBUG( "setsockopt() TCP_FASTOPEN_CONNECT failed, err %d", GET_ERRNO() );
+	}
+#endif
 
-	int ret = connect( m_sock, (struct sockaddr *)&addr, addrlen );
+	if( SockStat::IsEnabled() || m_stat != NULL ) {
+		stat_add( m_stat, DGN_SOCKSTAT_CONNECTS, 1 );
+		m_connect_start = Time::Now(); // latency counted when ConnectCheck() get result
+	}
+	int ret = connect( m_sock, (const struct sockaddr *)ep.GetAddr(), ep.GetAddrLen() );
 	if( ret >= 0 ) {
+		stat_connect( 1 );
 		return DGN_SOCKET_CONNECT_OK;
 	}
 
@@ -237,6 +722,7 @@ enum socket_connect_result_e Socket::Connect( const char * host, int port )
 #endif
 	{
 		PR_DEBUG( "connect failed, err %d", GET_ERRNO() );
+		stat_connect( 0 );
 		Close();
 		return DGN_SOCKET_CONNECT_FAILED;
 	}
@@ -273,10 +759,14 @@ enum socket_connect_result_e Socket::ConnectCheck()
 	tv.tv_usec = 0;
 
 	int ret = select( 0, &rset, &wset, &eset, &tv );
-	if( ret > 0 && FD_ISSET( m_sock, &wset ) )
+	if( ret > 0 && FD_ISSET( m_sock, &wset ) ) {
+		stat_connect( 1 );
 		return DGN_SOCKET_CONNECT_OK; // connected
-	if( ret > 0 && FD_ISSET( m_sock, &eset ) )
+	}
+	if( ret > 0 && FD_ISSET( m_sock, &eset ) ) {
+		stat_connect( 0 );
 		return DGN_SOCKET_CONNECT_FAILED; // connect failed
+	}
 	return DGN_SOCKET_CONNECT_TRYING; // still in progress
 
 #else
@@ -290,9 +780,12 @@ enum socket_connect_result_e Socket::ConnectCheck()
 		int err = 0;
 		socklen_t len = sizeof(err);
 		ret = getsockopt( m_sock, SOL_SOCKET, SO_ERROR, (void *)&err, &len );
-		if( ret == 0 && err == 0 )
+		if( ret == 0 && err == 0 ) {
+			stat_connect( 1 );
 			return DGN_SOCKET_CONNECT_OK; // connected
+		}
 		//PR_DEBUG( "getsockopt ret %d, err %d", ret, err );
+		stat_connect( 0 );
 		return DGN_SOCKET_CONNECT_FAILED; // failed
 	}
 
@@ -303,20 +796,34 @@ enum socket_connect_result_e Socket::ConnectCheck()
 
 int Socket::TcpSvr( const char * host, int port )
 {
-	int addrlen = 0;
-	struct sockaddr_storage addr;
-	if( GetHostAddr( host, port, &addr, &addrlen ) < 0 ) {
+	Endpoint ep;
+	if( ep.Set( host, port ) < 0 ) {
 		PR_DEBUG( "resolve [%s] failed", host );
 		return -1;
 	}
+	return TcpSvr( ep );
+}
+
+int Socket::TcpSvr( const Endpoint & ep )
+{
+	return TcpSvr( ep, s_default_opt );
+}
+
+int Socket::TcpSvr( const Endpoint & ep, const SockOpt & opt )
+{
+	if( ! ep.IsValid() ) {
+		PR_DEBUG( "listen on invalid endpoint" );
+		return -1;
+	}
 
 	Close();
 
-	m_sock = socket( AF_INET, SOCK_STREAM, 0 );
+	m_sock = socket( ep.GetFamily(), SOCK_STREAM, 0 );
 	if( m_sock == INVALID_SOCKET ) {
 		PR_DEBUG( "socket() failed" );
 		return -1;
 	}
+	m_family = ep.GetFamily();
 	if( SetNonBlock( m_sock, 1 ) < 0 ) {
 		PR_DEBUG( "SetNonBlock() failed" );
 		Close();
@@ -333,13 +840,34 @@ int Socket::TcpSvr( const char * host, int port )
 	}
 #endif
 
-	if( bind( m_sock, (struct sockaddr *)&addr, addrlen ) < 0 ) {
-		PR_DEBUG( "bind [%s:%d] failed", host, port );
+	if( m_family == AF_INET6 && set_v6only( m_sock, opt.m_v6only >= 0 ? opt.m_v6only : 0 ) < 0 ) {
 		Close();
 		return -1;
 	}
-	if( listen( m_sock, 7 ) < 0 ) {
-		PR_DEBUG( "listen() [%s:%d] failed", host, port );
+	if( set_opt( m_sock, opt, m_family != AF_UNIX ) < 0 && opt.m_reuseport > 0 ) {
+		// bind would fail or steal the port without reuseport
+		Close();
+		return -1;
+	}
+
+	if( unlink_stale_unix( ep.GetAddr(), ep.GetAddrLen(), SOCK_STREAM ) < 0 ) {
+		Close();
+		return -1;
+	}
+	if( bind( m_sock, (const struct sockaddr *)ep.GetAddr(), ep.GetAddrLen() ) < 0 ) {
+		PR_DEBUG( "bind [%s] failed", ep.ToStr().Str() );
+		Close();
+		return -1;
+	}
+#ifdef TCP_FASTOPEN
+	if( opt.m_fastopen >= 0 && m_family != AF_UNIX ) {
+		int qlen = opt.m_fastopen;
+		if( setsockopt( m_sock, IPPROTO_TCP, TCP_FASTOPEN, (char *)&qlen, sizeof(qlen) ) < 0 )
+			PR_DEBUG( "setsockopt() TCP_FASTOPEN failed, err %d", GET_ERRNO() );
+	}
+#endif
+	if( listen( m_sock, opt.m_backlog >= 0 ? opt.m_backlog : DGN_LISTEN_BACKLOG ) < 0 ) {
+		PR_DEBUG( "listen() [%s] failed", ep.ToStr().Str() );
 		Close();
 		return -1;
 	}
@@ -347,54 +875,109 @@ int Socket::TcpSvr( const char * host, int port )
 	return 0;
 }
 
-Socket * Socket::Accept()
+Socket * Socket::Accept( Endpoint * peer )
+{
+	// allocate only when accepted, spurious wakeup of busy listener is common
+	sock_t fd;
+	if( accept_fd( &fd, peer ) <= 0 )
+		return NULL;
+	Socket * sk = new Socket();
+	sk->m_sock = fd;
+	sk->m_family = m_family;
+	return sk;
+}
+
+int Socket::Accept( Socket * sk, Endpoint * peer )
+{
+	sock_t fd;
+	int ret = accept_fd( &fd, peer );
+	if( ret <= 0 )
+		return ret;
+	sk->Close();
+	sk->m_sock = fd;
+	sk->m_family = m_family;
+	return 1;
+}
+
+int Socket::accept_fd( sock_t * fd, Endpoint * peer )
 {
 	if( m_sock == INVALID_SOCKET ) {
 		PR_DEBUG( "accept but not listen()" );
-		return NULL;
+		return -1;
 	}
 
-	if( m_timeout_ms > 0 ) {
+	// peer address come with accept(), no getpeername() later
+	struct sockaddr_storage addr;
+	socklen_t addrlen = sizeof(addr);
+	struct sockaddr * paddr = peer != NULL ? (struct sockaddr *)&addr : NULL;
+	socklen_t * plen = peer != NULL ? &addrlen : NULL;
+#ifdef __linux__
+	// accept4() return non-blocking socket, save the fcntl() calls
+	SOCKET tmpsk = accept4( m_sock, paddr, plen, SOCK_NONBLOCK );
+#else
+	SOCKET tmpsk = accept( m_sock, paddr, plen );
+#endif
+	if( tmpsk == INVALID_SOCKET && IS_ERR_EAGAIN() && m_timeout_ms > 0 ) {
+		// poll only when nothing pending, busy listener accept at once
 		int ret_evt;
 		int ret = Poll( DGN_POLLIN, &ret_evt );
-		if( ret <= 0 ) {
-			return NULL;
-		}
+		if( ret <= 0 )
+			return ret < 0 ? -1 : 0;
+		addrlen = sizeof(addr);
+#ifdef __linux__
+		tmpsk = accept4( m_sock, paddr, plen, SOCK_NONBLOCK );
+#else
+		tmpsk = accept( m_sock, paddr, plen );
+#endif
 	}
-
-	SOCKET tmpsk = accept( m_sock, NULL, 0 );
 	if( tmpsk == INVALID_SOCKET )
-		return NULL;
+		return IS_ERR_EAGAIN() ? 0 : -1;
 
+#ifndef __linux__
 	if( SetNonBlock( tmpsk, 1 ) < 0 ) {
 		PR_DEBUG( "client set nonblock failed" );
 		closesocket( tmpsk ), tmpsk = INVALID_SOCKET;
-		return NULL;
+		return -1;
 	}
+#endif
 
-	Socket * sk = new Socket();
-	sk->m_sock = tmpsk;
-	
-	return sk;
+	set_opt( tmpsk, s_default_opt, m_family != AF_UNIX );
+
+	stat_add( m_stat, DGN_SOCKSTAT_ACCEPTS, 1 );
+	*fd = tmpsk;
+	if( peer != NULL ) {
+		peer->SetAddr( &addr, (int)addrlen );
+		peer->UnmapV4();
+	}
+	return 1;
 }
 
 int Socket::UdpSvr( const char * host, int port )
 {
-	int addrlen = 0;
-	struct sockaddr_storage addr;
-	if( GetHostAddr( host, port, &addr, &addrlen ) < 0 ) {
+	Endpoint ep;
+	if( ep.Set( host, port ) < 0 ) {
 		PR_DEBUG( "resolve [%s] failed", host );
 		return -1;
 	}
+	return UdpSvr( ep );
+}
+
+int Socket::UdpSvr( const Endpoint & ep )
+{
+	if( ! ep.IsValid() ) {
+		PR_DEBUG( "bind on invalid endpoint" );
+		return -1;
+	}
 
 	Close();
 
-	m_sock = socket( AF_INET, SOCK_DGRAM, 0 );
+	m_sock = socket( ep.GetFamily(), SOCK_DGRAM, 0 );
 	if( m_sock == INVALID_SOCKET ) {
 		PR_DEBUG( "socket() failed" );
 		Close();
 		return -1;
 	}
+	m_family = ep.GetFamily();
 
 	if( SetNonBlock( m_sock, 1 ) < 0 ) {
 		PR_DEBUG( "SetNonBlock() failed" );
@@ -412,12 +995,36 @@ int Socket::UdpSvr( const char * host, int port )
 	}
 #endif
 
-	if( bind( m_sock, (struct sockaddr *)&addr, addrlen ) < 0 ) {
-		PR_DEBUG( "bind [%s:%d] failed", host, port );
-		Close();
-		return -1;
+	if( m_family == AF_INET6 && set_v6only( m_sock, s_default_opt.m_v6only >= 0 ? s_default_opt.m_v6only : 0 ) < 0 ) {
+		Close();
+		return -1;
+	}
+	set_opt( m_sock, s_default_opt, 0 );
+
+	if( unlink_stale_unix( ep.GetAddr(), ep.GetAddrLen(), SOCK_DGRAM ) < 0 ) {
+		Close();
+		return -1;
+	}
+	if( bind( m_sock, (const struct sockaddr *)ep.GetAddr(), ep.GetAddrLen() ) < 0 ) {
+		PR_DEBUG( "bind [%s] failed", ep.ToStr().Str() );
+		Close();
+		return -1;
+	}
+
+	return 0;
+}
+
+int Socket::PeekAlive()
+{
+	if( m_sock == INVALID_SOCKET ) {
+		return 0;
 	}
 
+	// one non-blocking peek, EAGAIN means idle and still connected
+	char ch;
+	int ret = recv( m_sock, &ch, 1, MSG_PEEK );
+	if( ret < 0 && IS_ERR_EAGAIN() )
+		return 1;
 	return 0;
 }
 
@@ -425,6 +1032,12 @@ int Socket::AttachSock( sock_t sk )
 {
 	Close();
 	m_sock = sk;
+	if( m_sock != INVALID_SOCKET ) {
+		struct sockaddr_storage addr;
+		socklen_t addrlen = sizeof(addr);
+		if( getsockname( m_sock, (struct sockaddr *)&addr, &addrlen ) == 0 )
+			m_family = addr.ss_family;
+	}
 	return 0;
 }
 
@@ -432,9 +1045,34 @@ sock_t Socket::DetachSock()
 {
 	uint32_t tmp_sock = (uint32_t)m_sock;
 	m_sock = INVALID_SOCKET;
+	m_family = 0;
 	return tmp_sock;
 }
 
+int Socket::SocketPair( Socket * s1, Socket * s2, int dgram )
+{
+#ifdef _WIN32
+	PR_DEBUG( "socketpair not support on win32" );
+	return -1;
+#else
+	int sv[2];
+	if( socketpair( AF_UNIX, dgram ? SOCK_DGRAM : SOCK_STREAM, 0, sv ) < 0 ) {
+		PR_DEBUG( "socketpair() failed, err %d", GET_ERRNO() );
+		return -1;
+	}
+	if( SetNonBlock( sv[0], 1 ) < 0 || SetNonBlock( sv[1], 1 ) < 0 ) {
+		PR_DEBUG( "SetNonBlock() failed" );
+		close( sv[0] ), close( sv[1] );
+		return -1;
+	}
+	s1->Close();
+	s2->Close();
+	s1->m_sock = sv[0], s1->m_family = AF_UNIX;
+	s2->m_sock = sv[1], s2->m_family = AF_UNIX;
+	return 0;
+#endif
+}
+
 int Socket::LocalAddr( char ip[DGN_IP_LEN], int * port )
 {
 	if( m_sock == INVALID_SOCKET ) {
@@ -477,6 +1115,35 @@ int Socket::RemoteAddr( char ip[DGN_IP_LEN], int * port )
 	return GetAddrIp( &addr, addrlen, ip, port );
 }
 
+int Socket::LocalAddr( Endpoint * ep )
+{
+	if( m_sock == INVALID_SOCKET )
+		return -1;
+	struct sockaddr_storage addr;
+	socklen_t addrlen = sizeof(addr);
+	if( getsockname( m_sock, (struct sockaddr *)&addr, &addrlen ) < 0 ) {
+		PR_DEBUG( "getsockname() failed" );
+		return -1;
+	}
+	return ep->SetAddr( &addr, (int)addrlen );
+}
+
+int Socket::RemoteAddr( Endpoint * ep )
+{
+	if( m_sock == INVALID_SOCKET )
+		return -1;
+	struct sockaddr_storage addr;
+	socklen_t addrlen = sizeof(addr);
+	if( getpeername( m_sock, (struct sockaddr *)&addr, &addrlen ) < 0 ) {
+		PR_DEBUG( "getpeername() failed" );
+		return -1;
+	}
+	if( ep->SetAddr( &addr, (int)addrlen ) < 0 )
+		return -1;
+	ep->UnmapV4();
+	return 0;
+}
+
 int Socket::RemoteAddr( CStr * ip, int * port )
 {
 	ip->Reserve( DGN_IP_LEN );
@@ -495,8 +1162,11 @@ int Socket::Send( const char * buf, int len )
 
 	int currlen = 0;
 	int ret = send( m_sock, buf, len, 0 );
+	stat_io( m_stat, 0, ret );
 	if( ret == len )
 		return ret;
+	if( ret >= 0 )
+		stat_add( m_stat, DGN_SOCKSTAT_SEND_PARTIAL, 1 );
 	if( ret < 0 && ! IS_ERR_EAGAIN() )
 		return ret;
 	if( m_timeout_ms <= 0 ) {
@@ -514,6 +1184,7 @@ int Socket::Send( const char * buf, int len )
 		}
 
 		ret = send( m_sock, buf + currlen, len - currlen, 0 );
+		stat_io( m_stat, 0, ret );
 		if( ret < 0 && ! IS_ERR_EAGAIN() ) {
 			return currlen == 0 ? -1 : currlen;
 		}
@@ -531,6 +1202,7 @@ int Socket::Recv( char * buf, int minlen, int maxlen )
 
 	int currlen = 0;
 	int ret = recv( m_sock, buf, maxlen, 0 );
+	stat_io( m_stat, 1, ret );
 	if( ret >= minlen )
 		return ret;
 	if( ret == 0 )
@@ -552,6 +1224,7 @@ int Socket::Recv( char * buf, int minlen, int maxlen )
 		}
 
 		ret = recv( m_sock, buf + currlen, maxlen - currlen, 0 );
+		stat_io( m_stat, 1, ret );
 		if( ret < 0 && ! IS_ERR_EAGAIN() ) {
 			return currlen == 0 ? -1 : currlen;
 		}
@@ -575,20 +1248,47 @@ int Socket::SendTo( const char * buf, int len, const char * remote_host, int por
 	struct sockaddr_storage addr;
 	if( GetHostAddr( remote_host, port, &addr, &addrlen ) < 0 )
 		return -2;
-	return sendto( m_sock, buf, len, 0, (struct sockaddr *)&addr, addrlen );
+	return SendTo( buf, len, &addr, addrlen );
 }
 
 int Socket::RecvFrom( char * buf, int len, char remote_ip[DGN_IP_LEN], int * port )
+{
+	struct sockaddr_storage addr;
+	int addrlen = sizeof(addr);
+	int ret = RecvFrom( buf, len, &addr, &addrlen );
+	if( ret > 0 )
+		GetAddrIp( &addr, addrlen, remote_ip, port );
+	return ret;
+}
+
+int Socket::SendTo( const char * buf, int len, const struct sockaddr_storage * addr, int addrlen )
+{
+	if( m_sock == INVALID_SOCKET ) {
+		return -1;
+	}
+	struct sockaddr_in6 mapped;
+	if( m_family == AF_INET6 && addr->ss_family == AF_INET ) {
+		// ipv4 target from dual-stack socket
+		map_v4( (const struct sockaddr_in *)addr, &mapped );
+		addr = (const struct sockaddr_storage *)&mapped;
+		addrlen = (int)sizeof(mapped);
+	}
+	int ret = sendto( m_sock, buf, len, 0, (const struct sockaddr *)addr, addrlen );
+	stat_io( m_stat, 0, ret );
+	return ret;
+}
+
+int Socket::RecvFrom( char * buf, int len, struct sockaddr_storage * addr, int * addrlen )
 {
 	if( m_sock == INVALID_SOCKET ) {
 		return -1;
 	}
 
-	struct sockaddr_storage addr;
-	socklen_t addrlen = sizeof(addr);
-	int ret = recvfrom( m_sock, buf, len, 0, (struct sockaddr *)&addr, &addrlen );
+	socklen_t alen = sizeof(*addr);
+	int ret = recvfrom( m_sock, buf, len, 0, (struct sockaddr *)addr, &alen );
+	stat_io( m_stat, 1, ret );
 	if( ret > 0 ) {
-		GetAddrIp( &addr, addrlen, remote_ip, port );
+		*addrlen = (int)alen;
 		return ret;
 	}
 	if( ret < 0 && ! IS_ERR_EAGAIN() ) {
@@ -607,10 +1307,11 @@ int Socket::RecvFrom( char * buf, int len, char remote_ip[DGN_IP_LEN], int * por
 		return 0;
 	}
 
-	addrlen = sizeof(addr);
-	ret = recvfrom( m_sock, buf, len, 0, (struct sockaddr *)&addr, &addrlen );
+	alen = sizeof(*addr);
+	ret = recvfrom( m_sock, buf, len, 0, (struct sockaddr *)addr, &alen );
+	stat_io( m_stat, 1, ret );
 	if( ret > 0 ) {
-		GetAddrIp( &addr, addrlen, remote_ip, port );
+		*addrlen = (int)alen;
 		return ret;
 	}
 	if( ret < 0 && ! IS_ERR_EAGAIN() ) {
@@ -622,6 +1323,343 @@ int Socket::RecvFrom( char * buf, int len, char remote_ip[DGN_IP_LEN], int * por
 	return 0;
 }
 
+#ifdef _WIN32
+
+int Socket::SendFd( const char * buf, int len, const int * fds, int fd_num )
+{
+	return -1;
+}
+
+int Socket::RecvFd( char * buf, int len, int * fds, int * fd_num )
+{
+	*fd_num = 0;
+	return -1;
+}
+
+#else // _WIN32
+
+int Socket::SendFd( const char * buf, int len, const int * fds, int fd_num )
+{
+	if( m_sock == INVALID_SOCKET || len <= 0 || fd_num < 0 || fd_num > DGN_SOCK_MAX_FDS )
+		return -1;
+
+	union {
+		struct cmsghdr align;
+		char buf[CMSG_SPACE( sizeof(int) * DGN_SOCK_MAX_FDS )];
+	} ctrl;
+	struct iovec iov;
+	iov.iov_base = (void *)buf;
+	iov.iov_len = len;
+	struct msghdr msg;
+	memset( &msg, 0, sizeof(msg) );
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	if( fd_num > 0 ) {
+		msg.msg_control = ctrl.buf;
+		msg.msg_controllen = CMSG_SPACE( sizeof(int) * fd_num );
+		struct cmsghdr * cmsg = CMSG_FIRSTHDR( &msg );
+		cmsg->cmsg_level = SOL_SOCKET;
+		cmsg->cmsg_type = SCM_RIGHTS;
+		cmsg->cmsg_len = CMSG_LEN( sizeof(int) * fd_num );
+		memcpy( CMSG_DATA( cmsg ), fds, sizeof(int) * fd_num );
+	}
+
+	// fds must go with the first sent byte, rest of data by Send()
+	int ret = sendmsg( m_sock, &msg, MSG_NOSIGNAL );
+	stat_io( m_stat, 0, ret );
+	while( ret < 0 && IS_ERR_EAGAIN() && m_timeout_ms > 0 ) {
+		int ret_evt = 0;
+		ret = Poll( DGN_POLLOUT, &ret_evt );
+		if( ret <= 0 )
+			return ret < 0 ? -1 : 0;
+		ret = sendmsg( m_sock, &msg, MSG_NOSIGNAL );
+		stat_io( m_stat, 0, ret );
+	}
+	if( ret < 0 )
+		return IS_ERR_EAGAIN() ? 0 : -1;
+	if( ret == len )
+		return ret;
+	int ret2 = Send( buf + ret, len - ret );
+	return ret2 > 0 ? ret + ret2 : ret;
+}
+
+int Socket::RecvFd( char * buf, int len, int * fds, int * fd_num )
+{
+	*fd_num = 0;
+	if( m_sock == INVALID_SOCKET || len <= 0 )
+		return -1;
+
+	union {
+		struct cmsghdr align;
+		char buf[CMSG_SPACE( sizeof(int) * DGN_SOCK_MAX_FDS )];
+	} ctrl;
+	struct iovec iov;
+	iov.iov_base = buf;
+	iov.iov_len = len;
+	struct msghdr msg;
+	memset( &msg, 0, sizeof(msg) );
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = ctrl.buf;
+	msg.msg_controllen = sizeof(ctrl.buf);
+#ifdef MSG_CMSG_CLOEXEC
+	int flags = MSG_CMSG_CLOEXEC;
+#else
+	int flags = 0;
+#endif
+
+	int ret = recvmsg( m_sock, &msg, flags );
+	stat_io( m_stat, 1, ret );
+	while( ret < 0 && IS_ERR_EAGAIN() && m_timeout_ms > 0 ) {
+		int ret_evt = 0;
+		ret = Poll( DGN_POLLIN, &ret_evt );
+		if( ret <= 0 )
+			return ret < 0 ? -1 : 0;
+		msg.msg_controllen = sizeof(ctrl.buf);
+		ret = recvmsg( m_sock, &msg, flags );
+		stat_io( m_stat, 1, ret );
+	}
+	if( ret < 0 )
+		return IS_ERR_EAGAIN() ? 0 : -1;
+	if( ret == 0 )
+		return -1; // peer closed
+
+	struct cmsghdr * cmsg;
+	for( cmsg = CMSG_FIRSTHDR( &msg ); cmsg != NULL; cmsg = CMSG_NXTHDR( &msg, cmsg ) ) {
+		if( cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS )
+			continue;
+		int n = (int)( ( cmsg->cmsg_len - CMSG_LEN( 0 ) ) / sizeof(int) );
+		memcpy( fds + *fd_num, CMSG_DATA( cmsg ), sizeof(int) * n );
+		*fd_num += n;
+	}
+	if( msg.msg_flags & MSG_CTRUNC )
+		PR_DEBUG( "recv fd truncated, more than %d fds sent", DGN_SOCK_MAX_FDS );
+	return ret;
+}
+
+#endif // _WIN32
+
+#ifdef __linux__
+// cmsg space for UDP_SEGMENT ( uint16_t ) or UDP_GRO ( int )
+#define DGN_UDP_CMSG_SPACE	CMSG_SPACE( sizeof(int) )
+
+// per message control buffer, aligned for CMSG_FIRSTHDR()/CMSG_DATA()
+union udp_cmsg_t
+{
+	struct cmsghdr align;
+	char buf[DGN_UDP_CMSG_SPACE];
+};
+
+static int msg_bytes( const SockMsg * msgs, int num )
+{
+	int bytes = 0;
+	int i;
+	for( i = 0; i < num; ++i )
+		bytes += msgs[i].m_len;
+	return bytes;
+}
+
+static int do_sendmmsg( sock_t sk, SockMsg * msgs, int num )
+{
+	struct mmsghdr hdr[DGN_SOCK_BATCH_MAX];
+	struct iovec iov[DGN_SOCK_BATCH_MAX];
+	udp_cmsg_t ctrl[DGN_SOCK_BATCH_MAX];
+	int i;
+
+	if( num > DGN_SOCK_BATCH_MAX )
+		num = DGN_SOCK_BATCH_MAX;
+	memset( hdr, 0, sizeof(hdr[0]) * num );
+	for( i = 0; i < num; ++i ) {
+		iov[i].iov_base = msgs[i].m_buf;
+		iov[i].iov_len = msgs[i].m_len;
+		hdr[i].msg_hdr.msg_iov = &iov[i];
+		hdr[i].msg_hdr.msg_iovlen = 1;
+		hdr[i].msg_hdr.msg_name = msgs[i].m_addr;
+		hdr[i].msg_hdr.msg_namelen = msgs[i].m_addr == NULL ? 0 : msgs[i].m_addrlen;
+		if( msgs[i].m_seg_size > 0 ) {
+			memset( ctrl[i].buf, 0, sizeof(ctrl[i].buf) );
+			hdr[i].msg_hdr.msg_control = ctrl[i].buf;
+			hdr[i].msg_hdr.msg_controllen = CMSG_SPACE( sizeof(uint16_t) );
+			struct cmsghdr * cm = CMSG_FIRSTHDR( &hdr[i].msg_hdr );
+			cm->cmsg_level = SOL_UDP;
+			cm->cmsg_type = UDP_SEGMENT;
+			cm->cmsg_len = CMSG_LEN( sizeof(uint16_t) );
+			uint16_t seg = (uint16_t)msgs[i].m_seg_size;
+			memcpy( CMSG_DATA( cm ), &seg, sizeof(seg) );
+		}
+	}
+	return sendmmsg( sk, hdr, num, 0 );
+}
+
+static int do_recvmmsg( sock_t sk, SockMsg * msgs, int num )
+{
+	struct mmsghdr hdr[DGN_SOCK_BATCH_MAX];
+	struct iovec iov[DGN_SOCK_BATCH_MAX];
+	udp_cmsg_t ctrl[DGN_SOCK_BATCH_MAX];
+	int i;
+
+	if( num > DGN_SOCK_BATCH_MAX )
+		num = DGN_SOCK_BATCH_MAX;
+	memset( hdr, 0, sizeof(hdr[0]) * num );
+	for( i = 0; i < num; ++i ) {
+		iov[i].iov_base = msgs[i].m_buf;
+		iov[i].iov_len = msgs[i].m_len;
+		hdr[i].msg_hdr.msg_iov = &iov[i];
+		hdr[i].msg_hdr.msg_iovlen = 1;
+		hdr[i].msg_hdr.msg_name = msgs[i].m_addr;
+		hdr[i].msg_hdr.msg_namelen = msgs[i].m_addr == NULL ? 0 : sizeof(struct sockaddr_storage);
+		hdr[i].msg_hdr.msg_control = ctrl[i].buf;
+		hdr[i].msg_hdr.msg_controllen = sizeof(ctrl[i].buf);
+	}
+
+	int ret = recvmmsg( sk, hdr, num, 0, NULL );
+	for( i = 0; i < ret; ++i ) {
+		msgs[i].m_len = (int)hdr[i].msg_len;
+		msgs[i].m_addrlen = (int)hdr[i].msg_hdr.msg_namelen;
+		msgs[i].m_seg_size = 0;
+		struct cmsghdr * cm;
+		for( cm = CMSG_FIRSTHDR( &hdr[i].msg_hdr ); cm != NULL; cm = CMSG_NXTHDR( &hdr[i].msg_hdr, cm ) ) {
+			if( cm->cmsg_level == SOL_UDP && cm->cmsg_type == UDP_GRO ) {
+				int seg = 0;
+				memcpy( &seg, CMSG_DATA( cm ), sizeof(seg) );
+				msgs[i].m_seg_size = seg;
+			}
+		}
+	}
+	return ret;
+}
+#endif // __linux__
+
+int Socket::SendBatch( SockMsg * msgs, int num )
+{
+	if( m_sock == INVALID_SOCKET ) {
+		return -1;
+	}
+
+	int currnum = 0;
+	while( currnum < num ) {
+#ifdef __linux__
+		int ret = do_sendmmsg( m_sock, msgs + currnum, num - currnum );
+		stat_io( m_stat, 0, ret > 0 ? msg_bytes( msgs + currnum, ret ) : ret );
+#else
+		SockMsg * msg = msgs + currnum;
+		int ret = sendto( m_sock, msg->m_buf, msg->m_len, 0, (const struct sockaddr *)msg->m_addr, msg->m_addr == NULL ? 0 : msg->m_addrlen );
+		stat_io( m_stat, 0, ret );
+		if( ret >= 0 )
+			ret = 1;
+#endif
+		if( ret > 0 ) {
+			currnum += ret;
+			continue;
+		}
+		if( ret < 0 && ! IS_ERR_EAGAIN() ) {
+			PR_DEBUG( "send batch error %d", (int)GET_ERRNO() );
+			return currnum == 0 ? -1 : currnum;
+		}
+		if( m_timeout_ms <= 0 )
+			break;
+
+		int ret_evt = 0;
+		if( Poll( DGN_POLLOUT, &ret_evt ) <= 0 )
+			break;
+	}
+	return currnum;
+}
+
+int Socket::RecvBatch( SockMsg * msgs, int num )
+{
+	if( m_sock == INVALID_SOCKET ) {
+		return -1;
+	}
+	if( num <= 0 )
+		return 0;
+
+#ifdef __linux__
+	int ret = do_recvmmsg( m_sock, msgs, num );
+	stat_io( m_stat, 1, ret > 0 ? msg_bytes( msgs, ret ) : ret );
+	if( ret > 0 )
+		return ret;
+	if( ret < 0 && ! IS_ERR_EAGAIN() ) {
+		PR_DEBUG( "recv batch error %d", (int)GET_ERRNO() );
+		return -1;
+	}
+	if( m_timeout_ms <= 0 )
+		return 0;
+
+	int ret_evt = 0;
+	if( Poll( DGN_POLLIN, &ret_evt ) <= 0 )
+		return 0;
+
+	ret = do_recvmmsg( m_sock, msgs, num );
+	stat_io( m_stat, 1, ret > 0 ? msg_bytes( msgs, ret ) : ret );
+	if( ret > 0 )
+		return ret;
+	if( ret < 0 && ! IS_ERR_EAGAIN() ) {
+		PR_DEBUG( "recv batch error %d", (int)GET_ERRNO() );
+		return -1;
+	}
+	return 0;
+
+#else
+	// first one wait with timeout, others only take what already arrived
+	struct sockaddr_storage tmpaddr;
+	int i;
+	for( i = 0; i < num; ++i ) {
+		SockMsg * msg = msgs + i;
+		struct sockaddr_storage * addr = msg->m_addr == NULL ? &tmpaddr : msg->m_addr;
+		int ret;
+		if( i == 0 ) {
+			ret = RecvFrom( msg->m_buf, msg->m_len, addr, &msg->m_addrlen );
+		}
+		else {
+			socklen_t alen = sizeof(*addr);
+			ret = recvfrom( m_sock, msg->m_buf, msg->m_len, 0, (struct sockaddr *)addr, &alen );
+			stat_io( m_stat, 1, ret );
+			msg->m_addrlen = (int)alen;
+		}
+		if( ret <= 0 )
+			return i == 0 ? ret : i;
+		msg->m_len = ret;
+		msg->m_seg_size = 0;
+	}
+	return num;
+#endif
+}
+
+int Socket::SetUdpGso( int seg_size )
+{
+	if( m_sock == INVALID_SOCKET ) {
+		return -1;
+	}
+#ifdef __linux__
+	int val = seg_size > 0 ? seg_size : 0;
+	if( setsockopt( m_sock, SOL_UDP, UDP_SEGMENT, (char *)&val, sizeof(val) ) < 0 ) {
+		PR_DEBUG( "setsockopt() UDP_SEGMENT failed, err %d", GET_ERRNO() );
+		return -1;
+	}
+	return 0;
+#else
+	return -1;
+#endif
+}
+
+int Socket::SetUdpGro( int enable )
+{
+	if( m_sock == INVALID_SOCKET ) {
+		return -1;
+	}
+#ifdef __linux__
+	int val = enable ? 1 : 0;
+	if( setsockopt( m_sock, SOL_UDP, UDP_GRO, (char *)&val, sizeof(val) ) < 0 ) {
+		PR_DEBUG( "setsockopt() UDP_GRO failed, err %d", GET_ERRNO() );
+		return -1;
+	}
+	return 0;
+#else
+	return -1;
+#endif
+}
+
 
 int Socket::Poll( int want_evt, int * ret_evt, int check_timeout_interval_ms )
 {
@@ -646,10 +1684,13 @@ int Socket::Poll( int want_evt, int * ret_evt, int check_timeout_interval_ms )
 
 	// PR_DEBUG( "tm_end %d, now %d", tm_end, now );
 	while( 1 ) {
+		if( m_cancel )
+			return 0;
 		int new_timeout = m_timeout_ms;
 		if( new_timeout != old_timeout ) {
 			// PR_DEBUG( "tm_end %d, old %d, new %d", tm_end, old_timeout, new_timeout );
 			tm_end = tm_end - old_timeout + new_timeout;
+			old_timeout = new_timeout;
 		}
 		now = Time::Tick();
 		int diff = (int)( tm_end - now );
@@ -674,13 +1715,16 @@ int Socket::Poll( int want_evt, int * ret_evt, int check_timeout_interval_ms )
 		tv.tv_usec = (diff % 1000) * 1000;
 
 		int ret = select( 0, &rset, &wset, &eset, &tv );
+		stat_add( m_stat, DGN_SOCKSTAT_POLL_LOOPS, 1 );
 		if( ret < 0 ) {
 			// PR_DEBUG( "select ret %d, errno %d", ret, GET_ERRNO() );
 			return 0;
 		}
 		if( ret == 0 ) {
-			if( diff == 0 )
+			if( diff == 0 ) {
+				stat_add( m_stat, DGN_SOCKSTAT_TIMEOUTS, 1 );
 				return 0;
+			}
 			continue;
 		}
 		if( FD_ISSET( m_sock, &rset ) )
@@ -691,14 +1735,18 @@ int Socket::Poll( int want_evt, int * ret_evt, int check_timeout_interval_ms )
 	}
 
 #else
-	struct pollfd pfd;
+	struct pollfd pfd[2];
+	int use_notify = ( m_notify != NULL && m_notify->IsValid() ) ? 1 : 0;
 
 	// PR_DEBUG( "tm_end %d, now %d", tm_end, now );
 	while( 1 ) {
+		if( m_cancel )
+			return 0;
 		int new_timeout = m_timeout_ms;
 		if( new_timeout != old_timeout ) {
 			// PR_DEBUG( "tm_end %d, old %d, new %d", tm_end, old_timeout, new_timeout );
 			tm_end = tm_end - old_timeout + new_timeout;
+			old_timeout = new_timeout;
 		}
 		now = Time::Tick();
 		int diff = (int)( tm_end - now );
@@ -708,29 +1756,44 @@ int Socket::Poll( int want_evt, int * ret_evt, int check_timeout_interval_ms )
 			diff = 0;  // at lease once
 		}
 
-		pfd.fd = m_sock;
-		pfd.events = pfd.revents = 0;
+		pfd[0].fd = m_sock;
+		pfd[0].events = pfd[0].revents = 0;
 		if( want_evt & DGN_POLLIN )
-			pfd.events |= POLLIN;
+			pfd[0].events |= POLLIN;
 		if( want_evt & DGN_POLLOUT )
-			pfd.events |= POLLOUT;
+			pfd[0].events |= POLLOUT;
 
-		if( diff > check_timeout_interval_ms )
+		if( use_notify ) {
+			// sleep until deadline, timeout change or cancel will wake up
+			pfd[1].fd = m_notify->GetFd();
+			pfd[1].events = POLLIN;
+			pfd[1].revents = 0;
+		}
+		else if( diff > check_timeout_interval_ms ) {
 			diff = check_timeout_interval_ms;
+		}
 
-		int ret = poll( &pfd, 1, diff );
+		int ret = poll( pfd, 1 + use_notify, diff );
+		stat_add( m_stat, DGN_SOCKSTAT_POLL_LOOPS, 1 );
 		// PR_DEBUG( "poll ret %d, err no %d", ret, GET_ERRNO() );
 		if( ret < 0 && ! IS_ERR_EAGAIN() ) {
 			return 0;
 		}
+		if( ret > 0 && use_notify && pfd[1].revents != 0 ) {
+			m_notify->Drain();
+			if( pfd[0].revents == 0 )
+				continue;
+		}
 		if( ret <= 0 ) {
-			if( diff == 0 )
+			if( diff == 0 ) {
+				stat_add( m_stat, DGN_SOCKSTAT_TIMEOUTS, 1 );
 				return 0;
+			}
 			continue;
 		}
-		if( pfd.revents & POLLIN )
+		if( pfd[0].revents & POLLIN )
 			*ret_evt |= DGN_POLLIN;
-		if( pfd.revents & POLLOUT )
+		if( pfd[0].revents & POLLOUT )
 			*ret_evt |= DGN_POLLOUT;
 
 		return *ret_evt;
@@ -740,6 +1803,18 @@ int Socket::Poll( int want_evt, int * ret_evt, int check_timeout_interval_ms )
 }
 
 int Socket::Pollex( int num, Socket ** skarr, const int * want_evt, int * ret_evt, volatile int * timeout_ms, int check_timeout_interval_ms )
+{
+	return pollex_imp( num, skarr, want_evt, ret_evt, timeout_ms, check_timeout_interval_ms, NULL );
+}
+
+int Socket::PollexNotify( int num, Socket ** skarr, const int * want_evt, int * ret_evt, volatile int * timeout_ms, PollNotify * notify )
+{
+	if( notify == NULL || ! notify->IsValid() )
+		return pollex_imp( num, skarr, want_evt, ret_evt, timeout_ms, 250, NULL );
+	return pollex_imp( num, skarr, want_evt, ret_evt, timeout_ms, 0, notify );
+}
+
+int Socket::pollex_imp( int num, Socket ** skarr, const int * want_evt, int * ret_evt, volatile int * timeout_ms, int check_timeout_interval_ms, PollNotify * notify )
 {
 	int i;
 	int ret = 0;
@@ -760,7 +1835,10 @@ int Socket::Pollex( int num, Socket ** skarr, const int * want_evt, int * ret_ev
 	while( 1 ) {
 		int new_timeout = *timeout_ms;
 		if( new_timeout != old_timeout ) {
+			if( new_timeout < 0 )
+				break; // cancel
 			tm_end = tm_end - old_timeout + new_timeout;
+			old_timeout = new_timeout;
 		}
 		now = Time::Tick();
 		int diff = (int)( tm_end - now );
@@ -789,9 +1867,12 @@ int Socket::Pollex( int num, Socket ** skarr, const int * want_evt, int * ret_ev
 		tv.tv_usec = diff * 1000;
 
 		int ret = select( 0, &rset, &wset, &eset, &tv );
+		stat_add( NULL, DGN_SOCKSTAT_POLL_LOOPS, 1 );
 		if( ret == 0 || ( ret < 0 && IS_ERR_EAGAIN() ) ) {
-			if( diff == 0 )
+			if( diff == 0 ) {
+				stat_add( NULL, DGN_SOCKSTAT_TIMEOUTS, 1 );
 				break;
+			}
 			continue;
 		}
 		if( ret < 0 )
@@ -812,12 +1893,17 @@ int Socket::Pollex( int num, Socket ** skarr, const int * want_evt, int * ret_ev
 	}
 
 #else
-	struct pollfd pfd[1024];
+	struct pollfd pfd[1024 + 1];
 	int pnum = 0;
+	if( num > 1024 )
+		num = 1024;
 	while( 1 ) {
 		int new_timeout = *timeout_ms;
 		if( new_timeout != old_timeout ) {
+			if( new_timeout < 0 )
+				break; // cancel
 			tm_end = tm_end - old_timeout + new_timeout;
+			old_timeout = new_timeout;
 		}
 		now = Time::Tick();
 		int diff = (int)( tm_end - now );
@@ -840,13 +1926,28 @@ int Socket::Pollex( int num, Socket ** skarr, const int * want_evt, int * ret_ev
 			pnum++;
 		}
 
-		if( diff > check_timeout_interval_ms )
+		if( notify != NULL ) {
+			// notify always the last one
+			pfd[pnum].fd = notify->GetFd();
+			pfd[pnum].events = POLLIN;
+			pfd[pnum].revents = 0;
+		}
+		else if( diff > check_timeout_interval_ms ) {
 			diff = check_timeout_interval_ms;
+		}
 
-		int ret = poll( pfd, pnum, diff );
+		int ret = poll( pfd, pnum + ( notify != NULL ? 1 : 0 ), diff );
+		stat_add( NULL, DGN_SOCKSTAT_POLL_LOOPS, 1 );
+		if( ret > 0 && notify != NULL && pfd[pnum].revents != 0 ) {
+			notify->Drain();
+			if( --ret == 0 )
+				continue; // re-check timeout
+		}
 		if( ret == 0 || ( ret < 0 && IS_ERR_EAGAIN() ) ) {
-			if( diff == 0 )
+			if( diff == 0 ) {
+				stat_add( NULL, DGN_SOCKSTAT_TIMEOUTS, 1 );
 				break;
+			}
 			continue;
 		}
 		if( ret < 0 )
@@ -877,6 +1978,84 @@ int Socket::Pollex( int num, Socket ** skarr, const int * want_evt, int * ret_ev
 	return ret;
 }
 
+////////////////
+////	PollNotify
+
+int PollNotify::Open()
+{
+	if( m_rfd >= 0 )
+		return 0;
+#if defined( _WIN32 )
+	return -1;
+#elif defined( __linux__ )
+	m_rfd = eventfd( 0, EFD_NONBLOCK | EFD_CLOEXEC );
+	if( m_rfd < 0 ) {
+		PR_DEBUG( "eventfd() failed, err %d", GET_ERRNO() );
+		return -1;
+	}
+	m_wfd = m_rfd;
+	return 0;
+#else
+	int fds[2];
+	if( pipe( fds ) < 0 ) {
+		PR_DEBUG( "pipe() failed, err %d", GET_ERRNO() );
+		return -1;
+	}
+	fcntl( fds[0], F_SETFL, fcntl( fds[0], F_GETFL ) | O_NONBLOCK );
+	fcntl( fds[1], F_SETFL, fcntl( fds[1], F_GETFL ) | O_NONBLOCK );
+	m_rfd = fds[0];
+	m_wfd = fds[1];
+	return 0;
+#endif
+}
+
+void PollNotify::Close()
+{
+#ifndef _WIN32
+	if( m_wfd >= 0 && m_wfd != m_rfd )
+		close( m_wfd );
+	if( m_rfd >= 0 )
+		close( m_rfd );
+#endif
+	m_rfd = m_wfd = -1;
+	return;
+}
+
+int PollNotify::Notify()
+{
+#ifdef _WIN32
+	return -1;
+#else
+	if( m_wfd < 0 )
+		return -1;
+	uint64_t val = 1;
+	// eventfd need 8 bytes, pipe any bytes; full pipe or counter is still notified
+	int ret = (int)write( m_wfd, &val, sizeof(val) );
+	return ret < 0 && errno != EAGAIN ? -1 : 0;
+#endif
+}
+
+int PollNotify::Drain()
+{
+#ifdef _WIN32
+	return -1;
+#else
+	if( m_rfd < 0 )
+		return -1;
+#ifdef __linux__
+	uint64_t val = 0;
+	// eventfd read reset the counter at once
+	if( read( m_rfd, &val, sizeof(val) ) < 0 && errno != EAGAIN )
+		return -1;
+#else
+	char buf[64];
+	while( read( m_rfd, buf, sizeof(buf) ) > 0 ) {
+	}
+#endif
+	return 0;
+#endif
+}
+
 ////////////////
 END_NS_DGN
 
@@ -18,6 +18,7 @@
 #define INCLUDED_DGN_SOCKET_H
 
 #include <dgn/CStr.h>
+#include <dgn/Stream.h>
 
 #ifdef _MSC_VER
 #pragma comment( lib, "ws2_32" )
@@ -28,6 +29,8 @@ struct sockaddr_storage;
 BEGIN_NS_DGN
 ////////////////
 
+struct SockStatData;
+
 enum socket_connect_result_e {
 	DGN_SOCKET_CONNECT_UNKNOWN = 0,  // should not exist
 	DGN_SOCKET_CONNECT_TRYING,
@@ -41,6 +44,9 @@ enum {
 };
 
 #define DGN_IP_LEN	48    // ipv6 46 / ipv4 16 (with '\0'), use 48 for align
+#define DGN_SOCK_BATCH_MAX	64  // max message number per sendmmsg/recvmmsg syscall
+#define DGN_SOCKADDR_LEN	128 // sizeof(struct sockaddr_storage)
+#define DGN_SOCK_MAX_FDS	16  // max fd number per SendFd/RecvFd
 
 #ifdef _WIN64
 typedef unsigned __int64 sock_t;
@@ -51,7 +57,101 @@ typedef int sock_t;
 #endif
 #define DGN_INVALID_SOCK ((sock_t)-1)
 
-class DGN_LIB_API Socket
+// message for batch udp send/recv, all buffer own by caller
+struct SockMsg
+{
+	char * m_buf;
+	int m_len;       // send : data len, recv : buffer size before call, data len after call
+	int m_seg_size;  // gso/gro segment size, 0 means single datagram
+	struct sockaddr_storage * m_addr; // peer addr, can be NULL for connected socket
+	int m_addrlen;   // send : addr len, recv : addr len after call
+};
+
+// typed socket options, field < 0 means not set ( keep system default )
+// tcp only options ignored for udp socket, linux only options fail on other platform
+struct DGN_LIB_API SockOpt
+{
+	SockOpt() : m_nodelay( -1 ), m_sndbuf( -1 ), m_rcvbuf( -1 ), m_keepalive( -1 ), m_keepidle_s( -1 )
+		, m_keepintvl_s( -1 ), m_keepcnt( -1 ), m_fastopen( -1 ), m_quickack( -1 ), m_busy_poll_us( -1 )
+		, m_defer_accept_s( -1 ), m_reuseport( -1 ), m_backlog( -1 ), m_v6only( -1 ) {}
+
+	int m_nodelay;        // TCP_NODELAY, 1 disable nagle
+	int m_sndbuf;         // SO_SNDBUF bytes
+	int m_rcvbuf;         // SO_RCVBUF bytes
+	int m_keepalive;      // SO_KEEPALIVE
+	int m_keepidle_s;     // TCP_KEEPIDLE
+	int m_keepintvl_s;    // TCP_KEEPINTVL
+	int m_keepcnt;        // TCP_KEEPCNT
+	int m_fastopen;       // listen : TCP_FASTOPEN queue len, connect : > 0 use TCP_FASTOPEN_CONNECT
+	int m_quickack;       // TCP_QUICKACK, linux reset it after some ack, set again if need
+	int m_busy_poll_us;   // SO_BUSY_POLL
+	int m_defer_accept_s; // TCP_DEFER_ACCEPT, listen only
+	int m_reuseport;      // SO_REUSEPORT, listen only, before bind
+	int m_backlog;        // listen backlog, not set use 7 as before
+	int m_v6only;         // IPV6_V6ONLY for ipv6 listen, not set use 0 ( dual-stack, [::] accept ipv4 too )
+};
+
+// resolved address, resolve once and reuse to avoid getaddrinfo() on every call
+class DGN_LIB_API Endpoint
+{
+public:
+	Endpoint() : m_addrlen( 0 ) {}
+	Endpoint( const char * host, int port ) : m_addrlen( 0 ) { Set( host, port ); }
+
+	// numeric ipv4/ipv6 parse directly, other host name resolve by getaddrinfo()
+	// "unix:path" same as SetUnix( path ), port ignored
+	int Set( const char * host, int port );
+	// unix domain socket path, "@name" for linux abstract namespace ( no file )
+	int SetUnix( const char * path );
+	int SetAddr( const struct sockaddr_storage * addr, int addrlen );
+	int SetPort( int port );
+	void Clear() { m_addrlen = 0; }
+
+	bool IsValid() const { return m_addrlen > 0; }
+	int GetFamily() const; // AF_INET / AF_INET6 / AF_UNIX, 0 if not valid
+	// ipv4-mapped ipv6 ( ::ffff:a.b.c.d from dual-stack socket ) to plain ipv4
+	int UnmapV4();
+	int GetPort() const;
+	int GetIp( char ip[DGN_IP_LEN] ) const;
+	CStr ToStr() const; // ip:port or [ip6]:port or unix:path
+
+	const struct sockaddr_storage * GetAddr() const { return (const struct sockaddr_storage *)m_addr.buf; }
+	struct sockaddr_storage * GetAddr() { return (struct sockaddr_storage *)m_addr.buf; }
+	int GetAddrLen() const { return m_addrlen; }
+
+protected:
+	union {
+		char buf[DGN_SOCKADDR_LEN];
+		int64_t align;
+	} m_addr;
+	int m_addrlen;
+};
+
+// wakeup handle for Poll()/PollexNotify(), eventfd on linux, pipe on other unix
+// not support on win32, Open() return -1 and poll fallback to check interval
+class DGN_LIB_API PollNotify
+{
+public:
+	PollNotify() : m_rfd( -1 ), m_wfd( -1 ) {}
+	~PollNotify() { Close(); }
+
+	PollNotify( const PollNotify & pn ) = delete;
+	PollNotify & operator = ( const PollNotify & pn ) = delete;
+
+	int Open();
+	void Close();
+	bool IsValid() const { return m_rfd >= 0; }
+
+	int Notify(); // wake up poll waiting on this, safe to call from any thread
+	int Drain();  // clear notified state, call by the waiting side
+	int GetFd() const { return m_rfd; }
+
+protected:
+	int m_rfd;
+	int m_wfd; // same as m_rfd for eventfd
+};
+
+class DGN_LIB_API Socket : public Stream
 {
 public:
 	static int GetHostAddr( const char * host, int port, struct sockaddr_storage * addr, int * addrlen );
@@ -60,49 +160,120 @@ public:
 	static char * Resolve( const char * host, char ip[DGN_IP_LEN] );
 	static CStr Resolve( const char * host );
 	static int SetNonBlock( sock_t sock, int nonblock );
+	// connected unix socket pair, stream or datagram, not support on win32
+	static int SocketPair( Socket * s1, Socket * s2, int dgram = 0 );
+
+	// default options applied to sockets created by Connect()/Accept()/TcpSvr()/UdpSvr(),
+	// set it at startup before any socket created, not thread safe
+	static void SetDefaultOpt( const SockOpt & opt );
+	static const SockOpt & GetDefaultOpt();
 
 public:
 	Socket();
 	virtual ~Socket();
 
 public:
-	int SetTimeout( int timeout_ms ) { m_timeout_ms = timeout_ms; return 0; }
+	int SetTimeout( int timeout_ms ) { m_timeout_ms = timeout_ms; if( m_notify != NULL ) m_notify->Notify(); return 0; }
 	int GetTimeout() const { return m_timeout_ms; }
 
+	// with notify enabled, Poll() sleep until deadline instead of waking every check interval,
+	// SetTimeout() and Cancel() from other thread wake it up to re-evaluate
+	int EnableNotify();
+	// cancel = 1 make blocking Poll/Send/Recv return as timeout until Cancel( 0 )
+	void Cancel( int cancel = 1 ) { m_cancel = cancel; if( m_notify != NULL ) m_notify->Notify(); }
+
 	enum socket_connect_result_e Connect( const char * host, int port );
+	enum socket_connect_result_e Connect( const Endpoint & ep );
 	enum socket_connect_result_e ConnectCheck(); // return at once, no timeout
 
 	int TcpSvr( const char * host, int port );
-	Socket * Accept(); // ret new client Socket that need delete
+	int TcpSvr( const Endpoint & ep );
+	int TcpSvr( const Endpoint & ep, const SockOpt & opt ); // use opt instead of default
+	// ret new client Socket that need delete, peer address filled if not NULL ( ipv4-mapped unmapped )
+	Socket * Accept( Endpoint * peer = NULL );
+	// accept into caller provided Socket ( old sock closed ), no allocation
+	// return 1 if accepted, 0 if no pending connection until timeout, < 0 if error
+	int Accept( Socket * sk, Endpoint * peer = NULL );
 
 	int UdpSvr( const char * host, int port );
+	int UdpSvr( const Endpoint & ep );
 
 	sock_t GetRawSock() const { return m_sock; } // still own by me
 	int AttachSock( sock_t sk ); // old sock closed, new sock own by me
 	sock_t DetachSock(); // detached sock need close by outside
 
-	bool IsValid() const { return m_sock != DGN_INVALID_SOCK; }
-	int Close();
+	// apply all set options, return < 0 if any failed ( others still applied )
+	int SetOpt( const SockOpt & opt );
+	int SetNoDelay( int nodelay );
+	int SetQuickAck( int quickack ); // linux only, not inherited by accepted socket
+
+	// per-socket counters ( see SockStat.h ), sd own by caller, NULL to stop
+	// counted without lock, sd should not be shared by sockets of different threads
+	void SetStat( SockStatData * sd ) { m_stat = sd; }
+	SockStatData * GetStat() const { return m_stat; }
+
+	virtual bool IsValid() const { return m_sock != DGN_INVALID_SOCK; }
+	// cheap check for idle connection, return 1 if still usable
+	// return 0 if peer closed, error happened or has unexpected unread data
+	int PeekAlive();
+	virtual int Close();
 
 public:
 	int LocalAddr( char ip[DGN_IP_LEN], int * port );
 	int LocalAddr( CStr * ip, int * port );
 	int RemoteAddr( char ip[DGN_IP_LEN], int * port );
 	int RemoteAddr( CStr * ip, int * port );
+	int LocalAddr( Endpoint * ep );
+	int RemoteAddr( Endpoint * ep );
 
 	// for send/recv, return >0 for data processed, = 0 when no data and timeout
 	// return < 0 if no data and error happend, include peer reset
-	int Send( const char * buf, int len );
-	int Recv( char * buf, int minlen, int maxlen );
+	virtual int Send( const char * buf, int len );
+	virtual int Recv( char * buf, int minlen, int maxlen );
 	int SendTo( const char * buf, int len, const char * remote_host, int port );
+	int SendTo( const char * buf, int len, const Endpoint & ep ) { return SendTo( buf, len, ep.GetAddr(), ep.GetAddrLen() ); }
 	int RecvFrom( char * buf, int len, char remote_ip[DGN_IP_LEN], int * port );
+	// raw address version, no resolve or ip format
+	int SendTo( const char * buf, int len, const struct sockaddr_storage * addr, int addrlen );
+	int RecvFrom( char * buf, int len, struct sockaddr_storage * addr, int * addrlen );
+
+	// unix socket fd passing ( SCM_RIGHTS ), fds go with the first byte of buf, len must > 0
+	// sent fds still own by caller, received fds own by caller ( close-on-exec set on linux )
+	// fds buffer of RecvFd() should hold DGN_SOCK_MAX_FDS
+	// return like Send()/Recv(), *fd_num is 0 if no fd come with the data
+	int SendFd( const char * buf, int len, const int * fds, int fd_num );
+	int RecvFd( char * buf, int len, int * fds, int * fd_num );
+
+	// batch udp send/recv, use sendmmsg/recvmmsg on linux, loop sendto/recvfrom on other platform
+	// return message number processed, = 0 when no message and timeout, < 0 if error
+	int SendBatch( SockMsg * msgs, int num );
+	int RecvBatch( SockMsg * msgs, int num );
+	// udp gso/gro, linux only, return < 0 if not support
+	// gso : default segment size for send, SockMsg::m_seg_size override it if not 0
+	// gro : received coalesced datagram split by SockMsg::m_seg_size
+	int SetUdpGso( int seg_size );
+	int SetUdpGro( int enable );
 
 	int Poll( int want_evt, int * ret_evt, int check_timeout_interval_ms = 250 );
 	static int Pollex( int num, Socket ** skarr, const int * want_evt, int * ret_evt, volatile int * timeout_ms, int check_timeout_interval_ms = 250 );
+	// sleep until deadline, notify->Notify() after change *timeout_ms, set *timeout_ms < 0 to cancel
+	static int PollexNotify( int num, Socket ** skarr, const int * want_evt, int * ret_evt, volatile int * timeout_ms, PollNotify * notify );
+
+protected:
+	static int set_opt( sock_t sk, const SockOpt & opt, int is_tcp );
+	static int set_v6only( sock_t sk, int v6only );
+	void stat_connect( int ok ); // count connect result and latency if started
+	int accept_fd( sock_t * fd, Endpoint * peer ); // same return as Accept()
+	static int pollex_imp( int num, Socket ** skarr, const int * want_evt, int * ret_evt, volatile int * timeout_ms, int check_timeout_interval_ms, PollNotify * notify );
 
 protected:
 	sock_t m_sock;
+	int m_family; // AF_INET / AF_INET6 of m_sock, 0 if unknown ( attached )
 	volatile int m_timeout_ms; // default 0
+	volatile int m_cancel;
+	PollNotify * m_notify; // NULL unless EnableNotify()
+	SockStatData * m_stat;
+	int64_t m_connect_start; // us, 0 if no pending connect to count
 };
 
 ////////////////
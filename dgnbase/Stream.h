@@ -0,0 +1,47 @@
+// Stream.h : byte stream interface with Socket send/recv semantics
+// Copyright (C) 2011 ~ 2023 drangon <drangon.zhou (at) gmail.com>
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+
+
+#ifndef INCLUDED_DGN_STREAM_H
+#define INCLUDED_DGN_STREAM_H
+
+#include <dgn/dgn.h>
+
+BEGIN_NS_DGN
+////////////////
+
+// implemented by Socket ( plain tcp / unix ) and TlsStream,
+// buffered readers and protocols use this to run over either
+class DGN_LIB_API Stream
+{
+public:
+	virtual ~Stream() {}
+
+	// timeout follow the underlying Socket::SetTimeout()
+	// return > 0 for data processed, = 0 when no data and timeout
+	// return < 0 if no data and error happend, include peer closed
+	virtual int Send( const char * buf, int len ) = 0;
+	virtual int Recv( char * buf, int minlen, int maxlen ) = 0;
+
+	virtual bool IsValid() const = 0;
+	virtual int Close() = 0;
+};
+
+////////////////
+END_NS_DGN
+
+#endif // INCLUDED_DGN_STREAM_H
+
@@ -63,10 +63,10 @@ int CondVal::Wait( Mutex * lock, int timeout_ms )
 			struct timespec ts;
 			clock_gettime( CLOCK_REALTIME, &ts );
 			ts.tv_sec += timeout_ms / 1000;
-			ts.tv_nsec += (timeout_ms % 1000) * ( 1000 * 100 );
-			if( ts.tv_nsec >= 1000 * 1000 * 100 ) {
+			ts.tv_nsec += (timeout_ms % 1000) * ( 1000 * 1000 );
+			if( ts.tv_nsec >= 1000 * 1000 * 1000 ) {
 				ts.tv_sec += 1;
-				ts.tv_nsec -= 1000 * 1000 * 100;
+				ts.tv_nsec -= 1000 * 1000 * 1000;
 			}
 			/*ret =*/ pthread_cond_timedwait( &m_cond, &lock->m_lock, &ts );
 		}
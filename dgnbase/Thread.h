@@ -67,6 +67,16 @@ public:
 #endif
 	}
 
+	// return 0 if locked, < 0 if held by other
+	int TryLock()
+	{
+#ifdef _WIN32
+		return TryEnterCriticalSection( &m_lock ) ? 0 : -1;
+#else
+		return pthread_mutex_trylock( &m_lock ) == 0 ? 0 : -1;
+#endif
+	}
+
 	void UnLock()
 	{
 #ifdef _WIN32
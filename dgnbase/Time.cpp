@@ -530,7 +530,7 @@ int Time::ToRfc(  CStr * ret ) const
 		pt = &tt;
 	}
 	ret->Reserve( ret->Len() + 32 );
-	ret->AppendFmt( "%s, %2d %s %4d %02d:%02d:%02d GMT", 
+	ret->AppendFmt( "%s, %02d %s %4d %02d:%02d:%02d GMT", 
 			GetWeekdayName( GetWeekDay( pt->m_year, pt->m_month, pt->m_day ) ),
 			pt->m_day, GetMonthName( pt->m_month ), pt->m_year, 
 			pt->m_hour, pt->m_minute, pt->m_sec );
@@ -0,0 +1,226 @@
+// TimerWheel.cpp : hierarchical timer wheel on millisecond tick
+// Copyright (C) 2011 ~ 2023 drangon <drangon.zhou (at) gmail.com>
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+
+
+#include <dgn/TimerWheel.h>
+#include <dgn/Time.h>
+
+BEGIN_NS_DGN
+////////////////
+
+static void list_init( timer_link_t * head )
+{
+	head->m_prev = head->m_next = head;
+	return;
+}
+
+static void list_add_tail( timer_link_t * head, timer_link_t * node )
+{
+	node->m_prev = head->m_prev;
+	node->m_next = head;
+	head->m_prev->m_next = node;
+	head->m_prev = node;
+	return;
+}
+
+static void list_del( timer_link_t * node )
+{
+	node->m_prev->m_next = node->m_next;
+	node->m_next->m_prev = node->m_prev;
+	node->m_prev = node->m_next = NULL;
+	return;
+}
+
+// move all nodes of from to empty to
+static void list_move_all( timer_link_t * from, timer_link_t * to )
+{
+	if( from->m_next == from ) {
+		list_init( to );
+		return;
+	}
+	to->m_next = from->m_next;
+	to->m_prev = from->m_prev;
+	to->m_next->m_prev = to;
+	to->m_prev->m_next = to;
+	list_init( from );
+	return;
+}
+
+void Timer::Cancel()
+{
+	if( m_wheel != NULL )
+		m_wheel->del_timer( this );
+	return;
+}
+
+TimerWheel::TimerWheel()
+	: m_cur( Time::Tick() ), m_num( 0 )
+{
+	int i, j;
+	for( i = 0; i < DGN_TIMER_ROOT_SIZE; ++i )
+		list_init( &m_root[i] );
+	for( i = 0; i < DGN_TIMER_LEVEL_NUM; ++i ) {
+		for( j = 0; j < DGN_TIMER_LEVEL_SIZE; ++j )
+			list_init( &m_levels[i][j] );
+	}
+}
+
+TimerWheel::~TimerWheel()
+{
+	int i, j;
+	for( i = 0; i < DGN_TIMER_ROOT_SIZE; ++i ) {
+		while( m_root[i].m_next != &m_root[i] )
+			del_timer( static_cast< Timer * >( m_root[i].m_next ) );
+	}
+	for( i = 0; i < DGN_TIMER_LEVEL_NUM; ++i ) {
+		for( j = 0; j < DGN_TIMER_LEVEL_SIZE; ++j ) {
+			while( m_levels[i][j].m_next != &m_levels[i][j] )
+				del_timer( static_cast< Timer * >( m_levels[i][j].m_next ) );
+		}
+	}
+}
+
+int TimerWheel::Add( Timer * t, int delay_ms )
+{
+	return AddAt( t, Time::Tick() + ( delay_ms > 0 ? (uint32_t)delay_ms : 0 ) );
+}
+
+int TimerWheel::AddAt( Timer * t, uint32_t expire )
+{
+	if( t == NULL || t->m_cb == NULL )
+		return -1;
+	t->Cancel();
+	// idle wheel may be far behind, or over 2^31 ms so expire look passed
+	if( m_num == 0 )
+		m_cur = Time::Tick();
+	t->m_expire = expire;
+	t->m_wheel = this;
+	add_timer( t );
+	m_num++;
+	return 0;
+}
+
+void TimerWheel::add_timer( Timer * t )
+{
+	uint32_t expire = t->m_expire;
+	int32_t delta = (int32_t)( expire - m_cur );
+	timer_link_t * head;
+	if( delta < 0 ) {
+		// already expired, run at next tick
+		expire = m_cur;
+		head = &m_root[expire & ( DGN_TIMER_ROOT_SIZE - 1 )];
+	}
+	else if( delta < DGN_TIMER_ROOT_SIZE )
+		head = &m_root[expire & ( DGN_TIMER_ROOT_SIZE - 1 )];
+	else {
+		int level = 0;
+		int shift = DGN_TIMER_ROOT_BITS;
+		while( level < DGN_TIMER_LEVEL_NUM - 1 && (uint32_t)delta >= ( 1u << ( shift + DGN_TIMER_LEVEL_BITS ) ) ) {
+			level++;
+			shift += DGN_TIMER_LEVEL_BITS;
+		}
+		head = &m_levels[level][( expire >> shift ) & ( DGN_TIMER_LEVEL_SIZE - 1 )];
+	}
+	list_add_tail( head, t );
+	return;
+}
+
+void TimerWheel::del_timer( Timer * t )
+{
+	list_del( t );
+	t->m_wheel = NULL;
+	m_num--;
+	return;
+}
+
+// re-add timers of one slot into lower wheels, return slot index
+int TimerWheel::cascade( timer_link_t * level, int idx )
+{
+	timer_link_t list;
+	list_move_all( &level[idx], &list );
+	while( list.m_next != &list ) {
+		Timer * t = static_cast< Timer * >( list.m_next );
+		list_del( t );
+		add_timer( t );
+	}
+	return idx;
+}
+
+int TimerWheel::Expire()
+{
+	return Expire( Time::Tick() );
+}
+
+int TimerWheel::Expire( uint32_t now )
+{
+	if( m_num == 0 ) {
+		// nothing to cascade, jump
+		if( (int32_t)( now - m_cur ) >= 0 )
+			m_cur = now + 1;
+		return 0;
+	}
+
+	int num = 0;
+	timer_link_t work;
+	while( (int32_t)( now - m_cur ) >= 0 && m_num > 0 ) {
+		int idx = m_cur & ( DGN_TIMER_ROOT_SIZE - 1 );
+		if( idx == 0 ) {
+			int level;
+			for( level = 0; level < DGN_TIMER_LEVEL_NUM; ++level ) {
+				int shift = DGN_TIMER_ROOT_BITS + level * DGN_TIMER_LEVEL_BITS;
+				if( cascade( m_levels[level], ( m_cur >> shift ) & ( DGN_TIMER_LEVEL_SIZE - 1 ) ) != 0 )
+					break;
+			}
+		}
+		m_cur++;
+
+		// callback may add or cancel any timer, include ones still in work list
+		list_move_all( &m_root[idx], &work );
+		while( work.m_next != &work ) {
+			Timer * t = static_cast< Timer * >( work.m_next );
+			del_timer( t );
+			(*t->m_cb)( t, t->m_arg );
+			num++;
+		}
+	}
+	if( m_num == 0 && (int32_t)( now - m_cur ) >= 0 )
+		m_cur = now + 1;
+	return num;
+}
+
+int TimerWheel::NextTimeout( int max_ms )
+{
+	if( m_num == 0 )
+		return max_ms;
+	uint32_t now = Time::Tick();
+
+	// first non-empty root slot before wrap, or wrap point for cascade
+	uint32_t next = m_cur;
+	do {
+		if( m_root[next & ( DGN_TIMER_ROOT_SIZE - 1 )].m_next != &m_root[next & ( DGN_TIMER_ROOT_SIZE - 1 )] )
+			break;
+		next++;
+	} while( ( next & ( DGN_TIMER_ROOT_SIZE - 1 ) ) != 0 );
+
+	int wait = (int)( next - now );
+	if( wait < 0 )
+		wait = 0;
+	return ( max_ms >= 0 && max_ms < wait ) ? max_ms : wait;
+}
+
+////////////////
+END_NS_DGN
+
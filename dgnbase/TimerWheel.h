@@ -0,0 +1,116 @@
+// TimerWheel.h : hierarchical timer wheel on millisecond tick
+// Copyright (C) 2011 ~ 2023 drangon <drangon.zhou (at) gmail.com>
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+
+
+#ifndef INCLUDED_DGN_TIMERWHEEL_H
+#define INCLUDED_DGN_TIMERWHEEL_H
+
+#include <dgn/dgn.h>
+
+BEGIN_NS_DGN
+////////////////
+
+#define DGN_TIMER_ROOT_BITS	8
+#define DGN_TIMER_LEVEL_BITS	6
+#define DGN_TIMER_LEVEL_NUM	4 // levels above root, root + 4 levels cover 32 bits tick
+#define DGN_TIMER_ROOT_SIZE	( 1 << DGN_TIMER_ROOT_BITS )
+#define DGN_TIMER_LEVEL_SIZE	( 1 << DGN_TIMER_LEVEL_BITS )
+
+class Timer;
+class TimerWheel;
+
+// called when expired, timer already removed from wheel and can be added again
+typedef void (* timer_cb_t)( Timer * t, void * arg );
+
+struct timer_link_t
+{
+	timer_link_t * m_prev;
+	timer_link_t * m_next;
+};
+
+// Note :
+// embed in user object, no allocation when add or cancel
+// not thread safe, add/cancel in the thread that call TimerWheel::Expire()
+class DGN_LIB_API Timer : protected timer_link_t
+{
+public:
+	Timer( timer_cb_t cb = NULL, void * arg = NULL ) : m_wheel( NULL ), m_expire( 0 ), m_cb( cb ), m_arg( arg ) { m_prev = m_next = NULL; }
+	~Timer() { Cancel(); }
+
+	Timer( const Timer & t ) = delete;
+	Timer & operator = ( const Timer & t ) = delete;
+
+	void SetFunc( timer_cb_t cb, void * arg ) { m_cb = cb, m_arg = arg; }
+	void Cancel(); // no-op if not pending
+	bool IsPending() const { return m_wheel != NULL; }
+	uint32_t GetExpire() const { return m_expire; } // Time::Tick() value
+
+protected:
+	friend class TimerWheel;
+
+	TimerWheel * m_wheel; // NULL if not pending
+	uint32_t m_expire;
+	timer_cb_t m_cb;
+	void * m_arg;
+};
+
+// Note :
+// root wheel of 256 1ms slots, then 4 wheels of 64 slots each 64 times coarser,
+// add and cancel O(1), far timers cascade down when root wheel wrap
+// delay at most INT_MAX ms, expired timers of same tick called in add order
+class DGN_LIB_API TimerWheel
+{
+public:
+	TimerWheel(); // start from Time::Tick()
+	~TimerWheel(); // pending timers cancelled, not called
+
+	TimerWheel( const TimerWheel & tw ) = delete;
+	TimerWheel & operator = ( const TimerWheel & tw ) = delete;
+
+	// add or re-add, delay_ms <= 0 expire at next Expire()
+	int Add( Timer * t, int delay_ms );
+	int AddAt( Timer * t, uint32_t expire );
+	void Cancel( Timer * t ) { t->Cancel(); }
+
+	// call callback of timers expired until now, return called number
+	int Expire();
+	int Expire( uint32_t now );
+
+	// ms until next expire for poll timeout, capped by max_ms ( < 0 for no cap )
+	// may wake up earlier than first timer when far timers need cascade
+	int NextTimeout( int max_ms );
+
+	int GetNum() const { return m_num; }
+
+protected:
+	friend class Timer;
+
+	void add_timer( Timer * t );
+	void del_timer( Timer * t );
+	int cascade( timer_link_t * level, int idx );
+
+protected:
+	uint32_t m_cur; // next tick to process
+	int m_num;
+	timer_link_t m_root[DGN_TIMER_ROOT_SIZE];
+	timer_link_t m_levels[DGN_TIMER_LEVEL_NUM][DGN_TIMER_LEVEL_SIZE];
+};
+
+////////////////
+END_NS_DGN
+
+#endif // INCLUDED_DGN_TIMERWHEEL_H
+
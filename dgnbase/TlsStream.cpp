@@ -0,0 +1,342 @@
+// TlsStream.cpp : tls over Socket, openssl based
+// Copyright (C) 2011 ~ 2023 drangon <drangon.zhou (at) gmail.com>
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+
+
+#include <dgn/TlsStream.h>
+#include <dgn/Logger.h>
+
+#ifdef DGN_WITH_OPENSSL
+#include <openssl/ssl.h>
+#include <openssl/err.h>
+#endif
+
+BEGIN_NS_DGN
+////////////////
+
+#ifndef DGN_WITH_OPENSSL
+
+int TlsCtx::InitClient( const char * ca_file, int verify )
+{
+	PR_ERR( "tls not support, build with WITH_OPENSSL=1" );
+	return -1;
+}
+
+int TlsCtx::InitServer( const char * cert_file, const char * key_file )
+{
+	PR_ERR( "tls not support, build with WITH_OPENSSL=1" );
+	return -1;
+}
+
+void TlsCtx::Fini()
+{
+	return;
+}
+
+void TlsCtx::SetKtls( int enable )
+{
+	return;
+}
+
+TlsStream::TlsStream() : m_sk( NULL ), m_ssl( NULL ), m_done( 0 )
+{
+}
+
+TlsStream::~TlsStream()
+{
+}
+
+int TlsStream::Connect( TlsCtx * ctx, Socket * sk, const char * host )
+{
+	return -1;
+}
+
+int TlsStream::Accept( TlsCtx * ctx, Socket * sk )
+{
+	return -1;
+}
+
+int TlsStream::Handshake()
+{
+	return -1;
+}
+
+int TlsStream::GetKtls() const
+{
+	return 0;
+}
+
+int TlsStream::Send( const char * buf, int len )
+{
+	return -1;
+}
+
+int TlsStream::Recv( char * buf, int minlen, int maxlen )
+{
+	return -1;
+}
+
+int TlsStream::Close()
+{
+	return 0;
+}
+
+#else // DGN_WITH_OPENSSL
+
+static void pr_ssl_err( const char * what )
+{
+	char buf[256];
+	unsigned long err = ERR_get_error();
+	ERR_error_string_n( err, buf, sizeof(buf) );
+	PR_DEBUG( "%s failed, %s", what, err != 0 ? buf : "no ssl error" );
+	ERR_clear_error();
+	return;
+}
+
+int TlsCtx::InitClient( const char * ca_file, int verify )
+{
+	Fini();
+	SSL_CTX * ctx = SSL_CTX_new( TLS_client_method() );
+	if( ctx == NULL ) {
+		pr_ssl_err( "SSL_CTX_new()" );
+		return -1;
+	}
+	SSL_CTX_set_min_proto_version( ctx, TLS1_2_VERSION );
+	if( verify ) {
+		int ret = ca_file != NULL ? SSL_CTX_load_verify_locations( ctx, ca_file, NULL ) : SSL_CTX_set_default_verify_paths( ctx );
+		if( ret != 1 ) {
+			pr_ssl_err( "load ca" );
+			SSL_CTX_free( ctx );
+			return -1;
+		}
+		SSL_CTX_set_verify( ctx, SSL_VERIFY_PEER, NULL );
+	}
+	m_ctx = ctx;
+	SetKtls( 1 );
+	return 0;
+}
+
+int TlsCtx::InitServer( const char * cert_file, const char * key_file )
+{
+	Fini();
+	SSL_CTX * ctx = SSL_CTX_new( TLS_server_method() );
+	if( ctx == NULL ) {
+		pr_ssl_err( "SSL_CTX_new()" );
+		return -1;
+	}
+	SSL_CTX_set_min_proto_version( ctx, TLS1_2_VERSION );
+	if( SSL_CTX_use_certificate_chain_file( ctx, cert_file ) != 1
+			|| SSL_CTX_use_PrivateKey_file( ctx, key_file, SSL_FILETYPE_PEM ) != 1
+			|| SSL_CTX_check_private_key( ctx ) != 1 ) {
+		pr_ssl_err( "load cert / key" );
+		PR_ERR( "tls server load cert [%s] key [%s] failed", cert_file, key_file );
+		SSL_CTX_free( ctx );
+		return -1;
+	}
+	m_ctx = ctx;
+	SetKtls( 1 );
+	return 0;
+}
+
+void TlsCtx::Fini()
+{
+	if( m_ctx != NULL )
+		SSL_CTX_free( (SSL_CTX *)m_ctx ), m_ctx = NULL;
+	return;
+}
+
+void TlsCtx::SetKtls( int enable )
+{
+	if( m_ctx == NULL )
+		return;
+#ifdef SSL_OP_ENABLE_KTLS
+	if( enable )
+		SSL_CTX_set_options( (SSL_CTX *)m_ctx, SSL_OP_ENABLE_KTLS );
+	else
+		SSL_CTX_clear_options( (SSL_CTX *)m_ctx, SSL_OP_ENABLE_KTLS );
+#endif
+	return;
+}
+
+TlsStream::TlsStream() : m_sk( NULL ), m_ssl( NULL ), m_done( 0 )
+{
+}
+
+TlsStream::~TlsStream()
+{
+	Close();
+}
+
+int TlsStream::Connect( TlsCtx * ctx, Socket * sk, const char * host )
+{
+	return start( ctx, sk, host, 0 );
+}
+
+int TlsStream::Accept( TlsCtx * ctx, Socket * sk )
+{
+	return start( ctx, sk, NULL, 1 );
+}
+
+int TlsStream::start( TlsCtx * ctx, Socket * sk, const char * host, int is_server )
+{
+	Close();
+	if( ctx == NULL || ! ctx->IsValid() || sk == NULL || ! sk->IsValid() )
+		return -1;
+	SSL * ssl = SSL_new( (SSL_CTX *)ctx->GetRaw() );
+	if( ssl == NULL ) {
+		pr_ssl_err( "SSL_new()" );
+		return -1;
+	}
+	// Send() may take part of data like Socket, and retry with the rest
+	SSL_set_mode( ssl, SSL_MODE_ENABLE_PARTIAL_WRITE | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER );
+	if( SSL_set_fd( ssl, (int)sk->GetRawSock() ) != 1 ) {
+		pr_ssl_err( "SSL_set_fd()" );
+		SSL_free( ssl );
+		return -1;
+	}
+	if( is_server ) {
+		SSL_set_accept_state( ssl );
+	}
+	else {
+		SSL_set_connect_state( ssl );
+		if( host != NULL && ( SSL_set_tlsext_host_name( ssl, host ) != 1 || SSL_set1_host( ssl, host ) != 1 ) ) {
+			pr_ssl_err( "set host" );
+			SSL_free( ssl );
+			return -1;
+		}
+	}
+	m_sk = sk;
+	m_ssl = ssl;
+	return Handshake();
+}
+
+int TlsStream::Handshake()
+{
+	if( m_ssl == NULL )
+		return -1;
+	if( m_done )
+		return 1;
+	while( 1 ) {
+		ERR_clear_error();
+		int ret = SSL_do_handshake( (SSL *)m_ssl );
+		if( ret == 1 ) {
+			m_done = 1;
+			PR_DEBUG( "tls handshake done, %s, ktls %d", SSL_get_version( (SSL *)m_ssl ), GetKtls() );
+			return 1;
+		}
+		ret = wait( ret );
+		if( ret <= 0 ) {
+			if( ret < 0 )
+				pr_ssl_err( "tls handshake" );
+			return ret;
+		}
+	}
+	return -1; // never come here
+}
+
+int TlsStream::GetKtls() const
+{
+	if( m_ssl == NULL )
+		return 0;
+	int ktls = 0;
+#ifndef OPENSSL_NO_KTLS
+	if( BIO_get_ktls_send( SSL_get_wbio( (SSL *)m_ssl ) ) )
+		ktls |= 1;
+	if( BIO_get_ktls_recv( SSL_get_rbio( (SSL *)m_ssl ) ) )
+		ktls |= 2;
+#endif
+	return ktls;
+}
+
+int TlsStream::wait( int ssl_ret )
+{
+	int evt = 0;
+	switch( SSL_get_error( (SSL *)m_ssl, ssl_ret ) ) {
+	case SSL_ERROR_WANT_READ : evt = DGN_POLLIN; break;
+	case SSL_ERROR_WANT_WRITE : evt = DGN_POLLOUT; break;
+	default : return -1;
+	}
+	if( m_sk->GetTimeout() <= 0 )
+		return 0;
+	int ret_evt = 0;
+	int ret = m_sk->Poll( evt, &ret_evt );
+	if( ret < 0 )
+		return -1;
+	return ret > 0 ? 1 : 0;
+}
+
+int TlsStream::Send( const char * buf, int len )
+{
+	if( ! IsValid() )
+		return -1;
+
+	int currlen = 0;
+	while( currlen < len ) {
+		ERR_clear_error();
+		int ret = SSL_write( (SSL *)m_ssl, buf + currlen, len - currlen );
+		if( ret > 0 ) {
+			currlen += ret;
+			continue;
+		}
+		ret = wait( ret );
+		if( ret <= 0 )
+			return ( ret < 0 && currlen == 0 ) ? -1 : currlen;
+	}
+	return currlen;
+}
+
+int TlsStream::Recv( char * buf, int minlen, int maxlen )
+{
+	if( ! IsValid() )
+		return -1;
+
+	int currlen = 0;
+	do {
+		ERR_clear_error();
+		int ret = SSL_read( (SSL *)m_ssl, buf + currlen, maxlen - currlen );
+		if( ret > 0 ) {
+			currlen += ret;
+			continue;
+		}
+		if( SSL_get_error( (SSL *)m_ssl, ret ) == SSL_ERROR_ZERO_RETURN )
+			return currlen == 0 ? -1 : currlen; // peer close_notify
+		ret = wait( ret );
+		if( ret <= 0 )
+			return ( ret < 0 && currlen == 0 ) ? -1 : currlen;
+	} while( currlen < minlen );
+	return currlen;
+}
+
+int TlsStream::Close()
+{
+	if( m_ssl != NULL ) {
+		if( m_done ) {
+			ERR_clear_error();
+			SSL_shutdown( (SSL *)m_ssl );
+		}
+		SSL_free( (SSL *)m_ssl );
+		m_ssl = NULL;
+	}
+	ERR_clear_error();
+	m_sk = NULL;
+	m_done = 0;
+	return 0;
+}
+
+#endif // DGN_WITH_OPENSSL
+
+////////////////
+END_NS_DGN
+
@@ -0,0 +1,97 @@
+// TlsStream.h : tls over Socket, openssl based
+// Copyright (C) 2011 ~ 2023 drangon <drangon.zhou (at) gmail.com>
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+
+
+#ifndef INCLUDED_DGN_TLSSTREAM_H
+#define INCLUDED_DGN_TLSSTREAM_H
+
+#include <dgn/Stream.h>
+#include <dgn/Socket.h>
+
+BEGIN_NS_DGN
+////////////////
+
+// Note :
+// only work when built with DGN_WITH_OPENSSL ( make WITH_OPENSSL=1 ), otherwise all Init/Connect/Accept fail
+// kernel tls offload ( ktls ) tried by default, openssl use it after handshake if kernel support,
+// then Send()/Recv() go through the socket without user space encryption
+
+// shared config, one for many connections
+class DGN_LIB_API TlsCtx
+{
+public:
+	TlsCtx() : m_ctx( NULL ) {}
+	~TlsCtx() { Fini(); }
+
+	TlsCtx( const TlsCtx & ctx ) = delete;
+	TlsCtx & operator = ( const TlsCtx & ctx ) = delete;
+
+	// ca_file NULL use system default ca, verify = 0 skip peer check ( test only )
+	int InitClient( const char * ca_file = NULL, int verify = 1 );
+	// pem files, cert_file can hold the chain
+	int InitServer( const char * cert_file, const char * key_file );
+	void Fini();
+
+	void SetKtls( int enable ); // call after Init
+	bool IsValid() const { return m_ctx != NULL; }
+	void * GetRaw() const { return m_ctx; } // SSL_CTX *
+
+protected:
+	void * m_ctx;
+};
+
+// Send()/Recv() keep Socket semantics, timeout follow the Socket
+class DGN_LIB_API TlsStream : public Stream
+{
+public:
+	TlsStream();
+	virtual ~TlsStream();
+
+	TlsStream( const TlsStream & ts ) = delete;
+	TlsStream & operator = ( const TlsStream & ts ) = delete;
+
+	// sk connected or accepted, not owned, must keep valid until Close()
+	// host used for SNI and certificate name check, can be NULL
+	// return 1 if handshake done, 0 if timeout ( call Handshake() to continue ), < 0 if error
+	int Connect( TlsCtx * ctx, Socket * sk, const char * host = NULL );
+	int Accept( TlsCtx * ctx, Socket * sk );
+	int Handshake();
+
+	Socket * GetSocket() const { return m_sk; }
+	// bit 1 : send offloaded, bit 2 : recv offloaded
+	int GetKtls() const;
+
+	virtual int Send( const char * buf, int len );
+	virtual int Recv( char * buf, int minlen, int maxlen );
+	virtual bool IsValid() const { return m_ssl != NULL && m_done; }
+	// send close_notify ( no wait ) and free tls session, socket not closed
+	virtual int Close();
+
+protected:
+	int start( TlsCtx * ctx, Socket * sk, const char * host, int is_server );
+	int wait( int ssl_ret ); // wait for what openssl want, return like Socket::Poll()
+
+protected:
+	Socket * m_sk;
+	void * m_ssl; // SSL *
+	int m_done;   // handshake done
+};
+
+////////////////
+END_NS_DGN
+
+#endif // INCLUDED_DGN_TLSSTREAM_H
+
@@ -31,6 +31,7 @@ BEGIN_NS_DGN
 static volatile int s_init_num = 0;
 static Mutex s_init_mtx;
 static Logger * s_logger = NULL;
+static std::map< CStr, Logger * > s_named_loggers;
 
 void DgnLib::Init( int argc, char * argv[] )
 {
@@ -66,6 +67,10 @@ void DgnLib::Fini()
 	WSACleanup();
 #endif
 
+	std::map< CStr, Logger * >::iterator it;
+	for( it = s_named_loggers.begin(); it != s_named_loggers.end(); ++it )
+		delete it->second;
+	s_named_loggers.clear();
 	delete s_logger, s_logger = NULL;
 
 	return;
@@ -76,6 +81,19 @@ Logger * DgnLib::GetLogger()
 	return s_logger;
 }
 
+Logger * DgnLib::GetLogger( const char * name )
+{
+	if( name == NULL || name[0] == '\0' )
+		return s_logger;
+	MutexGuard guard( &s_init_mtx );
+	if( s_init_num == 0 )
+		return NULL;
+	Logger *& logger = s_named_loggers[name];
+	if( logger == NULL )
+		logger = new Logger();
+	return logger;
+}
+
 const char * DgnLib::GetName()
 {
 	return DGN_LIB_NAME;
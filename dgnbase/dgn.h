@@ -119,6 +119,10 @@ public:
 	static void Fini();
 	
 	static Logger * GetLogger();
+	// named Logger, e.g. "access", created at first use with default settings ( no output
+	// until InitLogFile() etc. ), own file, lock and writer thread, deleted by Fini(),
+	// name NULL or "" for default one, lookup hold a lock, keep the pointer for hot path
+	static Logger * GetLogger( const char * name );
 
 	static const char * GetName();
 	static const char * GetDesc();
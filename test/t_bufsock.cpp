@@ -0,0 +1,112 @@
+// t_bufsock.cpp : test dgn buffered socket
+// Copyright (C) 2011 ~ 2023 drangon <drangon.zhou (at) gmail.com>
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+
+#include <dgn/BufferedSocket.h>
+
+#include "catch.hpp"
+
+#include <stdio.h>
+#include <string.h>
+
+using namespace dgn;
+
+TEST_CASE( "buffered socket", "[bufsock]")
+{
+	Socket svr;
+	int ret = svr.TcpSvr( "127.0.0.1", 0 );
+	CHECK( ret == 0 );
+	char ip[DGN_IP_LEN];
+	int port = 0;
+	svr.LocalAddr( ip, &port );
+
+	Socket cli;
+	cli.SetTimeout( 1000 );
+	CHECK( cli.Connect( "127.0.0.1", port ) == DGN_SOCKET_CONNECT_OK );
+	svr.SetTimeout( 1000 );
+	Socket * peer = svr.Accept();
+	REQUIRE( peer != NULL );
+	peer->SetTimeout( 1000 );
+
+	BufferedSocket wr( &cli, 4096, 64 );
+	BufferedSocket rd( peer, 16 );
+
+	// small writes coalesced until flush
+	ret = wr.Write( "hello\r\n", 7 );
+	CHECK( ret == 7 );
+	ret = wr.Write( "world\nab", 8 );
+	CHECK( ret == 8 );
+	CHECK( wr.GetWritePending() == 15 );
+	ret = wr.WriteFrame( "fr\0me", 5 );
+	CHECK( ret == 9 );
+	ret = wr.Write( "cd--end--xyz", 12 );
+	CHECK( ret == 12 );
+	ret = wr.Flush();
+	CHECK( ret == 0 );
+
+	CStr s;
+	ret = rd.ReadLine( &s );
+	CHECK( ret == 7 );
+	CHECK( s == "hello" );
+	ret = rd.ReadLine( &s );
+	CHECK( ret == 6 );
+	CHECK( s == "world" );
+	char buf[16];
+	ret = rd.ReadExact( buf, 2 );
+	CHECK( ret == 2 );
+	CHECK( memcmp( buf, "ab", 2 ) == 0 );
+	ret = rd.ReadFrame( &s );
+	CHECK( ret == 9 );
+	CHECK( s.Len() == 5 );
+	CHECK( memcmp( s.Str(), "fr\0me", 5 ) == 0 );
+	ret = rd.ReadUntil( "--end--", 7, &s );
+	CHECK( ret == 9 );
+	CHECK( s == "cd" );
+	ret = rd.Read( buf, sizeof(buf) );
+	CHECK( ret == 3 );
+
+	// large write bypass buffer, read buffer grow
+	CStr big;
+	int i;
+	for( i = 0; i < 1000; ++i )
+		big.AppendFmt( "%04d", i );
+	ret = wr.Write( big.Str(), big.Len() );
+	CHECK( ret == big.Len() );
+	ret = wr.Write( "\n", 1 );
+	ret = wr.Flush();
+	CHECK( ret == 0 );
+	ret = rd.ReadLine( &s, 100 );
+	CHECK( ret < 0 ); // too long
+	ret = rd.ReadLine( &s );
+	CHECK( ret == big.Len() + 1 );
+	CHECK( s == big );
+
+	// timeout keep partial data
+	peer->SetTimeout( 50 );
+	ret = cli.Send( "part", 4 );
+	ret = rd.ReadLine( &s );
+	CHECK( ret == 0 );
+	CHECK( rd.GetReadPending() == 4 );
+	ret = cli.Send( "ial\n", 4 );
+	ret = rd.ReadLine( &s );
+	CHECK( ret == 8 );
+	CHECK( s == "partial" );
+
+	// peer closed
+	cli.Close();
+	ret = rd.ReadExact( buf, 1 );
+	CHECK( ret < 0 );
+	delete peer;
+}
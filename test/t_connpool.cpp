@@ -0,0 +1,81 @@
+// t_connpool.cpp : test dgn connection pool
+// Copyright (C) 2011 ~ 2023 drangon <drangon.zhou (at) gmail.com>
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+
+#include <dgn/ConnPool.h>
+#include <dgn/Time.h>
+
+#include "catch.hpp"
+
+#include <stdio.h>
+#include <string.h>
+
+using namespace dgn;
+
+TEST_CASE( "conn pool reuse", "[connpool]")
+{
+	Socket svr;
+	int ret = svr.TcpSvr( "127.0.0.1", 0 );
+	CHECK( ret == 0 );
+	char ip[DGN_IP_LEN];
+	int port = 0;
+	svr.LocalAddr( ip, &port );
+
+	ConnPool pool;
+	ret = pool.Init( 2, 2, 200, 0, 1000 );
+	CHECK( ret == 0 );
+
+	Socket * sk1 = pool.Get( "127.0.0.1", port );
+	CHECK( sk1 != NULL );
+	pool.Put( sk1 );
+	CHECK( pool.GetIdleNum() == 1 );
+	Socket * sk2 = pool.Get( "127.0.0.1", port );
+	CHECK( sk2 == sk1 );
+
+	// per host limit
+	Socket * sk3 = pool.Get( "127.0.0.1", port );
+	CHECK( sk3 != NULL );
+	Socket * sk4 = pool.Get( "127.0.0.1", port );
+	CHECK( sk4 == NULL );
+	CHECK( pool.GetBusyNum() == 2 );
+
+	// peer closed idle connection should not be reused
+	char ip2[DGN_IP_LEN];
+	int port2 = 0;
+	CHECK( sk2->LocalAddr( ip2, &port2 ) == 0 );
+	pool.Put( sk2 );
+	pool.Put( sk3, 0 );
+	svr.SetTimeout( 1000 );
+	Socket * peer = svr.Accept();
+	CHECK( peer != NULL );
+	delete peer;
+	Time::SleepMs( 20 );
+	Socket * sk5 = pool.Get( "127.0.0.1", port );
+	REQUIRE( sk5 != NULL );
+	CHECK( sk5->PeekAlive() == 1 );
+	// a new connection, the dead one evicted ( object address may be reused )
+	char ip5[DGN_IP_LEN];
+	int port5 = 0;
+	CHECK( sk5->LocalAddr( ip5, &port5 ) == 0 );
+	CHECK( port5 != port2 );
+	pool.Put( sk5 );
+
+	// idle timeout
+	Time::SleepMs( 250 );
+	ret = pool.CheckIdle();
+	CHECK( ret == 1 );
+	CHECK( pool.GetIdleNum() == 0 );
+	pool.Fini();
+}
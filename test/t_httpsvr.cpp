@@ -0,0 +1,197 @@
+// t_httpsvr.cpp : test dgn http server
+// Copyright (C) 2011 ~ 2023 drangon <drangon.zhou (at) gmail.com>
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+
+#include <dgn/HttpSvr.h>
+#include <dgn/BufferedSocket.h>
+#include <dgn/Time.h>
+
+#include "catch.hpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+using namespace dgn;
+
+static void http_echo( HttpRequest * req, HttpResponse * rsp, void * arg )
+{
+	if( req->m_path == "/chunk" ) {
+		rsp->SetChunked();
+		rsp->AppendBody( "abc", 3 );
+		rsp->AppendBody( "defgh", 5 );
+		return;
+	}
+	if( req->m_path == "/close" )
+		rsp->SetKeepAlive( 0 );
+	const CStr * ua = req->GetHeader( "user-agent" );
+	rsp->AddHeader( "X-Agent", ua != NULL ? ua->Str() : "" );
+	CStr body;
+	body.AssignFmt( "%s %s?%s ", req->m_method.Str(), req->m_path.Str(), req->m_query.Str() );
+	body.Append( req->m_body, req->m_body_len );
+	rsp->SetBody( body.Str(), body.Len() );
+}
+
+// read one response, return status code, body in *body
+static int read_response( BufferedSocket * bs, CStr * body, int * keep_alive )
+{
+	CStr line;
+	if( bs->ReadLine( &line ) <= 0 )
+		return -1;
+	int code = CStr::ToInt( line.Str() + 9 );
+	int len = -1, chunked = 0;
+	*keep_alive = 1;
+	while( bs->ReadLine( &line ) > 0 && line.Len() > 0 ) {
+		if( line.CaseCmp( "Content-Length: ", 16 ) == 0 )
+			len = CStr::ToInt( line.Str() + 16 );
+		else if( line == "Transfer-Encoding: chunked" )
+			chunked = 1;
+		else if( line == "Connection: close" )
+			*keep_alive = 0;
+	}
+	body->Assign( "", 0 );
+	if( chunked ) {
+		while( bs->ReadLine( &line ) > 0 ) {
+			int size = (int)strtol( line.Str(), NULL, 16 );
+			CStr data;
+			if( size > 0 ) {
+				data.Reserve( size + 1 );
+				bs->ReadExact( data.GetRaw(), size );
+				data.ReleaseRaw( size );
+				body->Append( data );
+			}
+			bs->ReadLine( &line );
+			if( size == 0 )
+				break;
+		}
+	}
+	else if( len > 0 ) {
+		body->Reserve( len + 1 );
+		bs->ReadExact( body->GetRaw(), len );
+		body->ReleaseRaw( len );
+	}
+	return code;
+}
+
+TEST_CASE( "http server", "[httpsvr]")
+{
+	HttpSvr svr;
+	int ret = svr.Init( "127.0.0.1", 0, http_echo, NULL );
+	REQUIRE( ret == 0 );
+	ret = svr.Start();
+	CHECK( ret == 0 );
+
+	Socket cli;
+	cli.SetTimeout( 2000 );
+	CHECK( cli.Connect( "127.0.0.1", svr.GetPort() ) == DGN_SOCKET_CONNECT_OK );
+	BufferedSocket bs( &cli );
+
+	// pipelined requests, content-length and chunked body
+	const char * reqs = "GET /a?x=1 HTTP/1.1\r\nHost: t\r\nUser-Agent: catch\r\n\r\n"
+		"POST /b HTTP/1.1\r\nContent-Length: 5\r\n\r\nhello"
+		"POST /c HTTP/1.1\r\ntransfer-encoding: chunked\r\n\r\n3;ext=1\r\nabc\r\n2\r\nde\r\n0\r\nTrailer: t\r\n\r\n"
+		"GET /chunk HTTP/1.1\r\n\r\n";
+	ret = cli.Send( reqs, (int)strlen( reqs ) );
+	CHECK( ret == (int)strlen( reqs ) );
+
+	CStr body;
+	int keep_alive = 0;
+	ret = read_response( &bs, &body, &keep_alive );
+	CHECK( ret == 200 );
+	CHECK( body == "GET /a?x=1 " );
+	ret = read_response( &bs, &body, &keep_alive );
+	CHECK( ret == 200 );
+	CHECK( body == "POST /b? hello" );
+	ret = read_response( &bs, &body, &keep_alive );
+	CHECK( ret == 200 );
+	CHECK( body == "POST /c? abcde" );
+	ret = read_response( &bs, &body, &keep_alive );
+	CHECK( ret == 200 );
+	CHECK( body == "abcdefgh" );
+	CHECK( keep_alive == 1 );
+
+	// request split into pieces
+	ret = cli.Send( "GET /sp", 7 );
+	Time::SleepMs( 20 );
+	ret = cli.Send( "lit HTTP/1.1\r\nContent-Le", 24 );
+	Time::SleepMs( 20 );
+	ret = cli.Send( "ngth: 2\r\n\r\nxy", 13 );
+	ret = read_response( &bs, &body, &keep_alive );
+	CHECK( ret == 200 );
+	CHECK( body == "GET /split? xy" );
+
+	ret = cli.Send( "GET /close HTTP/1.1\r\n\r\n", 23 );
+	ret = read_response( &bs, &body, &keep_alive );
+	CHECK( ret == 200 );
+	CHECK( keep_alive == 0 );
+	char buf[16];
+	ret = bs.Read( buf, sizeof(buf) );
+	CHECK( ret < 0 );
+
+	// bad request
+	Socket cli2;
+	cli2.SetTimeout( 2000 );
+	CHECK( cli2.Connect( "127.0.0.1", svr.GetPort() ) == DGN_SOCKET_CONNECT_OK );
+	BufferedSocket bs2( &cli2 );
+	ret = cli2.Send( "GET /x HTTP/2.0\r\n\r\n", 19 );
+	ret = read_response( &bs2, &body, &keep_alive );
+	CHECK( ret == 400 );
+	CHECK( keep_alive == 0 );
+
+	svr.Fini();
+}
+
+static void http_count( HttpRequest * req, HttpResponse * rsp, void * arg )
+{
+	( *(int *)arg )++;
+	if( req->m_path == "/big" ) {
+		// larger than socket buffers, flushed over several POLLOUT
+		CStr body;
+		body.Reserve( 4 * 1024 * 1024 + 1 );
+		memset( body.GetRaw(), 'x', 4 * 1024 * 1024 );
+		body.ReleaseRaw( 4 * 1024 * 1024 );
+		rsp->SetKeepAlive( 0 );
+		rsp->SetBody( body.Str(), body.Len() );
+		return;
+	}
+	rsp->SetBody( "ok", 2 );
+}
+
+TEST_CASE( "http server close drop pipelined", "[httpsvr]")
+{
+	int hits = 0;
+	HttpSvr svr;
+	REQUIRE( svr.Init( "127.0.0.1", 0, http_count, &hits ) == 0 );
+	CHECK( svr.Start() == 0 );
+
+	Socket cli;
+	cli.SetTimeout( 2000 );
+	CHECK( cli.Connect( "127.0.0.1", svr.GetPort() ) == DGN_SOCKET_CONNECT_OK );
+	BufferedSocket bs( &cli );
+	const char * reqs = "GET /big HTTP/1.1\r\n\r\nGET /a HTTP/1.1\r\n\r\nGET /b HTTP/1.1\r\n\r\n";
+	CHECK( cli.Send( reqs, (int)strlen( reqs ) ) == (int)strlen( reqs ) );
+	Time::SleepMs( 50 ); // server blocked on full send buffer
+
+	CStr body;
+	int keep_alive = 1;
+	CHECK( read_response( &bs, &body, &keep_alive ) == 200 );
+	CHECK( body.Len() == 4 * 1024 * 1024 );
+	CHECK( keep_alive == 0 );
+	char buf[16];
+	CHECK( bs.Read( buf, sizeof(buf) ) < 0 );
+	CHECK( hits == 1 );
+
+	svr.Fini();
+}
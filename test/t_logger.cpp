@@ -0,0 +1,835 @@
+// t_logger.cpp : test dgn logger
+// Copyright (C) 2011 ~ 2023 drangon <drangon.zhou (at) gmail.com>
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+
+
+#include <dgn/Logger.h>
+#include <dgn/Thread.h>
+#include <dgn/Time.h>
+
+#include "catch.hpp"
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <io.h> // unlink()
+#else
+#include <unistd.h>
+#include <sys/wait.h>
+#include <signal.h>
+#endif
+
+using namespace dgn;
+
+#define T_LOG_FILE	"t_logger.log"
+
+struct log_arg_t
+{
+	Logger * m_logger;
+	int m_idx;
+	int m_num;
+};
+
+static int log_writer( Thread * th, void * arg )
+{
+	log_arg_t * la = (log_arg_t *)arg;
+	int i;
+	for( i = 0; i < la->m_num; ++i )
+		la->m_logger->Log( DGN_LOG_LEVEL_INFO, __FILE__, __LINE__, "thread %d seq %d" DGN_LOG_LINE_END, la->m_idx, i );
+	return 0;
+}
+
+// return line number, check seq of each thread increase
+static int check_log_file( const char * fname, int thread_num )
+{
+	FILE * fp = fopen( fname, "r" );
+	if( fp == NULL )
+		return -1;
+	int last[16];
+	int i;
+	for( i = 0; i < thread_num; ++i )
+		last[i] = -1;
+	int num = 0;
+	char line[1024];
+	while( fgets( line, sizeof(line), fp ) != NULL ) {
+		const char * p = strstr( line, "thread " );
+		int idx = 0, seq = 0;
+		if( p == NULL || sscanf( p, "thread %d seq %d", &idx, &seq ) != 2 || idx >= thread_num || seq <= last[idx] ) {
+			num = -1;
+			break;
+		}
+		last[idx] = seq;
+		num++;
+	}
+	fclose( fp );
+	return num;
+}
+
+static int run_log_threads( Logger * logger, int thread_num, int line_num )
+{
+	log_arg_t args[16];
+	ThreadObj ths[16];
+	int i;
+	for( i = 0; i < thread_num; ++i ) {
+		args[i].m_logger = logger;
+		args[i].m_idx = i;
+		args[i].m_num = line_num;
+		ths[i].SetFunc( log_writer, &args[i] );
+		if( ths[i].Start() < 0 )
+			return -1;
+	}
+	for( i = 0; i < thread_num; ++i )
+		ths[i].WaitStop();
+	return 0;
+}
+
+TEST_CASE( "logger async", "[logger]" )
+{
+	unlink( T_LOG_FILE );
+	Logger logger;
+	logger.InitLevel( DGN_LOG_LEVEL_DEBUG );
+	logger.InitLogFile( T_LOG_FILE );
+	REQUIRE( logger.InitAsync( 1 ) == 0 );
+	REQUIRE( logger.InitAsync( 1 ) == 0 );
+
+	REQUIRE( run_log_threads( &logger, 4, 5000 ) == 0 );
+	REQUIRE( logger.Flush() == 0 );
+	int64_t dropped = logger.GetDropped();
+	REQUIRE( check_log_file( T_LOG_FILE, 4 ) + dropped == 4 * 5000 );
+
+	// small ring and slow writer, drop instead of block
+	REQUIRE( logger.InitAsync( 0 ) == 0 );
+	unlink( T_LOG_FILE );
+	logger.InitLogFile( T_LOG_FILE );
+	REQUIRE( logger.InitAsync( 1, 1, 1000 ) == 0 );
+	REQUIRE( run_log_threads( &logger, 2, 20000 ) == 0 );
+	REQUIRE( logger.Flush() == 0 );
+	int num = check_log_file( T_LOG_FILE, 2 );
+	REQUIRE( num > 0 );
+	REQUIRE( logger.GetDropped() - dropped > 0 );
+	REQUIRE( num + logger.GetDropped() - dropped == 2 * 20000 );
+
+	// sync again, written at once
+	REQUIRE( logger.InitAsync( 0 ) == 0 );
+	logger.Log( DGN_LOG_LEVEL_INFO, __FILE__, __LINE__, "thread 0 seq 99999" DGN_LOG_LINE_END );
+	REQUIRE( check_log_file( T_LOG_FILE, 2 ) == num + 1 );
+	unlink( T_LOG_FILE );
+}
+
+TEST_CASE( "logger prefix", "[logger]" )
+{
+	unlink( T_LOG_FILE );
+	Logger logger;
+	logger.InitLogFile( T_LOG_FILE );
+	int coarse;
+	for( coarse = 0; coarse < 2; ++coarse ) {
+		logger.InitCoarseTime( coarse );
+		Time before, after;
+		before.SetNow();
+		logger.Log( DGN_LOG_LEVEL_ERR, "/a/b/c.cpp", 1234, "msg %d" DGN_LOG_LINE_END, coarse );
+		after.SetNow();
+
+		char line[256] = { 0 };
+		FILE * fp = fopen( T_LOG_FILE, "r" );
+		REQUIRE( fp != NULL );
+		int i;
+		for( i = 0; i <= coarse; ++i )
+			REQUIRE( fgets( line, sizeof(line), fp ) != NULL );
+		fclose( fp );
+
+		REQUIRE( strlen( line ) == 20 + strlen( "|c.cpp:1234|ERR msg 0\n" ) );
+		REQUIRE( strncmp( line + 20, "|c.cpp:1234|ERR msg ", 20 ) == 0 );
+		REQUIRE( line[13] == '.' );
+		char exp[2][32];
+		snprintf( exp[0], sizeof(exp[0]), "%02d%02d %02d:%02d:%02d.", before.m_month, before.m_day, before.m_hour, before.m_minute, before.m_sec );
+		snprintf( exp[1], sizeof(exp[1]), "%02d%02d %02d:%02d:%02d.", after.m_month, after.m_day, after.m_hour, after.m_minute, after.m_sec );
+		// coarse clock may lag a tick behind
+		REQUIRE( ( strncmp( line, exp[0], 14 ) == 0 || strncmp( line, exp[1], 14 ) == 0 || coarse ) );
+		for( i = 14; i < 20; ++i )
+			REQUIRE( ( line[i] >= '0' && line[i] <= '9' ) );
+	}
+	unlink( T_LOG_FILE );
+}
+
+static int format_args( char * buf, const char * fmt, LogArgs * la )
+{
+	return Logger::FormatArgs( buf, 64, fmt, la->Len() > 0 ? la->Buf() : "", la->Len() );
+}
+
+TEST_CASE( "logger format args", "[logger]" )
+{
+	char args[DGN_LOG_ARGS_MAX];
+	char buf[64];
+	LogArgs la( args, sizeof(args) );
+	log_put_args( &la, 3.14159, 7, 42, 42LL, "abcdef", (unsigned char)'x', (void *)0x1234 );
+	const char * fmt = "%5.2f|%-*d|%05lld|%.3s|%c|%p|100%%";
+	char exp[64];
+	snprintf( exp, sizeof(exp), fmt, 3.14159, 7, 42, 42LL, "abcdef", 'x', (void *)0x1234 );
+	REQUIRE( format_args( buf, fmt, &la ) == (int)strlen( exp ) );
+	REQUIRE( strcmp( buf, exp ) == 0 );
+
+	LogArgs la2( args, sizeof(args) );
+	log_put_args( &la2, 1, "s" );
+	REQUIRE( format_args( buf, "%d %d %s", &la2 ) > 0 );
+	REQUIRE( strcmp( buf, "1 <?> <?>" ) == 0 ); // "s" taken by second %d
+	REQUIRE( format_args( buf, "%d %s %s", &la2 ) > 0 );
+	REQUIRE( strcmp( buf, "1 s <?>" ) == 0 );
+
+	// truncated to cap
+	LogArgs la3( args, sizeof(args) );
+	log_put_args( &la3, "0123456789012345678901234567890123456789012345678901234567890123456789" );
+	REQUIRE( format_args( buf, "[%s]", &la3 ) == 63 );
+	REQUIRE( strlen( buf ) == 63 );
+
+	// long string truncated when encoded
+	LogArgs la4( args, 16 );
+	log_put_args( &la4, 1, "0123456789abcdef" );
+	REQUIRE( la4.Len() == 16 );
+	REQUIRE( format_args( buf, "%d %s", &la4 ) > 0 );
+	REQUIRE( strcmp( buf, "1 01234567" ) == 0 );
+}
+
+static int read_file( const char * fname, char * buf, int cap )
+{
+	FILE * fp = fopen( fname, "rb" );
+	if( fp == NULL )
+		return -1;
+	int len = (int)fread( buf, 1, cap, fp );
+	fclose( fp );
+	return len;
+}
+
+TEST_CASE( "logger deferred", "[logger]" )
+{
+	static LogSite site = { DGN_LOG_LEVEL_INFO, "/x/d.cpp", 77, "v %d %s %.1f %lld" DGN_LOG_LINE_END, NULL, 0, 0 };
+	static LogSite site_dbg = { DGN_LOG_LEVEL_DEBUG, "/x/d.cpp", 78, "filtered" DGN_LOG_LINE_END, NULL, 0, 0 };
+	char buf[4096];
+
+	// text same as sync
+	unlink( T_LOG_FILE );
+	{
+		Logger logger;
+		logger.InitLevel( DGN_LOG_LEVEL_INFO );
+		logger.InitLogFile( T_LOG_FILE );
+		REQUIRE( logger.InitAsync( 1 ) == 0 );
+		REQUIRE( logger.InitDeferred( 1 ) == 0 );
+		logger.LogD( &site, 5, "str", 2.5, -3LL );
+		logger.LogD( &site_dbg );
+		REQUIRE( logger.Flush() == 0 );
+		REQUIRE( site.m_id > 0 );
+		REQUIRE( site_dbg.m_id == 0 );
+		REQUIRE( logger.InitAsync( 0 ) == 0 );
+		logger.LogD( &site, 5, "str", 2.5, -3LL );
+	}
+	int len = read_file( T_LOG_FILE, buf, sizeof(buf) - 1 );
+	buf[len > 0 ? len : 0] = '\0';
+	const char * exp = "|d.cpp:77|INFO v 5 str 2.5 -3" DGN_LOG_LINE_END;
+	int exp_len = (int)strlen( exp );
+	REQUIRE( len == 2 * ( 20 + exp_len ) );
+	REQUIRE( memcmp( buf + 20, exp, exp_len ) == 0 );
+	REQUIRE( memcmp( buf + 20 + exp_len + 20, exp, exp_len ) == 0 );
+
+	// binary file, text record mixed in
+	unlink( T_LOG_FILE );
+	{
+		Logger logger;
+		logger.InitLogFile( T_LOG_FILE );
+		REQUIRE( logger.InitAsync( 1 ) == 0 );
+		REQUIRE( logger.InitDeferred( 1, 1 ) == 0 );
+		logger.LogD( &site, 1, "a", 0.5, 10LL );
+		logger.Log( DGN_LOG_LEVEL_ERR, __FILE__, __LINE__, "plain %d" DGN_LOG_LINE_END, 9 );
+		logger.LogD( &site, 2, "b", 1.5, 20LL );
+		REQUIRE( logger.Flush() == 0 );
+		// sync again, text entry instead of lost
+		REQUIRE( logger.InitAsync( 0 ) == 0 );
+		logger.Log( DGN_LOG_LEVEL_ERR, __FILE__, __LINE__, "sync %d" DGN_LOG_LINE_END, 7 );
+	}
+	len = read_file( T_LOG_FILE, buf, sizeof(buf) );
+	REQUIRE( len > DGN_LOG_BIN_MAGIC_LEN );
+	REQUIRE( memcmp( buf, DGN_LOG_BIN_MAGIC, DGN_LOG_BIN_MAGIC_LEN ) == 0 );
+
+	const char * fmt = NULL;
+	int fmt_len = 0;
+	char text[4][256];
+	int num = 0;
+	int pos = DGN_LOG_BIN_MAGIC_LEN;
+	while( pos + 5 <= len && num < 4 ) {
+		int type = buf[pos];
+		uint32_t elen;
+		memcpy( &elen, buf + pos + 1, 4 );
+		const char * p = buf + pos + 5;
+		pos += 5 + elen;
+		REQUIRE( pos <= len );
+		if( type == DGN_LOG_BIN_SITE ) {
+			uint16_t flen, mlen;
+			memcpy( &flen, p + 9, 2 );
+			REQUIRE( memcmp( p + 11, "/x/d.cpp", flen ) == 0 );
+			memcpy( &mlen, p + 11 + flen, 2 );
+			fmt = p + 13 + flen;
+			fmt_len = mlen;
+		}
+		else if( type == DGN_LOG_BIN_LOG ) {
+			REQUIRE( fmt != NULL );
+			char f[128];
+			memcpy( f, fmt, fmt_len );
+			f[fmt_len] = '\0';
+			Logger::FormatArgs( text[num++], 256, f, p + 12, (int)elen - 12 );
+		}
+		else if( type == DGN_LOG_BIN_TEXT ) {
+			memcpy( text[num], p + 9, elen - 9 );
+			text[num++][elen - 9] = '\0';
+		}
+	}
+	REQUIRE( num == 4 );
+	REQUIRE( strcmp( text[0], "v 1 a 0.5 10" DGN_LOG_LINE_END ) == 0 );
+	REQUIRE( strstr( text[1], "|ERR plain 9" DGN_LOG_LINE_END ) != NULL );
+	REQUIRE( strcmp( text[2], "v 2 b 1.5 20" DGN_LOG_LINE_END ) == 0 );
+	REQUIRE( strstr( text[3], "|ERR sync 7" DGN_LOG_LINE_END ) != NULL );
+	REQUIRE( pos == len );
+	unlink( T_LOG_FILE );
+
+	// string longer than any encoded one, from a corrupted file
+	static char bad[3 + 0xffff];
+	bad[0] = DGN_LOG_ARG_STR;
+	bad[1] = bad[2] = (char)0xff;
+	memset( bad + 3, 'z', 0xffff );
+	char out[256];
+	REQUIRE( Logger::FormatArgs( out, sizeof(out), "%s", bad, sizeof(bad) ) == (int)sizeof(out) - 1 );
+	REQUIRE( out[0] == 'z' );
+}
+
+// return line number read
+static int read_lines( const char * fname, char lines[][2048], int max )
+{
+	FILE * fp = fopen( fname, "r" );
+	if( fp == NULL )
+		return -1;
+	int num = 0;
+	while( num < max && fgets( lines[num], 2048, fp ) != NULL )
+		num++;
+	fclose( fp );
+	return num;
+}
+
+enum { T_KV_ENUM = 3 };
+
+TEST_CASE( "logger kv", "[logger]" )
+{
+	static char lines[6][2048];
+	unlink( T_LOG_FILE );
+	{
+		Logger logger;
+		logger.InitLogFile( T_LOG_FILE );
+		logger.LogKV( DGN_LOG_LEVEL_INFO, "/x/k.cpp", 5, "login", "user", 42, "lat_us", -7LL, "ok", true, "ratio", 0.25,
+				"name", "bob", "note", "a b=\"c\"", "e", T_KV_ENUM );
+		logger.LogKV( DGN_LOG_LEVEL_ERR, "/x/k.cpp", 6, "bare" );
+		logger.LogKV( DGN_LOG_LEVEL_DEBUG, "/x/k.cpp", 7, "filtered", "k", 1 );
+	}
+	REQUIRE( read_lines( T_LOG_FILE, lines, 6 ) == 2 );
+	REQUIRE( strcmp( lines[0] + 20, "|k.cpp:5|INFO login user=42 lat_us=-7 ok=true ratio=0.25 name=bob note=\"a b=\\\"c\\\"\" e=3\n" ) == 0 );
+	REQUIRE( strcmp( lines[1] + 20, "|k.cpp:6|ERR bare\n" ) == 0 );
+
+	unlink( T_LOG_FILE );
+	static LogSite site = { DGN_LOG_LEVEL_INFO, "/x/k.cpp", 9, "deferred %d \"%s\"" DGN_LOG_LINE_END, NULL, 0, 0 };
+	{
+		Logger logger;
+		logger.InitLogFile( T_LOG_FILE );
+		REQUIRE( logger.InitJson( 1 ) == 0 );
+		int64_t before = Time::Now();
+		logger.LogKV( DGN_LOG_LEVEL_INFO, "/x/k.cpp", 5, "login\t1", "user", 42U, "lat_us", 1234567890123LL, "ok", false,
+				"name", "b\\o\"b", "nil", (const char *)NULL, "p", (void *)0xabc );
+		logger.Log( DGN_LOG_LEVEL_ERR, "/x/k.cpp", 6, "plain %s" DGN_LOG_LINE_END, "x\"y" );
+		// async and deferred format at writer
+		REQUIRE( logger.InitAsync( 1 ) == 0 );
+		REQUIRE( logger.InitDeferred( 1 ) == 0 );
+		logger.LogD( &site, 3, "q" );
+		logger.LogKV( DGN_LOG_LEVEL_INFO, "/x/k.cpp", 10, "async", "v", 1.5 );
+		REQUIRE( logger.Flush() == 0 );
+
+		// ts in us since epoch
+		REQUIRE( read_lines( T_LOG_FILE, lines, 6 ) == 4 );
+		long long ts = 0;
+		REQUIRE( sscanf( lines[0], "{\"ts\":%lld,", &ts ) == 1 );
+		REQUIRE( ts >= before );
+		REQUIRE( ts <= Time::Now() );
+	}
+	int i;
+	for( i = 0; i < 4; ++i ) {
+		char * p = strchr( lines[i], ',' );
+		REQUIRE( p != NULL );
+		memmove( lines[i], p, strlen( p ) + 1 );
+	}
+	REQUIRE( strcmp( lines[0], ",\"level\":\"INFO\",\"file\":\"k.cpp\",\"line\":5,\"msg\":\"login\\t1\",\"user\":42,"
+			"\"lat_us\":1234567890123,\"ok\":false,\"name\":\"b\\\\o\\\"b\",\"nil\":null,\"p\":\"0xabc\"}\n" ) == 0 );
+	REQUIRE( strcmp( lines[1], ",\"level\":\"ERR\",\"file\":\"k.cpp\",\"line\":6,\"msg\":\"plain x\\\"y\"}\n" ) == 0 );
+	REQUIRE( strcmp( lines[2], ",\"level\":\"INFO\",\"file\":\"k.cpp\",\"line\":9,\"msg\":\"deferred 3 \\\"q\\\"\"}\n" ) == 0 );
+	REQUIRE( strcmp( lines[3], ",\"level\":\"INFO\",\"file\":\"k.cpp\",\"line\":10,\"msg\":\"async\",\"v\":1.5}\n" ) == 0 );
+
+	// field not fit dropped whole, line still valid
+	unlink( T_LOG_FILE );
+	{
+		static char big[3000];
+		memset( big, 'a', sizeof(big) - 1 );
+		Logger logger;
+		logger.InitLogFile( T_LOG_FILE );
+		logger.InitJson( 1 );
+		logger.LogKV( DGN_LOG_LEVEL_INFO, "/x/k.cpp", 5, "big", "a", 1, "big", big, "c", 3 );
+	}
+	REQUIRE( read_lines( T_LOG_FILE, lines, 6 ) == 1 );
+	REQUIRE( strstr( lines[0], ",\"msg\":\"big\",\"a\":1}\n" ) != NULL );
+	unlink( T_LOG_FILE );
+	PR_DEBUG_KV( "macro", "n", 1, "s", "x" ); // global logger
+}
+
+#define T_ROLL_MAX	64
+
+static void remove_rolled( const char * fname )
+{
+	char buf[256];
+	int i;
+	unlink( fname );
+	for( i = 1; i < T_ROLL_MAX; ++i ) {
+		snprintf( buf, sizeof(buf), "%s.%d", fname, i );
+		unlink( buf );
+		snprintf( buf, sizeof(buf), "%s.%d.gz", fname, i );
+		unlink( buf );
+	}
+	return;
+}
+
+static int64_t file_size( const char * fname )
+{
+	struct stat st;
+	return stat( fname, &st ) == 0 ? (int64_t)st.st_size : -1;
+}
+
+// lines of all rolled files, oldest first, seq of each thread increase, max_size 0 not check size
+static int check_rolled( const char * fname, int thread_num, int64_t max_size )
+{
+	char buf[256];
+	int last[16];
+	int i;
+	for( i = 0; i < thread_num; ++i )
+		last[i] = -1;
+	int num = 0;
+	for( i = T_ROLL_MAX - 1; i >= 0; --i ) {
+		if( i > 0 )
+			snprintf( buf, sizeof(buf), "%s.%d", fname, i );
+		else
+			snprintf( buf, sizeof(buf), "%s", fname );
+		FILE * fp = fopen( buf, "r" );
+		if( fp == NULL )
+			continue;
+		// rotation after the write crossing limit, racing lines go on meanwhile
+		if( max_size > 0 && file_size( buf ) > max_size + 4096 ) {
+			fclose( fp );
+			return -1;
+		}
+		char line[1024];
+		while( fgets( line, sizeof(line), fp ) != NULL ) {
+			const char * p = strstr( line, "thread " );
+			int idx = 0, seq = 0;
+			if( p == NULL || sscanf( p, "thread %d seq %d", &idx, &seq ) != 2 || idx >= thread_num || seq <= last[idx] ) {
+				fclose( fp );
+				return -1;
+			}
+			last[idx] = seq;
+			num++;
+		}
+		fclose( fp );
+	}
+	return num;
+}
+
+TEST_CASE( "logger rotate", "[logger]" )
+{
+	char buf[256];
+	remove_rolled( T_LOG_FILE );
+	{
+		// only .1 and .2 kept
+		Logger logger;
+		logger.InitLogFile( T_LOG_FILE, 2, 3 );
+		REQUIRE( logger.InitRotate( 4096 ) == 0 );
+		int i;
+		for( i = 0; i < 200; ++i )
+			logger.Log( DGN_LOG_LEVEL_INFO, __FILE__, __LINE__, "thread 0 seq %d %060d" DGN_LOG_LINE_END, i, 0 );
+		REQUIRE( file_size( T_LOG_FILE ) > 0 );
+		REQUIRE( file_size( T_LOG_FILE ".1" ) >= 4096 );
+		REQUIRE( file_size( T_LOG_FILE ".2" ) >= 4096 );
+		REQUIRE( file_size( T_LOG_FILE ".3" ) < 0 );
+		int num = check_rolled( T_LOG_FILE, 1, 4096 );
+		REQUIRE( num > 60 ); // about 33 lines each file
+		REQUIRE( num < 200 );
+
+		// last line in current file
+		FILE * fp = fopen( T_LOG_FILE, "r" );
+		REQUIRE( fp != NULL );
+		char line[256];
+		while( fgets( line, sizeof(line), fp ) != NULL )
+			memcpy( buf, line, sizeof(buf) );
+		fclose( fp );
+		REQUIRE( strstr( buf, "seq 199 " ) != NULL );
+	}
+
+	// .rolling of a crashed rotation kept aside, not overwritten
+	remove_rolled( T_LOG_FILE );
+	{
+		FILE * fp = fopen( T_LOG_FILE ".rolling", "w" );
+		REQUIRE( fp != NULL );
+		fputs( "crashed" DGN_LOG_LINE_END, fp );
+		fclose( fp );
+		int64_t from = Time::Now() / 1000000;
+		Logger logger;
+		logger.InitLogFile( T_LOG_FILE, 2, 3 );
+		REQUIRE( logger.InitRotate( 4096 ) == 0 );
+		int i;
+		for( i = 0; i < 100; ++i )
+			logger.Log( DGN_LOG_LEVEL_INFO, __FILE__, __LINE__, "thread 0 seq %d %060d" DGN_LOG_LINE_END, i, 0 );
+		int64_t sec, to = Time::Now() / 1000000;
+		int64_t kept = -1;
+		for( sec = from; sec <= to && kept < 0; ++sec ) {
+			snprintf( buf, sizeof(buf), "%s.rolling.%lld", T_LOG_FILE, (long long)sec );
+			kept = file_size( buf );
+			if( kept >= 0 )
+				unlink( buf );
+		}
+		REQUIRE( kept == (int64_t)strlen( "crashed" DGN_LOG_LINE_END ) );
+		REQUIRE( file_size( T_LOG_FILE ".rolling" ) < 0 );
+	}
+
+	// sync and async threads, nothing lost across rotations
+	int async;
+	for( async = 0; async < 2; ++async ) {
+		remove_rolled( T_LOG_FILE );
+		Logger logger;
+		logger.InitLogFile( T_LOG_FILE, 2, T_ROLL_MAX );
+		REQUIRE( logger.InitRotate( 64 * 1024 ) == 0 );
+		REQUIRE( logger.InitAsync( async ) == 0 );
+		REQUIRE( run_log_threads( &logger, 4, 5000 ) == 0 );
+		REQUIRE( logger.Flush() == 0 );
+		REQUIRE( file_size( T_LOG_FILE ".2" ) > 0 );
+		REQUIRE( check_rolled( T_LOG_FILE, 4, 0 ) + logger.GetDropped() == 4 * 5000 );
+	}
+
+	// time based, every second
+	remove_rolled( T_LOG_FILE );
+	{
+		Logger logger;
+		logger.InitLogFile( T_LOG_FILE );
+		REQUIRE( logger.InitRotate( 0, 1 ) == 0 );
+		logger.Log( DGN_LOG_LEVEL_INFO, __FILE__, __LINE__, "thread 0 seq 0" DGN_LOG_LINE_END );
+		REQUIRE( file_size( T_LOG_FILE ".1" ) < 0 );
+		Time::SleepMs( 1100 );
+		logger.Log( DGN_LOG_LEVEL_INFO, __FILE__, __LINE__, "thread 0 seq 1" DGN_LOG_LINE_END );
+		logger.Log( DGN_LOG_LEVEL_INFO, __FILE__, __LINE__, "thread 0 seq 2" DGN_LOG_LINE_END );
+		REQUIRE( file_size( T_LOG_FILE ".1" ) > 0 );
+		REQUIRE( check_rolled( T_LOG_FILE, 1, 4096 ) == 3 );
+	}
+
+	// compressed in background, only when built with zlib
+	remove_rolled( T_LOG_FILE );
+	{
+		Logger logger;
+		logger.InitLogFile( T_LOG_FILE, 2, 4 );
+		if( logger.InitRotate( 4096, 0, 1 ) == 0 ) {
+			int i;
+			for( i = 0; i < 200; ++i )
+				logger.Log( DGN_LOG_LEVEL_INFO, __FILE__, __LINE__, "thread 0 seq %d %060d" DGN_LOG_LINE_END, i, 0 );
+			for( i = 0; i < 100 && file_size( T_LOG_FILE ".3.gz" ) < 0; ++i )
+				Time::SleepMs( 20 );
+			for( i = 0; i < 100 && file_size( T_LOG_FILE ".1.gz" ) < 0; ++i )
+				Time::SleepMs( 20 );
+			REQUIRE( file_size( T_LOG_FILE ".1.gz" ) > 0 );
+			REQUIRE( file_size( T_LOG_FILE ".1" ) < 0 );
+			REQUIRE( file_size( T_LOG_FILE ".3.gz" ) > 0 );
+			REQUIRE( file_size( T_LOG_FILE ".4.gz" ) < 0 );
+		}
+	}
+	remove_rolled( T_LOG_FILE );
+}
+
+TEST_CASE( "logger level", "[logger]" )
+{
+	static LogSite dbg = { DGN_LOG_LEVEL_DEBUG, "/x/mod_a.cpp", 1, "d" DGN_LOG_LINE_END, NULL, 0, 0 };
+	static LogSite info = { DGN_LOG_LEVEL_INFO, "/x/mod_a.cpp", 2, "i" DGN_LOG_LINE_END, NULL, 0, 0 };
+	static LogSite net = { DGN_LOG_LEVEL_DEBUG, "/x/conn.cpp", 3, "n" DGN_LOG_LINE_END, "net", 0, 0 };
+	Logger logger;
+	logger.InitLevel( DGN_LOG_LEVEL_INFO );
+	REQUIRE( ! logger.IsEnabled( &dbg ) );
+	REQUIRE( logger.IsEnabled( &info ) );
+	REQUIRE( ! logger.IsEnabled( &net ) );
+
+	// module of site, file name, then file name without extension
+	REQUIRE( logger.SetModuleLevel( "mod_a", DGN_LOG_LEVEL_DEBUG ) == 0 );
+	REQUIRE( logger.IsEnabled( &dbg ) );
+	REQUIRE( logger.SetModuleLevel( "mod_a.cpp", DGN_LOG_LEVEL_ERR ) == 0 );
+	REQUIRE( ! logger.IsEnabled( &dbg ) );
+	REQUIRE( ! logger.IsEnabled( &info ) );
+	REQUIRE( logger.GetLevel( &info ) == DGN_LOG_LEVEL_ERR );
+	REQUIRE( logger.SetModuleLevel( "conn", DGN_LOG_LEVEL_DEBUG ) == 0 );
+	REQUIRE( logger.IsEnabled( &net ) );
+	REQUIRE( logger.SetModuleLevel( "net", DGN_LOG_LEVEL_ERR ) == 0 );
+	REQUIRE( ! logger.IsEnabled( &net ) );
+
+	// global level still apply to others, removed override back to global
+	REQUIRE( logger.InitLevel( DGN_LOG_LEVEL_DEBUG ) == 0 );
+	REQUIRE( ! logger.IsEnabled( &info ) );
+	REQUIRE( logger.SetModuleLevel( "mod_a.cpp", -1 ) == 0 );
+	REQUIRE( logger.SetModuleLevel( "mod_a", -1 ) == 0 );
+	REQUIRE( logger.IsEnabled( &dbg ) );
+	REQUIRE( logger.InitLevel( DGN_LOG_LEVEL_INFO ) == 0 );
+	REQUIRE( ! logger.IsEnabled( &dbg ) );
+	REQUIRE( logger.SetModuleLevel( NULL, 0 ) < 0 );
+
+	// cache of a site shared by loggers
+	Logger other;
+	other.InitLevel( DGN_LOG_LEVEL_DEBUG );
+	REQUIRE( other.IsEnabled( &dbg ) );
+	REQUIRE( ! logger.IsEnabled( &dbg ) );
+	REQUIRE( other.IsEnabled( &dbg ) );
+
+	// arguments not evaluated when disabled
+	Logger * global = DgnLib::GetLogger();
+	int cnt = 0;
+	REQUIRE( global->SetModuleLevel( "t_logger", DGN_LOG_LEVEL_ERR ) == 0 );
+	PR_INFO( "not evaluated %d", ++cnt );
+	PR_INFO_KV( "not evaluated", "cnt", ++cnt );
+	REQUIRE( cnt == 0 );
+	REQUIRE( global->SetModuleLevel( "t_logger", -1 ) == 0 );
+	PR_ERR( "evaluated %d", ++cnt );
+	REQUIRE( cnt == 1 );
+}
+
+struct limit_arg_t
+{
+	LogLimit * m_lim;
+	int m_passed;
+	int m_suppressed;
+};
+
+static int limit_worker( Thread * th, void * arg )
+{
+	limit_arg_t * la = (limit_arg_t *)arg;
+	int i;
+	for( i = 0; i < 20000; ++i ) {
+		int suppressed = 0;
+		if( log_ratelimit( la->m_lim, 10, &suppressed ) )
+			la->m_passed++;
+		la->m_suppressed += suppressed;
+	}
+	return 0;
+}
+
+TEST_CASE( "logger rate limit", "[logger]" )
+{
+	int i;
+	int num = 0;
+	int suppressed = 0;
+	LogLimit every;
+	for( i = 0; i < 10; ++i )
+		num += log_every_n( &every, 3, &suppressed ) ? 1 : 0;
+	REQUIRE( num == 4 ); // 1st, 4th, 7th, 10th
+	REQUIRE( suppressed == 0 );
+
+	// start at a new second
+	LogLimit lim;
+	time_t start = time( NULL );
+	while( time( NULL ) == start )
+		Time::SleepMs( 5 );
+	start = time( NULL );
+	num = 0;
+	for( i = 0; i < 100; ++i ) {
+		REQUIRE( log_ratelimit( &lim, 5, &suppressed ) == ( i < 5 ) );
+		REQUIRE( suppressed == 0 );
+	}
+	REQUIRE( time( NULL ) == start );
+	while( time( NULL ) == start )
+		Time::SleepMs( 5 );
+	REQUIRE( log_ratelimit( &lim, 5, &suppressed ) );
+	REQUIRE( suppressed == 95 );
+
+	// threads, passed bounded, none lost from summary
+	LogLimit shared;
+	limit_arg_t args[4];
+	ThreadObj ths[4];
+	start = time( NULL );
+	for( i = 0; i < 4; ++i ) {
+		args[i].m_lim = &shared;
+		args[i].m_passed = 0;
+		args[i].m_suppressed = 0;
+		ths[i].SetFunc( limit_worker, &args[i] );
+		REQUIRE( ths[i].Start() == 0 );
+	}
+	int passed = 0;
+	suppressed = 0;
+	for( i = 0; i < 4; ++i ) {
+		ths[i].WaitStop();
+		passed += args[i].m_passed;
+		suppressed += args[i].m_suppressed;
+	}
+	int secs = (int)( time( NULL ) - start ) + 1;
+	REQUIRE( passed <= 10 * secs + 4 * secs ); // window reset race may let a few more
+	REQUIRE( suppressed + shared.m_suppressed.Get() + passed == 4 * 20000 );
+
+	// arguments only evaluated for logged ones
+	int cnt = 0;
+	for( i = 0; i < 5000; ++i )
+		PR_DEBUG_EVERY_N( 1000, "every n %d", ++cnt );
+	REQUIRE( cnt == 5 );
+	cnt = 0;
+	for( i = 0; i < 1000; ++i )
+		PR_DEBUG_RATELIMIT( 2, "rate limit %d", ++cnt );
+	REQUIRE( cnt >= 2 );
+	REQUIRE( cnt <= 4 );
+
+	static LogSite site = { DGN_LOG_LEVEL_ERR, "/x/r.cpp", 8, "r" DGN_LOG_LINE_END, NULL, 0, 0 };
+	unlink( T_LOG_FILE );
+	{
+		Logger logger;
+		logger.InitLogFile( T_LOG_FILE );
+		logger.LogSuppressed( &site, 95 );
+	}
+	char line[256] = { 0 };
+	FILE * fp = fopen( T_LOG_FILE, "r" );
+	REQUIRE( fp != NULL );
+	REQUIRE( fgets( line, sizeof(line), fp ) != NULL );
+	fclose( fp );
+	REQUIRE( strcmp( line + 20, "|r.cpp:8|ERR 95 records suppressed by rate limit\n" ) == 0 );
+	unlink( T_LOG_FILE );
+}
+
+#ifndef _WIN32
+#define T_RING_FILE	"log_ring.bin"
+
+TEST_CASE( "logger mmap ring", "[logger]" )
+{
+	unlink( T_RING_FILE );
+
+	// child crash right after logging, lines still in ring file
+	pid_t pid = fork();
+	REQUIRE( pid >= 0 );
+	if( pid == 0 ) {
+		Logger logger;
+		if( logger.InitMmapRing( T_RING_FILE, 4096 ) < 0 )
+			_exit( 1 );
+		int i;
+		for( i = 0; i < 200; ++i )
+			logger.Log( DGN_LOG_LEVEL_INFO, "/x/m.cpp", 3, "ring %d" DGN_LOG_LINE_END, i );
+		signal( SIGABRT, SIG_DFL ); // not caught and reported by test framework
+		abort();
+	}
+	int status = 0;
+	REQUIRE( waitpid( pid, &status, 0 ) == pid );
+	REQUIRE( WIFSIGNALED( status ) );
+
+	CStr text;
+	REQUIRE( Logger::ReadMmapRing( T_RING_FILE, &text ) == 0 );
+	REQUIRE( text.Len() > 3000 );
+	REQUIRE( text.Len() <= 4096 );
+	// whole lines, consecutive, end with last one
+	const char * p = text.Str();
+	int expect = -1;
+	int num = 0;
+	while( *p != '\0' ) {
+		const char * e = strchr( p, '\n' );
+		REQUIRE( e != NULL );
+		REQUIRE( strncmp( p + 20, "|m.cpp:3|INFO ring ", 19 ) == 0 );
+		int seq = atoi( p + 39 );
+		if( expect >= 0 )
+			REQUIRE( seq == expect );
+		expect = seq + 1;
+		num++;
+		p = e + 1;
+	}
+	REQUIRE( expect == 200 );
+	REQUIRE( num > 40 );
+
+	// reopen continue after old content
+	{
+		Logger logger;
+		REQUIRE( logger.InitMmapRing( T_RING_FILE, 4096 ) == 0 );
+		logger.Log( DGN_LOG_LEVEL_INFO, "/x/m.cpp", 3, "ring %d" DGN_LOG_LINE_END, 200 );
+	}
+	REQUIRE( Logger::ReadMmapRing( T_RING_FILE, &text ) == 0 );
+	REQUIRE( strstr( text.Str(), "|INFO ring 199\n" ) != NULL );
+	REQUIRE( strcmp( text.Str() + text.Len() - 15, "|INFO ring 200\n" ) == 0 );
+
+	// other size reinit
+	{
+		Logger logger;
+		REQUIRE( logger.InitMmapRing( T_RING_FILE, 8192 ) == 0 );
+		logger.Log( DGN_LOG_LEVEL_INFO, "/x/m.cpp", 3, "ring %d" DGN_LOG_LINE_END, 0 );
+	}
+	REQUIRE( Logger::ReadMmapRing( T_RING_FILE, &text ) == 0 );
+	REQUIRE( strcmp( text.Str() + 20, "|m.cpp:3|INFO ring 0\n" ) == 0 );
+	unlink( T_RING_FILE );
+}
+
+#endif // _WIN32
+
+TEST_CASE( "logger named", "[logger]" )
+{
+	Logger * access = DgnLib::GetLogger( "access" );
+	REQUIRE( access != NULL );
+	REQUIRE( access != DgnLib::GetLogger() );
+	REQUIRE( DgnLib::GetLogger( "access" ) == access );
+	REQUIRE( DgnLib::GetLogger( "error" ) != access );
+	REQUIRE( DgnLib::GetLogger( NULL ) == DgnLib::GetLogger() );
+	REQUIRE( DgnLib::GetLogger( "" ) == DgnLib::GetLogger() );
+
+	// own file and level
+	unlink( T_LOG_FILE );
+	access->InitLogFile( T_LOG_FILE );
+	access->InitLevel( DGN_LOG_LEVEL_INFO );
+	int cnt = 0;
+	PR_INFO_TO( access, "GET /a %d", ++cnt );
+	PR_DEBUG_TO( access, "not logged %d", ++cnt );
+	PR_DEBUG( "to default logger" );
+	REQUIRE( cnt == 1 );
+	access->InitLogFile( NULL );
+	char line[256] = { 0 };
+	FILE * fp = fopen( T_LOG_FILE, "r" );
+	REQUIRE( fp != NULL );
+	REQUIRE( fgets( line, sizeof(line), fp ) != NULL );
+	REQUIRE( strstr( line, "|INFO GET /a 1\n" ) != NULL );
+	REQUIRE( fgets( line, sizeof(line), fp ) == NULL );
+	fclose( fp );
+
+	// records of all threads written in time order
+	unlink( T_LOG_FILE );
+	access->InitLogFile( T_LOG_FILE );
+	REQUIRE( access->InitAsync( 1, DGN_LOG_RING_SIZE, 2000 ) == 0 );
+	REQUIRE( access->Flush() == 0 ); // writer sleep long after this
+	REQUIRE( run_log_threads( access, 4, 2000 ) == 0 );
+	REQUIRE( access->Flush() == 0 );
+	REQUIRE( access->GetDropped() == 0 );
+	REQUIRE( check_log_file( T_LOG_FILE, 4 ) == 4 * 2000 );
+	fp = fopen( T_LOG_FILE, "r" );
+	REQUIRE( fp != NULL );
+	char last[32] = { 0 };
+	int unordered = 0;
+	while( fgets( line, sizeof(line), fp ) != NULL ) {
+		if( strncmp( line, last, 20 ) < 0 )
+			unordered++;
+		memcpy( last, line, 20 );
+	}
+	fclose( fp );
+	REQUIRE( unordered == 0 );
+	access->InitAsync( 0 );
+	access->InitLogFile( NULL );
+	unlink( T_LOG_FILE );
+}
@@ -0,0 +1,83 @@
+// t_resolver.cpp : test dgn resolver
+// Copyright (C) 2011 ~ 2023 drangon <drangon.zhou (at) gmail.com>
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+
+#include <dgn/Resolver.h>
+#include <dgn/Atomic.h>
+#include <dgn/Time.h>
+
+#include "catch.hpp"
+
+#include <stdio.h>
+#include <string.h>
+
+using namespace dgn;
+
+struct resolve_result
+{
+	Atomic m_done;
+	Atomic m_ok;
+	int m_port;
+};
+
+static void on_resolved( const char * host, const Endpoint * ep, void * arg )
+{
+	struct resolve_result * rr = (struct resolve_result *)arg;
+	if( ep != NULL ) {
+		rr->m_port = ep->GetPort();
+		rr->m_ok.Inc();
+	}
+	rr->m_done.Inc();
+}
+
+TEST_CASE( "resolver cache", "[resolver]")
+{
+	Resolver rs;
+	int ret = rs.Init( 2, 1000, 1000 );
+	CHECK( ret == 0 );
+
+	Endpoint ep;
+	ret = rs.Lookup( "localhost", 80, &ep );
+	CHECK( ret == 0 ); // not cached, start resolve
+
+	ret = rs.Resolve( "localhost", 8080, &ep );
+	CHECK( ret == 0 );
+	CHECK( ep.GetPort() == 8080 );
+	ret = rs.Lookup( "localhost", 81, &ep );
+	CHECK( ret == 1 );
+	CHECK( ep.GetPort() == 81 );
+
+	struct resolve_result rr;
+	rr.m_port = 0;
+	ret = rs.ResolveAsync( "127.0.0.2", 90, on_resolved, &rr );
+	CHECK( ret == 0 );
+	int i;
+	for( i = 0; i < 200 && rr.m_done.Get() == 0; ++i )
+		Time::SleepMs( 10 );
+	CHECK( rr.m_done.Get() == 1 );
+	CHECK( rr.m_ok.Get() == 1 );
+	CHECK( rr.m_port == 90 );
+
+	// negative cache
+	ret = rs.Resolve( "no-such-host.invalid", 80, &ep );
+	CHECK( ret < 0 );
+	ret = rs.Lookup( "no-such-host.invalid", 80, &ep );
+	CHECK( ret < 0 );
+
+	rs.ClearCache();
+	ret = rs.Lookup( "127.0.0.2", 80, &ep );
+	CHECK( ret == 0 );
+	rs.Fini();
+}
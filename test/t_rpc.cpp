@@ -0,0 +1,177 @@
+// t_rpc.cpp : test dgn rpc client and server
+// Copyright (C) 2011 ~ 2023 drangon <drangon.zhou (at) gmail.com>
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+
+
+#include <dgn/Rpc.h>
+#include <dgn/Thread.h>
+#include <dgn/Time.h>
+
+#include "catch.hpp"
+
+#include <string.h>
+
+using namespace dgn;
+
+static int rpc_add( const JsonVal & req, JsonVal * rsp, void * arg )
+{
+	if( req.GetType() != JSONVAL_TYPE_ARRAY || req.Size() != 2 )
+		return 1;
+	*rsp = req[0].GetInt64() + req[1].GetInt64();
+	return 0;
+}
+
+static int rpc_sleep( const JsonVal & req, JsonVal * rsp, void * arg )
+{
+	Time::SleepMs( req.GetInt() );
+	*rsp = "wake";
+	return 0;
+}
+
+struct rpc_async_t
+{
+	RpcClient * m_cli;
+	volatile int m_ok;
+	volatile int m_fail;
+};
+
+static void on_add_done( int code, const JsonVal & rsp, void * arg )
+{
+	rpc_async_t * ra = (rpc_async_t *)arg;
+	if( code == 0 && rsp.GetInt64() == 3 )
+		ra->m_ok++;
+	else
+		ra->m_fail++;
+}
+
+static int rpc_caller( Thread * th, void * arg )
+{
+	rpc_async_t * ra = (rpc_async_t *)arg;
+	JsonVal req( JSONVAL_TYPE_ARRAY ), rsp;
+	int i, bad = 0;
+	for( i = 0; i < 200; ++i ) {
+		req.SetItem( 0, JsonVal( i ) );
+		req.SetItem( 1, JsonVal( 1 ) );
+		if( ra->m_cli->Call( "add", req, &rsp ) != 0 || rsp.GetInt64() != i + 1 )
+			bad++;
+	}
+	ra->m_fail = bad;
+	return 0;
+}
+
+TEST_CASE( "rpc frame", "[rpc]" )
+{
+	JsonVal body;
+	body.FromBuf( "{\"a\":[1,2,3],\"s\":\"x\"}" );
+	CStr buf;
+	REQUIRE( RpcFrame::PackRequest( &buf, 7, "test.method", body ) == 0 );
+	int len = buf.Len();
+	REQUIRE( RpcFrame::PackResponse( &buf, 7, -3, JsonVal::NullJsonVal() ) == 0 );
+	REQUIRE( RpcFrame::PackRequest( &buf, 1, "", body ) < 0 );
+	REQUIRE( buf.Len() == len + 4 + 9 );
+
+	const unsigned char * p = (const unsigned char *)buf.Str();
+	int flen = ( p[0] << 24 ) | ( p[1] << 16 ) | ( p[2] << 8 ) | p[3];
+	REQUIRE( flen + 4 == len );
+	RpcMsg msg;
+	REQUIRE( RpcFrame::Unpack( buf.Str() + 4, flen, &msg ) == 0 );
+	REQUIRE( msg.m_type == DGN_RPC_TYPE_REQUEST );
+	REQUIRE( msg.m_id == 7 );
+	REQUIRE( msg.m_method == "test.method" );
+	REQUIRE( msg.m_body["a"].Size() == 3 );
+	REQUIRE( msg.m_body["s"].GetString() == "x" );
+
+	REQUIRE( RpcFrame::Unpack( buf.Str() + len + 4, 9, &msg ) == 0 );
+	REQUIRE( msg.m_type == DGN_RPC_TYPE_RESPONSE );
+	REQUIRE( msg.m_code == DGN_RPC_ERR_NO_METHOD );
+	REQUIRE( msg.m_body.GetType() == JSONVAL_TYPE_NULL );
+
+	// truncated method, bad json
+	REQUIRE( RpcFrame::Unpack( buf.Str() + 4, 10, &msg ) < 0 );
+	REQUIRE( RpcFrame::Unpack( buf.Str() + 4, flen - 1, &msg ) < 0 );
+}
+
+TEST_CASE( "rpc call", "[rpc]" )
+{
+	RpcSvr svr;
+	REQUIRE( svr.Register( "add", rpc_add, NULL ) == 0 );
+	REQUIRE( svr.Register( "sleep", rpc_sleep, NULL ) == 0 );
+	REQUIRE( svr.Init( "127.0.0.1", 0 ) == 0 );
+	REQUIRE( svr.Start() == 0 );
+
+	RpcClient cli;
+	JsonVal req( JSONVAL_TYPE_ARRAY ), rsp;
+	REQUIRE( cli.Call( "add", req, &rsp ) == DGN_RPC_ERR_CONN );
+	REQUIRE( cli.Connect( "127.0.0.1", svr.GetPort() ) == 0 );
+	REQUIRE( cli.IsConnected() );
+
+	req.SetItem( 0, JsonVal( 40 ) );
+	req.SetItem( 1, JsonVal( 2 ) );
+	REQUIRE( cli.Call( "add", req, &rsp ) == 0 );
+	REQUIRE( rsp.GetInt64() == 42 );
+	REQUIRE( cli.Call( "add", JsonVal( 1 ), &rsp ) == 1 );
+	REQUIRE( cli.Call( "nothing", req, &rsp ) == DGN_RPC_ERR_NO_METHOD );
+	REQUIRE( rsp.GetString() == "nothing" );
+
+	SECTION( "multiplexed" ) {
+		// async calls and sync calls of several threads share one connection
+		rpc_async_t ra;
+		ra.m_cli = &cli;
+		ra.m_ok = ra.m_fail = 0;
+		rpc_async_t ra_th[4];
+		ThreadObj ths[4];
+		int i;
+		for( i = 0; i < 4; ++i ) {
+			ra_th[i].m_cli = &cli;
+			ra_th[i].m_ok = ra_th[i].m_fail = 0;
+			ths[i].SetFunc( rpc_caller, &ra_th[i] );
+			REQUIRE( ths[i].Start() == 0 );
+		}
+		req.SetItem( 0, JsonVal( 1 ) );
+		for( i = 0; i < 1000; ++i )
+			REQUIRE( cli.CallAsync( "add", req, on_add_done, &ra ) == 0 );
+		for( i = 0; i < 4; ++i ) {
+			ths[i].WaitStop();
+			REQUIRE( ra_th[i].m_fail == 0 );
+		}
+		for( i = 0; i < 300 && ra.m_ok + ra.m_fail < 1000; ++i )
+			Time::SleepMs( 10 );
+		REQUIRE( ra.m_ok == 1000 );
+		REQUIRE( cli.GetPendingNum() == 0 );
+	}
+
+	SECTION( "timeout and close" ) {
+		REQUIRE( cli.Call( "sleep", JsonVal( 300 ), &rsp, 50 ) == DGN_RPC_ERR_TIMEOUT );
+		REQUIRE( cli.GetPendingNum() == 0 );
+
+		// late response dropped, next call still work
+		rpc_async_t ra;
+		ra.m_cli = &cli;
+		ra.m_ok = ra.m_fail = 0;
+		REQUIRE( cli.CallAsync( "sleep", JsonVal( 300 ), on_add_done, &ra, 50 ) == 0 );
+		REQUIRE( cli.Call( "sleep", JsonVal( 0 ), &rsp, 3000 ) == 0 );
+		REQUIRE( rsp.GetString() == "wake" );
+		REQUIRE( ra.m_fail == 1 );
+
+		// pending async call fail at close
+		REQUIRE( cli.CallAsync( "sleep", JsonVal( 300 ), on_add_done, &ra ) == 0 );
+		cli.Close();
+		REQUIRE( ra.m_fail == 2 );
+		REQUIRE( ! cli.IsConnected() );
+	}
+
+	cli.Close();
+	svr.Fini();
+}
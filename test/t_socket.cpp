@@ -0,0 +1,472 @@
+// t_socket.cpp : test dgn socket
+// Copyright (C) 2011 ~ 2023 drangon <drangon.zhou (at) gmail.com>
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <unistd.h>
+#endif
+
+#include <dgn/Socket.h>
+#include <dgn/Thread.h>
+#include <dgn/Time.h>
+
+#include "catch.hpp"
+
+#include <stdio.h>
+#include <string.h>
+
+using namespace dgn;
+
+TEST_CASE( "udp batch send/recv", "[socket]")
+{
+	Socket s1, s2;
+	int ret = 0;
+	ret = s1.UdpSvr( "127.0.0.1", 0 );
+	CHECK( ret == 0 );
+	ret = s2.UdpSvr( "127.0.0.1", 0 );
+	CHECK( ret == 0 );
+
+	// local addr of s2 as send target
+	struct sockaddr_storage addr;
+	socklen_t alen = sizeof(addr);
+	ret = getsockname( s2.GetRawSock(), (struct sockaddr *)&addr, &alen );
+	CHECK( ret == 0 );
+
+	char data[3][16] = { "msg-0", "msg-1", "msg-2" };
+	SockMsg smsg[3];
+	int i;
+	for( i = 0; i < 3; ++i ) {
+		smsg[i].m_buf = data[i];
+		smsg[i].m_len = (int)strlen( data[i] );
+		smsg[i].m_seg_size = 0;
+		smsg[i].m_addr = &addr;
+		smsg[i].m_addrlen = (int)alen;
+	}
+	s1.SetTimeout( 1000 );
+	ret = s1.SendBatch( smsg, 3 );
+	CHECK( ret == 3 );
+
+	char rbuf[4][64];
+	struct sockaddr_storage raddr[4];
+	SockMsg rmsg[4];
+	for( i = 0; i < 4; ++i ) {
+		rmsg[i].m_buf = rbuf[i];
+		rmsg[i].m_len = sizeof(rbuf[i]);
+		rmsg[i].m_seg_size = 0;
+		rmsg[i].m_addr = &raddr[i];
+		rmsg[i].m_addrlen = 0;
+	}
+	s2.SetTimeout( 1000 );
+	int num = 0;
+	while( num < 3 ) {
+		ret = s2.RecvBatch( rmsg + num, 4 - num );
+		if( ret <= 0 )
+			break;
+		num += ret;
+	}
+	CHECK( num == 3 );
+	for( i = 0; i < num; ++i ) {
+		CHECK( rmsg[i].m_len == 5 );
+		CHECK( memcmp( rbuf[i], data[i], 5 ) == 0 );
+		CHECK( rmsg[i].m_addrlen > 0 );
+	}
+
+	// nothing left, timeout return 0
+	s2.SetTimeout( 10 );
+	ret = s2.RecvBatch( rmsg, 4 );
+	CHECK( ret == 0 );
+}
+
+TEST_CASE( "endpoint", "[socket]")
+{
+	Endpoint ep;
+	int ret = 0;
+	CHECK( ! ep.IsValid() );
+	ret = ep.Set( "127.0.0.1", 8080 );
+	CHECK( ret == 0 );
+	CHECK( ep.IsValid() );
+	CHECK( ep.GetFamily() == AF_INET );
+	CHECK( ep.GetPort() == 8080 );
+	CHECK( ep.ToStr() == "127.0.0.1:8080" );
+	ep.SetPort( 80 );
+	CHECK( ep.GetPort() == 80 );
+
+	ret = ep.Set( "::1", 443 );
+	CHECK( ret == 0 );
+	CHECK( ep.GetFamily() == AF_INET6 );
+	CHECK( ep.ToStr() == "[::1]:443" );
+
+	ret = ep.Set( "", 80 );
+	CHECK( ret < 0 );
+	CHECK( ! ep.IsValid() );
+
+	// udp send by endpoint
+	Socket s1, s2;
+	ret = s1.UdpSvr( "127.0.0.1", 0 );
+	CHECK( ret == 0 );
+	ret = s2.UdpSvr( Endpoint( "127.0.0.1", 0 ) );
+	CHECK( ret == 0 );
+	int port = 0;
+	char ip[DGN_IP_LEN];
+	s2.LocalAddr( ip, &port );
+	Endpoint dst( "127.0.0.1", port );
+	ret = s1.SendTo( "hello", 5, dst );
+	CHECK( ret == 5 );
+	char buf[16];
+	s2.SetTimeout( 1000 );
+	ret = s2.RecvFrom( buf, sizeof(buf), ip, &port );
+	CHECK( ret == 5 );
+}
+
+static int thread_shrink_timeout( Thread * th, void * arg )
+{
+	Socket * sk = (Socket *)arg;
+	Time::SleepMs( 50 );
+	sk->SetTimeout( 50 );
+	return 0;
+}
+
+static int thread_cancel( Thread * th, void * arg )
+{
+	Socket * sk = (Socket *)arg;
+	Time::SleepMs( 50 );
+	sk->Cancel();
+	return 0;
+}
+
+struct notify_arg_t
+{
+	volatile int * m_timeout;
+	PollNotify * m_notify;
+};
+
+static int thread_notify_cancel( Thread * th, void * arg )
+{
+	notify_arg_t * na = (notify_arg_t *)arg;
+	Time::SleepMs( 50 );
+	*na->m_timeout = -1;
+	na->m_notify->Notify();
+	return 0;
+}
+
+TEST_CASE( "poll notify", "[socket]")
+{
+	Socket sk;
+	int ret = sk.UdpSvr( "127.0.0.1", 0 );
+	CHECK( ret == 0 );
+	ret = sk.EnableNotify();
+	CHECK( ret == 0 );
+
+	// timeout shrink from other thread wake up poll at once
+	char buf[16];
+	sk.SetTimeout( 10000 );
+	ThreadObj th( thread_shrink_timeout, &sk );
+	th.Start();
+	uint32_t t1 = Time::Tick();
+	ret = sk.Recv( buf, 1, sizeof(buf) );
+	uint32_t t2 = Time::Tick();
+	th.WaitStop();
+	CHECK( ret == 0 );
+	CHECK( (int)( t2 - t1 ) < 2000 );
+
+	// cancel
+	sk.SetTimeout( 10000 );
+	th.SetFunc( thread_cancel, &sk );
+	th.Start();
+	t1 = Time::Tick();
+	ret = sk.Recv( buf, 1, sizeof(buf) );
+	t2 = Time::Tick();
+	th.WaitStop();
+	CHECK( ret == 0 );
+	CHECK( (int)( t2 - t1 ) < 2000 );
+	sk.Cancel( 0 );
+
+	// PollexNotify, cancel by timeout < 0
+	PollNotify notify;
+	ret = notify.Open();
+	CHECK( ret == 0 );
+	Socket * skarr[1] = { &sk };
+	int want_evt[1] = { DGN_POLLIN };
+	int ret_evt[1] = { 0 };
+	volatile int timeout = 10;
+	ret = Socket::PollexNotify( 1, skarr, want_evt, ret_evt, &timeout, &notify );
+	CHECK( ret == 0 );
+	timeout = -1;
+	notify.Notify();
+	ret = Socket::PollexNotify( 1, skarr, want_evt, ret_evt, &timeout, &notify );
+	CHECK( ret == 0 );
+
+	// cancel from other thread wake up a blocked one
+	timeout = 10000;
+	notify_arg_t na = { &timeout, &notify };
+	th.SetFunc( thread_notify_cancel, &na );
+	th.Start();
+	t1 = Time::Tick();
+	ret = Socket::PollexNotify( 1, skarr, want_evt, ret_evt, &timeout, &notify );
+	t2 = Time::Tick();
+	th.WaitStop();
+	CHECK( ret == 0 );
+	CHECK( (int)( t2 - t1 ) >= 40 );
+	CHECK( (int)( t2 - t1 ) < 2000 );
+}
+
+static int get_int_opt( sock_t sk, int level, int name )
+{
+	int val = -1;
+	socklen_t len = sizeof(val);
+	getsockopt( sk, level, name, (char *)&val, &len );
+	return val;
+}
+
+TEST_CASE( "socket option", "[socket]")
+{
+	SockOpt lopt;
+	lopt.m_backlog = 128;
+	lopt.m_rcvbuf = 256 * 1024;
+	Socket svr;
+	int ret = svr.TcpSvr( Endpoint( "127.0.0.1", 0 ), lopt );
+	CHECK( ret == 0 );
+	CHECK( get_int_opt( svr.GetRawSock(), SOL_SOCKET, SO_RCVBUF ) >= 256 * 1024 );
+	char ip[DGN_IP_LEN];
+	int port = 0;
+	svr.LocalAddr( ip, &port );
+
+	// default options applied to Connect() and Accept()
+	SockOpt old = Socket::GetDefaultOpt();
+	SockOpt opt;
+	opt.m_nodelay = 1;
+	opt.m_keepalive = 1;
+	Socket::SetDefaultOpt( opt );
+	Socket cli;
+	cli.SetTimeout( 1000 );
+	CHECK( cli.Connect( "127.0.0.1", port ) == DGN_SOCKET_CONNECT_OK );
+	svr.SetTimeout( 1000 );
+	Socket * peer = svr.Accept();
+	Socket::SetDefaultOpt( old );
+	REQUIRE( peer != NULL );
+	CHECK( get_int_opt( cli.GetRawSock(), IPPROTO_TCP, TCP_NODELAY ) != 0 );
+	CHECK( get_int_opt( cli.GetRawSock(), SOL_SOCKET, SO_KEEPALIVE ) != 0 );
+	CHECK( get_int_opt( peer->GetRawSock(), IPPROTO_TCP, TCP_NODELAY ) != 0 );
+
+	opt = SockOpt();
+	opt.m_nodelay = 0;
+	opt.m_sndbuf = 128 * 1024;
+	ret = peer->SetOpt( opt );
+	CHECK( ret == 0 );
+	CHECK( get_int_opt( peer->GetRawSock(), IPPROTO_TCP, TCP_NODELAY ) == 0 );
+	CHECK( get_int_opt( peer->GetRawSock(), SOL_SOCKET, SO_SNDBUF ) >= 128 * 1024 );
+	ret = peer->SetNoDelay( 1 );
+	CHECK( ret == 0 );
+	CHECK( get_int_opt( peer->GetRawSock(), IPPROTO_TCP, TCP_NODELAY ) != 0 );
+	delete peer;
+}
+TEST_CASE( "dual stack", "[socket]")
+{
+	Endpoint ep;
+	CHECK( ep.Set( "[::1]", 80 ) == 0 );
+	CHECK( ep.GetFamily() == AF_INET6 );
+
+	Socket svr;
+	if( svr.TcpSvr( Endpoint( "::", 0 ) ) < 0 ) {
+		WARN( "ipv6 not available, skip" );
+		return;
+	}
+	Endpoint local;
+	CHECK( svr.LocalAddr( &local ) == 0 );
+	CHECK( local.GetFamily() == AF_INET6 );
+	svr.SetTimeout( 1000 );
+
+	// ipv4 client on [::] listener, peer address unmapped
+	Socket c4;
+	c4.SetTimeout( 1000 );
+	CHECK( c4.Connect( "127.0.0.1", local.GetPort() ) == DGN_SOCKET_CONNECT_OK );
+	Endpoint peer;
+	Socket * s4 = svr.Accept( &peer );
+	REQUIRE( s4 != NULL );
+	CHECK( peer.GetFamily() == AF_INET );
+	CHECK( peer.ToStr() == Endpoint( "127.0.0.1", peer.GetPort() ).ToStr() );
+	Endpoint rpeer;
+	CHECK( s4->RemoteAddr( &rpeer ) == 0 );
+	CHECK( rpeer.ToStr() == peer.ToStr() );
+	char ip[DGN_IP_LEN];
+	int port = 0;
+	CHECK( s4->RemoteAddr( ip, &port ) == 0 );
+	CHECK( strcmp( ip, "127.0.0.1" ) == 0 );
+	CHECK( s4->Send( "v4", 2 ) == 2 );
+	char buf[16];
+	CHECK( c4.Recv( buf, 2, sizeof(buf) ) == 2 );
+	delete s4;
+
+	// ipv6 client
+	Socket c6;
+	c6.SetTimeout( 1000 );
+	if( c6.Connect( "::1", local.GetPort() ) == DGN_SOCKET_CONNECT_OK ) {
+		Socket * s6 = svr.Accept( &peer );
+		REQUIRE( s6 != NULL );
+		CHECK( peer.GetFamily() == AF_INET6 );
+		delete s6;
+	}
+
+	// v6only listener refuse ipv4
+	SockOpt opt;
+	opt.m_v6only = 1;
+	Socket svr6;
+	CHECK( svr6.TcpSvr( Endpoint( "::", 0 ), opt ) == 0 );
+	CHECK( svr6.LocalAddr( &local ) == 0 );
+	Socket c;
+	c.SetTimeout( 1000 );
+	CHECK( c.Connect( "127.0.0.1", local.GetPort() ) != DGN_SOCKET_CONNECT_OK );
+
+	// udp on [::] send to ipv4 target
+	Socket u6, u4;
+	CHECK( u6.UdpSvr( "::", 0 ) == 0 );
+	CHECK( u4.UdpSvr( "127.0.0.1", 0 ) == 0 );
+	Endpoint u4addr;
+	CHECK( u4.LocalAddr( &u4addr ) == 0 );
+	CHECK( u6.SendTo( "hello", 5, u4addr ) == 5 );
+	u4.SetTimeout( 1000 );
+	int rport = 0;
+	CHECK( u4.RecvFrom( buf, sizeof(buf), ip, &rport ) == 5 );
+	CHECK( memcmp( buf, "hello", 5 ) == 0 );
+}
+
+#ifndef _WIN32
+TEST_CASE( "unix socket", "[socket]")
+{
+	// path and abstract namespace listener
+	const char * names[2] = { "unix:/tmp/dgn_t_socket.sock", "unix:@dgn_t_socket" };
+	int i;
+	for( i = 0; i < 2; ++i ) {
+		Endpoint ep( names[i], 0 );
+		REQUIRE( ep.GetFamily() == AF_UNIX );
+		CHECK( ep.ToStr() == names[i] );
+
+		Socket svr;
+		CHECK( svr.TcpSvr( ep ) == 0 );
+		CHECK( svr.TcpSvr( ep ) == 0 ); // stale socket file removed
+		svr.SetTimeout( 1000 );
+		Socket cli;
+		cli.SetTimeout( 1000 );
+		CHECK( cli.Connect( ep ) == DGN_SOCKET_CONNECT_OK );
+		Socket * peer = svr.Accept();
+		REQUIRE( peer != NULL );
+		peer->SetTimeout( 1000 );
+		CHECK( cli.Send( "ping", 4 ) == 4 );
+		char buf[16];
+		CHECK( peer->Recv( buf, 4, sizeof(buf) ) == 4 );
+		CHECK( memcmp( buf, "ping", 4 ) == 0 );
+		delete peer;
+		Socket other;
+		CHECK( other.TcpSvr( ep ) < 0 ); // not taken from a live one
+		Socket cli2;
+		cli2.SetTimeout( 1000 );
+		CHECK( cli2.Connect( ep ) == DGN_SOCKET_CONNECT_OK );
+	}
+	unlink( "/tmp/dgn_t_socket.sock" );
+
+	// datagram
+	Socket u1, u2;
+	CHECK( u1.UdpSvr( "unix:@dgn_t_socket_d1", 0 ) == 0 );
+	CHECK( u2.UdpSvr( "unix:@dgn_t_socket_d2", 0 ) == 0 );
+	CHECK( u1.SendTo( "dgram", 5, Endpoint( "unix:@dgn_t_socket_d2", 0 ) ) == 5 );
+	u2.SetTimeout( 1000 );
+	struct sockaddr_storage addr;
+	int addrlen = 0;
+	char buf[16];
+	CHECK( u2.RecvFrom( buf, sizeof(buf), &addr, &addrlen ) == 5 );
+	Endpoint from;
+	from.SetAddr( &addr, addrlen );
+	CHECK( from.ToStr() == "unix:@dgn_t_socket_d1" );
+}
+
+TEST_CASE( "socketpair and fd passing", "[socket]")
+{
+	Socket s1, s2;
+	REQUIRE( Socket::SocketPair( &s1, &s2 ) == 0 );
+	s1.SetTimeout( 1000 );
+	s2.SetTimeout( 1000 );
+
+	int pfd[2];
+	REQUIRE( pipe( pfd ) == 0 );
+	CHECK( s1.SendFd( "fd", 2, &pfd[1], 1 ) == 2 );
+	char buf[16];
+	int fds[DGN_SOCK_MAX_FDS];
+	int fd_num = 0;
+	CHECK( s2.RecvFd( buf, sizeof(buf), fds, &fd_num ) == 2 );
+	REQUIRE( fd_num == 1 );
+	CHECK( fds[0] != pfd[1] );
+	// write by the received fd, read from the original pipe
+	CHECK( write( fds[0], "x", 1 ) == 1 );
+	CHECK( read( pfd[0], buf, 1 ) == 1 );
+	CHECK( buf[0] == 'x' );
+	close( fds[0] );
+	close( pfd[0] ), close( pfd[1] );
+
+	// no fd, plain data
+	CHECK( s2.Send( "abc", 3 ) == 3 );
+	CHECK( s1.RecvFd( buf, sizeof(buf), fds, &fd_num ) == 3 );
+	CHECK( fd_num == 0 );
+
+	// datagram pair keep message boundary
+	Socket d1, d2;
+	REQUIRE( Socket::SocketPair( &d1, &d2, 1 ) == 0 );
+	CHECK( d1.Send( "a", 1 ) == 1 );
+	CHECK( d1.Send( "bc", 2 ) == 2 );
+	d2.SetTimeout( 1000 );
+	CHECK( d2.Recv( buf, 1, sizeof(buf) ) == 1 );
+	CHECK( d2.Recv( buf, 1, sizeof(buf) ) == 2 );
+}
+#endif // _WIN32
+
+TEST_CASE( "accept in place", "[socket]")
+{
+	Socket svr;
+	REQUIRE( svr.TcpSvr( "127.0.0.1", 0 ) == 0 );
+	Endpoint local;
+	CHECK( svr.LocalAddr( &local ) == 0 );
+
+	// nothing pending
+	Socket peer;
+	CHECK( svr.Accept( &peer ) == 0 );
+	svr.SetTimeout( 50 );
+	CHECK( svr.Accept( &peer ) == 0 );
+	CHECK( ! peer.IsValid() );
+
+	// same Socket object reused, old connection closed
+	svr.SetTimeout( 1000 );
+	int i;
+	for( i = 0; i < 2; ++i ) {
+		Socket cli;
+		cli.SetTimeout( 1000 );
+		CHECK( cli.Connect( local ) == DGN_SOCKET_CONNECT_OK );
+		Endpoint from;
+		CHECK( svr.Accept( &peer, &from ) == 1 );
+		REQUIRE( peer.IsValid() );
+		Endpoint cli_local;
+		CHECK( cli.LocalAddr( &cli_local ) == 0 );
+		CHECK( from.ToStr() == cli_local.ToStr() );
+		peer.SetTimeout( 1000 );
+		CHECK( peer.Send( "ok", 2 ) == 2 );
+		char buf[4];
+		CHECK( cli.Recv( buf, 2, sizeof(buf) ) == 2 );
+	}
+}
+
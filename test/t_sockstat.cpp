@@ -0,0 +1,115 @@
+// t_sockstat.cpp : test socket counters
+// Copyright (C) 2011 ~ 2023 drangon <drangon.zhou (at) gmail.com>
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+
+
+#include <dgn/SockStat.h>
+#include <dgn/Socket.h>
+#include <dgn/JsonVal.h>
+#include <dgn/Thread.h>
+
+#include "catch.hpp"
+
+#include <stdio.h>
+#include <string.h>
+
+using namespace dgn;
+
+static int64_t hist_sum( const SockStatData & sd )
+{
+	int64_t n = 0;
+	int i;
+	for( i = 0; i < DGN_SOCKSTAT_HIST_NUM; ++i )
+		n += sd.m_connect_hist[i];
+	return n;
+}
+
+static int send_some( Thread * th, void * arg )
+{
+	Socket * sk = (Socket *)arg;
+	int i;
+	for( i = 0; i < 10; ++i )
+		sk->Send( "0123456789", 10 );
+	return 0;
+}
+
+TEST_CASE( "socket stat", "[sockstat]")
+{
+	Socket svr;
+	REQUIRE( svr.TcpSvr( "127.0.0.1", 0 ) == 0 );
+	Endpoint local;
+	svr.LocalAddr( &local );
+	svr.SetTimeout( 1000 );
+
+	// per-socket counters without global
+	SockStat::Enable( 0 );
+	SockStatData sd;
+	Socket cli;
+	cli.SetStat( &sd );
+	cli.SetTimeout( 1000 );
+	CHECK( cli.Connect( local ) == DGN_SOCKET_CONNECT_OK );
+	Socket peer;
+	CHECK( svr.Accept( &peer ) == 1 );
+	CHECK( sd.m_cnt[DGN_SOCKSTAT_CONNECTS] == 1 );
+	CHECK( sd.m_cnt[DGN_SOCKSTAT_CONNECT_FAILS] == 0 );
+	CHECK( hist_sum( sd ) == 1 );
+
+	CHECK( cli.Send( "hello", 5 ) == 5 );
+	CHECK( sd.m_cnt[DGN_SOCKSTAT_SEND_CALLS] == 1 );
+	CHECK( sd.m_cnt[DGN_SOCKSTAT_SEND_BYTES] == 5 );
+
+	char buf[16];
+	cli.SetTimeout( 30 );
+	CHECK( cli.Recv( buf, 1, sizeof(buf) ) == 0 );
+	CHECK( sd.m_cnt[DGN_SOCKSTAT_RECV_CALLS] == 1 );
+	CHECK( sd.m_cnt[DGN_SOCKSTAT_RECV_EAGAIN] == 1 );
+	CHECK( sd.m_cnt[DGN_SOCKSTAT_POLL_LOOPS] >= 1 );
+	CHECK( sd.m_cnt[DGN_SOCKSTAT_TIMEOUTS] == 1 );
+
+	// global counters, include exited thread
+	SockStat::Enable( 1 );
+	SockStat::Reset();
+	ThreadObj th;
+	th.SetFunc( send_some, &cli );
+	th.Start();
+	th.WaitStop();
+	CHECK( cli.Send( "x", 1 ) == 1 );
+	SockStatData all;
+	SockStat::Collect( &all );
+	CHECK( all.m_cnt[DGN_SOCKSTAT_SEND_CALLS] == 11 );
+	CHECK( all.m_cnt[DGN_SOCKSTAT_SEND_BYTES] == 101 );
+	CHECK( sd.m_cnt[DGN_SOCKSTAT_SEND_BYTES] == 106 );
+
+	// failed connect
+	Socket bad;
+	bad.SetTimeout( 1000 );
+	svr.Close();
+	CHECK( bad.Connect( local ) == DGN_SOCKET_CONNECT_FAILED );
+	SockStat::Collect( &all );
+	CHECK( all.m_cnt[DGN_SOCKSTAT_CONNECTS] == 1 );
+	CHECK( all.m_cnt[DGN_SOCKSTAT_CONNECT_FAILS] == 1 );
+
+	JsonVal jv;
+	SockStat::Dump( &jv );
+	CHECK( jv["send_bytes"].GetInt64() == 101 );
+	CHECK( jv["connects"].GetInt64() == 1 );
+	CHECK( jv["connect_us"].Size() == 0 );
+	sd.ToJson( &jv );
+	CHECK( jv["connect_us"].Size() == 1 );
+	CHECK( jv["connect_us"][0]["n"].GetInt64() == 1 );
+	printf( "sock stat : %s\n", jv.ToBuf().Str() );
+	SockStat::Enable( 0 );
+}
+
@@ -0,0 +1,161 @@
+// t_timer.cpp : test dgn timer wheel
+// Copyright (C) 2011 ~ 2023 drangon <drangon.zhou (at) gmail.com>
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+
+
+#include <dgn/TimerWheel.h>
+#include <dgn/Reactor.h>
+#include <dgn/Time.h>
+
+#include "catch.hpp"
+
+#include <stdlib.h>
+
+using namespace dgn;
+
+struct timer_ctx_t
+{
+	Timer m_timer;
+	uint32_t m_now; // tick passed to Expire()
+	uint32_t m_fired; // 0 if not fired
+	int m_count;
+	TimerWheel * m_wheel;
+	int m_period; // > 0 re-add in callback
+};
+
+static void on_timer( Timer * t, void * arg )
+{
+	timer_ctx_t * ctx = (timer_ctx_t *)arg;
+	ctx->m_fired = ctx->m_now;
+	ctx->m_count++;
+	if( ctx->m_period > 0 )
+		ctx->m_wheel->AddAt( t, t->GetExpire() + ctx->m_period );
+}
+
+TEST_CASE( "timer wheel", "[timer]" )
+{
+	TimerWheel tw;
+	uint32_t base = Time::Tick();
+	const int num = 20000;
+	timer_ctx_t * ctxs = new timer_ctx_t[num];
+	srand( 1234 );
+	int i;
+	for( i = 0; i < num; ++i ) {
+		timer_ctx_t & c = ctxs[i];
+		c.m_fired = 0, c.m_count = 0, c.m_wheel = &tw, c.m_period = 0;
+		c.m_timer.SetFunc( on_timer, &c );
+		// spread over root and first two levels, some far away
+		uint32_t delay = i % 100 == 0 ? 5000000 + rand() % 100000 : rand() % 200000;
+		REQUIRE( tw.AddAt( &c.m_timer, base + delay ) == 0 );
+	}
+	REQUIRE( tw.GetNum() == num );
+	// cancel every third, re-add every fifth later
+	for( i = 0; i < num; i += 3 )
+		ctxs[i].m_timer.Cancel();
+	for( i = 0; i < num; i += 5 )
+		tw.AddAt( &ctxs[i].m_timer, ctxs[i].m_timer.GetExpire() + 1000 );
+	int pending = 0;
+	for( i = 0; i < num; ++i )
+		pending += ctxs[i].m_timer.IsPending() ? 1 : 0;
+	REQUIRE( tw.GetNum() == pending );
+
+	// expire in uneven steps, each timer fire in the step cover its expire
+	int fired = 0;
+	uint32_t now = base;
+	while( tw.GetNum() > 0 ) {
+		now += 1 + rand() % 3000;
+		uint32_t step = now;
+		for( i = 0; i < num; ++i )
+			ctxs[i].m_now = step;
+		fired += tw.Expire( step );
+		if( (int32_t)( now - base ) > 6000000 )
+			break;
+	}
+	REQUIRE( tw.GetNum() == 0 );
+	REQUIRE( fired == pending );
+	for( i = 0; i < num; ++i ) {
+		timer_ctx_t & c = ctxs[i];
+		if( i % 3 == 0 && i % 5 != 0 ) {
+			REQUIRE( c.m_count == 0 );
+			continue;
+		}
+		REQUIRE( c.m_count == 1 );
+		REQUIRE( (int32_t)( c.m_fired - c.m_timer.GetExpire() ) >= 0 );
+		REQUIRE( (int32_t)( c.m_fired - c.m_timer.GetExpire() ) <= 3000 );
+	}
+
+	// periodic by re-add in callback, and already expired one
+	timer_ctx_t & p = ctxs[0];
+	p.m_count = 0, p.m_period = 10;
+	tw.AddAt( &p.m_timer, now + 10 );
+	timer_ctx_t & q = ctxs[1];
+	q.m_count = 0;
+	tw.AddAt( &q.m_timer, now - 100 );
+	p.m_now = q.m_now = now + 1;
+	REQUIRE( tw.Expire( now + 1 ) == 1 );
+	REQUIRE( q.m_count == 1 );
+	p.m_now = now + 100;
+	REQUIRE( tw.Expire( now + 100 ) == 10 );
+	REQUIRE( p.m_count == 10 );
+	REQUIRE( tw.GetNum() == 1 );
+	delete[] ctxs;
+	REQUIRE( tw.GetNum() == 0 ); // cancelled by Timer destructor
+}
+
+TEST_CASE( "timer wheel idle", "[timer]" )
+{
+	// last processed tick over 2^31 ms away, as after a long idle
+	TimerWheel tw;
+	REQUIRE( tw.Expire( Time::Tick() + 0x70000000u ) == 0 );
+	timer_ctx_t c;
+	c.m_count = 0, c.m_period = 0, c.m_wheel = &tw;
+	c.m_timer.SetFunc( on_timer, &c );
+	REQUIRE( tw.Add( &c.m_timer, 1000 ) == 0 );
+	uint32_t now = Time::Tick();
+	c.m_now = now;
+	REQUIRE( tw.Expire( now ) == 0 );
+	REQUIRE( c.m_count == 0 );
+	REQUIRE( tw.NextTimeout( 5000 ) > 0 );
+	c.m_now = now + 1100;
+	REQUIRE( tw.Expire( now + 1100 ) == 1 );
+	REQUIRE( c.m_count == 1 );
+}
+
+TEST_CASE( "reactor timer", "[timer]" )
+{
+	timer_ctx_t c; // outlive reactor, its wheel unlink pending timer on failed REQUIRE
+	Reactor r;
+	REQUIRE( r.Init() == 0 );
+	c.m_count = 0, c.m_period = 0, c.m_wheel = r.GetTimers();
+	c.m_timer.SetFunc( on_timer, &c );
+	REQUIRE( r.GetTimers()->Add( &c.m_timer, 30 ) == 0 );
+	REQUIRE( r.GetTimers()->NextTimeout( 1000 ) <= 30 );
+	// may be earlier root wheel wrap point, timer crossing it wait for cascade
+	int next = r.GetTimers()->NextTimeout( 5 );
+	REQUIRE( next > 0 );
+	REQUIRE( next <= 5 );
+
+	// poll timeout shortened to the timer
+	int64_t start = Time::Now();
+	int num = 0, loops = 0;
+	while( num == 0 && loops++ < 10 )
+		num = r.RunOnce( 1000 );
+	int64_t used = Time::Now() - start;
+	REQUIRE( num == 1 );
+	REQUIRE( c.m_count == 1 );
+	REQUIRE( used >= 25000 );
+	REQUIRE( used < 500000 );
+	REQUIRE( r.GetTimers()->NextTimeout( -1 ) == -1 );
+}
@@ -0,0 +1,194 @@
+// t_tls.cpp : test tls stream over loopback
+// Copyright (C) 2011 ~ 2023 drangon <drangon.zhou (at) gmail.com>
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+
+
+#include <dgn/TlsStream.h>
+#include <dgn/BufferedSocket.h>
+#include <dgn/Thread.h>
+
+#include "catch.hpp"
+
+#include <stdio.h>
+#include <string.h>
+
+#ifdef DGN_WITH_OPENSSL
+#include <openssl/evp.h>
+#include <openssl/x509.h>
+#include <openssl/x509v3.h>
+#include <openssl/pem.h>
+#endif
+
+using namespace dgn;
+
+#ifdef DGN_WITH_OPENSSL
+
+#define TLS_CERT_FILE	"tls_test_cert.pem"
+#define TLS_KEY_FILE	"tls_test_key.pem"
+
+// self-signed cert for "localhost", also used as client ca
+static int make_cert()
+{
+	EVP_PKEY * pkey = EVP_EC_gen( "P-256" );
+	if( pkey == NULL )
+		return -1;
+	X509 * x = X509_new();
+	X509_set_version( x, 2 );
+	ASN1_INTEGER_set( X509_get_serialNumber( x ), 1 );
+	X509_gmtime_adj( X509_getm_notBefore( x ), -60 );
+	X509_gmtime_adj( X509_getm_notAfter( x ), 3600 );
+	X509_set_pubkey( x, pkey );
+	X509_NAME * name = X509_get_subject_name( x );
+	X509_NAME_add_entry_by_txt( name, "CN", MBSTRING_ASC, (const unsigned char *)"localhost", -1, -1, 0 );
+	X509_set_issuer_name( x, name );
+	X509_EXTENSION * ext = X509V3_EXT_conf_nid( NULL, NULL, NID_subject_alt_name, (char *)"DNS:localhost" );
+	X509_add_ext( x, ext, -1 );
+	X509_EXTENSION_free( ext );
+	ext = X509V3_EXT_conf_nid( NULL, NULL, NID_basic_constraints, (char *)"critical,CA:TRUE" );
+	X509_add_ext( x, ext, -1 );
+	X509_EXTENSION_free( ext );
+	X509_sign( x, pkey, EVP_sha256() );
+
+	int ret = -1;
+	FILE * fp = fopen( TLS_CERT_FILE, "w" );
+	if( fp != NULL ) {
+		ret = PEM_write_X509( fp, x ) == 1 ? 0 : -1;
+		fclose( fp );
+	}
+	fp = fopen( TLS_KEY_FILE, "w" );
+	if( fp != NULL ) {
+		if( PEM_write_PrivateKey( fp, pkey, NULL, NULL, 0, NULL, NULL ) != 1 )
+			ret = -1;
+		fclose( fp );
+	}
+	X509_free( x );
+	EVP_PKEY_free( pkey );
+	return ret;
+}
+
+// echo frames until peer closed
+static int tls_echo( Thread * th, void * arg )
+{
+	TlsStream * ts = (TlsStream *)arg;
+	BufferedSocket bs( ts );
+	CStr frame;
+	while( bs.ReadFrame( &frame ) > 0 ) {
+		if( bs.WriteFrame( frame.Str(), frame.Len() ) < 0 || bs.Flush() != 0 )
+			break;
+	}
+	return 0;
+}
+
+TEST_CASE( "tls stream", "[tls]")
+{
+	REQUIRE( make_cert() == 0 );
+	TlsCtx sctx, cctx;
+	REQUIRE( sctx.InitServer( TLS_CERT_FILE, TLS_KEY_FILE ) == 0 );
+	REQUIRE( cctx.InitClient( TLS_CERT_FILE ) == 0 );
+
+	Socket svr;
+	REQUIRE( svr.TcpSvr( "127.0.0.1", 0 ) == 0 );
+	Endpoint local;
+	svr.LocalAddr( &local );
+	svr.SetTimeout( 1000 );
+
+	Socket csk, ssk;
+	csk.SetTimeout( 1000 );
+	REQUIRE( csk.Connect( local ) == DGN_SOCKET_CONNECT_OK );
+	REQUIRE( svr.Accept( &ssk ) == 1 );
+
+	// non-blocking handshake, drive both side in one thread
+	csk.SetTimeout( 0 );
+	ssk.SetTimeout( 0 );
+	TlsStream cts, sts;
+	int cret = cts.Connect( &cctx, &csk, "localhost" );
+	int sret = sts.Accept( &sctx, &ssk );
+	int i;
+	for( i = 0; i < 1000 && ( cret == 0 || sret == 0 ); ++i ) {
+		if( cret == 0 )
+			cret = cts.Handshake();
+		if( sret == 0 )
+			sret = sts.Handshake();
+	}
+	REQUIRE( cret == 1 );
+	REQUIRE( sret == 1 );
+	printf( "tls ktls : client %d, server %d\n", cts.GetKtls(), sts.GetKtls() );
+
+	csk.SetTimeout( 2000 );
+	ssk.SetTimeout( 2000 );
+	ThreadObj th;
+	th.SetFunc( tls_echo, &sts );
+	th.Start();
+
+	BufferedSocket bs( &cts );
+	CStr frame;
+	CHECK( bs.WriteFrame( "hello tls", 9 ) == 13 );
+	CHECK( bs.Flush() == 0 );
+	CHECK( bs.ReadFrame( &frame ) == 13 );
+	CHECK( frame == "hello tls" );
+
+	// larger than socket buffer, both side blocked in Send() partly
+	int big_len = 2 * 1024 * 1024;
+	char * big = new char[big_len];
+	for( i = 0; i < big_len; ++i )
+		big[i] = (char)( 'a' + i % 26 );
+	CHECK( bs.WriteFrame( big, big_len ) == big_len + 4 );
+	CHECK( bs.Flush() == 0 );
+	CHECK( bs.ReadFrame( &frame ) == big_len + 4 );
+	CHECK( frame.Len() == big_len );
+	CHECK( memcmp( frame.Str(), big, big_len ) == 0 );
+	delete[] big;
+
+	// close_notify end the echo loop
+	cts.Close();
+	th.WaitStop();
+	sts.Close();
+
+	// certificate name mismatch
+	Socket csk2, ssk2;
+	csk2.SetTimeout( 1000 );
+	REQUIRE( csk2.Connect( local ) == DGN_SOCKET_CONNECT_OK );
+	REQUIRE( svr.Accept( &ssk2 ) == 1 );
+	csk2.SetTimeout( 0 );
+	ssk2.SetTimeout( 0 );
+	TlsStream cts2, sts2;
+	cret = cts2.Connect( &cctx, &csk2, "example.com" );
+	sret = sts2.Accept( &sctx, &ssk2 );
+	for( i = 0; i < 1000 && cret == 0; ++i ) {
+		cret = cts2.Handshake();
+		if( sret == 0 )
+			sret = sts2.Handshake();
+	}
+	CHECK( cret < 0 );
+	CHECK( ! cts2.IsValid() );
+
+	remove( TLS_CERT_FILE );
+	remove( TLS_KEY_FILE );
+}
+
+#else // DGN_WITH_OPENSSL
+
+TEST_CASE( "tls stream", "[tls]")
+{
+	TlsCtx ctx;
+	CHECK( ctx.InitClient() < 0 );
+	Socket sk;
+	TlsStream ts;
+	CHECK( ts.Connect( &ctx, &sk ) < 0 );
+	CHECK( ! ts.IsValid() );
+}
+
+#endif // DGN_WITH_OPENSSL
+
@@ -0,0 +1,168 @@
+// bench_http.cpp : loopback load generator for HttpSvr
+// Copyright (C) 2011 ~ 2023 drangon <drangon.zhou (at) gmail.com>
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+
+// usage : bench_http.exe [-c conn] [-d pipeline_depth] [-t seconds] [-h host] [-p port] [-s]
+//   without -p, start an in-process HttpSvr ( one reactor thread ) on a random port
+//   -s : server only, run until killed
+
+#include <dgn/HttpSvr.h>
+#include <dgn/BufferedSocket.h>
+#include <dgn/Thread.h>
+#include <dgn/Time.h>
+#include <dgn/Logger.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+using namespace dgn;
+
+struct bench_arg_t
+{
+	const char * m_host;
+	int m_port;
+	int m_depth;
+	volatile int m_stop;
+	int64_t m_reqs;
+	int m_errs;
+};
+
+static void on_request( HttpRequest * req, HttpResponse * rsp, void * arg )
+{
+	rsp->AddHeader( "Content-Type", "text/plain" );
+	rsp->SetBody( "Hello, World!", 13 );
+}
+
+static int run_client( Thread * th, void * arg )
+{
+	bench_arg_t * ba = (bench_arg_t *)arg;
+	Socket sk;
+	sk.SetTimeout( 5000 );
+	if( sk.Connect( ba->m_host, ba->m_port ) != DGN_SOCKET_CONNECT_OK ) {
+		ba->m_errs++;
+		return -1;
+	}
+	BufferedSocket bs( &sk, 65536 );
+
+	CStr reqs;
+	int i;
+	for( i = 0; i < ba->m_depth; ++i )
+		reqs.Append( "GET /plaintext HTTP/1.1\r\nHost: bench\r\nAccept: */*\r\n\r\n" );
+
+	CStr head;
+	char body[4096];
+	while( ! ba->m_stop ) {
+		if( sk.Send( reqs.Str(), reqs.Len() ) != reqs.Len() ) {
+			ba->m_errs++;
+			return -1;
+		}
+		for( i = 0; i < ba->m_depth; ++i ) {
+			if( bs.ReadUntil( "\r\n\r\n", 4, &head ) <= 0 ) {
+				ba->m_errs++;
+				return -1;
+			}
+			const char * p = strstr( head.Str(), "Content-Length: " );
+			int len = p != NULL ? atoi( p + 16 ) : 0;
+			if( len > (int)sizeof(body) || ( len > 0 && bs.ReadExact( body, len ) <= 0 ) ) {
+				ba->m_errs++;
+				return -1;
+			}
+			ba->m_reqs++;
+		}
+	}
+	return 0;
+}
+
+int main( int argc, char ** argv )
+{
+	int conn_num = 16, depth = 16, seconds = 5, port = 0, server_only = 0;
+	const char * host = "127.0.0.1";
+	int i;
+	for( i = 1; i < argc; ++i ) {
+		if( strcmp( argv[i], "-s" ) == 0 )
+			server_only = 1;
+		else if( i + 1 < argc && strcmp( argv[i], "-c" ) == 0 )
+			conn_num = atoi( argv[++i] );
+		else if( i + 1 < argc && strcmp( argv[i], "-d" ) == 0 )
+			depth = atoi( argv[++i] );
+		else if( i + 1 < argc && strcmp( argv[i], "-t" ) == 0 )
+			seconds = atoi( argv[++i] );
+		else if( i + 1 < argc && strcmp( argv[i], "-h" ) == 0 )
+			host = argv[++i];
+		else if( i + 1 < argc && strcmp( argv[i], "-p" ) == 0 )
+			port = atoi( argv[++i] );
+		else {
+			printf( "usage : %s [-c conn] [-d pipeline_depth] [-t seconds] [-h host] [-p port] [-s]\n", argv[0] );
+			return 1;
+		}
+	}
+	if( conn_num <= 0 || depth <= 0 || seconds <= 0 )
+		return 1;
+
+	DgnLib::Init( argc, argv );
+	DgnLib::GetLogger()->InitLevel( DGN_LOG_LEVEL_ERR );
+
+	HttpSvr svr;
+	if( port == 0 || server_only ) {
+		if( svr.Init( host, port, on_request, NULL ) < 0 || svr.Start() < 0 ) {
+			printf( "start http server failed\n" );
+			return 1;
+		}
+		port = svr.GetPort();
+		printf( "http server on %s:%d\n", host, port );
+		if( server_only ) {
+			while( 1 )
+				Time::SleepMs( 1000 );
+		}
+	}
+
+	bench_arg_t * args = new bench_arg_t[conn_num];
+	ThreadObj * ths = new ThreadObj[conn_num];
+	for( i = 0; i < conn_num; ++i ) {
+		args[i].m_host = host;
+		args[i].m_port = port;
+		args[i].m_depth = depth;
+		args[i].m_stop = 0;
+		args[i].m_reqs = 0;
+		args[i].m_errs = 0;
+		ths[i].SetFunc( run_client, &args[i] );
+		ths[i].Start();
+	}
+
+	int64_t start = Time::Now();
+	Time::SleepMs( seconds * 1000 );
+	for( i = 0; i < conn_num; ++i )
+		args[i].m_stop = 1;
+	for( i = 0; i < conn_num; ++i )
+		ths[i].WaitStop();
+	int64_t used = Time::Now() - start;
+
+	int64_t reqs = 0;
+	int errs = 0;
+	for( i = 0; i < conn_num; ++i ) {
+		reqs += args[i].m_reqs;
+		errs += args[i].m_errs;
+	}
+	printf( "conn %d, depth %d, %lld requests in %.2f s, %.0f req/s, %d errors\n",
+			conn_num, depth, (long long)reqs, used / 1e6, reqs * 1e6 / ( used > 0 ? used : 1 ), errs );
+
+	delete[] ths;
+	delete[] args;
+	svr.Fini();
+	DgnLib::Fini();
+	return errs > 0 ? 1 : 0;
+}
+
@@ -0,0 +1,189 @@
+// bench_logger.cpp : Logger throughput and per call latency
+// Copyright (C) 2011 ~ 2023 drangon <drangon.zhou (at) gmail.com>
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+
+
+// usage : bench_logger.exe [-t max_threads] [-n lines_per_thread] [-s file|stderr|syslog|none]
+//                          [-f file] [-a] [-D] [-b ring_kb] [-r rotate_mb]
+//   run 1, 2, 4 ... max_threads threads, each print lines/s, latency percentiles of one
+//   call and records dropped by full ring
+//   -a : async, -D : deferred formatting ( async ), -b : async ring size of each thread,
+//   -r : rotate file at this size
+//   stderr sink better redirect, e.g. 2>/dev/null
+
+#include <dgn/Logger.h>
+#include <dgn/Thread.h>
+#include <dgn/Time.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <vector>
+#include <algorithm>
+
+using namespace dgn;
+
+struct bench_arg_t
+{
+	Logger * m_logger;
+	int m_idx;
+	int m_num;
+	std::vector< uint32_t > m_lat; // ns
+};
+
+static int64_t now_ns()
+{
+#ifdef _WIN32
+	return Time::Now() * 1000;
+#else
+	struct timespec ts;
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
+
+static int run_logger( Thread * th, void * arg )
+{
+	bench_arg_t * ba = (bench_arg_t *)arg;
+	Logger * logger = ba->m_logger;
+	ba->m_lat.resize( ba->m_num );
+	int i;
+	for( i = 0; i < ba->m_num; ++i ) {
+		int64_t start = now_ns();
+		PR_INFO_TO( logger, "bench thread %d seq %d user %s lat_us %lld", ba->m_idx, i, "someone", (long long)start / 1000 );
+		int64_t used = now_ns() - start;
+		ba->m_lat[i] = used > 0xffffffff ? 0xffffffff : (uint32_t)used;
+	}
+	return 0;
+}
+
+static uint32_t percentile( const std::vector< uint32_t > & lat, double p )
+{
+	size_t idx = (size_t)( lat.size() * p );
+	return lat[idx < lat.size() ? idx : lat.size() - 1];
+}
+
+int main( int argc, char ** argv )
+{
+	int max_threads = 8, num = 100000, async = 0, deferred = 0, ring_kb = DGN_LOG_RING_SIZE / 1024, rotate_mb = 0;
+	const char * sink = "file";
+	const char * fname = "bench_logger.log";
+	int i;
+	for( i = 1; i < argc; ++i ) {
+		if( strcmp( argv[i], "-a" ) == 0 )
+			async = 1;
+		else if( strcmp( argv[i], "-D" ) == 0 )
+			async = deferred = 1;
+		else if( i + 1 < argc && strcmp( argv[i], "-t" ) == 0 )
+			max_threads = atoi( argv[++i] );
+		else if( i + 1 < argc && strcmp( argv[i], "-n" ) == 0 )
+			num = atoi( argv[++i] );
+		else if( i + 1 < argc && strcmp( argv[i], "-s" ) == 0 )
+			sink = argv[++i];
+		else if( i + 1 < argc && strcmp( argv[i], "-f" ) == 0 )
+			fname = argv[++i];
+		else if( i + 1 < argc && strcmp( argv[i], "-b" ) == 0 )
+			ring_kb = atoi( argv[++i] );
+		else if( i + 1 < argc && strcmp( argv[i], "-r" ) == 0 )
+			rotate_mb = atoi( argv[++i] );
+		else {
+			printf( "usage : %s [-t max_threads] [-n lines_per_thread] [-s file|stderr|syslog|none] [-f file] [-a] [-D] [-b ring_kb] [-r rotate_mb]\n", argv[0] );
+			return 1;
+		}
+	}
+	if( max_threads <= 0 || num <= 0 || ring_kb <= 0 || ( strcmp( sink, "file" ) != 0 && strcmp( sink, "stderr" ) != 0
+			&& strcmp( sink, "syslog" ) != 0 && strcmp( sink, "none" ) != 0 ) )
+		return 1;
+
+	DgnLib::Init( argc, argv );
+	DgnLib::GetLogger()->InitSyslog( 0 );
+
+	int threads = 1;
+	while( 1 ) {
+		if( threads > max_threads )
+			threads = max_threads;
+		Logger * logger = new Logger();
+		if( strcmp( sink, "file" ) == 0 ) {
+			unlink( fname );
+			logger->InitLogFile( fname );
+			if( rotate_mb > 0 )
+				logger->InitRotate( (int64_t)rotate_mb * 1024 * 1024 );
+		}
+		else if( strcmp( sink, "stderr" ) == 0 )
+			logger->InitStderr( 1 );
+		else if( strcmp( sink, "syslog" ) == 0 )
+			logger->InitSyslog( 1 );
+		if( async && logger->InitAsync( 1, ring_kb * 1024 ) < 0 ) {
+			printf( "init async failed\n" );
+			return 1;
+		}
+		if( deferred )
+			logger->InitDeferred( 1 );
+
+		bench_arg_t * args = new bench_arg_t[threads];
+		ThreadObj * ths = new ThreadObj[threads];
+		int64_t start = Time::Now();
+		for( i = 0; i < threads; ++i ) {
+			args[i].m_logger = logger;
+			args[i].m_idx = i;
+			args[i].m_num = num;
+			ths[i].SetFunc( run_logger, &args[i] );
+			if( ths[i].Start() < 0 )
+				break;
+		}
+		int started = i;
+		for( i = 0; i < started; ++i )
+			ths[i].WaitStop();
+		if( started < threads ) {
+			printf( "start thread %d failed\n", started );
+			return 1;
+		}
+		int64_t call_used = Time::Now() - start;
+		if( logger->Flush( 60000 ) < 0 ) {
+			printf( "flush timeout\n" );
+			return 1;
+		}
+		int64_t used = Time::Now() - start; // include backend written all
+		int64_t dropped = logger->GetDropped();
+
+		std::vector< uint32_t > lat;
+		lat.reserve( (size_t)threads * num );
+		for( i = 0; i < threads; ++i )
+			lat.insert( lat.end(), args[i].m_lat.begin(), args[i].m_lat.end() );
+		std::sort( lat.begin(), lat.end() );
+		int64_t total = (int64_t)threads * num;
+		printf( "%s%s%s, threads %d, %lld lines, call %.0f lines/s, written %.0f lines/s, "
+				"latency ns p50 %u p90 %u p99 %u p99.9 %u max %u, dropped %lld\n",
+				sink, async ? ( deferred ? " deferred" : " async" ) : " sync", rotate_mb > 0 ? " rotate" : "",
+				threads, (long long)total, total * 1e6 / ( call_used > 0 ? call_used : 1 ),
+				( total - dropped ) * 1e6 / ( used > 0 ? used : 1 ),
+				percentile( lat, 0.5 ), percentile( lat, 0.9 ), percentile( lat, 0.99 ), percentile( lat, 0.999 ),
+				lat.back(), (long long)dropped );
+		fflush( stdout );
+
+		delete[] ths;
+		delete[] args;
+		delete logger;
+		if( threads == max_threads )
+			break;
+		threads *= 2;
+	}
+
+	DgnLib::Fini();
+	return 0;
+}
+
@@ -0,0 +1,145 @@
+// log_decode.cpp : print binary log file of deferred Logger as text
+// Copyright (C) 2011 ~ 2023 drangon <drangon.zhou (at) gmail.com>
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+
+
+// usage : log_decode.exe file ...
+//   files in write order ( oldest rolled first, e.g. log.2 log.1 log ), site
+//   definitions are repeated at head of each file so any one can be decoded alone
+
+#include <dgn/Logger.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <map>
+#include <string>
+
+using namespace dgn;
+
+struct site_t
+{
+	int m_level;
+	int m_line;
+	std::string m_file;
+	std::string m_fmt;
+};
+
+static uint32_t get_u32( const char * p ) { uint32_t v; memcpy( &v, p, 4 ); return v; }
+static uint16_t get_u16( const char * p ) { uint16_t v; memcpy( &v, p, 2 ); return v; }
+static int64_t get_i64( const char * p ) { int64_t v; memcpy( &v, p, 8 ); return v; }
+
+// return entry number, -1 if bad format
+static int decode( const char * buf, long len, FILE * out )
+{
+	std::map< uint32_t, site_t > sites;
+	char line[DGN_LOG_LINE_MAX + 512];
+	int num = 0;
+	long pos = 0;
+	while( pos < len ) {
+		if( len - pos >= DGN_LOG_BIN_MAGIC_LEN && memcmp( buf + pos, DGN_LOG_BIN_MAGIC, DGN_LOG_BIN_MAGIC_LEN ) == 0 ) {
+			sites.clear();
+			pos += DGN_LOG_BIN_MAGIC_LEN;
+			continue;
+		}
+		if( len - pos < 5 )
+			return -1;
+		int type = (unsigned char)buf[pos];
+		uint32_t elen = get_u32( buf + pos + 1 );
+		if( (uint64_t)( len - pos - 5 ) < elen )
+			return -1;
+		const char * p = buf + pos + 5;
+		pos += 5 + elen;
+
+		if( type == DGN_LOG_BIN_SITE ) {
+			if( elen < 13 )
+				return -1;
+			site_t s;
+			uint32_t id = get_u32( p );
+			s.m_level = (unsigned char)p[4];
+			s.m_line = (int)get_u32( p + 5 );
+			uint32_t flen = get_u16( p + 9 );
+			if( 11 + flen + 2 > elen )
+				return -1;
+			s.m_file.assign( p + 11, flen );
+			uint32_t mlen = get_u16( p + 11 + flen );
+			if( 13 + flen + mlen > elen )
+				return -1;
+			s.m_fmt.assign( p + 13 + flen, mlen );
+			sites[id] = s;
+			continue;
+		}
+
+		if( type == DGN_LOG_BIN_LOG ) {
+			if( elen < 12 )
+				return -1;
+			std::map< uint32_t, site_t >::iterator it = sites.find( get_u32( p ) );
+			if( it == sites.end() ) {
+				fprintf( out, "<unknown site %u>\n", get_u32( p ) );
+				continue;
+			}
+			site_t & s = it->second;
+			int n = Logger::FormatPrefix( line, get_i64( p + 4 ), s.m_level, s.m_file.c_str(), s.m_line );
+			n += Logger::FormatArgs( line + n, DGN_LOG_LINE_MAX, s.m_fmt.c_str(), p + 12, (int)elen - 12 );
+			fwrite( line, 1, n, out );
+		}
+		else if( type == DGN_LOG_BIN_TEXT ) {
+			if( elen < 9 )
+				return -1;
+			fwrite( p + 9, 1, elen - 9, out ); // already with prefix
+		}
+		// unknown type skipped
+		num++;
+	}
+	return num;
+}
+
+int main( int argc, char ** argv )
+{
+	if( argc < 2 ) {
+		printf( "usage : %s file ...\n", argv[0] );
+		return 1;
+	}
+	int i;
+	for( i = 1; i < argc; ++i ) {
+		FILE * fp = fopen( argv[i], "rb" );
+		if( fp == NULL ) {
+			fprintf( stderr, "open %s failed\n", argv[i] );
+			return 1;
+		}
+		fseek( fp, 0, SEEK_END );
+		long len = ftell( fp );
+		fseek( fp, 0, SEEK_SET );
+		char * buf = (char *)malloc( len > 0 ? len : 1 );
+		if( len > 0 && fread( buf, 1, len, fp ) != (size_t)len )
+			len = 0;
+		fclose( fp );
+
+		if( len < DGN_LOG_BIN_MAGIC_LEN || memcmp( buf, DGN_LOG_BIN_MAGIC, DGN_LOG_BIN_MAGIC_LEN ) != 0 ) {
+			fprintf( stderr, "%s is not binary log file\n", argv[i] );
+			free( buf );
+			return 1;
+		}
+		int ret = decode( buf, len, stdout );
+		free( buf );
+		if( ret < 0 ) {
+			fprintf( stderr, "%s truncated or corrupted\n", argv[i] );
+			return 1;
+		}
+	}
+	return 0;
+}
+
@@ -0,0 +1,42 @@
+// log_ring.cpp : print lines kept in mmap ring log file
+// Copyright (C) 2011 ~ 2023 drangon <drangon.zhou (at) gmail.com>
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+
+
+// usage : log_ring.exe file
+//   file written by Logger::InitMmapRing(), lines printed oldest first,
+//   also work on file left by a crashed process
+
+#include <dgn/Logger.h>
+
+#include <stdio.h>
+
+using namespace dgn;
+
+int main( int argc, char ** argv )
+{
+	if( argc != 2 ) {
+		printf( "usage : %s file\n", argv[0] );
+		return 1;
+	}
+	CStr text;
+	if( Logger::ReadMmapRing( argv[1], &text ) < 0 ) {
+		fprintf( stderr, "%s is not mmap ring log file\n", argv[1] );
+		return 1;
+	}
+	fwrite( text.Str(), 1, text.Len(), stdout );
+	return 0;
+}
+